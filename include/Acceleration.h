@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "Config.h"
+#include "RayTracer.h"
+
+// spatial index the renderer traces spheres through
+enum class Accelerator
+{
+    None,  // every ray tests every sphere
+    Bvh,
+    // the binary BVH collapsed to 8 children per node with quantized boxes: a third of the
+    // memory and one node fetch per 8 box tests, vectorized when built with AVX2
+    WideBvh,
+    // uniform grid (see Grid.h): linear-time build, for many similar spheres spread evenly
+    Grid
+};
+
+bool parse_accelerator(const std::string &name, Accelerator *accelerator);
+const char *accelerator_name(Accelerator accelerator);
+// median, sah or lbvh
+bool parse_bvh_builder(const std::string &name, BvhBuilder *builder);
+const char *bvh_builder_name(BvhBuilder builder);
+
+struct AccelerationReport
+{
+    Accelerator accelerator;
+    BvhBuilder builder;
+    double hash_milliseconds;
+    // until the index is ready: building, or mapping and checking the cache file (BVHs only), plus
+    // collapse_milliseconds turning the binary tree into a wide one
+    double build_milliseconds;
+    double collapse_milliseconds;
+    bool loaded_from_cache;
+    // why the cache was not used or not written; empty when everything went to plan
+    std::string cache_message;
+    // of the tree the renderer walks, or cells of the grid; the SAH cost is the binary tree's
+    uint64_t node_count;
+    uint64_t index_bytes;
+    float sah_cost;
+
+    // two-level part, when the scene has instances (see Instancing.h)
+    uint64_t instance_count;
+    uint64_t object_count;
+    uint64_t object_sphere_count;
+    uint64_t instanced_sphere_count;
+    double object_milliseconds;
+    double instance_milliseconds;
+
+    // meshes, each with its own binary BVH whatever the accelerator (blocks only under none)
+    uint64_t mesh_count;
+    uint64_t triangle_count;
+    double mesh_milliseconds;
+
+    // sdf surfaces, bounded and laid out in blocks of shapes for the evaluator
+    uint64_t sdf_count;
+    uint64_t sdf_shape_count;
+};
+
+// identifies the sphere data a BVH was built over, together with the builder that built it
+uint64_t hash_scene_spheres(const Scene &scene, BvhBuilder builder);
+
+// Builds the index config.accelerator asks for with config.bvh_builder, on as many threads as
+// the render will use, plus both levels over the scene's instances and a tree per mesh (BVHs
+// even under grid), and finishes every sdf surface.
+// With config.bvh_cache_file set, a cache built for the same spheres is mapped instead; a
+// missing, stale or damaged cache is rebuilt and rewritten.  Cache problems are reported,
+// never fatal.
+void prepare_acceleration(const RenderConfig &config, Scene *scene, AccelerationReport *report);
+void print_acceleration_report(const AccelerationReport &report);
+
+// Between frames of an animation the spheres and instances move but stay the same ones, so
+// their trees keep their shape and only need new boxes (see refit_bvh).  Object BVHs never
+// change: instances move their objects rigidly.
+struct AccelerationUpdate
+{
+    BvhRefitState spheres;
+    BvhRefitState instances;
+    // primitive bounds, reused from frame to frame
+    std::vector<Aabb> bounds;
+};
+
+struct AccelerationUpdateReport
+{
+    // refitting, any rebuilds and collapsing to bvh8
+    double milliseconds;
+    // trees whose refitted cost passed config.rebuild_threshold and were rebuilt instead
+    uint32_t rebuilt_count;
+    // worst refitted SAH cost over the cost at the last build, before any rebuild; 1 when
+    // nothing was refitted
+    float cost_ratio;
+};
+
+// after prepare_acceleration, which keeps the binary tree under bvh8 when config.frame_count
+// is set; a grid is simply rebuilt every frame
+void prepare_acceleration_updates(const Scene &scene, AccelerationUpdate *update);
+void update_acceleration(const RenderConfig &config, Scene *scene, AccelerationUpdate *update,
+                         AccelerationUpdateReport *report);
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Config.h"
+#include "RayTracer.h"
+
+// Motion for --frames: from where the scene starts, every sphere and instance drifts in its
+// own direction across the ground plane by ANIMATION_STEP times its own size per frame.  The
+// scene spreads out steadily, so trees built for the first frame wear out after a while;
+// meant for measuring index updates, not for authoring motion.
+constexpr float ANIMATION_STEP = 0.25f;
+
+struct AnimationRestPose
+{
+    std::vector<Vector::Vector3> sphere_positions;
+    std::vector<Vector::Vector3> sphere_velocities;
+    std::vector<Vector::Vector3> instance_translations;
+    std::vector<Vector::Vector3> instance_velocities;
+};
+
+void capture_rest_pose(const Scene &scene, AnimationRestPose *rest);
+// moves the spheres and instances to where they are at frame, counting from the rest pose
+void animate_scene(const AnimationRestPose &rest, uint32_t frame, Scene *scene);
+
+// --frames: renders config.frame_count frames, updating the index between them (see
+// update_acceleration), and reports what the updates cost next to a full build
+int run_animation(const RenderConfig &config);
@@ -0,0 +1,25 @@
+#pragma once
+#include "Config.h"
+
+// Benchmark modes render the default scene (or the --generate one) without writing an image and print
+// their results as tables (and CSV when --csv is given).  Each returns the
+// process exit code.
+
+// --sweep: throughput and parallel efficiency over threads x tile size x spp
+int run_parameter_sweep(const RenderConfig &config);
+
+// --scaling: speedup, parallel efficiency and per-thread idle time for 1..N workers,
+// optionally checked against a baseline written by an earlier --json run
+int run_thread_scaling(const RenderConfig &config);
+
+// --scene-scaling: generation time, memory and rays/s of procedural scenes as they grow
+int run_scene_scaling(const RenderConfig &config);
+
+// --bvh-builders: build time, SAH cost and rays/s of the scene's BVH from each builder
+int run_bvh_builders(const RenderConfig &config);
+
+// --accelerators: build time, memory and rays/s of every accelerator on the generated layouts
+int run_accelerator_comparison(const RenderConfig &config);
+
+// --occlusion: rays/s of closest_hit against occluded for shadow rays, per layout and accelerator
+int run_occlusion_benchmark(const RenderConfig &config);
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "RayTracer.h"
+
+// Binary scene format, made to be memory-mapped and traced without parsing or copying.
+// A fixed header is followed by the material, plane and sphere arrays, each stored exactly
+// as the in-memory Material, Plane and Sphere structs (little-endian, 64 byte aligned).
+// Loading checks the header and points Scene::planes and Scene::spheres straight into the
+// mapping; only the handful of materials is copied.
+//
+// Primitive data is trusted as written: the loader does not walk millions of spheres, it
+// only checks the highest material index the writer recorded in the header.
+//
+// Files are converted from the text format with
+//   raytracer --scene big.txt --write-scene big.rtscene
+// and load through --scene like text files; the magic number tells them apart.
+constexpr char BINARY_SCENE_MAGIC[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+// bump whenever the header or Material, Plane or Sphere change layout
+constexpr uint32_t BINARY_SCENE_VERSION = 1;
+constexpr uint32_t BINARY_SCENE_ALIGNMENT = 64;
+constexpr const char *BINARY_SCENE_EXTENSION = ".rtscene";
+
+struct BinarySceneSection
+{
+    uint64_t offset;  // from the start of the file
+    uint64_t count;
+};
+
+struct BinarySceneHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t file_size;
+    Camera camera;
+    // sizeof() of each element when the file was written
+    uint32_t material_size;
+    uint32_t plane_size;
+    uint32_t sphere_size;
+    uint32_t max_material_index;
+    BinarySceneSection materials;
+    BinarySceneSection planes;
+    BinarySceneSection spheres;
+};
+
+// peeks at the magic number, so --scene can take either format
+bool is_binary_scene_file(const std::string &file_name);
+// true for names ending in BINARY_SCENE_EXTENSION, which --write-scene writes in binary
+bool has_binary_scene_extension(const std::string &file_name);
+
+bool load_scene_binary(const std::string &file_name, Scene *scene, std::string *error);
+// fails for scenes with instances, which only the text format stores
+bool write_scene_binary(const Scene &scene, const std::string &file_name, std::string *error);
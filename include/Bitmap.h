@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <memory>
+#include <string>
 
 constexpr uint32_t BITMAP_ID_FIELD = 0x4D42;
 
@@ -8,6 +9,8 @@ constexpr uint32_t BITMAP_ID_FIELD = 0x4D42;
 constexpr uint32_t HEADER_SIZE_EXCLUDE_BYTES = 14;
 constexpr uint32_t BITMAP_PLANES = 1;
 constexpr uint32_t BITS_PER_PIXEL = 32;
+// where the pixels start in a mapped bitmap: past the header, on a cache line
+constexpr uint32_t MAPPED_PIXEL_OFFSET = 64;
 
 struct ImageData
 {
@@ -36,11 +39,11 @@ struct BitmapHeader
     uint32_t colors_used;
     uint32_t colors_important;
 
-    void compose(ImageData image_data, uint32_t output_pixel_size)
+    void compose(ImageData image_data, uint32_t output_pixel_size, uint32_t pixel_offset = sizeof(BitmapHeader))
     {
         file_type = BITMAP_ID_FIELD;
-        file_size = sizeof(BitmapHeader) + output_pixel_size;
-        bitmap_offset = sizeof(BitmapHeader);
+        file_size = pixel_offset + output_pixel_size;
+        bitmap_offset = pixel_offset;
         size = sizeof(BitmapHeader) - HEADER_SIZE_EXCLUDE_BYTES;
         width = image_data.width;
         height = image_data.height;
@@ -56,15 +59,21 @@ struct BitmapHeader
 };
 #pragma pack(pop)
 
+// Pixels live in memory and write_image saves them, unless map_file has pointed them into
+// a shared mapping of the output file: tiles then land in the file as they are rendered and
+// writing to that file again is a no-op.  The mapping is released with the last copy of
+// ImageData::pixels.
 class Bitmap
 {
 private:
     ImageData image_data;
     uint32_t output_pixel_size;
+    std::string mapped_file_name;
 
     const uint32_t calculate_total_pixel_size() const;
 public:
     Bitmap(uint32_t width, uint32_t height);
+    bool map_file(const std::string &file_name, std::string *error);
     void write_image(const std::string &file_name);
     const ImageData *get_image_data() const;
 };
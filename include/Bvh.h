@@ -0,0 +1,160 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "MappedFile.h"
+#include "SceneArray.h"
+#include "Vector.h"
+
+struct Aabb
+{
+    Vector::Vector3 min;
+    Vector::Vector3 max;
+};
+
+// Inner nodes have count 0 and their two children at nodes[first] and nodes[first + 1];
+// leaves cover primitive_indices[first, first + count).
+struct BvhNode
+{
+    Aabb bounds;
+    uint32_t first;
+    uint32_t count;
+};
+
+constexpr uint32_t BVH_MAX_LEAF_SIZE = 4;
+// builders never go deeper, so traversal gets by with a fixed stack
+constexpr uint32_t BVH_MAX_DEPTH = 64;
+
+// Bounding volume hierarchy over an array of primitives; primitive_indices maps leaves back
+// into that array, so the primitives themselves stay where they are (possibly in a mapped
+// scene file).  Both arrays can view a mapped BVH cache file instead of owning their data.
+struct Bvh
+{
+    // nodes[0] is the root; empty when there are no primitives
+    SceneArray<BvhNode> nodes;
+    SceneArray<uint32_t> primitive_indices;
+    std::shared_ptr<const MappedFile> mapped_file;
+};
+
+inline Aabb empty_aabb()
+{
+    return Aabb { Vector::Vector3 { FLT_MAX, FLT_MAX, FLT_MAX }, Vector::Vector3 { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+}
+
+inline void grow_aabb(Aabb *box, const Aabb &other)
+{
+    box->min = Vector::Vector3 { std::min(box->min.x, other.min.x), std::min(box->min.y, other.min.y), std::min(box->min.z, other.min.z) };
+    box->max = Vector::Vector3 { std::max(box->max.x, other.max.x), std::max(box->max.y, other.max.y), std::max(box->max.z, other.max.z) };
+}
+
+inline void grow_aabb(Aabb *box, const Vector::Vector3 &point)
+{
+    grow_aabb(box, Aabb { point, point });
+}
+
+inline Vector::Vector3 aabb_center(const Aabb &box)
+{
+    return 0.5f * (box.min + box.max);
+}
+
+inline float aabb_surface_area(const Aabb &box)
+{
+    Vector::Vector3 extent = box.max - box.min;
+    if ((extent.x < 0.0f) || (extent.y < 0.0f) || (extent.z < 0.0f))
+    {
+        return 0.0f;
+    }
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// spreads the low 10 bits of value out to every third bit, for Morton codes
+inline uint32_t expand_morton_bits(uint32_t value)
+{
+    value = (value * 0x00010001u) & 0xFF0000FFu;
+    value = (value * 0x00000101u) & 0x0F00F00Fu;
+    value = (value * 0x00000011u) & 0xC30C30C3u;
+    value = (value * 0x00000005u) & 0x49249249u;
+    return value;
+}
+
+inline float vector_axis(const Vector::Vector3 &vector, uint32_t axis)
+{
+    return (axis == 0) ? vector.x : ((axis == 1) ? vector.y : vector.z);
+}
+
+// entry distance of the ray into box, or false when it misses box before max_distance
+inline bool ray_hits_aabb(const Aabb &box, const Vector::Vector3 &origin, const Vector::Vector3 &inverse_direction,
+                          float max_distance, float *entry_distance)
+{
+    float x0 = (box.min.x - origin.x) * inverse_direction.x;
+    float x1 = (box.max.x - origin.x) * inverse_direction.x;
+    float y0 = (box.min.y - origin.y) * inverse_direction.y;
+    float y1 = (box.max.y - origin.y) * inverse_direction.y;
+    float z0 = (box.min.z - origin.z) * inverse_direction.z;
+    float z1 = (box.max.z - origin.z) * inverse_direction.z;
+
+    float near = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+    float far = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), max_distance));
+    *entry_distance = near;
+    return near <= far;
+}
+
+// Builders take the bounds of count primitives.  Median splits the longest axis in half by
+// primitive count: quick and balanced, but blind to empty space.  BinnedSah picks the
+// cheapest of 16 candidate planes per axis by the surface area heuristic and builds
+// subtrees as parallel tasks on thread_count threads; slower to build, faster to trace.
+// Lbvh sorts primitives along a 30 bit Morton curve and emits the whole hierarchy in
+// parallel (Karras 2012); by far the fastest build, for scenes that change every frame,
+// but its one-primitive leaves and grid-aligned splits trace slower than either.
+enum class BvhBuilder : uint32_t
+{
+    Median,
+    BinnedSah,
+    Lbvh
+};
+
+void build_bvh_median(const Aabb *primitive_bounds, uint32_t count, Bvh *bvh);
+void build_bvh_binned_sah(const Aabb *primitive_bounds, uint32_t count, uint32_t thread_count, Bvh *bvh);
+void build_bvh_lbvh(const Aabb *primitive_bounds, uint32_t count, uint32_t thread_count, Bvh *bvh);
+// with the given builder; median always runs on one thread
+void build_bvh(BvhBuilder builder, const Aabb *primitive_bounds, uint32_t count, uint32_t thread_count, Bvh *bvh);
+
+// What refit_bvh needs besides the tree, worked out once per tree: every node's parent
+// (UINT32_MAX for the root), the leaves, and the SAH cost the tree had when it was built.
+struct BvhRefitState
+{
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> leaves;
+    float built_sah_cost;
+};
+
+void prepare_bvh_refit(const Bvh &bvh, BvhRefitState *state);
+// Recomputes every box of bvh from primitive_bounds, which hold the same primitives in new
+// places, keeping the tree's shape: leaves first, then each parent once the second of its
+// children is done, on thread_count threads.  Returns the refitted tree's SAH cost; a tree
+// whose primitives moved far from where they were built grows costlier and should be rebuilt.
+float refit_bvh(const Aabb *primitive_bounds, uint32_t thread_count, const BvhRefitState &state, Bvh *bvh);
+
+// expected cost of tracing a ray that hits the root box: every node weighs its surface area
+// relative to the root's, times 1 for an inner node and times its primitive count for a leaf.
+// Lower is better; comparable between builders for the same primitives.
+float bvh_sah_cost(const Bvh &bvh);
+
+// fast non-cryptographic hash, used to recognise unchanged scenes and damaged cache files
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed);
+
+// BVH cache file: a header with the hash of the scene it was built for and of its own
+// contents, followed by the node and index arrays exactly as in memory, 64 byte aligned.
+// Loading maps the file and points bvh at it; anything that does not match (other scene,
+// other version, truncated or damaged data) fails with a reason so the caller can rebuild.
+constexpr char BVH_CACHE_MAGIC[8] = { 'R', 'T', 'B', 'V', 'H', '\0', '\0', '\0' };
+// bump whenever the header or BvhNode change layout
+constexpr uint32_t BVH_CACHE_VERSION = 1;
+
+bool load_bvh_cache(const std::string &file_name, uint64_t scene_hash, uint32_t primitive_count, Bvh *bvh,
+                    std::string *error);
+// writes a temporary file and renames it over file_name, so concurrent jobs never see half a cache
+bool write_bvh_cache(const std::string &file_name, uint64_t scene_hash, const Bvh &bvh, std::string *error);
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// defaults used when neither the command line nor a config file says otherwise
+constexpr uint32_t DEFAULT_IMAGE_WIDTH = 1280;
+constexpr uint32_t DEFAULT_IMAGE_HEIGHT = 720;
+constexpr uint32_t DEFAULT_MAX_BOUNCE_COUNT = 8;
+constexpr uint32_t DEFAULT_RAYS_PER_PIXEL = 512;
+// 64x64 tiles seemed to be a sweet spot on the original machine; --sweep finds it per host
+constexpr uint32_t DEFAULT_TILE_SIZE = 64;
+// 0 picks one thread per hardware thread
+constexpr uint32_t DEFAULT_THREAD_COUNT = 0;
+// keeps width * height * 4 bytes inside the 32 bit size fields of the bitmap header; a
+// tiled TIFF output is written without one and may be larger
+constexpr uint64_t MAX_IMAGE_PIXELS = (1ull << 30) - 1024;
+
+struct RenderConfig
+{
+    uint32_t image_width = DEFAULT_IMAGE_WIDTH;
+    uint32_t image_height = DEFAULT_IMAGE_HEIGHT;
+    uint32_t rays_per_pixel = DEFAULT_RAYS_PER_PIXEL;
+    uint32_t max_bounce_count = DEFAULT_MAX_BOUNCE_COUNT;
+    uint32_t tile_width = DEFAULT_TILE_SIZE;
+    uint32_t tile_height = DEFAULT_TILE_SIZE;
+    uint32_t thread_count = DEFAULT_THREAD_COUNT;
+    std::string output_file = "test.bmp";
+    // --map-output renders straight into a shared mapping of output_file instead of memory
+    // that is written out afterwards (see Bitmap.h)
+    bool map_output = false;
+    // --hdr-output FILE also writes the linear, unclamped colors to a .pfm or .exr file,
+    // EXR blocks compressed as --exr-compression says, zip or none (see HdrImage.h)
+    std::string hdr_output_file;
+    std::string exr_compression = "zip";
+
+    // scene file to render instead of the default scene (see SceneFile.h)
+    std::string scene_file;
+    // writes the scene that would be rendered to this file and exits
+    std::string write_scene_file;
+
+    // procedural sphere field (see SceneGenerator.h) used instead of the default scene
+    // when scene_layout is set: random, clustered, grid or instanced
+    std::string scene_layout;
+    uint32_t primitive_count = 1000;
+    uint32_t seed = 1;
+
+    // spatial index over the spheres: bvh, bvh8, grid or none (see Acceleration.h)
+    std::string accelerator = "bvh";
+    // how the BVH is built: sah or median (see Bvh.h)
+    std::string bvh_builder = "sah";
+    // built BVHs are kept here and reused while the spheres stay the same
+    std::string bvh_cache_file;
+
+    // --frames N renders N frames of the scene moving (see Animation.h) instead of one image,
+    // refitting the spatial index between frames and rebuilding a tree once its SAH cost
+    // grows past rebuild_threshold times its cost when it was built
+    uint32_t frame_count = 0;
+    float rebuild_threshold = 1.5f;
+    // --sort-rays traces each tile a bounce at a time, sorting the secondary rays by origin
+    // and direction before each bounce (see RayBinning.h)
+    bool sort_rays = false;
+    // --gbuffer N finds the first hit of N x N fixed subpixels per pixel once, up front, and
+    // starts every sample from one of them (see GBuffer.h); 0 jitters and traces primary rays
+    uint32_t gbuffer_size = 0;
+
+    // --sweep renders the scene over every combination of these instead of writing an image;
+    // an empty list means "use the default grid" (see Benchmark.cpp)
+    bool sweep = false;
+    std::vector<uint32_t> sweep_threads;
+    std::vector<uint32_t> sweep_tiles;
+    std::vector<uint32_t> sweep_rays_per_pixel;
+    // --scaling renders with 1..N threads (or --sweep-threads) and reports speedup and idle time;
+    // results can be saved with --json and compared against an earlier run with --baseline
+    bool scaling = false;
+    std::string json_file;
+    std::string baseline_file;
+    // --scene-scaling renders generated scenes of growing size (--scene-counts) for each layout
+    // (or only --generate's) and reports build time, memory and throughput
+    bool scene_scaling = false;
+    std::vector<uint32_t> scene_counts;
+    // --bvh-builders builds the scene's BVH with every builder and reports build time, tree
+    // quality and the throughput each tree gives
+    bool bvh_builders = false;
+    // --accelerators renders the generated scene families (or only --generate's) at each of
+    // --scene-counts through every accelerator and reports build time, memory and throughput
+    bool compare_accelerators = false;
+    // --occlusion traces shadow ray segments through the same scenes and accelerators with
+    // closest_hit and with occluded and reports both throughputs
+    bool occlusion = false;
+    // benchmarks keep the fastest of this many runs per data point
+    uint32_t benchmark_repeats = 1;
+    // optional machine readable copy of benchmark tables
+    std::string csv_file;
+
+    bool perf_counters = false;
+    bool perf_kernels = false;
+    bool show_help = false;
+};
+
+// Options are the same on the command line and in config files:
+//   --width 1920 --spp 64 --tile 32x32      (command line)
+//   width = 1920                             (config file, one option per line, # comments)
+// A config file is loaded where --config appears, so later options override it.
+bool apply_config_option(RenderConfig *config, const std::string &key, const std::string &value, std::string *error);
+bool load_config_file(RenderConfig *config, const std::string &file_name, std::string *error);
+bool parse_command_line(RenderConfig *config, int argc, char **argv, std::string *error);
+bool validate_config(const RenderConfig &config, std::string *error);
+
+// resolves DEFAULT_THREAD_COUNT to the hardware thread count
+uint32_t resolve_thread_count(uint32_t thread_count);
+
+void print_usage(const char *program_name);
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A small zlib (RFC 1950) stream encoder, enough for the ZIP compression of EXR files
+// without linking zlib.  Matches are found greedily through a hash chain over the last
+// 32 KiB and coded with deflate's fixed Huffman tables as a single block, which gets most
+// of the gain on the smooth, byte-predicted data EXR feeds it at a fraction of the code.
+
+// appends the zlib stream of data to compressed
+void zlib_compress(const uint8_t *data, size_t size, std::vector<uint8_t> *compressed);
+uint32_t adler32(const uint8_t *data, size_t size);
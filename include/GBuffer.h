@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "RayTracer.h"
+
+// Primary visibility buffer.  Every primary ray leaves camera_position, so with --gbuffer N
+// the first hit of the rays through N x N fixed subpixels of every pixel is found once per
+// frame, before any path is traced: planes are evaluated over every subpixel, and each sphere
+// only over the pixels its silhouette covers, keeping the nearest hit per subpixel.  Sample k
+// of a pixel then starts from subpixel k mod N^2 with its first hit already known, whatever
+// the sample count.  Anti-aliasing becomes that fixed subpixel pattern instead of a random
+// jitter.  Instanced spheres and meshes are found with one ray query per subpixel, cut off at
+// the depth rasterized before them.
+
+constexpr uint32_t MAX_GBUFFER_SIZE = 8;
+
+struct GBuffer
+{
+    // in pixels
+    uint32_t width;
+    uint32_t height;
+    // subpixels per pixel along each axis
+    uint32_t size;
+    // pixels row by row, each its size * size subpixels row by row; the primary ray's direction
+    // (normalized, as cast_rays makes it) and what it hits first
+    std::vector<Vector::Vector3> directions;
+    std::vector<RayHit> hits;
+};
+
+// position of subpixel index along one axis of its pixel's jitter range, from -1 to 1
+inline float gbuffer_subpixel_offset(uint32_t index, uint32_t size)
+{
+    return (2.0f * static_cast<float>(index) + 1.0f) / static_cast<float>(size) - 1.0f;
+}
+
+// index into directions and hits of the subpixel sample starts from, in the pixel at (x, y)
+inline size_t gbuffer_subpixel(const GBuffer *gbuffer, uint32_t x, uint32_t y, uint32_t sample)
+{
+    uint32_t count = gbuffer->size * gbuffer->size;
+    return (static_cast<size_t>(y) * gbuffer->width + x) * count + sample % count;
+}
+
+// pixels [x_min, one_past_x_max) x [y_min, one_past_y_max)
+struct PixelRect
+{
+    uint32_t x_min;
+    uint32_t y_min;
+    uint32_t one_past_x_max;
+    uint32_t one_past_y_max;
+};
+
+// Pixels whose primary rays may hit sphere, from the camera set up in camera (see
+// setup_camera); the whole image when the sphere reaches behind the camera plane, and an
+// empty rect when it projects outside the image.
+PixelRect sphere_pixel_rect(const CastState &camera, uint32_t image_width, uint32_t image_height,
+                            const Sphere &sphere);
+
+// Fills gbuffer for an image_width x image_height render of scene on thread_count threads;
+// defined with the intersection code in RayTracer.cpp.
+void build_gbuffer(const Scene *scene, uint32_t image_width, uint32_t image_height, uint32_t size,
+                   uint32_t thread_count, GBuffer *gbuffer);
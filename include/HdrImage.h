@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "Vector.h"
+
+// Linear HDR output for compositing, written next to the 8-bit bitmap from an unclamped
+// float copy of every pixel's color.  Colors are width x height, rows bottom to top the way
+// the renderer numbers them.
+//
+// .pfm: the portable float map, 32-bit RGB, which already runs bottom to top.
+// .exr: a single part scanline OpenEXR file with 32-bit float B, G and R channels, either
+// uncompressed or ZIP compressed 16 scanlines to a block (see Deflate.h).  Blocks are
+// packed and compressed in parallel, then written in order.
+
+enum class ExrCompression
+{
+    None,
+    Zip
+};
+
+// scanlines per EXR block, as the format fixes them for each compression
+constexpr uint32_t EXR_ZIP_SCANLINES = 16;
+
+bool has_hdr_image_extension(const std::string &file_name);
+bool parse_exr_compression(const std::string &name, ExrCompression *compression);
+
+bool write_pfm(const std::string &file_name, uint32_t width, uint32_t height, const Vector::Vector3 *colors,
+               std::string *error);
+bool write_exr(const std::string &file_name, uint32_t width, uint32_t height, const Vector::Vector3 *colors,
+               ExrCompression compression, uint32_t thread_count, std::string *error);
+// write_pfm or write_exr, whichever file_name's extension names
+bool write_hdr_image(const std::string &file_name, uint32_t width, uint32_t height, const Vector::Vector3 *colors,
+                     ExrCompression compression, uint32_t thread_count, std::string *error);
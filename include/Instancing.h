@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include "Bvh.h"
+#include "RayTracer.h"
+#include "Transform.h"
+
+// Two-level acceleration: every SceneObject gets its own BVH over its spheres (the bottom
+// level, built once), and Scene::instance_bvh covers the instances' world boxes (the top
+// level).  Rays reach an object's spheres by going through the instance's world_to_object
+// transform without renormalizing the direction, so hit distances need no conversion.
+
+// places scene->objects[object]; false when there is no such object, it has no spheres, or
+// object_to_world cannot be inverted
+bool add_instance(Scene *scene, uint32_t object, const Transform &object_to_world);
+
+// spheres the instances put in the world, repeats included
+uint64_t instanced_sphere_count(const Scene &scene);
+
+// box around each instance's object in the world, in instance order
+void instance_world_bounds(const Scene &scene, std::vector<Aabb> *bounds);
+
+void build_object_bvhs(Scene *scene, BvhBuilder builder, uint32_t thread_count);
+// from the instances' current transforms; after moving instances, call again or refit it
+// with instance_world_bounds (see update_acceleration)
+void build_instance_bvh(Scene *scene, BvhBuilder builder, uint32_t thread_count);
+
+// Replaces the instances with world-space copies of their spheres.  Only possible when every
+// transform keeps spheres round (rotation, uniform scale and translation); otherwise returns
+// false and leaves scene alone.
+bool flatten_instances(Scene *scene);
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// how the mapping will be read, passed on to the kernel's read-ahead
+enum class MappedAccess
+{
+    Sequential,  // parsed front to back once
+    Random       // traced in place, touched in whatever order rays go
+};
+
+// Read-only memory mapping of a whole file.  The mapping lives as long as the
+// object, so anything pointing into data() must not outlive it.
+class MappedFile
+{
+private:
+    int file_descriptor;
+    const uint8_t *mapped_data;
+    size_t mapped_size;
+
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &file_name, std::string *error, MappedAccess access = MappedAccess::Sequential);
+    void close();
+
+    const uint8_t *data() const;
+    size_t size() const;
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "Vector.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// one BVH leaf's worth of triangles, tested together
+constexpr uint32_t TRIANGLE_BLOCK_WIDTH = BVH_MAX_LEAF_SIZE;
+static_assert(TRIANGLE_BLOCK_WIDTH == 4, "the SSE triangle test handles 4 lanes");
+
+// Corners of 4 triangles, structure of arrays: vertices[corner][axis][lane].  Lanes past
+// the end of a leaf repeat its last triangle, so every lane can be tested unmasked.
+struct TriangleBlock
+{
+    float vertices[3][3][TRIANGLE_BLOCK_WIDTH];
+};
+
+// Indexed triangles: indices holds three vertex numbers per triangle.  bvh is over the
+// triangles with every leaf starting on a multiple of TRIANGLE_BLOCK_WIDTH in
+// primitive_indices, padded with repeats, and blocks mirrors primitive_indices 4 at a time.
+// Without a BVH, blocks hold the triangles in order.
+struct TriangleMesh
+{
+    std::vector<Vector::Vector3> vertices;
+    std::vector<uint32_t> indices;
+    Bvh bvh;
+    std::vector<TriangleBlock> blocks;
+};
+
+inline uint32_t triangle_count(const TriangleMesh &mesh)
+{
+    return static_cast<uint32_t>(mesh.indices.size() / 3);
+}
+
+// builds bvh with builder and lays out blocks along it
+void build_mesh_bvh(BvhBuilder builder, uint32_t thread_count, TriangleMesh *mesh);
+// drops bvh and lays out blocks in triangle order, for tracing without an index
+void build_mesh_blocks(TriangleMesh *mesh);
+
+// Per-ray constants for the watertight test (Woop, Benthin and Wald 2013): vertices are
+// moved into a space where the ray runs along +z from the origin, so the edge tests are
+// 2D and come out the same for both triangles sharing an edge; rays never slip between.
+struct TriangleRay
+{
+    Vector::Vector3 origin;
+    uint32_t axes[3];
+    float shear[3];
+};
+
+inline TriangleRay make_triangle_ray(const Vector::Vector3 &origin, const Vector::Vector3 &direction)
+{
+    TriangleRay ray = {};
+    ray.origin = origin;
+    float magnitudes[3] = { std::fabs(direction.x), std::fabs(direction.y), std::fabs(direction.z) };
+    uint32_t z = (magnitudes[0] > magnitudes[1]) ? ((magnitudes[0] > magnitudes[2]) ? 0 : 2)
+                                                 : ((magnitudes[1] > magnitudes[2]) ? 1 : 2);
+    uint32_t x = (z + 1) % 3;
+    uint32_t y = (x + 1) % 3;
+    // keeps the winding, so det's sign means the same thing for every ray
+    if (vector_axis(direction, z) < 0.0f)
+    {
+        std::swap(x, y);
+    }
+    ray.axes[0] = x;
+    ray.axes[1] = y;
+    ray.axes[2] = z;
+    ray.shear[0] = vector_axis(direction, x) / vector_axis(direction, z);
+    ray.shear[1] = vector_axis(direction, y) / vector_axis(direction, z);
+    ray.shear[2] = 1.0f / vector_axis(direction, z);
+    return ray;
+}
+
+// Tests the ray against the block's 4 triangles from both sides; returns the lane of the
+// nearest hit between min_distance and *hit_distance and moves *hit_distance there, or -1.
+inline int32_t intersect_triangle_block(const TriangleBlock &block, const TriangleRay &ray, float min_distance,
+                                        float *hit_distance)
+{
+    const float *origin = &ray.origin.x;
+    const uint32_t kx = ray.axes[0], ky = ray.axes[1], kz = ray.axes[2];
+    float distances[TRIANGLE_BLOCK_WIDTH];
+    uint32_t hits = 0;
+#ifdef __SSE2__
+    __m128 sx = _mm_set1_ps(ray.shear[0]), sy = _mm_set1_ps(ray.shear[1]), sz = _mm_set1_ps(ray.shear[2]);
+    __m128 px[3], py[3], pz[3];
+    for (uint32_t corner = 0; corner < 3; ++corner)
+    {
+        __m128 x = _mm_sub_ps(_mm_loadu_ps(block.vertices[corner][kx]), _mm_set1_ps(origin[kx]));
+        __m128 y = _mm_sub_ps(_mm_loadu_ps(block.vertices[corner][ky]), _mm_set1_ps(origin[ky]));
+        __m128 z = _mm_sub_ps(_mm_loadu_ps(block.vertices[corner][kz]), _mm_set1_ps(origin[kz]));
+        px[corner] = _mm_sub_ps(x, _mm_mul_ps(sx, z));
+        py[corner] = _mm_sub_ps(y, _mm_mul_ps(sy, z));
+        pz[corner] = _mm_mul_ps(sz, z);
+    }
+    __m128 u = _mm_sub_ps(_mm_mul_ps(px[2], py[1]), _mm_mul_ps(py[2], px[1]));
+    __m128 v = _mm_sub_ps(_mm_mul_ps(px[0], py[2]), _mm_mul_ps(py[0], px[2]));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(px[1], py[0]), _mm_mul_ps(py[1], px[0]));
+    __m128 zero = _mm_setzero_ps();
+    __m128 any_negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+    __m128 any_positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+    __m128 determinant = _mm_add_ps(_mm_add_ps(u, v), w);
+    __m128 scaled = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, pz[0]), _mm_mul_ps(v, pz[1])), _mm_mul_ps(w, pz[2]));
+    __m128 t = _mm_div_ps(scaled, determinant);
+    __m128 inside = _mm_andnot_ps(_mm_and_ps(any_negative, any_positive), _mm_cmpneq_ps(determinant, zero));
+    __m128 in_range = _mm_and_ps(_mm_cmpgt_ps(t, _mm_set1_ps(min_distance)), _mm_cmplt_ps(t, _mm_set1_ps(*hit_distance)));
+    _mm_storeu_ps(distances, t);
+    hits = static_cast<uint32_t>(_mm_movemask_ps(_mm_and_ps(inside, in_range)));
+#else
+    for (uint32_t lane = 0; lane < TRIANGLE_BLOCK_WIDTH; ++lane)
+    {
+        float px[3], py[3], pz[3];
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            float x = block.vertices[corner][kx][lane] - origin[kx];
+            float y = block.vertices[corner][ky][lane] - origin[ky];
+            float z = block.vertices[corner][kz][lane] - origin[kz];
+            px[corner] = x - ray.shear[0] * z;
+            py[corner] = y - ray.shear[1] * z;
+            pz[corner] = ray.shear[2] * z;
+        }
+        float u = px[2] * py[1] - py[2] * px[1];
+        float v = px[0] * py[2] - py[0] * px[2];
+        float w = px[1] * py[0] - py[1] * px[0];
+        bool any_negative = (u < 0.0f) || (v < 0.0f) || (w < 0.0f);
+        bool any_positive = (u > 0.0f) || (v > 0.0f) || (w > 0.0f);
+        float determinant = u + v + w;
+        float t = (u * pz[0] + v * pz[1] + w * pz[2]) / determinant;
+        distances[lane] = t;
+        hits |= static_cast<uint32_t>(!(any_negative && any_positive) && (determinant != 0.0f) && (t > min_distance) &&
+                                      (t < *hit_distance)) << lane;
+    }
+#endif
+
+    int32_t hit_lane = -1;
+    while (hits)
+    {
+        auto lane = static_cast<int32_t>(__builtin_ctz(hits));
+        hits &= hits - 1;
+        if (distances[lane] < *hit_distance)
+        {
+            *hit_distance = distances[lane];
+            hit_lane = lane;
+        }
+    }
+    return hit_lane;
+}
+
+// unnormalized, following the triangle's winding
+inline Vector::Vector3 triangle_block_normal(const TriangleBlock &block, uint32_t lane)
+{
+    Vector::Vector3 corners[3];
+    for (uint32_t corner = 0; corner < 3; ++corner)
+    {
+        corners[corner] = Vector::Vector3 { block.vertices[corner][0][lane], block.vertices[corner][1][lane],
+                                            block.vertices[corner][2][lane] };
+    }
+    Vector::Vector3 a = corners[1] - corners[0];
+    Vector::Vector3 b = corners[2] - corners[0];
+    return Vector::Vector3 { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Mesh.h"
+#include "RayTracer.h"
+
+// Triangle meshes from Wavefront OBJ or binary PLY, memory-mapped and parsed in parallel
+// chunks on thread_count threads: a first pass counts what each chunk holds, so the second
+// can write straight into its part of the mesh.
+//
+// OBJ: only v and f lines are read; faces of more than three corners are split into a fan,
+// v/vt/vn corners keep only v, and negative indices count back from the latest vertex.
+// PLY: binary, either endianness; a vertex element with x, y and z, and a face element
+// whose only property is the list of vertex indices.  Faces of more than three corners are
+// fanned too, at the cost of a sequential pass.
+
+bool parse_obj_mesh(const char *text, size_t size, uint32_t thread_count, TriangleMesh *mesh, std::string *error);
+bool parse_ply_mesh(const uint8_t *data, size_t size, uint32_t thread_count, TriangleMesh *mesh, std::string *error);
+// by extension: .obj or .ply
+bool load_mesh_file(const std::string &file_name, uint32_t thread_count, TriangleMesh *mesh, std::string *error);
+// little-endian binary PLY, float vertices and int indices
+bool write_ply_mesh(const TriangleMesh &mesh, const std::string &file_name, std::string *error);
+
+// loads every mesh a text scene names, relative paths from directory
+bool load_scene_meshes(Scene *scene, const std::string &directory, uint32_t thread_count, std::string *error);
@@ -0,0 +1,29 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Splits [0, count) into one contiguous chunk per thread and calls
+// function(chunk_index, begin, end) for each, the calling thread taking chunk 0.
+// Returns once every chunk is done.  For data-parallel passes where every element costs
+// about the same; uneven work belongs on a queue like the renderer's TileQueue.
+template <typename Function>
+void parallel_chunks(uint32_t count, uint32_t thread_count, const Function &function)
+{
+    thread_count = std::max(1u, std::min(thread_count, count));
+    uint32_t chunk_size = (count + thread_count - 1) / std::max(thread_count, 1u);
+
+    std::vector<std::thread> threads;
+    for (uint32_t chunk_index = 1; chunk_index < thread_count; ++chunk_index)
+    {
+        uint32_t begin = std::min(count, chunk_index * chunk_size);
+        uint32_t end = std::min(count, begin + chunk_size);
+        threads.emplace_back([&function, chunk_index, begin, end] { function(chunk_index, begin, end); });
+    }
+    function(0u, 0u, std::min(count, chunk_size));
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+
+// Hardware performance counters read through the Linux perf_event_open interface.
+// Counters are opened per thread (pid = 0, cpu = -1) so that every worker measures
+// only its own work; totals are merged once per thread when it runs out of tiles.
+// Nothing here needs the perf tool or any library beyond the kernel headers.
+
+enum class PerfEvent : uint32_t
+{
+    Cycles,
+    Instructions,
+    L1DataMisses,
+    LastLevelCacheMisses,
+    BranchMisses,
+    Count
+};
+
+// Render covers a whole worker thread; Intersection and Shading are only
+// collected when kernel profiling is on since they are read around every bounce
+enum class PerfPhase : uint32_t
+{
+    Render,
+    Intersection,
+    Shading,
+    Count
+};
+
+constexpr uint32_t PERF_EVENT_COUNT = static_cast<uint32_t>(PerfEvent::Count);
+constexpr uint32_t PERF_PHASE_COUNT = static_cast<uint32_t>(PerfPhase::Count);
+
+struct PerfCounterValues
+{
+    uint64_t values[PERF_EVENT_COUNT];
+};
+
+struct PerfCounterTotals
+{
+    PerfCounterValues phases[PERF_PHASE_COUNT];
+};
+
+struct PerfCounterGroup
+{
+    int file_descriptors[PERF_EVENT_COUNT];
+    // user page of each event, used to read the counter with rdpmc instead of
+    // a read() system call; null when the mapping or rdpmc is not available
+    void *user_pages[PERF_EVENT_COUNT];
+};
+
+// one per worker thread; owned by the thread and never shared, so the hot path
+// accumulates without any synchronization
+struct PerfThreadCounters
+{
+    PerfCounterGroup group;
+    bool profile_kernels;
+
+    PerfCounterValues render_start;
+    PerfCounterValues kernel_mark;
+    PerfCounterTotals totals;
+};
+
+// settings and merged results shared by all threads of one render
+struct PerfSession
+{
+    bool enabled;
+    bool profile_kernels;
+
+    // bit per PerfEvent, set when at least one thread could open the counter
+    volatile uint64_t available_events;
+    volatile uint64_t totals[PERF_PHASE_COUNT][PERF_EVENT_COUNT];
+    // errno of the last failed perf_event_open, for the report
+    volatile int open_error;
+};
+
+const char *perf_event_label(PerfEvent event);
+
+// returns 0 when every event opened, otherwise the errno of the last failure
+int perf_counters_open(PerfCounterGroup *group);
+void perf_counters_close(PerfCounterGroup *group);
+bool perf_counter_available(const PerfCounterGroup *group, PerfEvent event);
+void perf_counters_read(const PerfCounterGroup *group, PerfCounterValues *values);
+
+void perf_thread_begin(PerfSession *session, PerfThreadCounters *counters);
+void perf_thread_end(PerfSession *session, PerfThreadCounters *counters);
+
+// attributes everything counted since the previous mark to the kernel that just
+// finished, then starts the next mark; one counter read per kernel boundary
+void perf_kernel_mark(PerfThreadCounters *counters);
+void perf_kernel_finish(PerfThreadCounters *counters, PerfPhase phase);
+
+void perf_print_report(const PerfSession *session, uint64_t rays_traced);
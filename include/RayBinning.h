@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "Math.h"
+
+// Secondary ray binning.  After the first diffuse bounce neighbouring pixels send their rays
+// anywhere, and tracing them in pixel order walks a different corner of the BVH with every
+// ray.  With --sort-rays a tile's paths are traced one bounce at a time instead, and before
+// each bounce past the first the rays are sorted on a 32 bit key: the octant of the direction
+// in the top bits, then the Morton code of the cell of the scene bounds the origin lies in.
+// Rays leaving the same neighbourhood in the same general direction then run back to back and
+// find the nodes and spheres the ray before them touched still in cache.
+
+// cells per axis of the origin grid, as a power of two; 3 * 9 + 3 octant bits fit the key
+constexpr uint32_t RAY_BIN_CELL_BITS = 9;
+
+struct RayBinGrid
+{
+    Aabb bounds;
+    // cells per unit along each axis
+    Vector::Vector3 scale;
+    // 1 / the diagonal of bounds, to measure ray spacing in scene sizes
+    float inverse_diagonal;
+};
+
+RayBinGrid make_ray_bin_grid(const Aabb &bounds);
+
+inline uint32_t ray_octant(const Vector::Vector3 &direction)
+{
+    return ((direction.x < 0.0f) ? 4u : 0u) | ((direction.y < 0.0f) ? 2u : 0u) | ((direction.z < 0.0f) ? 1u : 0u);
+}
+
+// origins outside the grid fall into its border cells
+inline uint32_t ray_bin_key(const RayBinGrid &grid, const Vector::Vector3 &origin, const Vector::Vector3 &direction)
+{
+    const float cells = static_cast<float>((1u << RAY_BIN_CELL_BITS) - 1);
+    auto quantize = [cells](float value)
+    {
+        return static_cast<uint32_t>(std::min(std::max(value, 0.0f), cells));
+    };
+    uint32_t x = quantize((origin.x - grid.bounds.min.x) * grid.scale.x);
+    uint32_t y = quantize((origin.y - grid.bounds.min.y) * grid.scale.y);
+    uint32_t z = quantize((origin.z - grid.bounds.min.z) * grid.scale.z);
+    return (ray_octant(direction) << (3 * RAY_BIN_CELL_BITS)) |
+           (expand_morton_bits(x) << 2) | (expand_morton_bits(y) << 1) | expand_morton_bits(z);
+}
+
+// Sorts entries of (key << 32) | payload by key, least significant digit first, so rays with
+// equal keys keep their order.  Digits every key shares are skipped.  scratch is only
+// storage, kept by the caller so a worker allocates it once per render.
+void sort_ray_bins(std::vector<uint64_t> *entries, std::vector<uint64_t> *scratch);
+
+// how alike rays traced back to back are
+struct RayCoherence
+{
+    uint64_t pairs;
+    uint64_t same_octant;
+    double cosine_sum;
+    // origin distance in scene diagonals
+    double spacing_sum;
+};
+
+inline void count_ray_pair(RayCoherence *coherence, const RayBinGrid &grid,
+                           const Vector::Vector3 &origin, const Vector::Vector3 &direction,
+                           const Vector::Vector3 &next_origin, const Vector::Vector3 &next_direction)
+{
+    Vector::Vector3 spacing = next_origin - origin;
+    coherence->pairs += 1;
+    coherence->same_octant += (ray_octant(direction) == ray_octant(next_direction));
+    coherence->cosine_sum += Math::inner_product(direction, next_direction);
+    coherence->spacing_sum += Math::square_root(Math::inner_product(spacing, spacing)) * grid.inverse_diagonal;
+}
+
+// the secondary rays of a render, in the order they came off the previous bounce and in
+// the order they were traced
+struct RayBinningStatistics
+{
+    uint64_t sorted_rays;
+    uint64_t sort_nanoseconds;
+    RayCoherence unsorted;
+    RayCoherence sorted;
+};
+
+void merge_ray_binning_statistics(RayBinningStatistics *total, const RayBinningStatistics *statistics);
+void print_ray_binning_statistics(const RayBinningStatistics *statistics);
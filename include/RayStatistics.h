@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+
+// Ray statistics are compiled in only when RAY_STATISTICS is defined to 1
+// (cmake -DRAYTRACER_RAY_STATISTICS=ON); otherwise RAY_STATS() drops its argument and
+// the counting code costs nothing.  Each worker thread owns its RayStatistics and
+// merges it into the render total once, so the hot path never touches shared memory.
+#ifndef RAY_STATISTICS
+#define RAY_STATISTICS 0
+#endif
+
+#if RAY_STATISTICS
+#define RAY_STATS(statement) statement
+#else
+#define RAY_STATS(statement)
+#endif
+
+enum class RayCounter : uint32_t
+{
+    SphereTests,
+    PlaneTests,
+    SphereHits,
+    PlaneHits,
+    SkyMisses,
+    BoxTests,
+    TriangleTests,
+    TriangleHits,
+    SdfSteps,
+    SdfHits,
+    Count
+};
+
+// why a path stopped bouncing
+enum class RayTermination : uint32_t
+{
+    Sky,
+    BounceLimit,
+    Count
+};
+
+constexpr uint32_t RAY_COUNTER_COUNT = static_cast<uint32_t>(RayCounter::Count);
+constexpr uint32_t RAY_TERMINATION_COUNT = static_cast<uint32_t>(RayTermination::Count);
+// paths deeper than this land in the last bucket
+constexpr uint32_t RAY_DEPTH_BUCKETS = 64;
+
+struct RayStatistics
+{
+    uint64_t counters[RAY_COUNTER_COUNT];
+    uint64_t terminations[RAY_TERMINATION_COUNT];
+    // index is the number of bounces a path took before terminating
+    uint64_t depth_histogram[RAY_DEPTH_BUCKETS];
+};
+
+inline void count_ray(RayStatistics *statistics, RayCounter counter, uint64_t amount)
+{
+    statistics->counters[static_cast<uint32_t>(counter)] += amount;
+}
+
+inline void terminate_path(RayStatistics *statistics, RayTermination reason, uint32_t depth)
+{
+    statistics->terminations[static_cast<uint32_t>(reason)] += 1;
+    statistics->depth_histogram[(depth < RAY_DEPTH_BUCKETS) ? depth : (RAY_DEPTH_BUCKETS - 1)] += 1;
+}
+
+// atomic adds, meant to be called once per thread when it finishes
+void merge_ray_statistics(RayStatistics *total, const RayStatistics *thread_statistics);
+void print_ray_statistics(const RayStatistics *statistics);
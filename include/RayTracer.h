@@ -4,21 +4,31 @@
 #include <map>
 #include <cmath>
 #include <algorithm>
+#include <memory>
+#include <string>
 #include <vector>
+#include "Bitmap.h"
+#include "Bvh.h"
+#include "Config.h"
+#include "Grid.h"
+#include "WideBvh.h"
 #include "Vector.h"
 #include "Math.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "PerfCounters.h"
+#include "RayBinning.h"
+#include "RayStatistics.h"
+#include "SceneArray.h"
+#include "Sdf.h"
+#include "Transform.h"
 
 constexpr float FLOAT32_MAX = FLT_MAX;
 constexpr float MINIMUM_HIT_DISTANCE = 0.001f;
 constexpr float TOLERANCE = 0.0001f;
-constexpr uint32_t IMAGE_WIDTH = 1280;
-constexpr uint32_t IMAGE_HEIGHT = 720;
-constexpr uint32_t CORE_COUNT = 8;
-constexpr uint32_t MAX_BOUNCE_COUNT = 8;
-constexpr uint32_t RAYS_PER_PIXEL = 512;
-constexpr float CONTRIBUTION = (1.0f / (static_cast<float>(RAYS_PER_PIXEL)));
 
-enum class MaterialName
+// also the index into Scene::materials; scene files can add materials past LightBlueReflective
+enum class MaterialName : uint32_t
 {
     White,
     Metallic,
@@ -53,6 +63,39 @@ const std::map<const MaterialName, const Material> MATERIALS =
     { MaterialName::LightBlueReflective, Material {0.98f, Vector::Vector3 {}, Vector::Vector3 {0.01f, 1.0f, 0.9f} }}
 };
 
+constexpr uint32_t BUILTIN_MATERIAL_COUNT = 10;
+constexpr const char *BUILTIN_MATERIAL_NAMES[BUILTIN_MATERIAL_COUNT] =
+{
+    "White", "Metallic", "Orange", "Violet", "LightGreen", "Green", "MirrorBlue", "LightBlue", "Raspberry",
+    "LightBlueReflective"
+};
+
+inline std::vector<Material> builtin_materials()
+{
+    std::vector<Material> materials;
+    for (const auto &entry : MATERIALS)
+    {
+        materials.push_back(entry.second);
+    }
+    return materials;
+}
+
+struct Camera
+{
+    Vector::Vector3 position;
+    Vector::Vector3 look_at;
+    Vector::Vector3 up;
+    float film_distance;
+};
+
+const Camera DEFAULT_CAMERA =
+{
+    Vector::Vector3 {0.0f, -10.0f, 1.0f},
+    Vector::Vector3 {0.0f, 0.0f, 0.0f},
+    Vector::Vector3 {0.0f, 0.0f, 1.0f},
+    1.0f
+};
+
 struct Sphere
 {
     Vector::Vector3 position;
@@ -60,6 +103,13 @@ struct Sphere
     MaterialName material_name;
 };
 
+inline Aabb sphere_bounds(const Sphere &sphere)
+{
+    float radius = std::fabs(sphere.radius);
+    Vector::Vector3 extent = { radius, radius, radius };
+    return Aabb { sphere.position - extent, sphere.position + extent };
+}
+
 struct Plane
 {
     Vector::Vector3 normal;
@@ -67,12 +117,72 @@ struct Plane
     MaterialName material_name;
 };
 
-struct Scene
+// geometry placed many times by instances, in its own object space with its own BVH
+struct SceneObject
 {
-    std::vector<Plane> planes;
     std::vector<Sphere> spheres;
+    // bottom level; empty means every instance ray tests every sphere
+    Bvh bvh;
+};
+
+// one placement of Scene::objects[object]; both directions of the transform are kept
+// because rays go into object space and normals come back out
+struct Instance
+{
+    Transform object_to_world;
+    Transform world_to_object;
+    uint32_t object;
+};
+
+// triangles loaded from file_name, all of one material
+struct Mesh
+{
+    std::string file_name;
+    MaterialName material_name;
+    TriangleMesh geometry;
+};
+
+// an implicit surface, all of one material
+struct Sdf
+{
+    MaterialName material_name;
+    SdfSurface surface;
+};
+
+struct Scene
+{
+    // owned, or viewing mapped_file when the scene was loaded from a binary scene file
+    SceneArray<Plane> planes;
+    SceneArray<Sphere> spheres;
+    // indexed by MaterialName; White doubles as the sky
+    std::vector<Material> materials = builtin_materials();
+    Camera camera = DEFAULT_CAMERA;
+    std::shared_ptr<const MappedFile> mapped_file;
+
+    // over spheres (planes are unbounded); the renderer walks sphere_wide_bvh when it has
+    // nodes, else sphere_grid when it has cells, else sphere_bvh, and tests every sphere
+    // when all are empty
+    Bvh sphere_bvh;
+    WideBvh sphere_wide_bvh;
+    Grid sphere_grid;
+
+    // Instanced spheres, traced in addition to the ones above.  Memory follows the unique
+    // spheres in objects, not the number of instances.  instance_bvh is the top level over
+    // the instances' world boxes: moving instances only has to rebuild it (see Instancing.h).
+    std::vector<SceneObject> objects;
+    std::vector<Instance> instances;
+    Bvh instance_bvh;
+
+    // traced after the spheres, each through its own BVH
+    std::vector<Mesh> meshes;
+    // traced last, each marched inside its bounds
+    std::vector<Sdf> sdfs;
 };
 
+struct RayHit;
+struct GBuffer;
+class TiledImageWriter;
+
 struct CastState
 {
     Scene *scene;
@@ -88,11 +198,41 @@ struct CastState
     Vector::Vector3 camera_z_axis;
     Vector::Vector3 camera_position;
     Math::RandomSeries series;
+    uint32_t rays_per_pixel;
+    uint32_t max_bounce_count;
+
+    PerfThreadCounters *perf;
+    RayStatistics *statistics;
+    // scene spheres in the tile's frustum, which primary rays test instead of the scene's
+    // spatial index; null when the tile was not culled (see TileCulling.h)
+    const std::vector<uint32_t> *primary_spheres;
+    // the pixel's primary_hit_count G-buffer subpixels when the render has a G-buffer (see
+    // GBuffer.h); samples start from these rays and hits instead of a jitter and a search
+    const Vector::Vector3 *primary_directions;
+    const RayHit *primary_hits;
+    uint32_t primary_hit_count;
 
     Vector::Vector3 final_color;
     uint64_t bounces_computed;
 };
 
+using CastRaysFunction = void (CastState *state);
+
+// one sample's path through a tile rendered with ray binning, which traces all of a tile's
+// paths a bounce at a time rather than each path to its end
+struct TilePath
+{
+    Vector::Vector3 ray_origin;
+    Vector::Vector3 ray_direction;
+    Vector::Vector3 attenuation;
+    Vector::Vector3 sample;
+    Math::RandomSeries series;
+    // index of the pixel within the tile
+    uint32_t pixel;
+    // false once the path has left the scene or run out of bounces
+    bool active;
+};
+
 struct TileBatch
 {
     Scene *scene;
@@ -108,8 +248,119 @@ struct TileQueue
 {
     uint32_t tile_batch_count;
     TileBatch *tile_batches;
+    uint32_t rays_per_pixel;
+    uint32_t max_bounce_count;
+    CastRaysFunction *cast_rays;
+    // sort each bounce's secondary rays on ray_bin_grid before tracing them (see RayBinning.h)
+    bool sort_rays;
+    RayBinGrid ray_bin_grid;
+    // null unless the render rasterized its primary visibility
+    const GBuffer *gbuffer;
+    // when set, finished tiles go to this file instead of the image's pixels (see TiledImage.h)
+    TiledImageWriter *tiled_output;
+    // when set, every pixel's linear color is also kept here, image_width per row (see HdrImage.h)
+    Vector::Vector3 *linear_colors;
 
     volatile uint64_t next_tile_batch_index;
     volatile uint64_t bounces_computed;
     volatile uint64_t tiles_done;
+
+    PerfSession *perf_session;
+    RayStatistics *ray_statistics;
+};
+
+// everything a worker thread owns for the length of a render
+struct WorkerState
+{
+    PerfThreadCounters perf_counters;
+    // null when the render runs without performance counters
+    PerfThreadCounters *perf;
+    RayStatistics statistics;
+
+    // time spent rendering tiles vs. touching the shared TileQueue counters
+    uint64_t busy_nanoseconds;
+    uint64_t queue_nanoseconds;
+    uint32_t tiles_rendered;
+
+    // the current tile's culled sphere list (see TileCulling.h)
+    std::vector<uint32_t> tile_spheres;
+
+    // ray binning buffers, grown to the largest tile and reused
+    std::vector<TilePath> paths;
+    std::vector<uint64_t> ray_bins;
+    std::vector<uint64_t> ray_bin_scratch;
+    std::vector<Vector::Vector3> tile_colors;
+    // the current tile's packed pixels and their file samples, for tiled output
+    std::vector<uint32_t> tile_pixels;
+    std::vector<uint8_t> tile_samples;
+    RayBinningStatistics binning_statistics;
+};
+
+// per thread summary of a render; whatever is not busy or queue time was spent idle
+struct WorkerTiming
+{
+    double busy_milliseconds;
+    double queue_milliseconds;
+    uint32_t tiles_rendered;
+};
+
+struct RenderResult
+{
+    // includes gbuffer_milliseconds
+    double elapsed_milliseconds;
+    double gbuffer_milliseconds;
+    uint64_t bounces_computed;
+    uint32_t thread_count;
+    uint32_t total_tiles;
+    std::vector<WorkerTiming> workers;
+
+    PerfSession perf_session;
+    RayStatistics ray_statistics;
+    // filled when the render sorts its secondary rays
+    RayBinningStatistics ray_binning;
+};
+
+void build_default_scene(Scene *scene);
+// the default scene, or the file or procedural scene config asks for
+bool build_scene(const RenderConfig &config, Scene *scene, std::string *error);
+// renders the whole scene into image_data with the tile size, thread count and
+// quality settings of config; blocks until every tile is done.  With tiled_output the tiles
+// are written there as they finish and image_data only gives the image size.  With
+// linear_colors, width x height of them, the unclamped colors are kept there as well.
+void render_scene(Scene *scene, const RenderConfig &config, ImageData image_data, bool show_progress, RenderResult *result,
+                  TiledImageWriter *tiled_output = nullptr, Vector::Vector3 *linear_colors = nullptr);
+// camera axes, view extents and pixel size of an image_width x image_height render, the
+// way cast_rays expects them in state
+void setup_camera(const Camera &camera, uint32_t image_width, uint32_t image_height, CastState *state);
+
+enum class HitKind : uint8_t
+{
+    None,
+    Plane,
+    Sphere,
+    InstancedSphere,
+    Triangle,
+    Sdf
+};
+
+// what a ray hit, as the renderer shades it
+struct RayHit
+{
+    float distance;
+    HitKind kind;
+    // into Scene::planes, spheres, instances, meshes or sdfs, following kind
+    uint32_t primitive;
+    MaterialName material_name;
+    // unit length; out of spheres and sdfs, and towards the ray for triangles
+    Vector::Vector3 normal;
 };
+
+// Ray queries against everything the renderer traces, through the same traversal, with
+// distances in multiples of ray_direction's length and statistics counted as in a render.
+// closest_hit finds the nearest hit closer than max_distance; hit->distance is max_distance
+// on a miss.  occluded only asks whether anything lies closer than max_distance, and stops
+// at the first hit it finds in any order: for shadow and visibility rays.
+bool closest_hit(const Scene *scene, const Vector::Vector3 &ray_origin, const Vector::Vector3 &ray_direction,
+                 float max_distance, RayHit *hit, RayStatistics *statistics);
+bool occluded(const Scene *scene, const Vector::Vector3 &ray_origin, const Vector::Vector3 &ray_direction,
+              float max_distance, RayStatistics *statistics);
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Primitive array of a Scene.  Normally it owns its elements like a std::vector, but it can
+// also view elements that live somewhere else (a memory-mapped binary scene file), so large
+// scenes are traced in place instead of being copied.  Reading never copies; the first
+// modification of a viewed array copies it into owned storage.
+template <typename T>
+class SceneArray
+{
+private:
+    std::vector<T> owned;
+    const T *viewed_data = nullptr;
+    size_t viewed_size = 0;
+    bool viewing = false;
+
+    void make_owned()
+    {
+        if (viewing)
+        {
+            owned.assign(viewed_data, viewed_data + viewed_size);
+            viewed_data = nullptr;
+            viewed_size = 0;
+            viewing = false;
+        }
+    }
+
+public:
+    // the caller keeps data alive for as long as this array (or a copy of it) is used
+    void view(const T *data, size_t count)
+    {
+        owned.clear();
+        owned.shrink_to_fit();
+        viewed_data = data;
+        viewed_size = count;
+        viewing = true;
+    }
+
+    bool is_view() const { return viewing; }
+
+    const T *data() const { return viewing ? viewed_data : owned.data(); }
+    // for changing elements in place; copies a view first
+    T *mutable_data() { make_owned(); return owned.data(); }
+    size_t size() const { return viewing ? viewed_size : owned.size(); }
+    bool empty() const { return size() == 0; }
+    // owned storage only; a view costs no heap memory
+    size_t capacity() const { return owned.capacity(); }
+
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + size(); }
+    const T &operator[](size_t index) const { return data()[index]; }
+
+    // takes over a finished array, e.g. one a builder filled in
+    void assign(std::vector<T> &&elements)
+    {
+        owned = std::move(elements);
+        viewed_data = nullptr;
+        viewed_size = 0;
+        viewing = false;
+    }
+
+    void reserve(size_t count) { make_owned(); owned.reserve(count); }
+    void push_back(const T &value) { make_owned(); owned.push_back(value); }
+    void clear() { owned.clear(); viewed_data = nullptr; viewed_size = 0; viewing = false; }
+};
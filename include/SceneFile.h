@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "RayTracer.h"
+
+// Text scene format, one statement per line, '#' starts a comment:
+//
+//   camera   px py pz  lx ly lz  [ux uy uz  [film_distance]]
+//   material NAME specular  er eg eb  rr rg rb
+//   plane    nx ny nz distance MATERIAL
+//   sphere   x y z radius MATERIAL
+//   object   NAME
+//   end
+//   instance NAME tx ty tz
+//   instance NAME m00 m01 m02 m03  m10 m11 m12 m13  m20 m21 m22 m23
+//   mesh     FILE MATERIAL
+//   sdf      MATERIAL smoothness
+//   sphere   x y z radius
+//   box      x y z hx hy hz
+//   end
+//
+// camera is position, look-at point, up vector (default 0 0 1) and film distance (default 1).
+// material defines NAME with its specular factor, emit color and reflection color, or
+// overrides a built-in material of that name.  MATERIAL is a built-in name (White,
+// Metallic, ... see MaterialName) or one defined on an earlier line.
+// The sphere lines between object and end make up object NAME, in its own coordinates,
+// instead of going into the scene; instance places a copy of an earlier object, moved by
+// tx ty tz or by the affine transform whose 3x4 matrix is given row by row.
+// mesh adds the triangles of an .obj or .ply file (see MeshFile.h), relative to the scene
+// file; parse_scene_text only records the name, load_scene_text loads it.
+// The sphere and box lines between sdf and end, without materials of their own, blend into
+// one implicit surface (see Sdf.h) over smoothness units; box takes its center and half
+// extents.
+//
+// The parser walks the memory-mapped file with a tokenizer that never allocates;
+// names are compared in place and numbers go through std::from_chars, so the only
+// allocations are the scene's own arrays, which are sized from a line count up front.
+
+bool parse_scene_text(const char *text, size_t size, Scene *scene, std::string *error);
+bool load_scene_text(const std::string &file_name, Scene *scene, std::string *error);
+bool write_scene_text(const Scene &scene, const std::string &file_name, std::string *error);
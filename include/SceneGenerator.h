@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "RayTracer.h"
+
+// Procedural sphere fields for benchmarking at sizes the hand-built scene can't reach.
+// Every layout fills the same box in front of the default camera and shrinks the radius
+// as the count grows, so the fraction of the box that is solid stays roughly constant
+// from 10 to 10^7 spheres.  The same seed always produces the same scene.
+enum class SceneLayout
+{
+    Random,     // uniformly scattered
+    Clustered,  // dense clumps around cbrt(count) centers, large empty space between
+    Grid,       // regular lattice, all spheres the same size
+    Instanced   // the default scene's berry cluster, scattered as instances of one object
+};
+
+constexpr uint32_t MAX_GENERATED_SPHERES = 10000000;
+
+bool parse_scene_layout(const std::string &name, SceneLayout *layout);
+const char *scene_layout_name(SceneLayout layout);
+
+// replaces the contents of scene with a ground plane and sphere_count spheres
+void generate_sphere_field(Scene *scene, SceneLayout layout, uint32_t sphere_count, uint32_t seed);
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "Vector.h"
+
+// Implicit surfaces: the zero set of a signed distance field made of spheres and boxes,
+// blended by a polynomial smooth minimum (Quilez) over smoothness world units; 0 is a plain
+// union.  Rays find them by sphere tracing (Hart 1996): step along the ray by the distance
+// to the nearest surface until it falls under an epsilon that grows with the distance
+// travelled, or SDF_MAX_STEPS run out.  Only the stretch of the ray inside the surface's
+// bounds is marched, so rays that pass by cost one box test.
+
+constexpr uint32_t SDF_MAX_STEPS = 128;
+// hit epsilon per world unit travelled, and at least this in absolute terms
+constexpr float SDF_HIT_EPSILON = 1.0e-4f;
+
+// shapes are evaluated 4 at a time, as SSE lanes; lanes past the last shape are unused
+constexpr uint32_t SDF_BLOCK_WIDTH = 4;
+
+struct SdfSphere
+{
+    Vector::Vector3 center;
+    float radius;
+};
+
+struct SdfBox
+{
+    Vector::Vector3 center;
+    Vector::Vector3 half_extent;
+};
+
+// 4 shapes of a kind, structure of arrays: center[axis][lane]
+struct SdfSphereBlock
+{
+    float center[3][SDF_BLOCK_WIDTH];
+    float radius[SDF_BLOCK_WIDTH];
+};
+
+struct SdfBoxBlock
+{
+    float center[3][SDF_BLOCK_WIDTH];
+    float half_extent[3][SDF_BLOCK_WIDTH];
+};
+
+// spheres, then boxes, blend into the field in order; the blocks and bounds are derived
+// from them by finish_sdf_surface
+struct SdfSurface
+{
+    std::vector<SdfSphere> spheres;
+    std::vector<SdfBox> boxes;
+    float smoothness = 0.0f;
+    std::vector<SdfSphereBlock> sphere_blocks;
+    std::vector<SdfBoxBlock> box_blocks;
+    Aabb bounds;
+};
+
+// lays out the blocks and bounds the surface, smooth union bulges included; call after
+// changing the shapes and before tracing
+void finish_sdf_surface(SdfSurface *surface);
+
+// distance from point to the surface, negative inside; never more than the true distance,
+// so it is always a safe step
+float sdf_distance(const SdfSurface &surface, const Vector::Vector3 &point);
+
+// unit normal at a point on the surface, out of it
+Vector::Vector3 sdf_normal(const SdfSurface &surface, const Vector::Vector3 &point);
+
+// First crossing into the surface by ray_origin + t * ray_direction with t between
+// min_hit_distance and *hit_distance, which it then updates.  A ray starting on the surface
+// leaves it before it can hit, so bounces don't find the point they left from.  steps
+// counts distance evaluations.
+bool trace_sdf(const SdfSurface &surface, const Vector::Vector3 &ray_origin, const Vector::Vector3 &ray_direction,
+               float min_hit_distance, float *hit_distance, uint32_t *steps);
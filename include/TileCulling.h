@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "RayTracer.h"
+
+// Primary rays all leave the camera through one tile of the film, so the scene spheres they
+// can reach are the ones inside that tile's frustum, usually a handful.  render_tile collects
+// them once per tile and its primary rays test only those; bounces go back to the scene's own
+// spatial index.  Instanced spheres, planes and meshes are not culled.
+
+// spheres in a tile's list when the scene has a spatial index to fall back on; a longer list
+// would cost primary rays more than the index does
+constexpr uint32_t TILE_SPHERE_LIMIT = 32;
+// scenes with a wide BVH or a grid but no binary BVH are only scanned up to this many spheres
+constexpr uint32_t TILE_CULL_SCAN_LIMIT = 4096;
+
+// the camera and four planes through it along the tile's edges, plus one through it facing
+// the way the camera looks; normals point into the frustum
+struct TileFrustum
+{
+    Vector::Vector3 apex;
+    Vector::Vector3 normals[5];
+};
+
+// covers every primary ray cast_rays can send through the tile's pixels, jitter included
+TileFrustum make_tile_frustum(const CastState &state, const TileBatch &tile);
+
+// Fills spheres with the indices, ascending, of the scene spheres that may lie in frustum.
+// Returns false, leaving primary rays to the scene's spatial index, when the scene has one
+// and the tile holds more than TILE_SPHERE_LIMIT spheres, or when finding them would mean
+// scanning a large scene.
+bool cull_tile_spheres(const Scene &scene, const TileFrustum &frustum, std::vector<uint32_t> *spheres);
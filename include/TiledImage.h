@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Streaming output for images too large to hold: an --output ending in .tif or .tiff is
+// written as a tiled TIFF, each render tile stored with pwrite the moment it is done, so
+// memory follows the tiles in flight rather than the image.  The header and tile tables
+// are written up front, every tile at a fixed offset, so tiles go out in any order from
+// any thread.  Tiles are 8-bit RGB, uncompressed, padded to full size at the right and top
+// edges; rows run bottom to top (orientation 4), the order the renderer numbers them.
+// Files of 4 GiB and more are written as BigTIFF.
+
+// TIFF tiles are multiples of this on both axes, so render tiles have to be as well
+constexpr uint32_t TIFF_TILE_MULTIPLE = 16;
+
+bool has_tiled_image_extension(const std::string &file_name);
+
+class TiledImageWriter
+{
+private:
+    int file_descriptor;
+    uint32_t tile_width;
+    uint32_t tile_height;
+    uint32_t tiles_across;
+    uint64_t data_offset;
+    uint64_t tile_bytes;
+    // errno of the first failed tile write, 0 while none has failed
+    volatile int write_error;
+
+public:
+    TiledImageWriter();
+    ~TiledImageWriter();
+    TiledImageWriter(const TiledImageWriter &) = delete;
+    TiledImageWriter &operator=(const TiledImageWriter &) = delete;
+
+    // creates file_name at its full size, sparse until the tiles arrive
+    bool create(const std::string &file_name, uint32_t image_width, uint32_t image_height, uint32_t tile_width,
+                uint32_t tile_height, std::string *error);
+    // Stores the render tile whose corner is (x_min, y_min), width x height packed pixels
+    // (see Math::pack_BGRA) one row after the other; safe to call from several threads for
+    // different tiles.  scratch is the caller's conversion buffer.  Failures show up in close.
+    void write_tile(uint32_t x_min, uint32_t y_min, uint32_t width, uint32_t height, const uint32_t *pixels,
+                    std::vector<uint8_t> *scratch);
+    bool close(std::string *error);
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include "RayTracer.h"
+
+// Bulk ray queries for tools that want the intersection engine without the renderer.  Rays
+// and results are structures of arrays, which callers can fill and read with their own
+// vector code, and rays are handed out to the threads in slices from a shared counter,
+// since one ray can cost many times another.  The scene must be ready to trace, i.e.
+// through prepare_acceleration, and must not change during the call.
+
+enum class RayQuery
+{
+    ClosestHit,  // see closest_hit
+    AnyHit       // see occluded
+};
+
+// count rays; max_distance may be null for rays that go on forever
+struct RayBatch
+{
+    RayQuery query;
+    uint32_t count;
+    const float *origin_x;
+    const float *origin_y;
+    const float *origin_z;
+    const float *direction_x;
+    const float *direction_y;
+    const float *direction_z;
+    const float *max_distance;
+};
+
+// Where the results go, count entries per array.  Null arrays are skipped, and any-hit
+// batches only ever write hit.
+struct HitBatch
+{
+    // 1 for a hit (or an occluded ray), 0 for a miss
+    uint8_t *hit;
+    // the ray's max distance on a miss
+    float *distance;
+    // HitKind, primitive, material and normal as in RayHit
+    uint8_t *kind;
+    uint32_t *primitive;
+    uint32_t *material;
+    float *normal_x;
+    float *normal_y;
+    float *normal_z;
+};
+
+// rays per slice taken from the queue
+constexpr uint32_t TRACE_BATCH_SLICE_SIZE = 1024;
+
+// traces every ray of rays on thread_count threads (DEFAULT_THREAD_COUNT for all cores)
+// and returns once hits is filled in
+void trace_batch(const Scene &scene, const RayBatch &rays, uint32_t thread_count, HitBatch *hits);
@@ -0,0 +1,101 @@
+#pragma once
+#include <cmath>
+#include "Bvh.h"
+#include "Vector.h"
+
+// Affine transform as the top 3 rows of a 4x4 matrix, row major: the left 3x3 is the
+// linear part and the last column the translation.
+struct Transform
+{
+    float m[3][4];
+};
+
+inline Transform identity_transform()
+{
+    return Transform { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } } };
+}
+
+// uniform scale, then rotation about z, then translation; what the instance generator uses
+inline Transform scale_rotate_translate(float scale, float z_radians, const Vector::Vector3 &translation)
+{
+    float c = scale * std::cos(z_radians);
+    float s = scale * std::sin(z_radians);
+    return Transform { { { c, -s, 0.0f, translation.x }, { s, c, 0.0f, translation.y }, { 0.0f, 0.0f, scale, translation.z } } };
+}
+
+inline Vector::Vector3 transform_vector(const Transform &t, const Vector::Vector3 &v)
+{
+    return Vector::Vector3 { t.m[0][0] * v.x + t.m[0][1] * v.y + t.m[0][2] * v.z,
+                             t.m[1][0] * v.x + t.m[1][1] * v.y + t.m[1][2] * v.z,
+                             t.m[2][0] * v.x + t.m[2][1] * v.y + t.m[2][2] * v.z };
+}
+
+inline Vector::Vector3 transform_point(const Transform &t, const Vector::Vector3 &p)
+{
+    return transform_vector(t, p) + Vector::Vector3 { t.m[0][3], t.m[1][3], t.m[2][3] };
+}
+
+// Normals go through the transpose of the inverse.  Given the inverse itself (the
+// world-to-object transform, which instances keep anyway), that is just its transpose.
+inline Vector::Vector3 transform_normal_by_inverse(const Transform &inverse, const Vector::Vector3 &n)
+{
+    return Vector::Vector3 { inverse.m[0][0] * n.x + inverse.m[1][0] * n.y + inverse.m[2][0] * n.z,
+                             inverse.m[0][1] * n.x + inverse.m[1][1] * n.y + inverse.m[2][1] * n.z,
+                             inverse.m[0][2] * n.x + inverse.m[1][2] * n.y + inverse.m[2][2] * n.z };
+}
+
+// false for a singular transform
+inline bool invert_transform(const Transform &t, Transform *inverse)
+{
+    const float (*m)[4] = t.m;
+    float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    float determinant = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    if (!(std::fabs(determinant) > 1e-20f))
+    {
+        return false;
+    }
+    float r = 1.0f / determinant;
+
+    Transform result = {};
+    float (*out)[4] = result.m;
+    out[0][0] = c00 * r;
+    out[1][0] = c01 * r;
+    out[2][0] = c02 * r;
+    out[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * r;
+    out[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * r;
+    out[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * r;
+    out[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * r;
+    out[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * r;
+    out[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * r;
+
+    Vector::Vector3 translation = transform_vector(result, Vector::Vector3 { m[0][3], m[1][3], m[2][3] });
+    out[0][3] = -translation.x;
+    out[1][3] = -translation.y;
+    out[2][3] = -translation.z;
+    *inverse = result;
+    return true;
+}
+
+// box around the transformed box (Arvo 1990): each output axis takes the smaller and
+// larger of every matrix entry times the matching input extent
+inline Aabb transform_aabb(const Transform &t, const Aabb &box)
+{
+    const float *box_min = &box.min.x;
+    const float *box_max = &box.max.x;
+    float result_min[3], result_max[3];
+    for (uint32_t row = 0; row < 3; ++row)
+    {
+        result_min[row] = result_max[row] = t.m[row][3];
+        for (uint32_t column = 0; column < 3; ++column)
+        {
+            float a = t.m[row][column] * box_min[column];
+            float b = t.m[row][column] * box_max[column];
+            result_min[row] += std::min(a, b);
+            result_max[row] += std::max(a, b);
+        }
+    }
+    return Aabb { Vector::Vector3 { result_min[0], result_min[1], result_min[2] },
+                  Vector::Vector3 { result_max[0], result_max[1], result_max[2] } };
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Bvh.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+constexpr uint32_t WIDE_BVH_WIDTH = 8;
+
+// One node of an 8-wide BVH, 80 bytes against the 32 of a binary node that covers only two
+// children.  Child boxes are stored as 8 bit offsets from origin in steps of 2^exponent per
+// axis, rounded outward, so they only ever grow.  Children fill slots [0, child_count).
+// child_meta is 0 for an empty slot; a node child has (k + 1) << 3 and lives at
+// nodes[first_child + k]; a leaf child has offset << 3 | count and covers
+// primitive_indices[first_primitive + offset, + count).
+struct WideBvhNode
+{
+    Vector::Vector3 origin;
+    int8_t exponents[3];
+    uint8_t child_count;
+    uint32_t first_child;
+    uint32_t first_primitive;
+    uint8_t child_meta[WIDE_BVH_WIDTH];
+    uint8_t lower[3][WIDE_BVH_WIDTH];
+    uint8_t upper[3][WIDE_BVH_WIDTH];
+};
+static_assert(sizeof(WideBvhNode) == 80, "WideBvhNode is meant to span 80 bytes");
+// leaf offsets have 5 bits; the last of 8 leaves starts after at most 7 full ones
+static_assert(BVH_MAX_LEAF_SIZE * (WIDE_BVH_WIDTH - 1) < 32, "leaf offsets must fit 5 bits");
+
+// a wide node is never deeper than the binary node it came from, except below oversized
+// leaves, which split 8 ways per level
+constexpr uint32_t WIDE_BVH_MAX_DEPTH = BVH_MAX_DEPTH + 11;
+// traversal pushes at most all but one child per level
+constexpr uint32_t WIDE_BVH_STACK_SIZE = (WIDE_BVH_WIDTH - 1) * WIDE_BVH_MAX_DEPTH;
+
+// Collapsed from a binary Bvh, with its own copy of the primitive indices reordered so
+// the leaves of one node are contiguous.  nodes[0] is the root; empty without primitives.
+struct WideBvh
+{
+    std::vector<WideBvhNode> nodes;
+    std::vector<uint32_t> primitive_indices;
+};
+
+// Every node absorbs the largest of its children's children until it has 8 or only leaves
+// are left.  Binary leaves of more than BVH_MAX_LEAF_SIZE primitives (a builder that hit
+// BVH_MAX_DEPTH) are split over extra nodes with the leaf's box.
+void build_wide_bvh(const Bvh &bvh, WideBvh *wide);
+
+inline bool wide_child_is_leaf(uint8_t meta)
+{
+    return (meta & 7) != 0;
+}
+
+inline float wide_exponent_scale(int8_t exponent)
+{
+    // exponents are kept within the normal float range
+    uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+// decoded box of a child, as the traversal sees it
+inline Aabb wide_child_bounds(const WideBvhNode &node, uint32_t slot)
+{
+    Vector::Vector3 scale = { wide_exponent_scale(node.exponents[0]), wide_exponent_scale(node.exponents[1]),
+                              wide_exponent_scale(node.exponents[2]) };
+    return Aabb { Vector::Vector3 { node.origin.x + node.lower[0][slot] * scale.x, node.origin.y + node.lower[1][slot] * scale.y,
+                                    node.origin.z + node.lower[2][slot] * scale.z },
+                  Vector::Vector3 { node.origin.x + node.upper[0][slot] * scale.x, node.origin.y + node.upper[1][slot] * scale.y,
+                                    node.origin.z + node.upper[2][slot] * scale.z } };
+}
+
+// Per-ray constants for wide_node_hits: which of lower and upper is the near plane on each
+// axis follows from the direction's sign, so it is chosen once per ray.
+struct WideRay
+{
+    Vector::Vector3 origin;
+    Vector::Vector3 inverse_direction;
+    uint32_t near_is_upper[3];
+};
+
+inline WideRay make_wide_ray(const Vector::Vector3 &origin, const Vector::Vector3 &inverse_direction)
+{
+    return WideRay { origin, inverse_direction,
+                     { inverse_direction.x < 0.0f, inverse_direction.y < 0.0f, inverse_direction.z < 0.0f } };
+}
+
+// Tests the ray against all of node's children at once; returns a mask of the children it
+// enters before max_distance and writes their entry distances to entry_distances.
+inline uint32_t wide_node_hits(const WideBvhNode &node, const WideRay &ray, float max_distance, float *entry_distances)
+{
+    float step[3], offset[3];
+    const float *origin = &node.origin.x;
+    const float *ray_origin = &ray.origin.x;
+    const float *inverse_direction = &ray.inverse_direction.x;
+    const uint8_t *near_planes[3];
+    const uint8_t *far_planes[3];
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        // t = (q * 2^e + origin - ray origin) / direction; folding 1 / direction into the step
+        // would give 0 * infinity for axis-parallel rays
+        step[axis] = wide_exponent_scale(node.exponents[axis]);
+        offset[axis] = origin[axis] - ray_origin[axis];
+        near_planes[axis] = ray.near_is_upper[axis] ? node.upper[axis] : node.lower[axis];
+        far_planes[axis] = ray.near_is_upper[axis] ? node.lower[axis] : node.upper[axis];
+    }
+
+#ifdef __AVX2__
+    auto plane_distances = [&](const uint8_t *const *planes, uint32_t axis)
+    {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(planes[axis]));
+        __m256 quantized = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+        __m256 position = _mm256_add_ps(_mm256_mul_ps(quantized, _mm256_set1_ps(step[axis])), _mm256_set1_ps(offset[axis]));
+        return _mm256_mul_ps(position, _mm256_set1_ps(inverse_direction[axis]));
+    };
+    __m256 near = _mm256_max_ps(_mm256_max_ps(plane_distances(near_planes, 0), plane_distances(near_planes, 1)),
+                                _mm256_max_ps(plane_distances(near_planes, 2), _mm256_setzero_ps()));
+    __m256 far = _mm256_min_ps(_mm256_min_ps(plane_distances(far_planes, 0), plane_distances(far_planes, 1)),
+                               _mm256_min_ps(plane_distances(far_planes, 2), _mm256_set1_ps(max_distance)));
+    _mm256_storeu_ps(entry_distances, near);
+    auto hits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ)));
+#else
+    uint32_t hits = 0;
+    for (uint32_t slot = 0; slot < node.child_count; ++slot)
+    {
+        float near = 0.0f;
+        float far = max_distance;
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            near = std::max(near, (near_planes[axis][slot] * step[axis] + offset[axis]) * inverse_direction[axis]);
+            far = std::min(far, (far_planes[axis][slot] * step[axis] + offset[axis]) * inverse_direction[axis]);
+        }
+        entry_distances[slot] = near;
+        hits |= static_cast<uint32_t>(near <= far) << slot;
+    }
+#endif
+    return hits & ((1u << node.child_count) - 1);
+}
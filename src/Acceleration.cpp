@@ -0,0 +1,365 @@
+#include <chrono>
+#include <iostream>
+#include "../include/Acceleration.h"
+#include "../include/Instancing.h"
+
+bool parse_accelerator(const std::string &name, Accelerator *accelerator)
+{
+    if (name == "none")
+    {
+        *accelerator = Accelerator::None;
+    }
+    else if (name == "bvh")
+    {
+        *accelerator = Accelerator::Bvh;
+    }
+    else if (name == "bvh8")
+    {
+        *accelerator = Accelerator::WideBvh;
+    }
+    else if (name == "grid")
+    {
+        *accelerator = Accelerator::Grid;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char *accelerator_name(Accelerator accelerator)
+{
+    switch (accelerator)
+    {
+        case Accelerator::None: return "none";
+        case Accelerator::Bvh: return "bvh";
+        case Accelerator::WideBvh: return "bvh8";
+        case Accelerator::Grid: return "grid";
+    }
+    return "unknown";
+}
+
+bool parse_bvh_builder(const std::string &name, BvhBuilder *builder)
+{
+    if (name == "median")
+    {
+        *builder = BvhBuilder::Median;
+    }
+    else if (name == "sah")
+    {
+        *builder = BvhBuilder::BinnedSah;
+    }
+    else if (name == "lbvh")
+    {
+        *builder = BvhBuilder::Lbvh;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char *bvh_builder_name(BvhBuilder builder)
+{
+    switch (builder)
+    {
+        case BvhBuilder::Median: return "median";
+        case BvhBuilder::BinnedSah: return "sah";
+        case BvhBuilder::Lbvh: return "lbvh";
+    }
+    return "unknown";
+}
+
+uint64_t hash_scene_spheres(const Scene &scene, BvhBuilder builder)
+{
+    // a different builder or leaf size gives a different tree for the same spheres
+    uint64_t settings = (static_cast<uint64_t>(BVH_CACHE_VERSION) << 32) | (static_cast<uint64_t>(builder) << 16) |
+                        BVH_MAX_LEAF_SIZE;
+    return hash_bytes(scene.spheres.data(), scene.spheres.size() * sizeof(Sphere), settings);
+}
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void sphere_bounds_of(const Scene &scene, std::vector<Aabb> *bounds)
+{
+    bounds->resize(scene.spheres.size());
+    for (size_t sphere_index = 0; sphere_index < bounds->size(); ++sphere_index)
+    {
+        (*bounds)[sphere_index] = sphere_bounds(scene.spheres[sphere_index]);
+    }
+}
+
+static void build_sphere_bvh(Scene *scene, BvhBuilder builder, uint32_t thread_count)
+{
+    std::vector<Aabb> bounds;
+    sphere_bounds_of(*scene, &bounds);
+    build_bvh(builder, bounds.data(), static_cast<uint32_t>(bounds.size()), thread_count, &scene->sphere_bvh);
+}
+
+static void build_sphere_grid(Scene *scene, uint32_t thread_count)
+{
+    std::vector<Aabb> bounds;
+    sphere_bounds_of(*scene, &bounds);
+    build_grid(bounds.data(), static_cast<uint32_t>(bounds.size()), thread_count, &scene->sphere_grid);
+}
+
+void prepare_acceleration(const RenderConfig &config, Scene *scene, AccelerationReport *report)
+{
+    *report = {};
+    parse_accelerator(config.accelerator, &report->accelerator);
+    parse_bvh_builder(config.bvh_builder, &report->builder);
+    scene->sphere_bvh = {};
+    scene->sphere_wide_bvh = {};
+    scene->sphere_grid = {};
+    scene->instance_bvh = {};
+    for (auto &object : scene->objects)
+    {
+        object.bvh = {};
+    }
+    report->instance_count = scene->instances.size();
+    report->object_count = scene->objects.size();
+    for (const auto &object : scene->objects)
+    {
+        report->object_sphere_count += object.spheres.size();
+    }
+    report->instanced_sphere_count = instanced_sphere_count(*scene);
+
+    report->mesh_count = scene->meshes.size();
+    auto mesh_start = std::chrono::steady_clock::now();
+    for (auto &mesh : scene->meshes)
+    {
+        report->triangle_count += triangle_count(mesh.geometry);
+        if (report->accelerator == Accelerator::None)
+        {
+            build_mesh_blocks(&mesh.geometry);
+        }
+        else
+        {
+            build_mesh_bvh(report->builder, resolve_thread_count(config.thread_count), &mesh.geometry);
+        }
+    }
+    report->mesh_milliseconds = milliseconds_since(mesh_start);
+    report->sdf_count = scene->sdfs.size();
+    for (auto &sdf : scene->sdfs)
+    {
+        report->sdf_shape_count += sdf.surface.spheres.size() + sdf.surface.boxes.size();
+        finish_sdf_surface(&sdf.surface);
+    }
+    if (report->accelerator == Accelerator::None)
+    {
+        return;
+    }
+
+    if (!scene->instances.empty())
+    {
+        uint32_t thread_count = resolve_thread_count(config.thread_count);
+        auto bottom_start = std::chrono::steady_clock::now();
+        build_object_bvhs(scene, report->builder, thread_count);
+        report->object_milliseconds = milliseconds_since(bottom_start);
+        auto top_start = std::chrono::steady_clock::now();
+        build_instance_bvh(scene, report->builder, thread_count);
+        report->instance_milliseconds = milliseconds_since(top_start);
+    }
+
+    if (report->accelerator == Accelerator::Grid)
+    {
+        // quicker to build than to hash, so never cached
+        auto build_start = std::chrono::steady_clock::now();
+        build_sphere_grid(scene, resolve_thread_count(config.thread_count));
+        report->build_milliseconds = milliseconds_since(build_start);
+        report->node_count = scene->sphere_grid.cell_starts.empty() ? 0 : scene->sphere_grid.cell_starts.size() - 1;
+        report->index_bytes = (scene->sphere_grid.cell_starts.size() + scene->sphere_grid.primitive_indices.size()) *
+                              sizeof(uint32_t);
+        return;
+    }
+
+    const std::string &cache_file = config.bvh_cache_file;
+    uint64_t scene_hash = 0;
+    if (!cache_file.empty())
+    {
+        auto hash_start = std::chrono::steady_clock::now();
+        scene_hash = hash_scene_spheres(*scene, report->builder);
+        report->hash_milliseconds = milliseconds_since(hash_start);
+    }
+
+    auto build_start = std::chrono::steady_clock::now();
+    std::string error;
+    if (!cache_file.empty() &&
+        load_bvh_cache(cache_file, scene_hash, static_cast<uint32_t>(scene->spheres.size()), &scene->sphere_bvh, &error))
+    {
+        report->loaded_from_cache = true;
+    }
+    else
+    {
+        if (!cache_file.empty())
+        {
+            report->cache_message = "cache not used (" + error + ")";
+        }
+        build_sphere_bvh(scene, report->builder, resolve_thread_count(config.thread_count));
+    }
+    report->build_milliseconds = milliseconds_since(build_start);
+    report->node_count = scene->sphere_bvh.nodes.size();
+    report->index_bytes = scene->sphere_bvh.nodes.size() * sizeof(BvhNode) +
+                          scene->sphere_bvh.primitive_indices.size() * sizeof(uint32_t);
+    report->sah_cost = bvh_sah_cost(scene->sphere_bvh);
+
+    if (!cache_file.empty() && !report->loaded_from_cache)
+    {
+        if (write_bvh_cache(cache_file, scene_hash, scene->sphere_bvh, &error))
+        {
+            report->cache_message += ", wrote " + cache_file;
+        }
+        else
+        {
+            report->cache_message += ", " + error;
+        }
+    }
+
+    if (report->accelerator == Accelerator::WideBvh)
+    {
+        // the cache keeps the binary tree; collapsing it is cheap next to building it
+        auto collapse_start = std::chrono::steady_clock::now();
+        build_wide_bvh(scene->sphere_bvh, &scene->sphere_wide_bvh);
+        if (config.frame_count == 0)
+        {
+            // animations refit the binary tree and collapse it again every frame
+            scene->sphere_bvh = {};
+        }
+        report->collapse_milliseconds = milliseconds_since(collapse_start);
+        report->build_milliseconds += report->collapse_milliseconds;
+        report->node_count = scene->sphere_wide_bvh.nodes.size();
+        report->index_bytes = scene->sphere_wide_bvh.nodes.size() * sizeof(WideBvhNode) +
+                              scene->sphere_wide_bvh.primitive_indices.size() * sizeof(uint32_t);
+    }
+}
+
+void prepare_acceleration_updates(const Scene &scene, AccelerationUpdate *update)
+{
+    prepare_bvh_refit(scene.sphere_bvh, &update->spheres);
+    prepare_bvh_refit(scene.instance_bvh, &update->instances);
+}
+
+// refits bvh over update->bounds, or rebuilds it when that leaves it too costly
+static void refit_or_rebuild(const RenderConfig &config, BvhRefitState *state, std::vector<Aabb> &bounds, Bvh *bvh,
+                             AccelerationUpdateReport *report)
+{
+    if (bvh->nodes.empty())
+    {
+        return;
+    }
+    uint32_t thread_count = resolve_thread_count(config.thread_count);
+    float cost = refit_bvh(bounds.data(), thread_count, *state, bvh);
+    float cost_ratio = cost / std::max(state->built_sah_cost, FLT_MIN);
+    report->cost_ratio = std::max(report->cost_ratio, cost_ratio);
+    if (cost_ratio > config.rebuild_threshold)
+    {
+        BvhBuilder builder = BvhBuilder::BinnedSah;
+        parse_bvh_builder(config.bvh_builder, &builder);
+        build_bvh(builder, bounds.data(), static_cast<uint32_t>(bounds.size()), thread_count, bvh);
+        prepare_bvh_refit(*bvh, state);
+        report->rebuilt_count += 1;
+    }
+}
+
+void update_acceleration(const RenderConfig &config, Scene *scene, AccelerationUpdate *update,
+                         AccelerationUpdateReport *report)
+{
+    *report = {};
+    report->cost_ratio = 1.0f;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Aabb> &bounds = update->bounds;
+    if (!scene->sphere_grid.cell_starts.empty())
+    {
+        sphere_bounds_of(*scene, &bounds);
+        build_grid(bounds.data(), static_cast<uint32_t>(bounds.size()), resolve_thread_count(config.thread_count),
+                   &scene->sphere_grid);
+        report->rebuilt_count += 1;
+    }
+    if (!scene->sphere_bvh.nodes.empty())
+    {
+        sphere_bounds_of(*scene, &bounds);
+        refit_or_rebuild(config, &update->spheres, bounds, &scene->sphere_bvh, report);
+        if (!scene->sphere_wide_bvh.nodes.empty())
+        {
+            build_wide_bvh(scene->sphere_bvh, &scene->sphere_wide_bvh);
+        }
+    }
+
+    if (!scene->instance_bvh.nodes.empty())
+    {
+        instance_world_bounds(*scene, &bounds);
+        refit_or_rebuild(config, &update->instances, bounds, &scene->instance_bvh, report);
+    }
+    report->milliseconds = milliseconds_since(start);
+}
+
+static void print_surface_report(const AccelerationReport &report)
+{
+    if (report.mesh_count)
+    {
+        std::cout << "  " << report.mesh_count << " meshes, " << report.triangle_count << " triangles laid out in "
+                  << report.mesh_milliseconds << "ms\n";
+    }
+    if (report.sdf_count)
+    {
+        std::cout << "  " << report.sdf_count << " sdf surfaces of " << report.sdf_shape_count << " shapes\n";
+    }
+}
+
+void print_acceleration_report(const AccelerationReport &report)
+{
+    if (report.accelerator == Accelerator::None)
+    {
+        std::cout << "Acceleration: none\n";
+        if (report.instance_count)
+        {
+            std::cout << "  " << report.instance_count << " instances of " << report.object_count << " objects, "
+                      << report.instanced_sphere_count << " spheres\n";
+        }
+        print_surface_report(report);
+        return;
+    }
+
+    std::cout << "Acceleration: " << accelerator_name(report.accelerator);
+    if (report.accelerator == Accelerator::Grid)
+    {
+        std::cout << ", " << report.node_count << " cells built";
+    }
+    else
+    {
+        std::cout << " (" << bvh_builder_name(report.builder) << "), " << report.node_count << " nodes "
+                  << (report.loaded_from_cache ? "loaded from cache" : "built");
+    }
+    std::cout << " in " << report.build_milliseconds << "ms";
+    if (report.collapse_milliseconds > 0.0)
+    {
+        std::cout << " (" << report.collapse_milliseconds << "ms collapsing)";
+    }
+    if (report.hash_milliseconds > 0.0)
+    {
+        std::cout << " (+" << report.hash_milliseconds << "ms scene hash)";
+    }
+    std::cout << ", " << (static_cast<double>(report.index_bytes) / (1024.0 * 1024.0)) << " MB";
+    if (report.accelerator != Accelerator::Grid)
+    {
+        std::cout << ", SAH cost " << report.sah_cost;
+    }
+    std::cout << "\n";
+    if (!report.cache_message.empty())
+    {
+        std::cout << "  " << report.cache_message << "\n";
+    }
+    if (report.instance_count)
+    {
+        std::cout << "  " << report.instance_count << " instances of " << report.object_count << " objects: "
+                  << report.object_sphere_count << " unique spheres standing in for " << report.instanced_sphere_count
+                  << ", bottom levels built in " << report.object_milliseconds << "ms, top level in "
+                  << report.instance_milliseconds << "ms\n";
+    }
+    print_surface_report(report);
+}
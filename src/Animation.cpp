@@ -0,0 +1,133 @@
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include "../include/Acceleration.h"
+#include "../include/Animation.h"
+#include "../include/Bitmap.h"
+#include "../include/Instancing.h"
+
+// unit vector in the ground plane, the same for the same index and seed
+static Vector::Vector3 drift_direction(uint32_t index, uint64_t seed)
+{
+    uint64_t hash = hash_bytes(&index, sizeof(index), seed);
+    float angle = static_cast<float>(hash & 0xFFFF) * (6.2831853f / 65536.0f);
+    return Vector::Vector3 { std::cos(angle), std::sin(angle), 0.0f };
+}
+
+void capture_rest_pose(const Scene &scene, AnimationRestPose *rest)
+{
+    *rest = {};
+    for (uint32_t sphere_index = 0; sphere_index < scene.spheres.size(); ++sphere_index)
+    {
+        const Sphere &sphere = scene.spheres[sphere_index];
+        rest->sphere_positions.push_back(sphere.position);
+        rest->sphere_velocities.push_back((ANIMATION_STEP * sphere.radius) * drift_direction(sphere_index, 1));
+    }
+
+    std::vector<Aabb> bounds;
+    instance_world_bounds(scene, &bounds);
+    for (uint32_t instance_index = 0; instance_index < scene.instances.size(); ++instance_index)
+    {
+        const Transform &transform = scene.instances[instance_index].object_to_world;
+        Vector::Vector3 extent = bounds[instance_index].max - bounds[instance_index].min;
+        float size = 0.5f * std::max(extent.x, std::max(extent.y, extent.z));
+        rest->instance_translations.push_back(Vector::Vector3 { transform.m[0][3], transform.m[1][3], transform.m[2][3] });
+        rest->instance_velocities.push_back((ANIMATION_STEP * size) * drift_direction(instance_index, 2));
+    }
+}
+
+void animate_scene(const AnimationRestPose &rest, uint32_t frame, Scene *scene)
+{
+    auto time = static_cast<float>(frame);
+    Sphere *spheres = scene->spheres.mutable_data();
+    for (size_t sphere_index = 0; sphere_index < rest.sphere_positions.size(); ++sphere_index)
+    {
+        spheres[sphere_index].position = rest.sphere_positions[sphere_index] + time * rest.sphere_velocities[sphere_index];
+    }
+    for (size_t instance_index = 0; instance_index < rest.instance_translations.size(); ++instance_index)
+    {
+        Instance &instance = scene->instances[instance_index];
+        Vector::Vector3 translation = rest.instance_translations[instance_index] + time * rest.instance_velocities[instance_index];
+        instance.object_to_world.m[0][3] = translation.x;
+        instance.object_to_world.m[1][3] = translation.y;
+        instance.object_to_world.m[2][3] = translation.z;
+        invert_transform(instance.object_to_world, &instance.world_to_object);
+    }
+}
+
+// test.bmp becomes test_0000.bmp, test_0001.bmp, ...
+static std::string frame_file_name(const std::string &output_file, uint32_t frame)
+{
+    size_t dot = output_file.rfind('.');
+    size_t slash = output_file.rfind('/');
+    if ((dot == std::string::npos) || ((slash != std::string::npos) && (dot < slash)))
+    {
+        dot = output_file.size();
+    }
+    char number[16];
+    snprintf(number, sizeof(number), "_%04u", frame);
+    return output_file.substr(0, dot) + number + output_file.substr(dot);
+}
+
+int run_animation(const RenderConfig &config)
+{
+    Scene scene = {};
+    std::string error;
+    if (!build_scene(config, &scene, &error))
+    {
+        std::cerr << "error: " << error << "\n";
+        return 1;
+    }
+
+    AccelerationReport acceleration = {};
+    prepare_acceleration(config, &scene, &acceleration);
+    print_acceleration_report(acceleration);
+    AccelerationUpdate update = {};
+    prepare_acceleration_updates(scene, &update);
+    AnimationRestPose rest;
+    capture_rest_pose(scene, &rest);
+    double full_build_milliseconds = acceleration.build_milliseconds + acceleration.object_milliseconds +
+                                     acceleration.instance_milliseconds;
+
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+    std::cout << "Animation: " << config.frame_count << " frames, " << config.image_width << "x" << config.image_height
+              << ", " << config.rays_per_pixel << " rays/pixel, rebuild past " << config.rebuild_threshold
+              << "x the built SAH cost\n\n";
+    std::cout << std::setw(7) << "frame" << std::setw(12) << "update ms" << std::setw(9) << "rebuilt"
+              << std::setw(12) << "cost ratio" << std::setw(12) << "render ms" << "\n";
+
+    double update_milliseconds = 0.0;
+    uint32_t rebuild_count = 0;
+    for (uint32_t frame = 0; frame < config.frame_count; ++frame)
+    {
+        AccelerationUpdateReport report = {};
+        report.cost_ratio = 1.0f;
+        if (frame > 0)
+        {
+            animate_scene(rest, frame, &scene);
+            update_acceleration(config, &scene, &update, &report);
+            update_milliseconds += report.milliseconds;
+            rebuild_count += report.rebuilt_count;
+        }
+
+        RenderResult result = {};
+        render_scene(&scene, config, *image_data, false, &result);
+        bitmap.write_image(frame_file_name(config.output_file, frame));
+        std::cout << std::fixed << std::setw(7) << frame
+                  << std::setw(12) << std::setprecision(2) << report.milliseconds
+                  << std::setw(9) << report.rebuilt_count
+                  << std::setw(12) << std::setprecision(3) << report.cost_ratio
+                  << std::setw(12) << std::setprecision(1) << result.elapsed_milliseconds << "\n";
+    }
+
+    if (config.frame_count > 1)
+    {
+        uint32_t update_count = config.frame_count - 1;
+        std::cout << "\n" << std::setprecision(2) << "updates averaged " << (update_milliseconds / update_count)
+                  << "ms with " << rebuild_count << " rebuilds, against " << full_build_milliseconds
+                  << "ms for the first frame's full build\n";
+    }
+    return 0;
+}
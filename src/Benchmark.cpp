@@ -0,0 +1,1188 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/Acceleration.h"
+#include "../include/Benchmark.h"
+#include "../include/Bitmap.h"
+#include "../include/Instancing.h"
+#include "../include/Parallel.h"
+#include "../include/RayTracer.h"
+#include "../include/SceneGenerator.h"
+#include "../include/TraceBatch.h"
+
+constexpr uint32_t DEFAULT_SWEEP_TILES[] = { 16, 32, 64, 128 };
+// pass --scene-counts to go up to 10^7
+constexpr uint32_t DEFAULT_SCENE_COUNTS[] = { 10, 100, 1000, 10000 };
+constexpr BvhBuilder BVH_BUILDERS[] = { BvhBuilder::Median, BvhBuilder::BinnedSah, BvhBuilder::Lbvh };
+
+struct SweepPoint
+{
+    uint32_t thread_count;
+    uint32_t tile_size;
+    uint32_t rays_per_pixel;
+    double milliseconds;
+    uint64_t bounces_computed;
+    double rays_per_second;
+    // speedup over the smallest thread count divided by the thread ratio
+    double parallel_efficiency;
+};
+
+// renders config.benchmark_repeats times and keeps the fastest run, which is the
+// least disturbed by whatever else the machine was doing
+static void render_best_of(Scene *scene, const RenderConfig &config, ImageData image_data, RenderResult *best)
+{
+    for (uint32_t repeat = 0; repeat < config.benchmark_repeats; ++repeat)
+    {
+        RenderResult result = {};
+        render_scene(scene, config, image_data, false, &result);
+        if ((repeat == 0) || (result.elapsed_milliseconds < best->elapsed_milliseconds))
+        {
+            best->elapsed_milliseconds = result.elapsed_milliseconds;
+            best->bounces_computed = result.bounces_computed;
+            best->thread_count = result.thread_count;
+            best->total_tiles = result.total_tiles;
+            best->workers = result.workers;
+        }
+    }
+}
+
+static double rays_per_second(const RenderResult &result)
+{
+    return static_cast<double>(result.bounces_computed) / (std::max(result.elapsed_milliseconds, 0.001) / 1000.0);
+}
+
+// powers of two up to the hardware thread count, plus the thread count itself
+static std::vector<uint32_t> default_thread_counts()
+{
+    uint32_t hardware_threads = resolve_thread_count(DEFAULT_THREAD_COUNT);
+    std::vector<uint32_t> thread_counts;
+    for (uint32_t thread_count = 1; thread_count < hardware_threads; thread_count *= 2)
+    {
+        thread_counts.push_back(thread_count);
+    }
+    thread_counts.push_back(hardware_threads);
+    return thread_counts;
+}
+
+static std::vector<uint32_t> sorted_unique(std::vector<uint32_t> values)
+{
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+}
+
+int run_parameter_sweep(const RenderConfig &config)
+{
+    std::vector<uint32_t> thread_counts = config.sweep_threads.empty() ? default_thread_counts() : config.sweep_threads;
+    for (auto &thread_count : thread_counts)
+    {
+        thread_count = resolve_thread_count(thread_count);
+    }
+    thread_counts = sorted_unique(thread_counts);
+
+    std::vector<uint32_t> tile_sizes = config.sweep_tiles.empty()
+        ? std::vector<uint32_t>(std::begin(DEFAULT_SWEEP_TILES), std::end(DEFAULT_SWEEP_TILES))
+        : sorted_unique(config.sweep_tiles);
+    std::vector<uint32_t> rays_per_pixel = config.sweep_rays_per_pixel.empty()
+        ? std::vector<uint32_t> { config.rays_per_pixel }
+        : sorted_unique(config.sweep_rays_per_pixel);
+
+    Scene scene = {};
+    std::string error;
+    if (!build_scene(config, &scene, &error))
+    {
+        std::cerr << "error: " << error << "\n";
+        return 1;
+    }
+    AccelerationReport acceleration = {};
+    prepare_acceleration(config, &scene, &acceleration);
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+
+    std::cout << "Sweep: " << config.image_width << "x" << config.image_height << ", "
+              << config.max_bounce_count << " bounces (max), best of " << config.benchmark_repeats << "\n";
+
+    std::vector<SweepPoint> points;
+    for (uint32_t spp : rays_per_pixel)
+    {
+        for (uint32_t tile_size : tile_sizes)
+        {
+            double baseline_rays_per_second = 0.0;
+            for (uint32_t thread_count : thread_counts)
+            {
+                RenderConfig point_config = config;
+                point_config.thread_count = thread_count;
+                point_config.tile_width = tile_size;
+                point_config.tile_height = tile_size;
+                point_config.rays_per_pixel = spp;
+                point_config.perf_counters = false;
+                point_config.perf_kernels = false;
+
+                RenderResult result = {};
+                render_best_of(&scene, point_config, *image_data, &result);
+
+                SweepPoint point = {};
+                point.thread_count = thread_count;
+                point.tile_size = tile_size;
+                point.rays_per_pixel = spp;
+                point.milliseconds = result.elapsed_milliseconds;
+                point.bounces_computed = result.bounces_computed;
+                point.rays_per_second = rays_per_second(result);
+                if (thread_count == thread_counts.front())
+                {
+                    baseline_rays_per_second = point.rays_per_second / thread_count;
+                }
+                point.parallel_efficiency = point.rays_per_second / (baseline_rays_per_second * thread_count);
+                points.push_back(point);
+
+                std::cout << "\r  spp " << spp << ", tile " << tile_size << ", " << thread_count << " threads: "
+                          << std::fixed << std::setprecision(1) << point.milliseconds << "ms          ";
+                fflush(stdout);
+            }
+        }
+    }
+    std::cout << "\n";
+
+    // one table per spp: rows are tile sizes, columns thread counts
+    for (uint32_t spp : rays_per_pixel)
+    {
+        std::cout << "\n" << spp << " rays/pixel -- Mrays/s (parallel efficiency)\n";
+        std::cout << std::setw(8) << "tile";
+        for (uint32_t thread_count : thread_counts)
+        {
+            std::cout << std::setw(18) << (std::to_string(thread_count) + " threads");
+        }
+        std::cout << "\n";
+
+        const SweepPoint *best = nullptr;
+        for (uint32_t tile_size : tile_sizes)
+        {
+            std::cout << std::setw(8) << (std::to_string(tile_size) + "x" + std::to_string(tile_size));
+            for (const auto &point : points)
+            {
+                if ((point.rays_per_pixel != spp) || (point.tile_size != tile_size))
+                {
+                    continue;
+                }
+                std::cout << std::fixed << std::setprecision(2) << std::setw(10) << (point.rays_per_second / 1.0e6)
+                          << " (" << std::setprecision(0) << std::setw(3) << (100.0 * point.parallel_efficiency) << "%)";
+                if (!best || (point.rays_per_second > best->rays_per_second))
+                {
+                    best = &point;
+                }
+            }
+            std::cout << "\n";
+        }
+
+        if (best)
+        {
+            std::cout << "best: --threads " << best->thread_count << " --tile " << best->tile_size
+                      << " (" << std::setprecision(2) << (best->rays_per_second / 1.0e6) << " Mrays/s)\n";
+        }
+    }
+
+    if (!config.csv_file.empty())
+    {
+        std::ofstream csv(config.csv_file, std::ios::out | std::ios::trunc);
+        if (!csv.is_open())
+        {
+            std::cerr << "error: cannot write " << config.csv_file << "\n";
+            return 1;
+        }
+        csv << "threads,tile,spp,milliseconds,bounces,rays_per_second,parallel_efficiency\n";
+        for (const auto &point : points)
+        {
+            csv << point.thread_count << "," << point.tile_size << "," << point.rays_per_pixel << ","
+                << std::fixed << std::setprecision(3) << point.milliseconds << "," << point.bounces_computed << ","
+                << std::setprecision(0) << point.rays_per_second << ","
+                << std::setprecision(4) << point.parallel_efficiency << "\n";
+        }
+        std::cout << "\nwrote " << config.csv_file << "\n";
+    }
+
+    return 0;
+}
+
+// a step that adds less than half a thread's worth of speedup per added thread is flattening
+constexpr double FLATTENING_MARGINAL_SPEEDUP = 0.5;
+// workers idle for more than this share of the render point at load imbalance
+constexpr double IDLE_WARNING_FRACTION = 0.10;
+// queue time per tile growing this much over the smallest thread count points at the TileQueue counters
+constexpr double QUEUE_CONTENTION_FACTOR = 4.0;
+// throughput drop against the baseline that counts as a regression
+constexpr double BASELINE_TOLERANCE = 0.05;
+
+struct ScalingPoint
+{
+    uint32_t thread_count;
+    double milliseconds;
+    double rays_per_second;
+    double speedup;
+    double efficiency;
+    double mean_idle_fraction;
+    double max_idle_fraction;
+    double queue_microseconds_per_tile;
+};
+
+static void measure_idle(const RenderResult &result, ScalingPoint *point)
+{
+    double total_idle = 0.0;
+    double total_queue = 0.0;
+    uint32_t total_tiles = 0;
+    for (const auto &worker : result.workers)
+    {
+        double idle = 1.0 - (worker.busy_milliseconds + worker.queue_milliseconds) / result.elapsed_milliseconds;
+        idle = std::max(idle, 0.0);
+        total_idle += idle;
+        point->max_idle_fraction = std::max(point->max_idle_fraction, idle);
+        total_queue += worker.queue_milliseconds;
+        total_tiles += worker.tiles_rendered;
+    }
+
+    point->mean_idle_fraction = total_idle / std::max<size_t>(result.workers.size(), 1);
+    point->queue_microseconds_per_tile = 1000.0 * total_queue / std::max(total_tiles, 1u);
+}
+
+static std::string diagnose(const ScalingPoint &point, const ScalingPoint &previous, const ScalingPoint &first,
+                            uint32_t hardware_threads)
+{
+    if (point.thread_count > hardware_threads)
+    {
+        return "oversubscribed";
+    }
+
+    double marginal_speedup = (point.speedup - previous.speedup) /
+                              static_cast<double>(point.thread_count - previous.thread_count);
+    if (marginal_speedup >= FLATTENING_MARGINAL_SPEEDUP)
+    {
+        return "";
+    }
+    if (point.mean_idle_fraction > IDLE_WARNING_FRACTION)
+    {
+        return "flattening: workers idle (too few tiles or tail imbalance)";
+    }
+    if ((point.queue_microseconds_per_tile > QUEUE_CONTENTION_FACTOR * first.queue_microseconds_per_tile) &&
+        (point.queue_microseconds_per_tile > 1.0))
+    {
+        return "flattening: TileQueue counter contention";
+    }
+    return "flattening: shared resource (memory bandwidth, SMT or clock limits)";
+}
+
+static void write_scaling_json(std::ostream &json, const RenderConfig &config, const std::vector<ScalingPoint> &points)
+{
+    json << "{\n"
+         << "  \"benchmark\": \"thread_scaling\",\n"
+         << "  \"width\": " << config.image_width << ",\n"
+         << "  \"height\": " << config.image_height << ",\n"
+         << "  \"spp\": " << config.rays_per_pixel << ",\n"
+         << "  \"bounces\": " << config.max_bounce_count << ",\n"
+         << "  \"tile_width\": " << config.tile_width << ",\n"
+         << "  \"tile_height\": " << config.tile_height << ",\n"
+         << "  \"points\": [\n";
+    for (size_t point_index = 0; point_index < points.size(); ++point_index)
+    {
+        const ScalingPoint &point = points[point_index];
+        json << std::fixed
+             << "    { \"threads\": " << point.thread_count
+             << ", \"milliseconds\": " << std::setprecision(3) << point.milliseconds
+             << ", \"rays_per_second\": " << std::setprecision(0) << point.rays_per_second
+             << ", \"speedup\": " << std::setprecision(4) << point.speedup
+             << ", \"efficiency\": " << point.efficiency
+             << ", \"mean_idle\": " << point.mean_idle_fraction
+             << ", \"max_idle\": " << point.max_idle_fraction
+             << ", \"queue_us_per_tile\": " << std::setprecision(3) << point.queue_microseconds_per_tile
+             << " }" << ((point_index + 1 < points.size()) ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+}
+
+// finds "key": number inside text; only needs to read what write_scaling_json writes
+static bool find_json_number(const std::string &text, const std::string &key, double *value)
+{
+    size_t key_position = text.find("\"" + key + "\"");
+    if (key_position == std::string::npos)
+    {
+        return false;
+    }
+    size_t colon = text.find(':', key_position);
+    if (colon == std::string::npos)
+    {
+        return false;
+    }
+
+    const char *start = text.c_str() + colon + 1;
+    char *end = nullptr;
+    *value = std::strtod(start, &end);
+    return end != start;
+}
+
+static bool read_scaling_baseline(const std::string &file_name, std::vector<ScalingPoint> *points, std::string *header)
+{
+    std::ifstream file(file_name);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t points_start = text.find("\"points\"");
+    if (points_start == std::string::npos)
+    {
+        return false;
+    }
+    *header = text.substr(0, points_start);
+
+    size_t object_start = text.find('{', points_start);
+    while (object_start != std::string::npos)
+    {
+        size_t object_end = text.find('}', object_start);
+        if (object_end == std::string::npos)
+        {
+            break;
+        }
+        std::string object = text.substr(object_start, object_end - object_start);
+
+        double threads = 0.0;
+        ScalingPoint point = {};
+        if (find_json_number(object, "threads", &threads) &&
+            find_json_number(object, "rays_per_second", &point.rays_per_second))
+        {
+            point.thread_count = static_cast<uint32_t>(threads);
+            find_json_number(object, "milliseconds", &point.milliseconds);
+            find_json_number(object, "speedup", &point.speedup);
+            find_json_number(object, "efficiency", &point.efficiency);
+            points->push_back(point);
+        }
+        object_start = text.find('{', object_end);
+    }
+
+    return !points->empty();
+}
+
+static bool baseline_setting_matches(const std::string &header, const std::string &key, uint32_t expected)
+{
+    double value = 0.0;
+    return !find_json_number(header, key, &value) || (static_cast<uint32_t>(value) == expected);
+}
+
+int run_thread_scaling(const RenderConfig &config)
+{
+    uint32_t hardware_threads = resolve_thread_count(DEFAULT_THREAD_COUNT);
+    std::vector<uint32_t> thread_counts;
+    if (config.sweep_threads.empty())
+    {
+        for (uint32_t thread_count = 1; thread_count <= hardware_threads; ++thread_count)
+        {
+            thread_counts.push_back(thread_count);
+        }
+    }
+    else
+    {
+        for (uint32_t thread_count : config.sweep_threads)
+        {
+            thread_counts.push_back(resolve_thread_count(thread_count));
+        }
+        thread_counts = sorted_unique(thread_counts);
+    }
+
+    Scene scene = {};
+    std::string error;
+    if (!build_scene(config, &scene, &error))
+    {
+        std::cerr << "error: " << error << "\n";
+        return 1;
+    }
+    AccelerationReport acceleration = {};
+    prepare_acceleration(config, &scene, &acceleration);
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+
+    std::cout << "Thread scaling: " << config.image_width << "x" << config.image_height << ", "
+              << config.rays_per_pixel << " rays/pixel, " << config.tile_width << "x" << config.tile_height
+              << " tiles, " << hardware_threads << " hardware threads, best of " << config.benchmark_repeats << "\n";
+
+    std::vector<ScalingPoint> points;
+    for (uint32_t thread_count : thread_counts)
+    {
+        RenderConfig point_config = config;
+        point_config.thread_count = thread_count;
+        point_config.perf_counters = false;
+        point_config.perf_kernels = false;
+
+        RenderResult result = {};
+        render_best_of(&scene, point_config, *image_data, &result);
+
+        ScalingPoint point = {};
+        point.thread_count = thread_count;
+        point.milliseconds = result.elapsed_milliseconds;
+        point.rays_per_second = rays_per_second(result);
+        // relative to the smallest thread count, scaled as if it had been a single thread
+        double single_thread_rays_per_second = points.empty()
+            ? (point.rays_per_second / thread_count)
+            : (points.front().rays_per_second / points.front().thread_count);
+        point.speedup = point.rays_per_second / single_thread_rays_per_second;
+        point.efficiency = point.speedup / thread_count;
+        measure_idle(result, &point);
+        points.push_back(point);
+
+        std::cout << "\r  " << thread_count << " threads: " << std::fixed << std::setprecision(1)
+                  << point.milliseconds << "ms          ";
+        fflush(stdout);
+    }
+    std::cout << "\n\n";
+
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(10) << "Mrays/s"
+              << std::setw(9) << "speedup" << std::setw(11) << "efficiency" << std::setw(10) << "idle avg"
+              << std::setw(10) << "idle max" << std::setw(12) << "queue us/t" << "\n";
+    for (size_t point_index = 0; point_index < points.size(); ++point_index)
+    {
+        const ScalingPoint &point = points[point_index];
+        std::cout << std::fixed
+                  << std::setw(8) << point.thread_count
+                  << std::setw(12) << std::setprecision(1) << point.milliseconds
+                  << std::setw(10) << std::setprecision(2) << (point.rays_per_second / 1.0e6)
+                  << std::setw(9) << point.speedup
+                  << std::setw(10) << std::setprecision(1) << (100.0 * point.efficiency) << "%"
+                  << std::setw(9) << (100.0 * point.mean_idle_fraction) << "%"
+                  << std::setw(9) << (100.0 * point.max_idle_fraction) << "%"
+                  << std::setw(12) << std::setprecision(2) << point.queue_microseconds_per_tile;
+        if (point_index > 0)
+        {
+            std::string diagnosis = diagnose(point, points[point_index - 1], points.front(), hardware_threads);
+            if (!diagnosis.empty())
+            {
+                std::cout << "  <- " << diagnosis;
+            }
+        }
+        std::cout << "\n";
+    }
+
+    if (!config.json_file.empty())
+    {
+        std::ofstream json(config.json_file, std::ios::out | std::ios::trunc);
+        if (!json.is_open())
+        {
+            std::cerr << "error: cannot write " << config.json_file << "\n";
+            return 1;
+        }
+        write_scaling_json(json, config, points);
+        std::cout << "\nwrote " << config.json_file << "\n";
+    }
+
+    if (!config.csv_file.empty())
+    {
+        std::ofstream csv(config.csv_file, std::ios::out | std::ios::trunc);
+        if (!csv.is_open())
+        {
+            std::cerr << "error: cannot write " << config.csv_file << "\n";
+            return 1;
+        }
+        csv << "threads,milliseconds,rays_per_second,speedup,efficiency,mean_idle,max_idle,queue_us_per_tile\n";
+        for (const auto &point : points)
+        {
+            csv << point.thread_count << "," << std::fixed << std::setprecision(3) << point.milliseconds << ","
+                << std::setprecision(0) << point.rays_per_second << "," << std::setprecision(4) << point.speedup << ","
+                << point.efficiency << "," << point.mean_idle_fraction << "," << point.max_idle_fraction << ","
+                << std::setprecision(3) << point.queue_microseconds_per_tile << "\n";
+        }
+        std::cout << "wrote " << config.csv_file << "\n";
+    }
+
+    if (config.baseline_file.empty())
+    {
+        return 0;
+    }
+
+    std::vector<ScalingPoint> baseline;
+    std::string baseline_header;
+    if (!read_scaling_baseline(config.baseline_file, &baseline, &baseline_header))
+    {
+        std::cerr << "error: cannot read baseline " << config.baseline_file << "\n";
+        return 1;
+    }
+    if (!baseline_setting_matches(baseline_header, "width", config.image_width) ||
+        !baseline_setting_matches(baseline_header, "height", config.image_height) ||
+        !baseline_setting_matches(baseline_header, "spp", config.rays_per_pixel) ||
+        !baseline_setting_matches(baseline_header, "bounces", config.max_bounce_count))
+    {
+        std::cout << "\nwarning: baseline was recorded with different image or quality settings\n";
+    }
+
+    std::cout << "\nAgainst baseline " << config.baseline_file << ":\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "base Mrays/s" << std::setw(10) << "Mrays/s"
+              << std::setw(10) << "change" << std::setw(14) << "base effic." << std::setw(10) << "effic." << "\n";
+    bool regressed = false;
+    for (const auto &point : points)
+    {
+        auto match = std::find_if(baseline.begin(), baseline.end(), [&point](const ScalingPoint &base)
+        {
+            return base.thread_count == point.thread_count;
+        });
+        if (match == baseline.end())
+        {
+            continue;
+        }
+
+        double change = point.rays_per_second / match->rays_per_second - 1.0;
+        std::cout << std::fixed
+                  << std::setw(8) << point.thread_count
+                  << std::setw(14) << std::setprecision(2) << (match->rays_per_second / 1.0e6)
+                  << std::setw(10) << (point.rays_per_second / 1.0e6)
+                  << std::setw(9) << std::setprecision(1) << (100.0 * change) << "%"
+                  << std::setw(13) << (100.0 * match->efficiency) << "%"
+                  << std::setw(9) << (100.0 * point.efficiency) << "%";
+        if (change < -BASELINE_TOLERANCE)
+        {
+            std::cout << "  <- regression";
+            regressed = true;
+        }
+        std::cout << "\n";
+    }
+
+    return regressed ? 1 : 0;
+}
+
+struct SceneScalingPoint
+{
+    SceneLayout layout;
+    uint32_t sphere_count;
+    double generate_milliseconds;
+    double index_milliseconds;
+    // the primitives and every index built over them
+    uint64_t scene_bytes;
+    // of the child process that measured this point alone
+    uint64_t peak_resident_bytes;
+    double render_milliseconds;
+    double rays_per_second;
+};
+
+static uint64_t object_memory_bytes(const Scene &scene)
+{
+    uint64_t bytes = scene.objects.capacity() * sizeof(SceneObject);
+    for (const auto &object : scene.objects)
+    {
+        bytes += object.spheres.capacity() * sizeof(Sphere) + object.bvh.nodes.capacity() * sizeof(BvhNode) +
+                 object.bvh.primitive_indices.capacity() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+static uint64_t mesh_memory_bytes(const Scene &scene)
+{
+    uint64_t bytes = scene.meshes.capacity() * sizeof(Mesh);
+    for (const auto &mesh : scene.meshes)
+    {
+        const TriangleMesh &geometry = mesh.geometry;
+        bytes += geometry.vertices.capacity() * sizeof(Vector::Vector3) + geometry.indices.capacity() * sizeof(uint32_t) +
+                 geometry.bvh.nodes.capacity() * sizeof(BvhNode) + geometry.bvh.primitive_indices.capacity() * sizeof(uint32_t) +
+                 geometry.blocks.capacity() * sizeof(TriangleBlock);
+    }
+    return bytes;
+}
+
+static uint64_t scene_memory_bytes(const Scene &scene)
+{
+    return scene.spheres.capacity() * sizeof(Sphere) + scene.planes.capacity() * sizeof(Plane) +
+           scene.sphere_bvh.nodes.capacity() * sizeof(BvhNode) +
+           scene.sphere_bvh.primitive_indices.capacity() * sizeof(uint32_t) +
+           scene.sphere_wide_bvh.nodes.capacity() * sizeof(WideBvhNode) +
+           scene.sphere_wide_bvh.primitive_indices.capacity() * sizeof(uint32_t) +
+           (scene.sphere_grid.cell_starts.capacity() + scene.sphere_grid.primitive_indices.capacity()) * sizeof(uint32_t) +
+           object_memory_bytes(scene) +
+           scene.instances.capacity() * sizeof(Instance) + scene.instance_bvh.nodes.capacity() * sizeof(BvhNode) +
+           scene.instance_bvh.primitive_indices.capacity() * sizeof(uint32_t) + mesh_memory_bytes(scene);
+}
+
+static uint64_t peak_resident_bytes()
+{
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    // kilobytes on linux
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+// --generate's layout, or all of them
+static std::vector<SceneLayout> benchmark_layouts(const RenderConfig &config)
+{
+    SceneLayout requested_layout;
+    if (!config.scene_layout.empty() && parse_scene_layout(config.scene_layout, &requested_layout))
+    {
+        return { requested_layout };
+    }
+    return { SceneLayout::Random, SceneLayout::Clustered, SceneLayout::Grid, SceneLayout::Instanced };
+}
+
+static std::vector<uint32_t> benchmark_scene_counts(const RenderConfig &config)
+{
+    return config.scene_counts.empty()
+        ? std::vector<uint32_t>(std::begin(DEFAULT_SCENE_COUNTS), std::end(DEFAULT_SCENE_COUNTS))
+        : sorted_unique(config.scene_counts);
+}
+
+// generates, indexes and renders point's layout and sphere count, filling in the rest of point
+static void measure_scene_point(const RenderConfig &config, const RenderConfig &render_config,
+                                const ImageData &image_data, SceneScalingPoint *point)
+{
+    Scene scene = {};
+    auto generate_start = std::chrono::steady_clock::now();
+    generate_sphere_field(&scene, point->layout, point->sphere_count, config.seed);
+    auto generate_end = std::chrono::steady_clock::now();
+    point->generate_milliseconds = std::chrono::duration<double, std::milli>(generate_end - generate_start).count();
+
+    AccelerationReport acceleration = {};
+    prepare_acceleration(config, &scene, &acceleration);
+    point->index_milliseconds = acceleration.build_milliseconds + acceleration.object_milliseconds +
+                                acceleration.instance_milliseconds;
+    // once the indexes are built, so their memory counts too
+    point->scene_bytes = scene_memory_bytes(scene);
+
+    RenderResult result = {};
+    render_best_of(&scene, render_config, image_data, &result);
+    point->render_milliseconds = result.elapsed_milliseconds;
+    point->rays_per_second = rays_per_second(result);
+    point->peak_resident_bytes = peak_resident_bytes();
+}
+
+// measure_scene_point in a forked child: the peak resident size getrusage reports is the
+// process's high water mark, which in this process would stay at the largest scene so far
+static bool measure_scene_point_in_child(const RenderConfig &config, const RenderConfig &render_config,
+                                         const ImageData &image_data, SceneScalingPoint *point)
+{
+    int result_pipe[2];
+    if (pipe(result_pipe) != 0)
+    {
+        return false;
+    }
+    pid_t child = fork();
+    if (child < 0)
+    {
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        return false;
+    }
+    if (child == 0)
+    {
+        close(result_pipe[0]);
+        measure_scene_point(config, render_config, image_data, point);
+        bool sent = (write(result_pipe[1], point, sizeof(*point)) == static_cast<ssize_t>(sizeof(*point)));
+        _exit(sent ? 0 : 1);
+    }
+
+    close(result_pipe[1]);
+    SceneScalingPoint measured = {};
+    size_t received = 0;
+    while (received < sizeof(measured))
+    {
+        ssize_t count = read(result_pipe[0], reinterpret_cast<char *>(&measured) + received, sizeof(measured) - received);
+        if ((count < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        received += static_cast<size_t>(count);
+    }
+    close(result_pipe[0]);
+    int status = 0;
+    if ((waitpid(child, &status, 0) != child) || (received != sizeof(measured)) || !WIFEXITED(status) ||
+        (WEXITSTATUS(status) != 0))
+    {
+        errno = ECHILD;
+        return false;
+    }
+    *point = measured;
+    return true;
+}
+
+int run_scene_scaling(const RenderConfig &config)
+{
+    std::vector<SceneLayout> layouts = benchmark_layouts(config);
+    std::vector<uint32_t> sphere_counts = benchmark_scene_counts(config);
+
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+
+    RenderConfig render_config = config;
+    render_config.perf_counters = false;
+    render_config.perf_kernels = false;
+
+    std::cout << "Scene scaling: " << config.image_width << "x" << config.image_height << ", "
+              << config.rays_per_pixel << " rays/pixel, " << resolve_thread_count(config.thread_count)
+              << " threads, seed " << config.seed << ", best of " << config.benchmark_repeats << "\n";
+
+    std::vector<SceneScalingPoint> points;
+    for (SceneLayout layout : layouts)
+    {
+        for (uint32_t sphere_count : sphere_counts)
+        {
+            std::cout << "\r  " << scene_layout_name(layout) << ", " << sphere_count << " spheres...          ";
+            fflush(stdout);
+
+            SceneScalingPoint point = {};
+            point.layout = layout;
+            point.sphere_count = sphere_count;
+
+            if (!measure_scene_point_in_child(config, render_config, *image_data, &point))
+            {
+                std::cerr << "\nerror: measuring " << sphere_count << " spheres failed: " << strerror(errno) << "\n";
+                return 1;
+            }
+            points.push_back(point);
+        }
+    }
+    std::cout << "\n\n";
+
+    std::cout << std::setw(10) << "layout" << std::setw(10) << "spheres" << std::setw(13) << "generate ms"
+              << std::setw(10) << "index ms"
+              << std::setw(11) << "scene MB" << std::setw(14) << "peak RSS MB" << std::setw(12) << "render ms"
+              << std::setw(10) << "Mrays/s" << "\n";
+    for (const auto &point : points)
+    {
+        std::cout << std::fixed
+                  << std::setw(10) << scene_layout_name(point.layout)
+                  << std::setw(10) << point.sphere_count
+                  << std::setw(13) << std::setprecision(2) << point.generate_milliseconds
+                  << std::setw(10) << point.index_milliseconds
+                  << std::setw(11) << (static_cast<double>(point.scene_bytes) / (1024.0 * 1024.0))
+                  << std::setw(14) << (static_cast<double>(point.peak_resident_bytes) / (1024.0 * 1024.0))
+                  << std::setw(12) << std::setprecision(1) << point.render_milliseconds
+                  << std::setw(10) << std::setprecision(4) << (point.rays_per_second / 1.0e6) << "\n";
+    }
+
+    if (!config.csv_file.empty())
+    {
+        std::ofstream csv(config.csv_file, std::ios::out | std::ios::trunc);
+        if (!csv.is_open())
+        {
+            std::cerr << "error: cannot write " << config.csv_file << "\n";
+            return 1;
+        }
+        csv << "layout,spheres,generate_milliseconds,index_milliseconds,scene_bytes,peak_resident_bytes,render_milliseconds,rays_per_second\n";
+        for (const auto &point : points)
+        {
+            csv << scene_layout_name(point.layout) << "," << point.sphere_count << ","
+                << std::fixed << std::setprecision(3) << point.generate_milliseconds << ","
+                << point.index_milliseconds << ","
+                << point.scene_bytes << "," << point.peak_resident_bytes << ","
+                << point.render_milliseconds << "," << std::setprecision(0) << point.rays_per_second << "\n";
+        }
+        std::cout << "\nwrote " << config.csv_file << "\n";
+    }
+
+    return 0;
+}
+
+struct BuilderPoint
+{
+    BvhBuilder builder;
+    double build_milliseconds;
+    uint64_t node_count;
+    float sah_cost;
+    double render_milliseconds;
+    double rays_per_second;
+};
+
+int run_bvh_builders(const RenderConfig &config)
+{
+    Scene scene = {};
+    std::string error;
+    if (!build_scene(config, &scene, &error))
+    {
+        std::cerr << "error: " << error << "\n";
+        return 1;
+    }
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+
+    std::cout << "BVH builders: " << scene.spheres.size() << " spheres, " << config.image_width << "x"
+              << config.image_height << ", " << config.rays_per_pixel << " rays/pixel, "
+              << resolve_thread_count(config.thread_count) << " threads, best of " << config.benchmark_repeats << "\n";
+
+    std::vector<BuilderPoint> points;
+    for (BvhBuilder builder : BVH_BUILDERS)
+    {
+        RenderConfig builder_config = config;
+        // --accel bvh8 compares the builders through the wide tree
+        if (builder_config.accelerator != accelerator_name(Accelerator::WideBvh))
+        {
+            builder_config.accelerator = accelerator_name(Accelerator::Bvh);
+        }
+        builder_config.bvh_builder = bvh_builder_name(builder);
+        builder_config.bvh_cache_file.clear();
+        builder_config.perf_counters = false;
+        builder_config.perf_kernels = false;
+
+        BuilderPoint point = {};
+        point.builder = builder;
+        for (uint32_t repeat = 0; repeat < config.benchmark_repeats; ++repeat)
+        {
+            AccelerationReport acceleration = {};
+            prepare_acceleration(builder_config, &scene, &acceleration);
+            if ((repeat == 0) || (acceleration.build_milliseconds < point.build_milliseconds))
+            {
+                point.build_milliseconds = acceleration.build_milliseconds;
+            }
+            point.node_count = acceleration.node_count;
+            point.sah_cost = acceleration.sah_cost;
+        }
+
+        RenderResult result = {};
+        render_best_of(&scene, builder_config, *image_data, &result);
+        point.render_milliseconds = result.elapsed_milliseconds;
+        point.rays_per_second = rays_per_second(result);
+        points.push_back(point);
+    }
+
+    // build plus render is what a job that renders this scene once actually waits for
+    std::cout << "\n" << std::setw(8) << "builder" << std::setw(12) << "build ms" << std::setw(10) << "nodes"
+              << std::setw(11) << "SAH cost" << std::setw(12) << "render ms" << std::setw(10) << "Mrays/s"
+              << std::setw(11) << "total ms" << "\n";
+    for (const auto &point : points)
+    {
+        std::cout << std::fixed
+                  << std::setw(8) << bvh_builder_name(point.builder)
+                  << std::setw(12) << std::setprecision(2) << point.build_milliseconds
+                  << std::setw(10) << point.node_count
+                  << std::setw(11) << point.sah_cost
+                  << std::setw(12) << std::setprecision(1) << point.render_milliseconds
+                  << std::setw(10) << std::setprecision(3) << (point.rays_per_second / 1.0e6)
+                  << std::setw(11) << std::setprecision(1) << (point.build_milliseconds + point.render_milliseconds)
+                  << "\n";
+    }
+
+    if (!config.csv_file.empty())
+    {
+        std::ofstream csv(config.csv_file, std::ios::out | std::ios::trunc);
+        if (!csv.is_open())
+        {
+            std::cerr << "error: cannot write " << config.csv_file << "\n";
+            return 1;
+        }
+        csv << "builder,build_milliseconds,nodes,sah_cost,render_milliseconds,rays_per_second\n";
+        for (const auto &point : points)
+        {
+            csv << bvh_builder_name(point.builder) << "," << std::fixed << std::setprecision(3)
+                << point.build_milliseconds << "," << point.node_count << "," << point.sah_cost << ","
+                << point.render_milliseconds << "," << std::setprecision(0) << point.rays_per_second << "\n";
+        }
+        std::cout << "\nwrote " << config.csv_file << "\n";
+    }
+
+    return 0;
+}
+
+struct AcceleratorPoint
+{
+    SceneLayout layout;
+    uint32_t sphere_count;
+    Accelerator accelerator;
+    double build_milliseconds;
+    uint64_t index_bytes;
+    double render_milliseconds;
+    double rays_per_second;
+};
+
+int run_accelerator_comparison(const RenderConfig &config)
+{
+    std::vector<SceneLayout> layouts = benchmark_layouts(config);
+    std::vector<uint32_t> sphere_counts = benchmark_scene_counts(config);
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+
+    std::cout << "Accelerators: " << config.image_width << "x" << config.image_height << ", " << config.rays_per_pixel
+              << " rays/pixel, " << resolve_thread_count(config.thread_count) << " threads, BVHs built with "
+              << config.bvh_builder << ", seed " << config.seed << ", best of " << config.benchmark_repeats << "\n";
+
+    std::vector<AcceleratorPoint> points;
+    for (SceneLayout layout : layouts)
+    {
+        for (uint32_t sphere_count : sphere_counts)
+        {
+            Scene scene = {};
+            generate_sphere_field(&scene, layout, sphere_count, config.seed);
+            for (Accelerator accelerator : { Accelerator::Bvh, Accelerator::WideBvh, Accelerator::Grid })
+            {
+                std::cout << "\r  " << scene_layout_name(layout) << ", " << sphere_count << " spheres, "
+                          << accelerator_name(accelerator) << "...          ";
+                fflush(stdout);
+
+                RenderConfig accelerator_config = config;
+                accelerator_config.accelerator = accelerator_name(accelerator);
+                accelerator_config.bvh_cache_file.clear();
+                accelerator_config.perf_counters = false;
+                accelerator_config.perf_kernels = false;
+
+                AcceleratorPoint point = {};
+                point.layout = layout;
+                point.sphere_count = sphere_count;
+                point.accelerator = accelerator;
+                for (uint32_t repeat = 0; repeat < config.benchmark_repeats; ++repeat)
+                {
+                    AccelerationReport acceleration = {};
+                    prepare_acceleration(accelerator_config, &scene, &acceleration);
+                    double build_milliseconds = acceleration.build_milliseconds + acceleration.object_milliseconds +
+                                                acceleration.instance_milliseconds;
+                    if ((repeat == 0) || (build_milliseconds < point.build_milliseconds))
+                    {
+                        point.build_milliseconds = build_milliseconds;
+                    }
+                    point.index_bytes = acceleration.index_bytes;
+                }
+
+                RenderResult result = {};
+                render_best_of(&scene, accelerator_config, *image_data, &result);
+                point.render_milliseconds = result.elapsed_milliseconds;
+                point.rays_per_second = rays_per_second(result);
+                points.push_back(point);
+            }
+        }
+    }
+    std::cout << "\n\n";
+
+    // instanced layouts put only the flat spheres (none) in the grid; their instances keep BVHs
+    std::cout << std::setw(10) << "layout" << std::setw(10) << "spheres" << std::setw(7) << "accel"
+              << std::setw(11) << "build ms" << std::setw(11) << "index MB" << std::setw(12) << "render ms"
+              << std::setw(10) << "Mrays/s" << "\n";
+    for (const auto &point : points)
+    {
+        std::cout << std::fixed
+                  << std::setw(10) << scene_layout_name(point.layout)
+                  << std::setw(10) << point.sphere_count
+                  << std::setw(7) << accelerator_name(point.accelerator)
+                  << std::setw(11) << std::setprecision(2) << point.build_milliseconds
+                  << std::setw(11) << (static_cast<double>(point.index_bytes) / (1024.0 * 1024.0))
+                  << std::setw(12) << std::setprecision(1) << point.render_milliseconds
+                  << std::setw(10) << std::setprecision(4) << (point.rays_per_second / 1.0e6) << "\n";
+    }
+
+    if (!config.csv_file.empty())
+    {
+        std::ofstream csv(config.csv_file, std::ios::out | std::ios::trunc);
+        if (!csv.is_open())
+        {
+            std::cerr << "error: cannot write " << config.csv_file << "\n";
+            return 1;
+        }
+        csv << "layout,spheres,accelerator,build_milliseconds,index_bytes,render_milliseconds,rays_per_second\n";
+        for (const auto &point : points)
+        {
+            csv << scene_layout_name(point.layout) << "," << point.sphere_count << ","
+                << accelerator_name(point.accelerator) << "," << std::fixed << std::setprecision(3)
+                << point.build_milliseconds << "," << point.index_bytes << "," << point.render_milliseconds << ","
+                << std::setprecision(0) << point.rays_per_second << "\n";
+        }
+        std::cout << "\nwrote " << config.csv_file << "\n";
+    }
+
+    return 0;
+}
+
+struct OcclusionPoint
+{
+    SceneLayout layout;
+    uint32_t sphere_count;
+    Accelerator accelerator;
+    double occluded_fraction;
+    double closest_rays_per_second;
+    double any_rays_per_second;
+    // rays the two queries disagree on; anything but 0 is a bug
+    uint64_t mismatches;
+};
+
+// arrays behind a RayBatch
+struct ShadowRays
+{
+    std::vector<float> origin[3];
+    std::vector<float> direction[3];
+    std::vector<float> max_distance;
+};
+
+static RayBatch shadow_ray_batch(const ShadowRays &rays, RayQuery query)
+{
+    return RayBatch { query, static_cast<uint32_t>(rays.origin[0].size()), rays.origin[0].data(), rays.origin[1].data(),
+                      rays.origin[2].data(), rays.direction[0].data(), rays.direction[1].data(),
+                      rays.direction[2].data(), rays.max_distance.data() };
+}
+
+// Shadow rays: a ray from the camera toward a random point of the scene's bounds, then from
+// wherever it lands toward a random point of an area light above the scene, reached at 1.
+static void make_shadow_rays(const Scene &scene, uint32_t ray_count, uint32_t seed, uint32_t thread_count,
+                             ShadowRays *rays)
+{
+    Aabb bounds = empty_aabb();
+    for (const auto &sphere : scene.spheres)
+    {
+        grow_aabb(&bounds, sphere_bounds(sphere));
+    }
+    std::vector<Aabb> instance_bounds;
+    instance_world_bounds(scene, &instance_bounds);
+    for (const auto &box : instance_bounds)
+    {
+        grow_aabb(&bounds, box);
+    }
+    Vector::Vector3 center = 0.5f * (bounds.min + bounds.max);
+    Vector::Vector3 extent = bounds.max - bounds.min;
+    Vector::Vector3 light_center = { center.x, center.y, bounds.max.z + extent.z + 1.0f };
+
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        rays->origin[axis].resize(ray_count);
+        rays->direction[axis].resize(ray_count);
+    }
+    rays->max_distance.assign(ray_count, 1.0f);
+    parallel_chunks(ray_count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        Math::RandomSeries series = { (seed * 9781u + begin * 6271u) | 1u };
+        RayStatistics statistics = {};
+        for (uint32_t ray = begin; ray < end; ++ray)
+        {
+            Vector::Vector3 target = { center.x + 0.5f * extent.x * random_bilateral(&series),
+                                       center.y + 0.5f * extent.y * random_bilateral(&series),
+                                       center.z + 0.5f * extent.z * random_bilateral(&series) };
+            Vector::Vector3 camera_direction = target - scene.camera.position;
+            RayHit hit;
+            closest_hit(&scene, scene.camera.position, camera_direction, 1.0f, &hit, &statistics);
+            Vector::Vector3 origin = scene.camera.position + hit.distance * camera_direction;
+            Vector::Vector3 light = { light_center.x + 0.25f * extent.x * random_bilateral(&series),
+                                      light_center.y + 0.25f * extent.y * random_bilateral(&series), light_center.z };
+            Vector::Vector3 direction = light - origin;
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                rays->origin[axis][ray] = vector_axis(origin, axis);
+                rays->direction[axis][ray] = vector_axis(direction, axis);
+            }
+        }
+    });
+}
+
+int run_occlusion_benchmark(const RenderConfig &config)
+{
+    std::vector<SceneLayout> layouts = benchmark_layouts(config);
+    std::vector<uint32_t> sphere_counts = benchmark_scene_counts(config);
+    uint32_t thread_count = resolve_thread_count(config.thread_count);
+    // one batch carries every ray, and RayBatch counts them in 32 bits
+    uint64_t requested_rays = static_cast<uint64_t>(config.image_width) * config.image_height * config.rays_per_pixel;
+    if (requested_rays > UINT32_MAX)
+    {
+        std::cerr << "error: " << requested_rays << " shadow rays is more than one batch holds (" << UINT32_MAX
+                  << "); lower --width, --height or --spp\n";
+        return 1;
+    }
+    uint32_t ray_count = static_cast<uint32_t>(requested_rays);
+
+    std::cout << "Occlusion: " << ray_count << " shadow rays, " << thread_count << " threads, BVHs built with "
+              << config.bvh_builder << ", seed " << config.seed << ", best of " << config.benchmark_repeats << "\n";
+
+    std::vector<OcclusionPoint> points;
+    ShadowRays rays;
+    std::vector<uint8_t> closest_hits(ray_count), any_hits(ray_count);
+    HitBatch closest_batch = { closest_hits.data(), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+    HitBatch any_batch = { any_hits.data(), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+    for (SceneLayout layout : layouts)
+    {
+        for (uint32_t sphere_count : sphere_counts)
+        {
+            Scene scene = {};
+            generate_sphere_field(&scene, layout, sphere_count, config.seed);
+            for (Accelerator accelerator : { Accelerator::Bvh, Accelerator::WideBvh, Accelerator::Grid })
+            {
+                std::cout << "\r  " << scene_layout_name(layout) << ", " << sphere_count << " spheres, "
+                          << accelerator_name(accelerator) << "...          ";
+                fflush(stdout);
+
+                RenderConfig accelerator_config = config;
+                accelerator_config.accelerator = accelerator_name(accelerator);
+                accelerator_config.bvh_cache_file.clear();
+                AccelerationReport acceleration = {};
+                prepare_acceleration(accelerator_config, &scene, &acceleration);
+                if (accelerator == Accelerator::Bvh)
+                {
+                    make_shadow_rays(scene, ray_count, config.seed, thread_count, &rays);
+                }
+
+                OcclusionPoint point = {};
+                point.layout = layout;
+                point.sphere_count = sphere_count;
+                point.accelerator = accelerator;
+                double closest_milliseconds = 0.0, any_milliseconds = 0.0;
+                for (uint32_t repeat = 0; repeat < config.benchmark_repeats; ++repeat)
+                {
+                    auto closest_start = std::chrono::steady_clock::now();
+                    trace_batch(scene, shadow_ray_batch(rays, RayQuery::ClosestHit), thread_count, &closest_batch);
+                    auto any_start = std::chrono::steady_clock::now();
+                    trace_batch(scene, shadow_ray_batch(rays, RayQuery::AnyHit), thread_count, &any_batch);
+                    auto any_end = std::chrono::steady_clock::now();
+                    double closest = std::chrono::duration<double, std::milli>(any_start - closest_start).count();
+                    double any = std::chrono::duration<double, std::milli>(any_end - any_start).count();
+                    closest_milliseconds = (repeat == 0) ? closest : std::min(closest, closest_milliseconds);
+                    any_milliseconds = (repeat == 0) ? any : std::min(any, any_milliseconds);
+                }
+
+                uint64_t occluded_count = 0;
+                for (uint32_t ray = 0; ray < ray_count; ++ray)
+                {
+                    occluded_count += any_hits[ray];
+                    point.mismatches += (any_hits[ray] != closest_hits[ray]);
+                }
+                point.occluded_fraction = static_cast<double>(occluded_count) / std::max(ray_count, 1u);
+                point.closest_rays_per_second = ray_count / (std::max(closest_milliseconds, 0.001) / 1000.0);
+                point.any_rays_per_second = ray_count / (std::max(any_milliseconds, 0.001) / 1000.0);
+                points.push_back(point);
+            }
+        }
+    }
+    std::cout << "\n\n";
+
+    std::cout << std::setw(10) << "layout" << std::setw(10) << "spheres" << std::setw(7) << "accel"
+              << std::setw(11) << "occluded" << std::setw(16) << "closest Mrays/s" << std::setw(15) << "any Mrays/s"
+              << std::setw(9) << "speedup" << std::setw(12) << "mismatches" << "\n";
+    for (const auto &point : points)
+    {
+        std::cout << std::fixed
+                  << std::setw(10) << scene_layout_name(point.layout)
+                  << std::setw(10) << point.sphere_count
+                  << std::setw(7) << accelerator_name(point.accelerator)
+                  << std::setw(10) << std::setprecision(1) << (100.0 * point.occluded_fraction) << "%"
+                  << std::setw(16) << std::setprecision(4) << (point.closest_rays_per_second / 1.0e6)
+                  << std::setw(15) << (point.any_rays_per_second / 1.0e6)
+                  << std::setw(9) << std::setprecision(2) << (point.any_rays_per_second / point.closest_rays_per_second)
+                  << std::setw(12) << point.mismatches << "\n";
+    }
+
+    if (!config.csv_file.empty())
+    {
+        std::ofstream csv(config.csv_file, std::ios::out | std::ios::trunc);
+        if (!csv.is_open())
+        {
+            std::cerr << "error: cannot write " << config.csv_file << "\n";
+            return 1;
+        }
+        csv << "layout,spheres,accelerator,occluded_fraction,closest_rays_per_second,any_rays_per_second,mismatches\n";
+        for (const auto &point : points)
+        {
+            csv << scene_layout_name(point.layout) << "," << point.sphere_count << ","
+                << accelerator_name(point.accelerator) << "," << std::fixed << std::setprecision(4)
+                << point.occluded_fraction << "," << std::setprecision(0) << point.closest_rays_per_second << ","
+                << point.any_rays_per_second << "," << point.mismatches << "\n";
+        }
+        std::cout << "\nwrote " << config.csv_file << "\n";
+    }
+
+    bool agreed = true;
+    for (const auto &point : points)
+    {
+        agreed = agreed && (point.mismatches == 0);
+    }
+    return agreed ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include "../include/BinaryScene.h"
+
+// the arrays are used in place, so the file layout is the in-memory layout of this machine
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "binary scenes are little-endian");
+static_assert(std::is_trivially_copyable<Material>::value && std::is_trivially_copyable<Plane>::value &&
+              std::is_trivially_copyable<Sphere>::value && std::is_trivially_copyable<Camera>::value,
+              "binary scene elements are written and mapped as raw bytes");
+static_assert((alignof(Material) <= BINARY_SCENE_ALIGNMENT) && (alignof(Plane) <= BINARY_SCENE_ALIGNMENT) &&
+              (alignof(Sphere) <= BINARY_SCENE_ALIGNMENT), "sections must be aligned for their elements");
+static_assert(sizeof(BinarySceneHeader) % BINARY_SCENE_ALIGNMENT == 0, "first section follows the header");
+
+static uint64_t align_up(uint64_t value)
+{
+    return (value + BINARY_SCENE_ALIGNMENT - 1) & ~static_cast<uint64_t>(BINARY_SCENE_ALIGNMENT - 1);
+}
+
+bool is_binary_scene_file(const std::string &file_name)
+{
+    FILE *file = fopen(file_name.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    char magic[sizeof(BINARY_SCENE_MAGIC)] = {};
+    bool is_binary = (fread(magic, 1, sizeof(magic), file) == sizeof(magic)) &&
+                     (memcmp(magic, BINARY_SCENE_MAGIC, sizeof(magic)) == 0);
+    fclose(file);
+    return is_binary;
+}
+
+bool has_binary_scene_extension(const std::string &file_name)
+{
+    size_t extension_length = strlen(BINARY_SCENE_EXTENSION);
+    return (file_name.size() > extension_length) &&
+           (file_name.compare(file_name.size() - extension_length, extension_length, BINARY_SCENE_EXTENSION) == 0);
+}
+
+// section has to be aligned and lie entirely inside the file, without overflowing on the way
+static bool section_fits(const BinarySceneSection &section, uint64_t element_size, uint64_t file_size)
+{
+    if ((section.offset % BINARY_SCENE_ALIGNMENT) || (section.offset < sizeof(BinarySceneHeader)) ||
+        (section.offset > file_size))
+    {
+        return false;
+    }
+    return section.count <= (file_size - section.offset) / element_size;
+}
+
+bool load_scene_binary(const std::string &file_name, Scene *scene, std::string *error)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(file_name, error, MappedAccess::Random))
+    {
+        return false;
+    }
+
+    auto fail = [&file_name, error](const char *message)
+    {
+        *error = file_name + ": " + message;
+        return false;
+    };
+
+    BinarySceneHeader header = {};
+    if (file->size() < sizeof(header))
+    {
+        return fail("too small for a binary scene header");
+    }
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, BINARY_SCENE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        return fail("not a binary scene file");
+    }
+    if (header.version != BINARY_SCENE_VERSION)
+    {
+        *error = file_name + ": binary scene version " + std::to_string(header.version) + ", expected " +
+                 std::to_string(BINARY_SCENE_VERSION) + "; convert it again from the text scene";
+        return false;
+    }
+    if ((header.header_size != sizeof(BinarySceneHeader)) || (header.material_size != sizeof(Material)) ||
+        (header.plane_size != sizeof(Plane)) || (header.sphere_size != sizeof(Sphere)))
+    {
+        return fail("written with a different struct layout");
+    }
+    if (header.file_size != file->size())
+    {
+        return fail("truncated or padded, size does not match the header");
+    }
+    if (!section_fits(header.materials, sizeof(Material), header.file_size) ||
+        !section_fits(header.planes, sizeof(Plane), header.file_size) ||
+        !section_fits(header.spheres, sizeof(Sphere), header.file_size))
+    {
+        return fail("section lies outside the file");
+    }
+    // White is the sky, so there always is at least one material
+    if ((header.materials.count == 0) || (header.max_material_index >= header.materials.count))
+    {
+        return fail("primitives refer to materials the file does not have");
+    }
+
+    const uint8_t *data = file->data();
+    auto materials = reinterpret_cast<const Material *>(data + header.materials.offset);
+
+    *scene = {};
+    scene->camera = header.camera;
+    scene->materials.assign(materials, materials + header.materials.count);
+    scene->planes.view(reinterpret_cast<const Plane *>(data + header.planes.offset), header.planes.count);
+    scene->spheres.view(reinterpret_cast<const Sphere *>(data + header.spheres.offset), header.spheres.count);
+    scene->mapped_file = file;
+
+    return true;
+}
+
+static bool write_section(FILE *file, const void *elements, uint64_t size, uint64_t *offset)
+{
+    static const uint8_t padding[BINARY_SCENE_ALIGNMENT] = {};
+    uint64_t aligned_offset = align_up(*offset);
+    bool written = (fwrite(padding, 1, aligned_offset - *offset, file) == aligned_offset - *offset) &&
+                   (fwrite(elements, 1, size, file) == size);
+    *offset = aligned_offset + size;
+    return written;
+}
+
+bool write_scene_binary(const Scene &scene, const std::string &file_name, std::string *error)
+{
+    if (!scene.instances.empty())
+    {
+        *error = "binary scenes cannot hold instances yet; write a text scene instead";
+        return false;
+    }
+    if (!scene.meshes.empty())
+    {
+        *error = "binary scenes cannot hold meshes yet; write a text scene instead";
+        return false;
+    }
+    if (!scene.sdfs.empty())
+    {
+        *error = "binary scenes cannot hold sdf surfaces yet; write a text scene instead";
+        return false;
+    }
+
+    BinarySceneHeader header = {};
+    memcpy(header.magic, BINARY_SCENE_MAGIC, sizeof(header.magic));
+    header.version = BINARY_SCENE_VERSION;
+    header.header_size = sizeof(BinarySceneHeader);
+    header.camera = scene.camera;
+    header.material_size = sizeof(Material);
+    header.plane_size = sizeof(Plane);
+    header.sphere_size = sizeof(Sphere);
+
+    for (const auto &plane : scene.planes)
+    {
+        header.max_material_index = std::max(header.max_material_index, static_cast<uint32_t>(plane.material_name));
+    }
+    for (const auto &sphere : scene.spheres)
+    {
+        header.max_material_index = std::max(header.max_material_index, static_cast<uint32_t>(sphere.material_name));
+    }
+
+    uint64_t material_bytes = scene.materials.size() * sizeof(Material);
+    uint64_t plane_bytes = scene.planes.size() * sizeof(Plane);
+    uint64_t sphere_bytes = scene.spheres.size() * sizeof(Sphere);
+    header.materials = BinarySceneSection { sizeof(BinarySceneHeader), scene.materials.size() };
+    header.planes = BinarySceneSection { align_up(header.materials.offset + material_bytes), scene.planes.size() };
+    header.spheres = BinarySceneSection { align_up(header.planes.offset + plane_bytes), scene.spheres.size() };
+    header.file_size = header.spheres.offset + sphere_bytes;
+
+    FILE *file = fopen(file_name.c_str(), "wb");
+    if (!file)
+    {
+        *error = "cannot write '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+
+    uint64_t offset = 0;
+    bool written = write_section(file, &header, sizeof(header), &offset) &&
+                   write_section(file, scene.materials.data(), material_bytes, &offset) &&
+                   write_section(file, scene.planes.data(), plane_bytes, &offset) &&
+                   write_section(file, scene.spheres.data(), sphere_bytes, &offset);
+    written = (fclose(file) == 0) && written;
+    if (!written)
+    {
+        *error = "failed writing '" + file_name + "'";
+    }
+    return written;
+}
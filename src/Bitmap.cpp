@@ -3,6 +3,11 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "../include/Bitmap.h"
 
 Bitmap::Bitmap(uint32_t width, uint32_t height)
@@ -21,8 +26,50 @@ const inline uint32_t Bitmap::calculate_total_pixel_size() const
     return (image_data.width * image_data.height * sizeof(uint32_t));
 }
 
+bool Bitmap::map_file(const std::string &file_name, std::string *error)
+{
+    const size_t file_size = static_cast<size_t>(MAPPED_PIXEL_OFFSET) + output_pixel_size;
+    int file_descriptor = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor < 0)
+    {
+        *error = "cannot create '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+    if (ftruncate(file_descriptor, static_cast<off_t>(file_size)) != 0)
+    {
+        *error = "cannot size '" + file_name + "': " + strerror(errno);
+        close(file_descriptor);
+        return false;
+    }
+    void *mapping = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+    // the mapping keeps the file open on its own
+    close(file_descriptor);
+    if (mapping == MAP_FAILED)
+    {
+        *error = "cannot map '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+
+    BitmapHeader header = {};
+    header.compose(image_data, output_pixel_size, MAPPED_PIXEL_OFFSET);
+    memcpy(mapping, &header, sizeof(header));
+    uint32_t *pixels = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(mapping) + MAPPED_PIXEL_OFFSET);
+    image_data.pixels = std::shared_ptr<uint32_t>(pixels, [mapping, file_size](uint32_t *)
+    {
+        munmap(mapping, file_size);
+    });
+    mapped_file_name = file_name;
+    return true;
+}
+
 void Bitmap::write_image(const std::string &file_name)
 {
+    if (!mapped_file_name.empty() && (file_name == mapped_file_name))
+    {
+        // already there; the kernel writes the dirty pages back
+        return;
+    }
+
     BitmapHeader header = {};
     header.compose(image_data, output_pixel_size);
 
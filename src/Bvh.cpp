@@ -0,0 +1,226 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "../include/Bvh.h"
+
+static void build_node(const Aabb *primitive_bounds, std::vector<uint32_t> *indices, std::vector<BvhNode> *nodes,
+                       uint32_t node_index, uint32_t begin, uint32_t end, uint32_t depth)
+{
+    Aabb bounds = empty_aabb();
+    Aabb centroid_bounds = empty_aabb();
+    for (uint32_t index = begin; index < end; ++index)
+    {
+        const Aabb &primitive = primitive_bounds[(*indices)[index]];
+        grow_aabb(&bounds, primitive);
+        grow_aabb(&centroid_bounds, aabb_center(primitive));
+    }
+
+    uint32_t count = end - begin;
+    if ((count <= BVH_MAX_LEAF_SIZE) || (depth + 1 >= BVH_MAX_DEPTH))
+    {
+        (*nodes)[node_index] = BvhNode { bounds, begin, count };
+        return;
+    }
+
+    Vector::Vector3 extent = centroid_bounds.max - centroid_bounds.min;
+    uint32_t axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+    uint32_t middle = begin + count / 2;
+    std::nth_element(indices->begin() + begin, indices->begin() + middle, indices->begin() + end,
+                     [primitive_bounds, axis](uint32_t a, uint32_t b)
+                     {
+                         return vector_axis(aabb_center(primitive_bounds[a]), axis) <
+                                vector_axis(aabb_center(primitive_bounds[b]), axis);
+                     });
+
+    auto first_child = static_cast<uint32_t>(nodes->size());
+    nodes->resize(nodes->size() + 2);
+    (*nodes)[node_index] = BvhNode { bounds, first_child, 0 };
+    build_node(primitive_bounds, indices, nodes, first_child, begin, middle, depth + 1);
+    build_node(primitive_bounds, indices, nodes, first_child + 1, middle, end, depth + 1);
+}
+
+void build_bvh_median(const Aabb *primitive_bounds, uint32_t count, Bvh *bvh)
+{
+    *bvh = {};
+    if (count == 0)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> indices(count);
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        indices[index] = index;
+    }
+    // a binary tree with leaves of at least one primitive has fewer than 2 * count nodes
+    std::vector<BvhNode> nodes(1);
+    nodes.reserve(2 * static_cast<size_t>(count));
+    build_node(primitive_bounds, &indices, &nodes, 0, 0, count, 0);
+
+    bvh->nodes.assign(std::move(nodes));
+    bvh->primitive_indices.assign(std::move(indices));
+}
+
+void build_bvh(BvhBuilder builder, const Aabb *primitive_bounds, uint32_t count, uint32_t thread_count, Bvh *bvh)
+{
+    switch (builder)
+    {
+        case BvhBuilder::Median: build_bvh_median(primitive_bounds, count, bvh); break;
+        case BvhBuilder::BinnedSah: build_bvh_binned_sah(primitive_bounds, count, thread_count, bvh); break;
+        case BvhBuilder::Lbvh: build_bvh_lbvh(primitive_bounds, count, thread_count, bvh); break;
+    }
+}
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed)
+{
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    uint64_t hash = seed ^ (size * multiplier);
+
+    size_t word_count = size / sizeof(uint64_t);
+    for (size_t word_index = 0; word_index < word_count; ++word_index)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + word_index * sizeof(uint64_t), sizeof(word));
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + word_count * sizeof(uint64_t), size % sizeof(uint64_t));
+    hash = (hash ^ tail) * multiplier;
+
+    // MurmurHash3 finalizer, so every input bit reaches every output bit
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+struct BvhCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t file_size;
+    uint64_t scene_hash;
+    // hash of everything after the header, catches damaged files
+    uint64_t contents_hash;
+    uint32_t node_size;
+    uint32_t primitive_count;
+    uint64_t node_offset;
+    uint64_t node_count;
+    uint64_t index_offset;
+    uint64_t index_count;
+};
+
+constexpr uint64_t BVH_CACHE_ALIGNMENT = 64;
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "BVH caches are little-endian");
+
+static uint64_t align_up(uint64_t value)
+{
+    return (value + BVH_CACHE_ALIGNMENT - 1) & ~(BVH_CACHE_ALIGNMENT - 1);
+}
+
+static uint64_t hash_contents(const uint8_t *contents, uint64_t size)
+{
+    return hash_bytes(contents, size, BVH_CACHE_VERSION);
+}
+
+bool load_bvh_cache(const std::string &file_name, uint64_t scene_hash, uint32_t primitive_count, Bvh *bvh,
+                    std::string *error)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(file_name, error, MappedAccess::Random))
+    {
+        return false;
+    }
+
+    BvhCacheHeader header = {};
+    if ((file->size() < sizeof(header)) || (memcmp(file->data(), BVH_CACHE_MAGIC, sizeof(header.magic)) != 0))
+    {
+        *error = "not a BVH cache file";
+        return false;
+    }
+    memcpy(&header, file->data(), sizeof(header));
+    if ((header.version != BVH_CACHE_VERSION) || (header.header_size != sizeof(header)) ||
+        (header.node_size != sizeof(BvhNode)))
+    {
+        *error = "written by another version";
+        return false;
+    }
+    if ((header.scene_hash != scene_hash) || (header.primitive_count != primitive_count))
+    {
+        *error = "built for a different scene";
+        return false;
+    }
+
+    uint64_t file_size = file->size();
+    uint64_t contents_offset = align_up(sizeof(header));
+    bool fits = (header.file_size == file_size) && (header.node_offset >= contents_offset) &&
+                (header.node_offset % BVH_CACHE_ALIGNMENT == 0) && (header.node_offset <= file_size) &&
+                (header.node_count <= (file_size - header.node_offset) / sizeof(BvhNode)) &&
+                (header.index_offset >= contents_offset) && (header.index_offset % BVH_CACHE_ALIGNMENT == 0) &&
+                (header.index_offset <= file_size) &&
+                (header.index_count <= (file_size - header.index_offset) / sizeof(uint32_t)) &&
+                (header.index_count == primitive_count) && ((header.node_count == 0) == (primitive_count == 0));
+    if (!fits || (file_size < contents_offset) ||
+        (hash_contents(file->data() + contents_offset, file_size - contents_offset) != header.contents_hash))
+    {
+        *error = "truncated or damaged";
+        return false;
+    }
+
+    *bvh = {};
+    bvh->nodes.view(reinterpret_cast<const BvhNode *>(file->data() + header.node_offset), header.node_count);
+    bvh->primitive_indices.view(reinterpret_cast<const uint32_t *>(file->data() + header.index_offset),
+                                header.index_count);
+    bvh->mapped_file = file;
+    return true;
+}
+
+bool write_bvh_cache(const std::string &file_name, uint64_t scene_hash, const Bvh &bvh, std::string *error)
+{
+    BvhCacheHeader header = {};
+    memcpy(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = BVH_CACHE_VERSION;
+    header.header_size = sizeof(header);
+    header.scene_hash = scene_hash;
+    header.node_size = sizeof(BvhNode);
+    header.primitive_count = static_cast<uint32_t>(bvh.primitive_indices.size());
+    header.node_offset = align_up(sizeof(header));
+    header.node_count = bvh.nodes.size();
+    header.index_offset = align_up(header.node_offset + header.node_count * sizeof(BvhNode));
+    header.index_count = bvh.primitive_indices.size();
+    header.file_size = header.index_offset + header.index_count * sizeof(uint32_t);
+
+    // contents are assembled in memory once so the hash covers exactly the bytes written
+    std::vector<uint8_t> contents(header.file_size - header.node_offset);
+    memcpy(contents.data(), bvh.nodes.data(), header.node_count * sizeof(BvhNode));
+    memcpy(contents.data() + (header.index_offset - header.node_offset), bvh.primitive_indices.data(),
+           header.index_count * sizeof(uint32_t));
+    header.contents_hash = hash_contents(contents.data(), contents.size());
+
+    std::string temporary_name = file_name + ".tmp." + std::to_string(getpid());
+    FILE *file = fopen(temporary_name.c_str(), "wb");
+    if (!file)
+    {
+        *error = "cannot write '" + temporary_name + "': " + strerror(errno);
+        return false;
+    }
+
+    uint8_t padding[BVH_CACHE_ALIGNMENT] = {};
+    bool written = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+                   (fwrite(padding, 1, header.node_offset - sizeof(header), file) == header.node_offset - sizeof(header)) &&
+                   (fwrite(contents.data(), 1, contents.size(), file) == contents.size());
+    written = (fclose(file) == 0) && written;
+    if (!written || (rename(temporary_name.c_str(), file_name.c_str()) != 0))
+    {
+        *error = "failed writing '" + file_name + "': " + strerror(errno);
+        remove(temporary_name.c_str());
+        return false;
+    }
+    return true;
+}
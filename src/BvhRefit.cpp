@@ -0,0 +1,75 @@
+#include "../include/Bvh.h"
+#include "../include/Parallel.h"
+
+void prepare_bvh_refit(const Bvh &bvh, BvhRefitState *state)
+{
+    state->parents.assign(bvh.nodes.size(), UINT32_MAX);
+    state->leaves.clear();
+    for (uint32_t node_index = 0; node_index < bvh.nodes.size(); ++node_index)
+    {
+        const BvhNode &node = bvh.nodes[node_index];
+        if (node.count)
+        {
+            state->leaves.push_back(node_index);
+        }
+        else
+        {
+            state->parents[node.first] = node_index;
+            state->parents[node.first + 1] = node_index;
+        }
+    }
+    state->built_sah_cost = bvh_sah_cost(bvh);
+}
+
+float refit_bvh(const Aabb *primitive_bounds, uint32_t thread_count, const BvhRefitState &state, Bvh *bvh)
+{
+    if (bvh->nodes.empty())
+    {
+        return 0.0f;
+    }
+
+    BvhNode *nodes = bvh->nodes.mutable_data();
+    const uint32_t *primitive_indices = bvh->primitive_indices.data();
+    const uint32_t *parents = state.parents.data();
+    // same scheme as the LBVH bounds pass: the second child to arrive at a node merges both,
+    // and the atomic add orders the first child's writes before the merge.  Each chunk sums
+    // the unnormalized SAH cost of the nodes it finished along the way.
+    std::vector<uint32_t> arrivals(bvh->nodes.size(), 0);
+    std::vector<double> chunk_costs(std::max(thread_count, 1u), 0.0);
+    parallel_chunks(static_cast<uint32_t>(state.leaves.size()), thread_count, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+    {
+        double cost = 0.0;
+        for (uint32_t leaf_index = begin; leaf_index < end; ++leaf_index)
+        {
+            uint32_t node = state.leaves[leaf_index];
+            BvhNode &leaf = nodes[node];
+            Aabb bounds = empty_aabb();
+            for (uint32_t index = leaf.first; index < leaf.first + leaf.count; ++index)
+            {
+                grow_aabb(&bounds, primitive_bounds[primitive_indices[index]]);
+            }
+            leaf.bounds = bounds;
+            cost += static_cast<double>(aabb_surface_area(bounds)) * static_cast<double>(leaf.count);
+
+            node = parents[node];
+            while ((node != UINT32_MAX) && (__sync_fetch_and_add(&arrivals[node], 1) == 1))
+            {
+                uint32_t first_child = nodes[node].first;
+                bounds = nodes[first_child].bounds;
+                grow_aabb(&bounds, nodes[first_child + 1].bounds);
+                nodes[node].bounds = bounds;
+                cost += aabb_surface_area(bounds);
+                node = parents[node];
+            }
+        }
+        chunk_costs[chunk] = cost;
+    });
+
+    // normalized as in bvh_sah_cost
+    double cost = 0.0;
+    for (double chunk_cost : chunk_costs)
+    {
+        cost += chunk_cost;
+    }
+    return static_cast<float>(cost / std::max(aabb_surface_area(nodes[0].bounds), FLT_MIN));
+}
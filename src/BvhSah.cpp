@@ -0,0 +1,292 @@
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "../include/Bvh.h"
+
+constexpr uint32_t SAH_BIN_COUNT = 16;
+// subtrees smaller than this are built by whichever thread split them off
+constexpr uint32_t SAH_TASK_MINIMUM = 4096;
+
+struct SahBin
+{
+    Aabb bounds;
+    uint32_t count;
+};
+
+// primitives are moved around with their bounds, so every pass over a node reads memory in order
+struct SahReference
+{
+    Aabb bounds;
+    uint32_t primitive;
+};
+
+// bounds of the node's primitives and of their centers, worked out while its parent was split
+struct SahBuildTask
+{
+    uint32_t node_index;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t depth;
+    Aabb bounds;
+    Aabb centroid_bounds;
+};
+
+// shared by all builder threads; every task owns a disjoint range of references and the
+// nodes it allocates, so only the task list and the node counter are contended
+struct SahBuild
+{
+    std::vector<SahReference> references;
+    std::unique_ptr<BvhNode[]> nodes;
+    volatile uint32_t node_count;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<SahBuildTask> tasks;
+    uint32_t busy_threads;
+};
+
+static void measure_range(const SahReference *references, SahBuildTask *task)
+{
+    task->bounds = empty_aabb();
+    task->centroid_bounds = empty_aabb();
+    for (uint32_t index = task->begin; index < task->end; ++index)
+    {
+        grow_aabb(&task->bounds, references[index].bounds);
+        grow_aabb(&task->centroid_bounds, aabb_center(references[index].bounds));
+    }
+}
+
+// splits the node's range between two child tasks, or makes it a leaf and returns false
+static bool split_node(SahBuild *build, const SahBuildTask &task, SahBuildTask *left, SahBuildTask *right)
+{
+    SahReference *references = build->references.data();
+    const Aabb &bounds = task.bounds;
+    const Aabb &centroid_bounds = task.centroid_bounds;
+
+    uint32_t count = task.end - task.begin;
+    BvhNode &node = build->nodes[task.node_index];
+    if ((count <= BVH_MAX_LEAF_SIZE) || (task.depth + 1 >= BVH_MAX_DEPTH))
+    {
+        node = BvhNode { bounds, task.begin, count };
+        return false;
+    }
+
+    // one pass drops every primitive into a bin on each of the three axes
+    SahBin bins[3][SAH_BIN_COUNT];
+    float bin_scales[3];
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        for (auto &bin : bins[axis])
+        {
+            bin = SahBin { empty_aabb(), 0 };
+        }
+        float axis_extent = vector_axis(centroid_bounds.max, axis) - vector_axis(centroid_bounds.min, axis);
+        bin_scales[axis] = (axis_extent > 0.0f) ? (static_cast<float>(SAH_BIN_COUNT) / axis_extent) : 0.0f;
+    }
+    for (uint32_t index = task.begin; index < task.end; ++index)
+    {
+        const Aabb &primitive_box = references[index].bounds;
+        Vector::Vector3 offset = aabb_center(primitive_box) - centroid_bounds.min;
+        auto bin_x = std::min(static_cast<uint32_t>(offset.x * bin_scales[0]), SAH_BIN_COUNT - 1);
+        auto bin_y = std::min(static_cast<uint32_t>(offset.y * bin_scales[1]), SAH_BIN_COUNT - 1);
+        auto bin_z = std::min(static_cast<uint32_t>(offset.z * bin_scales[2]), SAH_BIN_COUNT - 1);
+        grow_aabb(&bins[0][bin_x].bounds, primitive_box);
+        grow_aabb(&bins[1][bin_y].bounds, primitive_box);
+        grow_aabb(&bins[2][bin_z].bounds, primitive_box);
+        bins[0][bin_x].count += 1;
+        bins[1][bin_y].count += 1;
+        bins[2][bin_z].count += 1;
+    }
+
+    // cheapest plane between bins over all three axes, costed as area * count on either side
+    float best_cost = FLT_MAX;
+    uint32_t best_axis = 0;
+    uint32_t best_split = 0;
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        if (bin_scales[axis] == 0.0f)
+        {
+            continue;
+        }
+
+        // right_costs[split] covers bins split + 1 and up
+        float right_costs[SAH_BIN_COUNT] = {};
+        Aabb right_bounds = empty_aabb();
+        uint32_t right_count = 0;
+        for (uint32_t split = SAH_BIN_COUNT - 1; split > 0; --split)
+        {
+            grow_aabb(&right_bounds, bins[axis][split].bounds);
+            right_count += bins[axis][split].count;
+            right_costs[split - 1] = aabb_surface_area(right_bounds) * static_cast<float>(right_count);
+        }
+
+        Aabb left_bounds = empty_aabb();
+        uint32_t left_count = 0;
+        for (uint32_t split = 0; split < SAH_BIN_COUNT - 1; ++split)
+        {
+            grow_aabb(&left_bounds, bins[axis][split].bounds);
+            left_count += bins[axis][split].count;
+            float cost = aabb_surface_area(left_bounds) * static_cast<float>(left_count) + right_costs[split];
+            if ((left_count > 0) && (left_count < count) && (cost < best_cost))
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = split;
+            }
+        }
+    }
+
+    uint32_t first_child = __sync_fetch_and_add(&build->node_count, 2);
+    node = BvhNode { bounds, first_child, 0 };
+    *left = SahBuildTask { first_child, task.begin, task.begin, task.depth + 1, empty_aabb(), empty_aabb() };
+    *right = SahBuildTask { first_child + 1, task.end, task.end, task.depth + 1, empty_aabb(), empty_aabb() };
+
+    if (best_cost < FLT_MAX)
+    {
+        // partition in place, measuring both sides on the way so the children need no pass of their own
+        float axis_min = vector_axis(centroid_bounds.min, best_axis);
+        float bin_scale = bin_scales[best_axis];
+        while (left->end < right->begin)
+        {
+            SahReference &reference = references[left->end];
+            Vector::Vector3 center = aabb_center(reference.bounds);
+            auto bin_index = static_cast<uint32_t>((vector_axis(center, best_axis) - axis_min) * bin_scale);
+            if (std::min(bin_index, SAH_BIN_COUNT - 1) <= best_split)
+            {
+                grow_aabb(&left->bounds, reference.bounds);
+                grow_aabb(&left->centroid_bounds, center);
+                left->end += 1;
+            }
+            else
+            {
+                right->begin -= 1;
+                grow_aabb(&right->bounds, reference.bounds);
+                grow_aabb(&right->centroid_bounds, center);
+                std::swap(reference, references[right->begin]);
+            }
+        }
+    }
+    else
+    {
+        // every centroid in the same spot: any split is as good as another
+        left->end = right->begin = task.begin + count / 2;
+        measure_range(references, left);
+        measure_range(references, right);
+    }
+    return true;
+}
+
+static void push_task(SahBuild *build, const SahBuildTask &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(build->mutex);
+        build->tasks.push_back(task);
+    }
+    build->wake.notify_one();
+}
+
+static void build_subtree(SahBuild *build, SahBuildTask task)
+{
+    SahBuildTask left, right;
+    while (split_node(build, task, &left, &right))
+    {
+        if (right.end - right.begin >= SAH_TASK_MINIMUM)
+        {
+            push_task(build, right);
+        }
+        else
+        {
+            build_subtree(build, right);
+        }
+        task = left;
+    }
+}
+
+// runs tasks until none are left and no thread is still working on one that could add more
+static void run_build_tasks(SahBuild *build)
+{
+    std::unique_lock<std::mutex> lock(build->mutex);
+    for (;;)
+    {
+        build->wake.wait(lock, [build] { return !build->tasks.empty() || (build->busy_threads == 0); });
+        if (build->tasks.empty())
+        {
+            break;
+        }
+
+        SahBuildTask task = build->tasks.back();
+        build->tasks.pop_back();
+        build->busy_threads += 1;
+        lock.unlock();
+
+        build_subtree(build, task);
+
+        lock.lock();
+        build->busy_threads -= 1;
+        if (build->busy_threads == 0)
+        {
+            build->wake.notify_all();
+        }
+    }
+}
+
+void build_bvh_binned_sah(const Aabb *primitive_bounds, uint32_t count, uint32_t thread_count, Bvh *bvh)
+{
+    *bvh = {};
+    if (count == 0)
+    {
+        return;
+    }
+
+    SahBuild build;
+    build.references.resize(count);
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        build.references[index] = SahReference { primitive_bounds[index], index };
+    }
+    // at most 2 * count - 1 nodes; left uninitialized so untouched pages are never faulted in
+    build.nodes.reset(new BvhNode[2 * static_cast<size_t>(count)]);
+    build.node_count = 1;
+    SahBuildTask root = { 0, 0, count, 0, empty_aabb(), empty_aabb() };
+    measure_range(build.references.data(), &root);
+    build.tasks.push_back(root);
+    build.busy_threads = 0;
+
+    std::vector<std::thread> threads;
+    for (uint32_t thread_index = 1; thread_index < thread_count; ++thread_index)
+    {
+        threads.emplace_back(run_build_tasks, &build);
+    }
+    run_build_tasks(&build);
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    bvh->nodes.assign(std::vector<BvhNode>(build.nodes.get(), build.nodes.get() + build.node_count));
+    std::vector<uint32_t> indices(count);
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        indices[index] = build.references[index].primitive;
+    }
+    bvh->primitive_indices.assign(std::move(indices));
+}
+
+float bvh_sah_cost(const Bvh &bvh)
+{
+    if (bvh.nodes.empty())
+    {
+        return 0.0f;
+    }
+
+    // a box test costs about as much as a sphere test here, so both weigh 1
+    double root_area = std::max(aabb_surface_area(bvh.nodes[0].bounds), FLT_MIN);
+    double cost = 0.0;
+    for (const auto &node : bvh.nodes)
+    {
+        double relative_area = aabb_surface_area(node.bounds) / root_area;
+        cost += relative_area * (node.count ? static_cast<double>(node.count) : 1.0);
+    }
+    return static_cast<float>(cost);
+}
@@ -0,0 +1,607 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include "../include/Acceleration.h"
+#include "../include/Config.h"
+#include "../include/GBuffer.h"
+#include "../include/HdrImage.h"
+#include "../include/SceneGenerator.h"
+#include "../include/TiledImage.h"
+
+static bool parse_unsigned(const std::string &key, const std::string &value, uint32_t *result, std::string *error)
+{
+    char *end = nullptr;
+    errno = 0;
+    unsigned long parsed = std::strtoul(value.c_str(), &end, 10);
+    if (value.empty() || (value[0] == '-') || (*end != '\0') || (errno == ERANGE) || (parsed > UINT32_MAX))
+    {
+        *error = "invalid value '" + value + "' for " + key;
+        return false;
+    }
+
+    *result = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+static bool parse_bool(const std::string &key, const std::string &value, bool *result, std::string *error)
+{
+    if (value.empty() || (value == "true") || (value == "on") || (value == "1"))
+    {
+        *result = true;
+    }
+    else if ((value == "false") || (value == "off") || (value == "0"))
+    {
+        *result = false;
+    }
+    else
+    {
+        *error = "invalid value '" + value + "' for " + key;
+        return false;
+    }
+
+    return true;
+}
+
+static bool parse_float(const std::string &key, const std::string &value, float *result, std::string *error)
+{
+    char *end = nullptr;
+    errno = 0;
+    float parsed = std::strtof(value.c_str(), &end);
+    if (value.empty() || (*end != '\0') || (errno == ERANGE) || !std::isfinite(parsed))
+    {
+        *error = "invalid value '" + value + "' for " + key;
+        return false;
+    }
+
+    *result = parsed;
+    return true;
+}
+
+// accepts either "64" for square tiles or "64x32"
+static bool parse_tile_size(const std::string &key, const std::string &value, RenderConfig *config, std::string *error)
+{
+    size_t separator = value.find('x');
+    if (separator == std::string::npos)
+    {
+        if (!parse_unsigned(key, value, &config->tile_width, error))
+        {
+            return false;
+        }
+        config->tile_height = config->tile_width;
+        return true;
+    }
+
+    return parse_unsigned(key, value.substr(0, separator), &config->tile_width, error) &&
+           parse_unsigned(key, value.substr(separator + 1), &config->tile_height, error);
+}
+
+// comma separated, e.g. "1,2,4,8"
+static bool parse_list(const std::string &key, const std::string &value, std::vector<uint32_t> *result, std::string *error)
+{
+    result->clear();
+    size_t start = 0;
+    while (start <= value.size())
+    {
+        size_t separator = value.find(',', start);
+        size_t length = (separator == std::string::npos) ? std::string::npos : (separator - start);
+        uint32_t entry = 0;
+        if (!parse_unsigned(key, value.substr(start, length), &entry, error))
+        {
+            return false;
+        }
+        result->push_back(entry);
+
+        if (separator == std::string::npos)
+        {
+            break;
+        }
+        start = separator + 1;
+    }
+
+    return true;
+}
+
+static bool is_flag(const std::string &key)
+{
+    return (key == "perf") || (key == "perf-kernels") || (key == "help") || (key == "sweep") || (key == "scaling") ||
+           (key == "scene-scaling") || (key == "bvh-builders") || (key == "accelerators") ||
+           (key == "occlusion") || (key == "sort-rays") || (key == "map-output");
+}
+
+// the options that take a value, so a misspelt flag is not taken to want one
+static bool is_value_option(const std::string &key)
+{
+    return (key == "config") || (key == "width") || (key == "height") || (key == "spp") ||
+           (key == "rays-per-pixel") || (key == "bounces") || (key == "tile") || (key == "threads") ||
+           (key == "output") || (key == "hdr-output") || (key == "exr-compression") || (key == "scene") ||
+           (key == "write-scene") || (key == "generate") || (key == "primitives") || (key == "seed") ||
+           (key == "accel") || (key == "bvh-builder") || (key == "bvh-cache") || (key == "frames") ||
+           (key == "rebuild-threshold") || (key == "gbuffer") || (key == "scene-counts") || (key == "json") ||
+           (key == "baseline") || (key == "sweep-threads") || (key == "sweep-tiles") || (key == "sweep-spp") ||
+           (key == "repeat") || (key == "csv");
+}
+
+bool apply_config_option(RenderConfig *config, const std::string &key, const std::string &value, std::string *error)
+{
+    if (key == "width")
+    {
+        return parse_unsigned(key, value, &config->image_width, error);
+    }
+    if (key == "height")
+    {
+        return parse_unsigned(key, value, &config->image_height, error);
+    }
+    if ((key == "spp") || (key == "rays-per-pixel"))
+    {
+        return parse_unsigned(key, value, &config->rays_per_pixel, error);
+    }
+    if (key == "bounces")
+    {
+        return parse_unsigned(key, value, &config->max_bounce_count, error);
+    }
+    if (key == "tile")
+    {
+        return parse_tile_size(key, value, config, error);
+    }
+    if (key == "threads")
+    {
+        return parse_unsigned(key, value, &config->thread_count, error);
+    }
+    if (key == "output")
+    {
+        if (value.empty())
+        {
+            *error = "output needs a file name";
+            return false;
+        }
+        config->output_file = value;
+        return true;
+    }
+    if (key == "map-output")
+    {
+        return parse_bool(key, value, &config->map_output, error);
+    }
+    if (key == "hdr-output")
+    {
+        if (!has_hdr_image_extension(value))
+        {
+            *error = "hdr-output needs a file name ending in .pfm or .exr";
+            return false;
+        }
+        config->hdr_output_file = value;
+        return true;
+    }
+    if (key == "exr-compression")
+    {
+        ExrCompression compression;
+        if (!parse_exr_compression(value, &compression))
+        {
+            *error = "unknown EXR compression '" + value + "' (zip or none)";
+            return false;
+        }
+        config->exr_compression = value;
+        return true;
+    }
+    if (key == "scene")
+    {
+        config->scene_file = value;
+        return true;
+    }
+    if (key == "write-scene")
+    {
+        config->write_scene_file = value;
+        return true;
+    }
+    if (key == "generate")
+    {
+        SceneLayout layout;
+        if (!parse_scene_layout(value, &layout))
+        {
+            *error = "unknown scene layout '" + value + "' (random, clustered, grid or instanced)";
+            return false;
+        }
+        config->scene_layout = value;
+        return true;
+    }
+    if (key == "primitives")
+    {
+        return parse_unsigned(key, value, &config->primitive_count, error);
+    }
+    if (key == "seed")
+    {
+        return parse_unsigned(key, value, &config->seed, error);
+    }
+    if (key == "accel")
+    {
+        Accelerator accelerator;
+        if (!parse_accelerator(value, &accelerator))
+        {
+            *error = "unknown accelerator '" + value + "' (bvh, bvh8, grid or none)";
+            return false;
+        }
+        config->accelerator = value;
+        return true;
+    }
+    if (key == "bvh-builder")
+    {
+        BvhBuilder builder;
+        if (!parse_bvh_builder(value, &builder))
+        {
+            *error = "unknown BVH builder '" + value + "' (sah, median or lbvh)";
+            return false;
+        }
+        config->bvh_builder = value;
+        return true;
+    }
+    if (key == "bvh-cache")
+    {
+        config->bvh_cache_file = value;
+        return true;
+    }
+    if (key == "frames")
+    {
+        return parse_unsigned(key, value, &config->frame_count, error);
+    }
+    if (key == "rebuild-threshold")
+    {
+        return parse_float(key, value, &config->rebuild_threshold, error);
+    }
+    if (key == "scene-scaling")
+    {
+        return parse_bool(key, value, &config->scene_scaling, error);
+    }
+    if (key == "bvh-builders")
+    {
+        return parse_bool(key, value, &config->bvh_builders, error);
+    }
+    if (key == "accelerators")
+    {
+        return parse_bool(key, value, &config->compare_accelerators, error);
+    }
+    if (key == "occlusion")
+    {
+        return parse_bool(key, value, &config->occlusion, error);
+    }
+    if (key == "sort-rays")
+    {
+        return parse_bool(key, value, &config->sort_rays, error);
+    }
+    if (key == "gbuffer")
+    {
+        return parse_unsigned(key, value, &config->gbuffer_size, error);
+    }
+    if (key == "scene-counts")
+    {
+        return parse_list(key, value, &config->scene_counts, error);
+    }
+    if (key == "sweep")
+    {
+        return parse_bool(key, value, &config->sweep, error);
+    }
+    if (key == "scaling")
+    {
+        return parse_bool(key, value, &config->scaling, error);
+    }
+    if (key == "json")
+    {
+        config->json_file = value;
+        return true;
+    }
+    if (key == "baseline")
+    {
+        config->baseline_file = value;
+        return true;
+    }
+    if (key == "sweep-threads")
+    {
+        return parse_list(key, value, &config->sweep_threads, error);
+    }
+    if (key == "sweep-tiles")
+    {
+        return parse_list(key, value, &config->sweep_tiles, error);
+    }
+    if (key == "sweep-spp")
+    {
+        return parse_list(key, value, &config->sweep_rays_per_pixel, error);
+    }
+    if (key == "repeat")
+    {
+        return parse_unsigned(key, value, &config->benchmark_repeats, error);
+    }
+    if (key == "csv")
+    {
+        config->csv_file = value;
+        return true;
+    }
+    if (key == "perf")
+    {
+        return parse_bool(key, value, &config->perf_counters, error);
+    }
+    if (key == "perf-kernels")
+    {
+        if (!parse_bool(key, value, &config->perf_kernels, error))
+        {
+            return false;
+        }
+        config->perf_counters = config->perf_counters || config->perf_kernels;
+        return true;
+    }
+    if (key == "help")
+    {
+        return parse_bool(key, value, &config->show_help, error);
+    }
+
+    *error = "unknown option '" + key + "'";
+    return false;
+}
+
+static std::string trim(const std::string &text)
+{
+    const char *whitespace = " \t\r\n";
+    size_t first = text.find_first_not_of(whitespace);
+    if (first == std::string::npos)
+    {
+        return "";
+    }
+    size_t last = text.find_last_not_of(whitespace);
+    return text.substr(first, last - first + 1);
+}
+
+bool load_config_file(RenderConfig *config, const std::string &file_name, std::string *error)
+{
+    std::ifstream file(file_name);
+    if (!file.is_open())
+    {
+        *error = "cannot open config file '" + file_name + "'";
+        return false;
+    }
+
+    std::string line;
+    uint32_t line_number = 0;
+    while (std::getline(file, line))
+    {
+        ++line_number;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+        {
+            continue;
+        }
+
+        size_t separator = line.find('=');
+        std::string key = trim(line.substr(0, separator));
+        std::string value = (separator == std::string::npos) ? "" : trim(line.substr(separator + 1));
+        if ((separator == std::string::npos) && !is_flag(key))
+        {
+            *error = file_name + ":" + std::to_string(line_number) + ": expected 'key = value'";
+            return false;
+        }
+        if (!apply_config_option(config, key, value, error))
+        {
+            *error = file_name + ":" + std::to_string(line_number) + ": " + *error;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool parse_command_line(RenderConfig *config, int argc, char **argv, std::string *error)
+{
+    for (int arg_index = 1; arg_index < argc; ++arg_index)
+    {
+        std::string arg = argv[arg_index];
+        if ((arg.size() < 3) || (arg.compare(0, 2, "--") != 0))
+        {
+            *error = "unexpected argument '" + arg + "'";
+            return false;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value;
+        size_t separator = key.find('=');
+        if (separator != std::string::npos)
+        {
+            value = key.substr(separator + 1);
+            key = key.substr(0, separator);
+        }
+        if (!is_flag(key) && !is_value_option(key))
+        {
+            *error = "unknown option '" + key + "'";
+            return false;
+        }
+        if ((separator == std::string::npos) && !is_flag(key))
+        {
+            if (arg_index + 1 >= argc)
+            {
+                *error = "missing value for " + arg;
+                return false;
+            }
+            value = argv[++arg_index];
+        }
+
+        bool applied = (key == "config") ? load_config_file(config, value, error)
+                                         : apply_config_option(config, key, value, error);
+        if (!applied)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool validate_config(const RenderConfig &config, std::string *error)
+{
+    if ((config.image_width == 0) || (config.image_height == 0))
+    {
+        *error = "image size must be non-zero";
+        return false;
+    }
+    if ((config.rays_per_pixel == 0) || (config.max_bounce_count == 0))
+    {
+        *error = "spp and bounces must be at least 1";
+        return false;
+    }
+    if ((config.tile_width == 0) || (config.tile_height == 0))
+    {
+        *error = "tile size must be non-zero";
+        return false;
+    }
+    // tiles are counted, and their edges found, in 32 bits
+    const uint64_t tiles_across = (static_cast<uint64_t>(config.image_width) + config.tile_width - 1) / config.tile_width;
+    const uint64_t tiles_up = (static_cast<uint64_t>(config.image_height) + config.tile_height - 1) / config.tile_height;
+    if ((tiles_across * config.tile_width > UINT32_MAX) || (tiles_up * config.tile_height > UINT32_MAX) ||
+        (tiles_across * tiles_up > UINT32_MAX))
+    {
+        *error = "the image needs more than " + std::to_string(UINT32_MAX) + " tiles, or tiles reaching past " +
+                 std::to_string(UINT32_MAX) + " pixels";
+        return false;
+    }
+    // only a plain render to a tiled TIFF never holds the image in memory; the benchmarks
+    // render theirs into bitmaps whatever the output file is
+    const bool held_in_memory = !has_tiled_image_extension(config.output_file) || config.sweep || config.scaling ||
+                                config.scene_scaling || config.bvh_builders || config.compare_accelerators;
+    if (held_in_memory && (static_cast<uint64_t>(config.image_width) * config.image_height > MAX_IMAGE_PIXELS))
+    {
+        *error = "image size must be at most " + std::to_string(MAX_IMAGE_PIXELS) +
+                 " pixels unless it is rendered to a tiled .tif";
+        return false;
+    }
+    if (config.primitive_count > MAX_GENERATED_SPHERES)
+    {
+        *error = "at most " + std::to_string(MAX_GENERATED_SPHERES) + " generated primitives";
+        return false;
+    }
+    for (uint32_t count : config.scene_counts)
+    {
+        if (count > MAX_GENERATED_SPHERES)
+        {
+            *error = "at most " + std::to_string(MAX_GENERATED_SPHERES) + " generated primitives";
+            return false;
+        }
+    }
+    if (!(config.rebuild_threshold >= 1.0f))
+    {
+        *error = "rebuild-threshold must be at least 1";
+        return false;
+    }
+    if (config.map_output && config.frame_count)
+    {
+        *error = "map-output maps a single image; it cannot be used with frames";
+        return false;
+    }
+    if (!config.hdr_output_file.empty() && config.frame_count)
+    {
+        *error = "hdr-output writes a single image; it cannot be used with frames";
+        return false;
+    }
+    if (has_tiled_image_extension(config.output_file))
+    {
+        if ((config.tile_width % TIFF_TILE_MULTIPLE) || (config.tile_height % TIFF_TILE_MULTIPLE))
+        {
+            *error = "tiled output needs tile sizes that are multiples of " + std::to_string(TIFF_TILE_MULTIPLE);
+            return false;
+        }
+        if (config.map_output || config.frame_count || config.gbuffer_size || !config.hdr_output_file.empty())
+        {
+            *error = "tiled output cannot be combined with map-output, frames, gbuffer or hdr-output";
+            return false;
+        }
+    }
+    if (config.gbuffer_size > MAX_GBUFFER_SIZE)
+    {
+        *error = "gbuffer must be at most " + std::to_string(MAX_GBUFFER_SIZE) + " subpixels across";
+        return false;
+    }
+    if (config.benchmark_repeats == 0)
+    {
+        *error = "repeat must be at least 1";
+        return false;
+    }
+    for (auto *list : {&config.sweep_tiles, &config.sweep_rays_per_pixel})
+    {
+        if (std::find(list->begin(), list->end(), 0u) != list->end())
+        {
+            *error = "sweep tile sizes and spp must be non-zero";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint32_t resolve_thread_count(uint32_t thread_count)
+{
+    if (thread_count == DEFAULT_THREAD_COUNT)
+    {
+        thread_count = std::thread::hardware_concurrency();
+    }
+    return std::max(thread_count, 1u);
+}
+
+void print_usage(const char *program_name)
+{
+    std::cout << "usage: " << program_name << " [options]\n"
+              << "  --config FILE        load options from FILE ('key = value' per line)\n"
+              << "  --width N            image width (default " << DEFAULT_IMAGE_WIDTH << ")\n"
+              << "  --height N           image height (default " << DEFAULT_IMAGE_HEIGHT << ")\n"
+              << "  --spp N              rays per pixel (default " << DEFAULT_RAYS_PER_PIXEL << ")\n"
+              << "  --bounces N          maximum bounces per ray (default " << DEFAULT_MAX_BOUNCE_COUNT << ")\n"
+              << "  --tile WxH           tile size, or N for square tiles (default " << DEFAULT_TILE_SIZE << ")\n"
+              << "  --threads N          worker threads, 0 for one per hardware thread (default)\n"
+              << "  --output FILE        output bitmap (default test.bmp); FILE ending in .tif or .tiff is a\n"
+              << "                       tiled TIFF written tile by tile, for images too large to hold\n"
+              << "  --map-output         render straight into a memory mapping of the output file\n"
+              << "  --hdr-output FILE    also write the linear colors, unclamped, to FILE: a float map if it\n"
+              << "                       ends in .pfm, an OpenEXR file if it ends in .exr\n"
+              << "  --exr-compression C  zip (default) or none\n"
+              << "  --perf               report hardware performance counters\n"
+              << "  --perf-kernels       also split counters between intersection and shading\n"
+              << "  --help               show this message\n"
+              << "  --scene FILE         render the scene in FILE (text or binary) instead of the default one\n"
+              << "  --write-scene FILE   save the scene that would be rendered and exit; binary if FILE\n"
+              << "                       ends in .rtscene, text otherwise\n"
+              << "  --generate LAYOUT    render a procedural sphere field: random, clustered, grid, or\n"
+              << "                       instanced, one berry cluster placed N/5 times\n"
+              << "  --primitives N       spheres in the generated field (default 1000, at most 10^7)\n"
+              << "  --seed N             generator seed; the same seed gives the same scene (default 1)\n"
+              << "  --accel NAME         spatial index over the spheres: bvh (default), none, or bvh8,\n"
+              << "                       8 children per node, fastest with RAYTRACER_AVX2, or grid, a\n"
+              << "                       uniform grid for many similar spheres\n"
+              << "  --bvh-builder NAME   sah (default): slower build, faster rays; median: quick build;\n"
+              << "                       lbvh: fastest parallel build, for scenes that change every frame\n"
+              << "  --bvh-cache FILE     reuse the BVH stored in FILE while the spheres are unchanged,\n"
+              << "                       rebuild and store it otherwise\n"
+              << "  --frames N           render N frames of the scene drifting apart to OUTPUT_0000.bmp and\n"
+              << "                       on, refitting the BVH between frames instead of rebuilding it\n"
+              << "  --rebuild-threshold X  rebuild a refitted BVH once its SAH cost reaches X times its cost\n"
+              << "                       when built (default 1.5)\n"
+              << "  --sort-rays          trace tiles a bounce at a time, sorting secondary rays by origin and\n"
+              << "                       direction first, and report how much more alike neighbouring rays got\n"
+              << "  --gbuffer N          find the first hits of N x N fixed subpixels per pixel once, by\n"
+              << "                       rasterizing spheres and planes, and start every sample from one of\n"
+              << "                       them (default 0: jittered samples, each traced from the camera)\n"
+              << "benchmarks:\n"
+              << "  --sweep              render every threads x tile x spp combination and report throughput\n"
+              << "  --sweep-threads LIST thread counts, e.g. 1,2,4,8 (default: powers of two up to the core count)\n"
+              << "  --sweep-tiles LIST   square tile sizes (default 16,32,64,128)\n"
+              << "  --sweep-spp LIST     rays per pixel (default: --spp)\n"
+              << "  --scaling            speedup, efficiency and idle time for 1..N threads (or --sweep-threads)\n"
+              << "  --json FILE          write --scaling results as JSON, usable as a later --baseline\n"
+              << "  --baseline FILE      compare --scaling results against an earlier --json run\n"
+              << "  --scene-scaling      build time, memory and throughput of generated scenes as they grow\n"
+              << "  --scene-counts LIST  sphere counts for --scene-scaling, --accelerators and --occlusion\n"
+              << "                       (default 10,100,1000,10000)\n"
+              << "  --bvh-builders       build time, SAH cost and throughput of each BVH builder on the scene\n"
+              << "  --accelerators       build time, memory and throughput of bvh, bvh8 and grid on each\n"
+              << "                       generated layout at --scene-counts sizes\n"
+              << "  --occlusion          closest-hit against any-hit throughput of --width x --height x --spp\n"
+              << "                       shadow rays, on the same scenes and accelerators as --accelerators\n"
+              << "  --repeat N           keep the fastest of N runs per data point (default 1)\n"
+              << "  --csv FILE           also write benchmark results as CSV\n";
+}
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include "../include/Deflate.h"
+
+constexpr uint32_t DEFLATE_WINDOW = 32768;
+constexpr uint32_t DEFLATE_MIN_MATCH = 3;
+constexpr uint32_t DEFLATE_MAX_MATCH = 258;
+constexpr uint32_t DEFLATE_HASH_BITS = 15;
+// candidates tried per position; longer chains buy little on image data
+constexpr uint32_t DEFLATE_MAX_CHAIN = 32;
+constexpr uint32_t DEFLATE_END_OF_BLOCK = 256;
+
+// RFC 1951 3.2.5: the lengths and distances each code starts at, and its extra bits
+static const uint16_t LENGTH_BASE[29] = { 3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                          31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA_BITS[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                               2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DISTANCE_BASE[30] = { 1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                            33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                            1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DISTANCE_EXTRA_BITS[30] = { 0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                                 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// deflate packs bits from the least significant end of each byte
+struct BitWriter
+{
+    std::vector<uint8_t> *bytes;
+    uint64_t bits;
+    uint32_t bit_count;
+
+    void put(uint32_t value, uint32_t count)
+    {
+        bits |= static_cast<uint64_t>(value) << bit_count;
+        bit_count += count;
+        while (bit_count >= 8)
+        {
+            bytes->push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    // Huffman codes go most significant bit first
+    void put_code(uint32_t code, uint32_t length)
+    {
+        uint32_t reversed = 0;
+        for (uint32_t bit = 0; bit < length; ++bit)
+        {
+            reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+        }
+        put(reversed, length);
+    }
+
+    void flush()
+    {
+        if (bit_count)
+        {
+            put(0, 8 - bit_count);
+        }
+    }
+};
+
+// the fixed literal/length code of RFC 1951 3.2.6
+static void put_fixed_symbol(BitWriter *writer, uint32_t symbol)
+{
+    if (symbol < 144)
+    {
+        writer->put_code(0x30 + symbol, 8);
+    }
+    else if (symbol < 256)
+    {
+        writer->put_code(0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280)
+    {
+        writer->put_code(symbol - 256, 7);
+    }
+    else
+    {
+        writer->put_code(0xc0 + symbol - 280, 8);
+    }
+}
+
+static void put_match(BitWriter *writer, uint32_t length, uint32_t distance)
+{
+    uint32_t length_code = static_cast<uint32_t>(std::upper_bound(LENGTH_BASE, LENGTH_BASE + 29, length) - LENGTH_BASE) - 1;
+    put_fixed_symbol(writer, 257 + length_code);
+    writer->put(length - LENGTH_BASE[length_code], LENGTH_EXTRA_BITS[length_code]);
+
+    uint32_t distance_code =
+        static_cast<uint32_t>(std::upper_bound(DISTANCE_BASE, DISTANCE_BASE + 30, distance) - DISTANCE_BASE) - 1;
+    writer->put_code(distance_code, 5);
+    writer->put(distance - DISTANCE_BASE[distance_code], DISTANCE_EXTRA_BITS[distance_code]);
+}
+
+static inline uint32_t hash_three_bytes(const uint8_t *bytes)
+{
+    uint32_t value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+    return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+uint32_t adler32(const uint8_t *data, size_t size)
+{
+    // 5552 bytes is the most that can be summed before the sums overflow 32 bits
+    uint32_t a = 1;
+    uint32_t b = 0;
+    while (size)
+    {
+        size_t run = std::min(size, static_cast<size_t>(5552));
+        size -= run;
+        while (run--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+void zlib_compress(const uint8_t *data, size_t size, std::vector<uint8_t> *compressed)
+{
+    // deflate with a 32 KiB window, no preset dictionary
+    compressed->push_back(0x78);
+    compressed->push_back(0x01);
+
+    BitWriter writer = { compressed, 0, 0 };
+    writer.put(1, 1);  // the final block
+    writer.put(1, 2);  // fixed Huffman codes
+
+    // the most recent position with each hash, and for each position the one before it
+    std::vector<int32_t> head(1u << DEFLATE_HASH_BITS, -1);
+    std::vector<int32_t> previous(DEFLATE_WINDOW, -1);
+    auto insert = [&](size_t position)
+    {
+        if (position + DEFLATE_MIN_MATCH <= size)
+        {
+            uint32_t hash = hash_three_bytes(data + position);
+            previous[position % DEFLATE_WINDOW] = head[hash];
+            head[hash] = static_cast<int32_t>(position);
+        }
+    };
+
+    size_t position = 0;
+    while (position < size)
+    {
+        uint32_t best_length = 0;
+        uint32_t best_distance = 0;
+        if (position + DEFLATE_MIN_MATCH <= size)
+        {
+            const uint32_t max_length = static_cast<uint32_t>(std::min(size - position, static_cast<size_t>(DEFLATE_MAX_MATCH)));
+            int32_t candidate = head[hash_three_bytes(data + position)];
+            for (uint32_t chain = 0; (chain < DEFLATE_MAX_CHAIN) && (candidate >= 0) &&
+                                     (position - static_cast<size_t>(candidate) <= DEFLATE_WINDOW); ++chain)
+            {
+                const uint8_t *match = data + candidate;
+                // a longer match has to agree one past the best so far
+                if (match[best_length] == data[position + best_length])
+                {
+                    uint32_t length = 0;
+                    while ((length < max_length) && (match[length] == data[position + length]))
+                    {
+                        ++length;
+                    }
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        best_distance = static_cast<uint32_t>(position - static_cast<size_t>(candidate));
+                        if (length == max_length)
+                        {
+                            break;
+                        }
+                    }
+                }
+                candidate = previous[static_cast<size_t>(candidate) % DEFLATE_WINDOW];
+            }
+        }
+
+        if (best_length >= DEFLATE_MIN_MATCH)
+        {
+            put_match(&writer, best_length, best_distance);
+            for (uint32_t offset = 0; offset < best_length; ++offset)
+            {
+                insert(position + offset);
+            }
+            position += best_length;
+        }
+        else
+        {
+            put_fixed_symbol(&writer, data[position]);
+            insert(position);
+            ++position;
+        }
+    }
+    put_fixed_symbol(&writer, DEFLATE_END_OF_BLOCK);
+    writer.flush();
+
+    uint32_t checksum = adler32(data, size);
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        compressed->push_back(static_cast<uint8_t>(checksum >> shift));
+    }
+}
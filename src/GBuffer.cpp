@@ -0,0 +1,58 @@
+#include "../include/GBuffer.h"
+
+// Film offsets, in view units, of the tangents to a circle at (across, depth) of the given
+// radius in a plane through the camera: the extremes of across / depth over the circle,
+// scaled from the film distance to the view extent.  The circle must lie ahead of the camera.
+static void tangent_offsets(float across, float depth, float radius, float film_scale, float *low, float *high)
+{
+    float spread = radius * Math::square_root(across * across + depth * depth - radius * radius);
+    float denominator = depth * depth - radius * radius;
+    *low = film_scale * (across * depth - spread) / denominator;
+    *high = film_scale * (across * depth + spread) / denominator;
+}
+
+// pixels along one axis whose jittered rays reach offsets [low, high]; false when none do
+static bool offset_pixel_range(float low, float high, float half_pixel, uint32_t pixel_count, uint32_t *first,
+                               uint32_t *one_past_last)
+{
+    // pixel p is centered on -1 + 2p / count; one pixel of slack each way for rounding
+    const float count = static_cast<float>(pixel_count);
+    float first_pixel = std::floor((low - half_pixel + 1.0f) * 0.5f * count) - 1.0f;
+    float last_pixel = std::ceil((high + half_pixel + 1.0f) * 0.5f * count) + 1.0f;
+    if (!(last_pixel >= 0.0f) || !(first_pixel <= count - 1.0f))
+    {
+        return false;
+    }
+    *first = static_cast<uint32_t>(std::max(first_pixel, 0.0f));
+    *one_past_last = static_cast<uint32_t>(std::min(last_pixel, count - 1.0f)) + 1;
+    return true;
+}
+
+PixelRect sphere_pixel_rect(const CastState &camera, uint32_t image_width, uint32_t image_height,
+                            const Sphere &sphere)
+{
+    const PixelRect whole_image = { 0, 0, image_width, image_height };
+    Vector::Vector3 offset = sphere.position - camera.camera_position;
+    float across = Math::inner_product(offset, camera.camera_x_axis);
+    float up = Math::inner_product(offset, camera.camera_y_axis);
+    float depth = -Math::inner_product(offset, camera.camera_z_axis);
+    float radius = std::fabs(sphere.radius);
+    // with the sphere touching the camera plane its silhouette has no bounds on the film
+    if (depth <= radius * 1.001f + 1.0e-6f)
+    {
+        return whole_image;
+    }
+
+    float film_distance = -Math::inner_product(camera.view_center - camera.camera_position, camera.camera_z_axis);
+    float x_low, x_high, y_low, y_high;
+    tangent_offsets(across, depth, radius, film_distance / (0.5f * camera.view_width), &x_low, &x_high);
+    tangent_offsets(up, depth, radius, film_distance / (0.5f * camera.view_height), &y_low, &y_high);
+
+    PixelRect rect = {};
+    if (!offset_pixel_range(x_low, x_high, camera.half_pixel_width, image_width, &rect.x_min, &rect.one_past_x_max) ||
+        !offset_pixel_range(y_low, y_high, camera.half_pixel_height, image_height, &rect.y_min, &rect.one_past_y_max))
+    {
+        return PixelRect {};
+    }
+    return rect;
+}
@@ -0,0 +1,202 @@
+#include <cmath>
+#include "../include/Grid.h"
+#include "../include/Parallel.h"
+
+// Resolution proportional to each axis' extent, so cells come out roughly cubic.  An axis
+// too thin for even one cell at that density gets one, and the others share its cells.
+static void choose_resolution(const Vector::Vector3 &extent, uint32_t count, uint32_t *resolution)
+{
+    float target_cells = GRID_CELLS_PER_PRIMITIVE * static_cast<float>(count);
+    bool fixed[3] = { false, false, false };
+    for (uint32_t pass = 0; pass < 3; ++pass)
+    {
+        float free_volume = 1.0f;
+        float free_axes = 0.0f;
+        float fixed_cells = 1.0f;
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            if (fixed[axis])
+            {
+                fixed_cells *= static_cast<float>(resolution[axis]);
+            }
+            else
+            {
+                free_volume *= vector_axis(extent, axis);
+                free_axes += 1.0f;
+            }
+        }
+        if (free_axes == 0.0f)
+        {
+            break;
+        }
+
+        // cells per unit length along the free axes
+        float density = (free_volume > 0.0f) ? std::pow(target_cells / fixed_cells / free_volume, 1.0f / free_axes) : 0.0f;
+        bool changed = false;
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            float cells = vector_axis(extent, axis) * density;
+            if (!fixed[axis] && !(cells >= 1.0f))
+            {
+                fixed[axis] = true;
+                resolution[axis] = 1;
+                changed = true;
+            }
+            else if (!fixed[axis])
+            {
+                resolution[axis] = static_cast<uint32_t>(std::min(std::ceil(cells), static_cast<float>(GRID_MAX_RESOLUTION)));
+            }
+        }
+        if (!changed)
+        {
+            break;
+        }
+    }
+}
+
+static void set_cell_size(const Vector::Vector3 &extent, Grid *grid)
+{
+    float cell_sizes[3];
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        // a flat axis still needs a non-zero cell for the traversal's steps
+        cell_sizes[axis] = std::max(vector_axis(extent, axis) / static_cast<float>(grid->resolution[axis]), FLT_MIN);
+    }
+    grid->cell_size = Vector::Vector3 { cell_sizes[0], cell_sizes[1], cell_sizes[2] };
+    grid->inverse_cell_size = Vector::Vector3 { 1.0f / cell_sizes[0], 1.0f / cell_sizes[1], 1.0f / cell_sizes[2] };
+}
+
+// how many cells the primitive's box overlaps
+static uint64_t cells_overlapped(const Grid &grid, const Aabb &box)
+{
+    uint64_t cells = 1;
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        cells *= grid_cell(grid, axis, vector_axis(box.max, axis)) - grid_cell(grid, axis, vector_axis(box.min, axis)) + 1;
+    }
+    return cells;
+}
+
+void build_grid(const Aabb *primitive_bounds, uint32_t count, uint32_t thread_count, Grid *grid,
+                uint64_t max_references)
+{
+    *grid = {};
+    if (count == 0)
+    {
+        return;
+    }
+
+    std::vector<Aabb> chunk_bounds(std::max(thread_count, 1u), empty_aabb());
+    parallel_chunks(count, thread_count, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            grow_aabb(&chunk_bounds[chunk], primitive_bounds[index]);
+        }
+    });
+    grid->bounds = empty_aabb();
+    for (const auto &bounds : chunk_bounds)
+    {
+        grow_aabb(&grid->bounds, bounds);
+    }
+
+    Vector::Vector3 extent = grid->bounds.max - grid->bounds.min;
+    choose_resolution(extent, count, grid->resolution);
+    set_cell_size(extent, grid);
+
+    // large primitives over fine cells can be listed more often than cell_starts can count;
+    // a single cell lists every primitive once, so halving ends within the limit
+    std::vector<uint64_t> chunk_references(std::max(thread_count, 1u));
+    for (;;)
+    {
+        std::fill(chunk_references.begin(), chunk_references.end(), 0);
+        parallel_chunks(count, thread_count, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+        {
+            for (uint32_t index = begin; index < end; ++index)
+            {
+                chunk_references[chunk] += cells_overlapped(*grid, primitive_bounds[index]);
+            }
+        });
+        uint64_t references = 0;
+        for (uint64_t chunk_total : chunk_references)
+        {
+            references += chunk_total;
+        }
+        uint32_t *resolution = grid->resolution;
+        if ((references <= max_references) || (resolution[0] * resolution[1] * resolution[2] == 1))
+        {
+            break;
+        }
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            resolution[axis] = std::max(resolution[axis] / 2, 1u);
+        }
+        set_cell_size(extent, grid);
+    }
+
+    const uint32_t *resolution = grid->resolution;
+    uint32_t cell_count = resolution[0] * resolution[1] * resolution[2];
+    auto for_each_cell = [grid, resolution](const Aabb &box, auto function)
+    {
+        uint32_t lower[3], upper[3];
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            lower[axis] = grid_cell(*grid, axis, vector_axis(box.min, axis));
+            upper[axis] = grid_cell(*grid, axis, vector_axis(box.max, axis));
+        }
+        for (uint32_t z = lower[2]; z <= upper[2]; ++z)
+        {
+            for (uint32_t y = lower[1]; y <= upper[1]; ++y)
+            {
+                for (uint32_t x = lower[0]; x <= upper[0]; ++x)
+                {
+                    function((z * resolution[1] + y) * resolution[0] + x);
+                }
+            }
+        }
+    };
+
+    // count, then an exclusive prefix sum turns counts into starts, then every primitive
+    // claims its slot in each of its cells
+    std::vector<uint32_t> cell_starts(static_cast<size_t>(cell_count) + 1, 0);
+    uint32_t *starts = cell_starts.data();
+    parallel_chunks(count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            for_each_cell(primitive_bounds[index], [starts](uint32_t cell) { __sync_fetch_and_add(&starts[cell], 1); });
+        }
+    });
+    uint64_t total = 0;
+    for (uint32_t cell = 0; cell <= cell_count; ++cell)
+    {
+        uint32_t cell_size = cell_starts[cell];
+        cell_starts[cell] = static_cast<uint32_t>(total);
+        total += cell_size;
+    }
+
+    std::vector<uint32_t> cursors(cell_starts.begin(), cell_starts.end() - 1);
+    std::vector<uint32_t> primitive_indices(total);
+    uint32_t *cell_cursors = cursors.data();
+    uint32_t *indices = primitive_indices.data();
+    parallel_chunks(count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            for_each_cell(primitive_bounds[index], [cell_cursors, indices, index](uint32_t cell)
+            {
+                indices[__sync_fetch_and_add(&cell_cursors[cell], 1)] = index;
+            });
+        }
+    });
+    parallel_chunks(cell_count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t cell = begin; cell < end; ++cell)
+        {
+            std::sort(indices + starts[cell], indices + starts[cell + 1]);
+        }
+    });
+
+    grid->cell_starts = std::move(cell_starts);
+    grid->primitive_indices = std::move(primitive_indices);
+}
@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include "../include/Deflate.h"
+#include "../include/HdrImage.h"
+#include "../include/Parallel.h"
+
+constexpr uint32_t EXR_MAGIC = 20000630;
+constexpr uint32_t EXR_VERSION = 2;
+constexpr uint32_t EXR_PIXEL_TYPE_FLOAT = 2;
+constexpr uint8_t EXR_NO_COMPRESSION = 0;
+constexpr uint8_t EXR_ZIP_COMPRESSION = 3;
+// the channels in the order EXR stores them, alphabetical
+static const char EXR_CHANNEL_NAMES[3] = { 'B', 'G', 'R' };
+
+static bool has_extension(const std::string &file_name, const char *extension)
+{
+    size_t extension_length = strlen(extension);
+    return (file_name.size() > extension_length) &&
+           (file_name.compare(file_name.size() - extension_length, extension_length, extension) == 0);
+}
+
+bool has_hdr_image_extension(const std::string &file_name)
+{
+    return has_extension(file_name, ".pfm") || has_extension(file_name, ".exr");
+}
+
+bool parse_exr_compression(const std::string &name, ExrCompression *compression)
+{
+    if (name == "none")
+    {
+        *compression = ExrCompression::None;
+    }
+    else if (name == "zip")
+    {
+        *compression = ExrCompression::Zip;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+static bool finish_file(std::ofstream &file, const std::string &file_name, std::string *error)
+{
+    file.close();
+    if (!file)
+    {
+        *error = "cannot write '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool write_pfm(const std::string &file_name, uint32_t width, uint32_t height, const Vector::Vector3 *colors,
+               std::string *error)
+{
+    std::ofstream file(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        *error = "cannot create '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+    // a negative scale marks the floats little endian
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+    std::vector<float> row(static_cast<size_t>(width) * 3);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const Vector::Vector3 *pixels = colors + static_cast<size_t>(y) * width;
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            row[3 * x] = pixels[x].x;
+            row[3 * x + 1] = pixels[x].y;
+            row[3 * x + 2] = pixels[x].z;
+        }
+        file.write(reinterpret_cast<const char *>(row.data()), row.size() * sizeof(float));
+    }
+    return finish_file(file, file_name, error);
+}
+
+static void put_bytes(std::vector<uint8_t> *bytes, const void *data, size_t size)
+{
+    const uint8_t *first = static_cast<const uint8_t *>(data);
+    bytes->insert(bytes->end(), first, first + size);
+}
+
+template <typename Value>
+static void put_value(std::vector<uint8_t> *bytes, Value value)
+{
+    put_bytes(bytes, &value, sizeof(value));
+}
+
+static void put_attribute(std::vector<uint8_t> *header, const char *name, const char *type,
+                          const std::vector<uint8_t> &value)
+{
+    put_bytes(header, name, strlen(name) + 1);
+    put_bytes(header, type, strlen(type) + 1);
+    put_value(header, static_cast<int32_t>(value.size()));
+    put_bytes(header, value.data(), value.size());
+}
+
+static std::vector<uint8_t> exr_box(uint32_t width, uint32_t height)
+{
+    std::vector<uint8_t> box;
+    put_value(&box, 0);
+    put_value(&box, 0);
+    put_value(&box, static_cast<int32_t>(width) - 1);
+    put_value(&box, static_cast<int32_t>(height) - 1);
+    return box;
+}
+
+// The block's scanlines, each its B, G then R values pixel by pixel.  EXR numbers
+// scanlines from the top, the renderer from the bottom.
+static void pack_exr_block(uint32_t width, uint32_t height, const Vector::Vector3 *colors, uint32_t first_line,
+                           uint32_t line_count, std::vector<uint8_t> *data)
+{
+    data->resize(static_cast<size_t>(line_count) * width * 3 * sizeof(float));
+    float *values = reinterpret_cast<float *>(data->data());
+    for (uint32_t line = first_line; line < first_line + line_count; ++line)
+    {
+        const Vector::Vector3 *pixels = colors + static_cast<size_t>(height - 1 - line) * width;
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            values[x] = pixels[x].z;
+            values[width + x] = pixels[x].y;
+            values[2 * width + x] = pixels[x].x;
+        }
+        values += 3 * width;
+    }
+}
+
+// ZIP compression deflates the bytes after splitting them into even and odd halves and
+// replacing each with its difference to the one before, so the slowly changing high
+// bytes of neighbouring floats turn into runs of 128
+static void zip_exr_block(const std::vector<uint8_t> &data, std::vector<uint8_t> *scratch, std::vector<uint8_t> *block)
+{
+    const size_t size = data.size();
+    scratch->resize(size);
+    uint8_t *even = scratch->data();
+    uint8_t *odd = scratch->data() + (size + 1) / 2;
+    for (size_t index = 0; index < size; ++index)
+    {
+        if (index & 1)
+        {
+            *odd++ = data[index];
+        }
+        else
+        {
+            *even++ = data[index];
+        }
+    }
+    uint8_t previous = size ? (*scratch)[0] : 0;
+    for (size_t index = 1; index < size; ++index)
+    {
+        uint8_t current = (*scratch)[index];
+        (*scratch)[index] = static_cast<uint8_t>(current - previous + 128);
+        previous = current;
+    }
+
+    block->clear();
+    zlib_compress(scratch->data(), size, block);
+    // readers take a block of the uncompressed size as stored
+    if (block->size() >= size)
+    {
+        *block = data;
+    }
+}
+
+bool write_exr(const std::string &file_name, uint32_t width, uint32_t height, const Vector::Vector3 *colors,
+               ExrCompression compression, uint32_t thread_count, std::string *error)
+{
+    const uint32_t block_lines = (compression == ExrCompression::Zip) ? EXR_ZIP_SCANLINES : 1;
+    const uint32_t block_count = (height + block_lines - 1) / block_lines;
+
+    std::vector<std::vector<uint8_t>> blocks(block_count);
+    parallel_chunks(block_count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> scratch;
+        for (uint32_t block = begin; block < end; ++block)
+        {
+            uint32_t first_line = block * block_lines;
+            uint32_t line_count = std::min(block_lines, height - first_line);
+            if (compression == ExrCompression::Zip)
+            {
+                pack_exr_block(width, height, colors, first_line, line_count, &data);
+                zip_exr_block(data, &scratch, &blocks[block]);
+            }
+            else
+            {
+                pack_exr_block(width, height, colors, first_line, line_count, &blocks[block]);
+            }
+        }
+    });
+
+    std::vector<uint8_t> header;
+    put_value(&header, EXR_MAGIC);
+    put_value(&header, EXR_VERSION);
+    std::vector<uint8_t> channels;
+    for (char name : EXR_CHANNEL_NAMES)
+    {
+        put_value(&channels, name);
+        put_value(&channels, '\0');
+        put_value(&channels, EXR_PIXEL_TYPE_FLOAT);
+        put_value(&channels, 0u);  // not perceptually linear, then three reserved bytes
+        put_value(&channels, 1);   // x sampling
+        put_value(&channels, 1);   // y sampling
+    }
+    put_value(&channels, '\0');
+    put_attribute(&header, "channels", "chlist", channels);
+    put_attribute(&header, "compression", "compression",
+                  { (compression == ExrCompression::Zip) ? EXR_ZIP_COMPRESSION : EXR_NO_COMPRESSION });
+    put_attribute(&header, "dataWindow", "box2i", exr_box(width, height));
+    put_attribute(&header, "displayWindow", "box2i", exr_box(width, height));
+    put_attribute(&header, "lineOrder", "lineOrder", { 0 });  // increasing y
+    std::vector<uint8_t> one;
+    put_value(&one, 1.0f);
+    put_attribute(&header, "pixelAspectRatio", "float", one);
+    put_attribute(&header, "screenWindowCenter", "v2f", std::vector<uint8_t>(2 * sizeof(float), 0));
+    put_attribute(&header, "screenWindowWidth", "float", one);
+    header.push_back(0);
+
+    // the offset table, then every block behind its first scanline and size
+    uint64_t offset = header.size() + static_cast<uint64_t>(block_count) * sizeof(uint64_t);
+    for (const auto &block : blocks)
+    {
+        put_value(&header, offset);
+        offset += 2 * sizeof(int32_t) + block.size();
+    }
+
+    std::ofstream file(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        *error = "cannot create '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    for (uint32_t block = 0; block < block_count; ++block)
+    {
+        int32_t block_head[2] = { static_cast<int32_t>(block * block_lines), static_cast<int32_t>(blocks[block].size()) };
+        file.write(reinterpret_cast<const char *>(block_head), sizeof(block_head));
+        file.write(reinterpret_cast<const char *>(blocks[block].data()), blocks[block].size());
+    }
+    return finish_file(file, file_name, error);
+}
+
+bool write_hdr_image(const std::string &file_name, uint32_t width, uint32_t height, const Vector::Vector3 *colors,
+                     ExrCompression compression, uint32_t thread_count, std::string *error)
+{
+    if (has_extension(file_name, ".pfm"))
+    {
+        return write_pfm(file_name, width, height, colors, error);
+    }
+    return write_exr(file_name, width, height, colors, compression, thread_count, error);
+}
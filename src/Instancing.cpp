@@ -0,0 +1,117 @@
+#include "../include/Instancing.h"
+
+bool add_instance(Scene *scene, uint32_t object, const Transform &object_to_world)
+{
+    Instance instance = {};
+    instance.object_to_world = object_to_world;
+    instance.object = object;
+    if ((object >= scene->objects.size()) || scene->objects[object].spheres.empty() ||
+        !invert_transform(object_to_world, &instance.world_to_object))
+    {
+        return false;
+    }
+    scene->instances.push_back(instance);
+    return true;
+}
+
+uint64_t instanced_sphere_count(const Scene &scene)
+{
+    uint64_t count = 0;
+    for (const auto &instance : scene.instances)
+    {
+        count += scene.objects[instance.object].spheres.size();
+    }
+    return count;
+}
+
+static Aabb object_bounds(const SceneObject &object)
+{
+    if (!object.bvh.nodes.empty())
+    {
+        return object.bvh.nodes[0].bounds;
+    }
+    Aabb bounds = empty_aabb();
+    for (const auto &sphere : object.spheres)
+    {
+        grow_aabb(&bounds, sphere_bounds(sphere));
+    }
+    return bounds;
+}
+
+void build_object_bvhs(Scene *scene, BvhBuilder builder, uint32_t thread_count)
+{
+    std::vector<Aabb> bounds;
+    for (auto &object : scene->objects)
+    {
+        bounds.resize(object.spheres.size());
+        for (size_t sphere_index = 0; sphere_index < bounds.size(); ++sphere_index)
+        {
+            bounds[sphere_index] = sphere_bounds(object.spheres[sphere_index]);
+        }
+        build_bvh(builder, bounds.data(), static_cast<uint32_t>(bounds.size()), thread_count, &object.bvh);
+    }
+}
+
+void instance_world_bounds(const Scene &scene, std::vector<Aabb> *bounds)
+{
+    std::vector<Aabb> local_bounds(scene.objects.size());
+    for (size_t object_index = 0; object_index < local_bounds.size(); ++object_index)
+    {
+        local_bounds[object_index] = object_bounds(scene.objects[object_index]);
+    }
+
+    bounds->resize(scene.instances.size());
+    for (size_t instance_index = 0; instance_index < bounds->size(); ++instance_index)
+    {
+        const Instance &instance = scene.instances[instance_index];
+        (*bounds)[instance_index] = transform_aabb(instance.object_to_world, local_bounds[instance.object]);
+    }
+}
+
+void build_instance_bvh(Scene *scene, BvhBuilder builder, uint32_t thread_count)
+{
+    std::vector<Aabb> bounds;
+    instance_world_bounds(*scene, &bounds);
+    build_bvh(builder, bounds.data(), static_cast<uint32_t>(bounds.size()), thread_count, &scene->instance_bvh);
+}
+
+bool flatten_instances(Scene *scene)
+{
+    std::vector<float> scales(scene->instances.size());
+    for (size_t instance_index = 0; instance_index < scales.size(); ++instance_index)
+    {
+        // a similarity has orthogonal columns of one length
+        const Transform &t = scene->instances[instance_index].object_to_world;
+        Vector::Vector3 columns[3];
+        for (uint32_t column = 0; column < 3; ++column)
+        {
+            columns[column] = Vector::Vector3 { t.m[0][column], t.m[1][column], t.m[2][column] };
+        }
+        float length = Math::square_root(Math::inner_product(columns[0], columns[0]));
+        for (uint32_t column = 0; column < 3; ++column)
+        {
+            float tolerance = 1e-4f * length * length;
+            if ((std::fabs(Math::inner_product(columns[column], columns[column]) - length * length) > tolerance) ||
+                (std::fabs(Math::inner_product(columns[column], columns[(column + 1) % 3])) > tolerance))
+            {
+                return false;
+            }
+        }
+        scales[instance_index] = length;
+    }
+
+    scene->spheres.reserve(scene->spheres.size() + instanced_sphere_count(*scene));
+    for (size_t instance_index = 0; instance_index < scales.size(); ++instance_index)
+    {
+        const Instance &instance = scene->instances[instance_index];
+        for (const auto &sphere : scene->objects[instance.object].spheres)
+        {
+            scene->spheres.push_back(Sphere { transform_point(instance.object_to_world, sphere.position),
+                                              sphere.radius * scales[instance_index], sphere.material_name });
+        }
+    }
+    scene->objects.clear();
+    scene->instances.clear();
+    scene->instance_bvh = {};
+    return true;
+}
@@ -0,0 +1,243 @@
+#include "../include/Bvh.h"
+#include "../include/Parallel.h"
+
+// 10 bits per axis, so a key fits 32 bits and sorts in four 8 bit radix passes
+constexpr uint32_t MORTON_BITS_PER_AXIS = 10;
+constexpr uint32_t RADIX_BITS = 8;
+constexpr uint32_t RADIX_BUCKETS = 1u << RADIX_BITS;
+
+static uint32_t morton_code(const Vector::Vector3 &point, const Aabb &centroid_bounds, const Vector::Vector3 &scale)
+{
+    const float cells = static_cast<float>((1u << MORTON_BITS_PER_AXIS) - 1);
+    auto quantize = [cells](float value)
+    {
+        return static_cast<uint32_t>(std::min(std::max(value, 0.0f), cells));
+    };
+    uint32_t x = quantize((point.x - centroid_bounds.min.x) * scale.x);
+    uint32_t y = quantize((point.y - centroid_bounds.min.y) * scale.y);
+    uint32_t z = quantize((point.z - centroid_bounds.min.z) * scale.z);
+    return (expand_morton_bits(x) << 2) | (expand_morton_bits(y) << 1) | expand_morton_bits(z);
+}
+
+// Least significant digit first, so equal codes keep their original (index) order.  Each
+// thread counts the digits in its chunk; prefix sums over (digit, thread) then give every
+// thread its own output range per digit, and the scatter needs no synchronisation.
+// Keys are (morton code << 32) | primitive index.
+static void radix_sort(std::vector<uint64_t> *keys, uint32_t thread_count)
+{
+    auto count = static_cast<uint32_t>(keys->size());
+    thread_count = std::max(1u, std::min(thread_count, count));
+    std::vector<uint64_t> scratch(count);
+    std::vector<uint32_t> histograms(static_cast<size_t>(thread_count) * RADIX_BUCKETS);
+
+    uint64_t *source = keys->data();
+    uint64_t *target = scratch.data();
+    for (uint32_t shift = 32; shift < 64; shift += RADIX_BITS)
+    {
+        parallel_chunks(count, thread_count, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+        {
+            uint32_t *histogram = histograms.data() + chunk * RADIX_BUCKETS;
+            std::fill(histogram, histogram + RADIX_BUCKETS, 0u);
+            for (uint32_t index = begin; index < end; ++index)
+            {
+                histogram[(source[index] >> shift) & (RADIX_BUCKETS - 1)] += 1;
+            }
+        });
+
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RADIX_BUCKETS; ++digit)
+        {
+            for (uint32_t chunk = 0; chunk < thread_count; ++chunk)
+            {
+                uint32_t &bucket = histograms[chunk * RADIX_BUCKETS + digit];
+                uint32_t bucket_count = bucket;
+                bucket = offset;
+                offset += bucket_count;
+            }
+        }
+
+        parallel_chunks(count, thread_count, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+        {
+            uint32_t *offsets = histograms.data() + chunk * RADIX_BUCKETS;
+            for (uint32_t index = begin; index < end; ++index)
+            {
+                target[offsets[(source[index] >> shift) & (RADIX_BUCKETS - 1)]++] = source[index];
+            }
+        });
+        std::swap(source, target);
+    }
+    // an even number of passes leaves the result back in keys
+    static_assert((32 / RADIX_BITS) % 2 == 0, "radix passes must end in keys");
+}
+
+// length of the common prefix of the keys at i and j, or -1 when j is out of range;
+// the keys include the primitive index, so duplicate codes still order strictly
+static int common_prefix(const uint64_t *keys, uint32_t count, int64_t i, int64_t j)
+{
+    if ((j < 0) || (j >= static_cast<int64_t>(count)))
+    {
+        return -1;
+    }
+    uint64_t difference = keys[i] ^ keys[j];
+    return difference ? __builtin_clzll(difference) : 64;
+}
+
+void build_bvh_lbvh(const Aabb *primitive_bounds, uint32_t count, uint32_t thread_count, Bvh *bvh)
+{
+    *bvh = {};
+    if (count == 0)
+    {
+        return;
+    }
+    thread_count = std::max(1u, thread_count);
+
+    // centroid bounds, reduced per chunk
+    std::vector<Aabb> chunk_bounds(thread_count, empty_aabb());
+    parallel_chunks(count, thread_count, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+    {
+        Aabb bounds = empty_aabb();
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            grow_aabb(&bounds, aabb_center(primitive_bounds[index]));
+        }
+        chunk_bounds[chunk] = bounds;
+    });
+    Aabb centroid_bounds = empty_aabb();
+    for (const auto &bounds : chunk_bounds)
+    {
+        grow_aabb(&centroid_bounds, bounds);
+    }
+
+    Vector::Vector3 extent = centroid_bounds.max - centroid_bounds.min;
+    const float cells = static_cast<float>((1u << MORTON_BITS_PER_AXIS) - 1);
+    Vector::Vector3 scale =
+    {
+        (extent.x > 0.0f) ? (cells / extent.x) : 0.0f,
+        (extent.y > 0.0f) ? (cells / extent.y) : 0.0f,
+        (extent.z > 0.0f) ? (cells / extent.z) : 0.0f
+    };
+
+    std::vector<uint64_t> keys(count);
+    parallel_chunks(count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            uint32_t code = morton_code(aabb_center(primitive_bounds[index]), centroid_bounds, scale);
+            keys[index] = (static_cast<uint64_t>(code) << 32) | index;
+        }
+    });
+    radix_sort(&keys, thread_count);
+
+    // Karras (2012): internal node i of the radix tree over the sorted keys starts or ends at
+    // key i, so every internal node finds its range and split on its own.  Internal node i's
+    // children land at 2i + 1 and 2i + 2 of the final array and the root at 0, which keeps
+    // siblings adjacent without a pass that allocates nodes.
+    uint32_t internal_count = count - 1;
+    std::vector<BvhNode> nodes(2 * static_cast<size_t>(count) - 1);
+    // position of each internal node in nodes, and its parent, for the bottom-up bounds pass
+    std::vector<uint32_t> internal_positions(std::max(internal_count, 1u));
+    std::vector<uint32_t> leaf_parents(count);
+    std::vector<uint32_t> internal_parents(std::max(internal_count, 1u));
+    std::vector<uint32_t> primitive_indices(count);
+
+    const uint64_t *sorted = keys.data();
+    internal_positions[0] = 0;
+    parallel_chunks(count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            primitive_indices[index] = static_cast<uint32_t>(sorted[index]);
+        }
+    });
+    if (count == 1)
+    {
+        nodes[0] = BvhNode { primitive_bounds[primitive_indices[0]], 0, 1 };
+    }
+
+    parallel_chunks(internal_count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t node = begin; node < end; ++node)
+        {
+            auto i = static_cast<int64_t>(node);
+            // direction of the range: toward the neighbour sharing the longer prefix
+            int64_t direction = (common_prefix(sorted, count, i, i + 1) - common_prefix(sorted, count, i, i - 1)) >= 0 ? 1 : -1;
+            int prefix_minimum = common_prefix(sorted, count, i, i - direction);
+
+            int64_t length_maximum = 2;
+            while (common_prefix(sorted, count, i, i + length_maximum * direction) > prefix_minimum)
+            {
+                length_maximum *= 2;
+            }
+            int64_t length = 0;
+            for (int64_t step = length_maximum / 2; step >= 1; step /= 2)
+            {
+                if (common_prefix(sorted, count, i, i + (length + step) * direction) > prefix_minimum)
+                {
+                    length += step;
+                }
+            }
+            int64_t j = i + length * direction;
+
+            int node_prefix = common_prefix(sorted, count, i, j);
+            int64_t split = 0;
+            for (int64_t step = (length + 1) / 2; ; step = (step + 1) / 2)
+            {
+                if (common_prefix(sorted, count, i, i + (split + step) * direction) > node_prefix)
+                {
+                    split += step;
+                }
+                if (step == 1)
+                {
+                    break;
+                }
+            }
+            auto gamma = static_cast<uint32_t>(i + split * direction + std::min<int64_t>(direction, 0));
+
+            uint32_t first_child = 2 * node + 1;
+            uint32_t children[2] = { gamma, gamma + 1 };
+            bool leaves[2] = { std::min(i, j) == gamma, std::max(i, j) == gamma + 1 };
+            for (uint32_t side = 0; side < 2; ++side)
+            {
+                uint32_t position = first_child + side;
+                if (leaves[side])
+                {
+                    uint32_t leaf = children[side];
+                    nodes[position] = BvhNode { primitive_bounds[primitive_indices[leaf]], leaf, 1 };
+                    leaf_parents[leaf] = node;
+                }
+                else
+                {
+                    internal_positions[children[side]] = position;
+                    internal_parents[children[side]] = node;
+                }
+            }
+        }
+    });
+
+    // bounds bottom-up: every leaf climbs toward the root and the second child to arrive at
+    // a node merges both; the atomic add orders the first child's writes before the merge
+    std::vector<uint32_t> arrivals(std::max(internal_count, 1u), 0);
+    parallel_chunks(internal_count ? count : 0, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t leaf = begin; leaf < end; ++leaf)
+        {
+            uint32_t node = leaf_parents[leaf];
+            while (__sync_fetch_and_add(&arrivals[node], 1) == 1)
+            {
+                uint32_t position = internal_positions[node];
+                uint32_t first_child = 2 * node + 1;
+                Aabb bounds = nodes[first_child].bounds;
+                grow_aabb(&bounds, nodes[first_child + 1].bounds);
+                nodes[position] = BvhNode { bounds, first_child, 0 };
+                if (node == 0)
+                {
+                    break;
+                }
+                node = internal_parents[node];
+            }
+        }
+    });
+
+    bvh->nodes.assign(std::move(nodes));
+    bvh->primitive_indices.assign(std::move(primitive_indices));
+}
@@ -0,0 +1,83 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/MappedFile.h"
+
+MappedFile::MappedFile()
+{
+    file_descriptor = -1;
+    mapped_data = nullptr;
+    mapped_size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &file_name, std::string *error, MappedAccess access)
+{
+    close();
+
+    file_descriptor = ::open(file_name.c_str(), O_RDONLY);
+    if (file_descriptor < 0)
+    {
+        *error = "cannot open '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+
+    struct stat file_status = {};
+    if (fstat(file_descriptor, &file_status) != 0)
+    {
+        *error = "cannot stat '" + file_name + "': " + strerror(errno);
+        close();
+        return false;
+    }
+
+    mapped_size = static_cast<size_t>(file_status.st_size);
+    if (mapped_size == 0)
+    {
+        // mmap refuses empty ranges; an empty file is simply no data
+        return true;
+    }
+
+    void *mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (mapping == MAP_FAILED)
+    {
+        *error = "cannot map '" + file_name + "': " + strerror(errno);
+        close();
+        return false;
+    }
+    madvise(mapping, mapped_size, (access == MappedAccess::Sequential) ? MADV_SEQUENTIAL : MADV_RANDOM);
+    mapped_data = static_cast<const uint8_t *>(mapping);
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapped_data)
+    {
+        munmap(const_cast<uint8_t *>(mapped_data), mapped_size);
+        mapped_data = nullptr;
+    }
+    if (file_descriptor >= 0)
+    {
+        ::close(file_descriptor);
+        file_descriptor = -1;
+    }
+    mapped_size = 0;
+}
+
+const uint8_t *MappedFile::data() const
+{
+    return mapped_data;
+}
+
+size_t MappedFile::size() const
+{
+    return mapped_size;
+}
@@ -0,0 +1,89 @@
+#include "../include/Mesh.h"
+#include "../include/Parallel.h"
+
+// Moves every leaf to start on a multiple of TRIANGLE_BLOCK_WIDTH and pads it with its last
+// triangle.  Counts stay as they are; the repeats only ever hit where the original does.
+static void align_leaves(Bvh *bvh)
+{
+    BvhNode *nodes = bvh->nodes.mutable_data();
+    const uint32_t *old_indices = bvh->primitive_indices.data();
+    std::vector<uint32_t> indices;
+    indices.reserve(bvh->primitive_indices.size() + bvh->primitive_indices.size() / 2);
+    for (uint32_t node_index = 0; node_index < bvh->nodes.size(); ++node_index)
+    {
+        BvhNode &node = nodes[node_index];
+        if (node.count == 0)
+        {
+            continue;
+        }
+        auto first = static_cast<uint32_t>(indices.size());
+        indices.insert(indices.end(), old_indices + node.first, old_indices + node.first + node.count);
+        while (indices.size() % TRIANGLE_BLOCK_WIDTH)
+        {
+            indices.push_back(indices.back());
+        }
+        node.first = first;
+    }
+    bvh->primitive_indices.assign(std::move(indices));
+}
+
+// block b lane l holds triangle order[b * width + l], or the last one past the end
+static void fill_blocks(const TriangleMesh &source, const uint32_t *order, uint32_t count,
+                        std::vector<TriangleBlock> *blocks)
+{
+    blocks->resize((count + TRIANGLE_BLOCK_WIDTH - 1) / TRIANGLE_BLOCK_WIDTH);
+    const Vector::Vector3 *vertices = source.vertices.data();
+    const uint32_t *indices = source.indices.data();
+    for (uint32_t position = 0; position < blocks->size() * TRIANGLE_BLOCK_WIDTH; ++position)
+    {
+        uint32_t triangle = order ? order[std::min(position, count - 1)] : std::min(position, count - 1);
+        TriangleBlock &block = (*blocks)[position / TRIANGLE_BLOCK_WIDTH];
+        uint32_t lane = position % TRIANGLE_BLOCK_WIDTH;
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            const Vector::Vector3 &vertex = vertices[indices[3 * triangle + corner]];
+            block.vertices[corner][0][lane] = vertex.x;
+            block.vertices[corner][1][lane] = vertex.y;
+            block.vertices[corner][2][lane] = vertex.z;
+        }
+    }
+}
+
+void build_mesh_bvh(BvhBuilder builder, uint32_t thread_count, TriangleMesh *mesh)
+{
+    uint32_t count = triangle_count(*mesh);
+    std::vector<Aabb> bounds(count);
+    const Vector::Vector3 *vertices = mesh->vertices.data();
+    const uint32_t *indices = mesh->indices.data();
+    parallel_chunks(count, thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t triangle = begin; triangle < end; ++triangle)
+        {
+            Aabb box = empty_aabb();
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                grow_aabb(&box, vertices[indices[3 * triangle + corner]]);
+            }
+            bounds[triangle] = box;
+        }
+    });
+    build_bvh(builder, bounds.data(), count, thread_count, &mesh->bvh);
+    if (count == 0)
+    {
+        mesh->blocks.clear();
+        return;
+    }
+    align_leaves(&mesh->bvh);
+    fill_blocks(*mesh, mesh->bvh.primitive_indices.data(), static_cast<uint32_t>(mesh->bvh.primitive_indices.size()),
+                &mesh->blocks);
+}
+
+void build_mesh_blocks(TriangleMesh *mesh)
+{
+    mesh->bvh = {};
+    mesh->blocks.clear();
+    if (triangle_count(*mesh))
+    {
+        fill_blocks(*mesh, nullptr, triangle_count(*mesh), &mesh->blocks);
+    }
+}
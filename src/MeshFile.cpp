@@ -0,0 +1,714 @@
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include "../include/MappedFile.h"
+#include "../include/MeshFile.h"
+#include "../include/Parallel.h"
+
+static bool is_blank(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static const char *skip_blanks(const char *cursor, const char *end)
+{
+    while ((cursor < end) && is_blank(*cursor))
+    {
+        ++cursor;
+    }
+    return cursor;
+}
+
+static const char *line_end(const char *cursor, const char *end)
+{
+    const void *newline = memchr(cursor, '\n', static_cast<size_t>(end - cursor));
+    return newline ? static_cast<const char *>(newline) : end;
+}
+
+// 'v' or 'f' when the line starts with that statement, 0 for anything else
+static char obj_statement(const char *cursor, const char *end)
+{
+    cursor = skip_blanks(cursor, end);
+    if ((end - cursor >= 2) && ((cursor[0] == 'v') || (cursor[0] == 'f')) && is_blank(cursor[1]))
+    {
+        return cursor[0];
+    }
+    return 0;
+}
+
+static uint32_t count_corners(const char *cursor, const char *end)
+{
+    uint32_t corners = 0;
+    for (;;)
+    {
+        cursor = skip_blanks(cursor, end);
+        if ((cursor == end) || (*cursor == '#'))
+        {
+            return corners;
+        }
+        corners += 1;
+        while ((cursor < end) && !is_blank(*cursor) && (*cursor != '#'))
+        {
+            ++cursor;
+        }
+    }
+}
+
+// a contiguous run of whole lines; the first pass fills the counts, the second the offsets
+struct ObjChunk
+{
+    const char *begin;
+    const char *end;
+    uint32_t line_count;
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+    uint32_t first_line;
+    uint32_t first_vertex;
+    uint32_t first_triangle;
+    std::string error;
+};
+
+static bool parse_obj_float(const char **cursor, const char *end, float *value)
+{
+    const char *start = skip_blanks(*cursor, end);
+    if ((start < end) && (*start == '+'))
+    {
+        ++start;
+    }
+    auto result = std::from_chars(start, end, *value);
+    if ((result.ec != std::errc()) || ((result.ptr < end) && !is_blank(*result.ptr) && (*result.ptr != '#')))
+    {
+        return false;
+    }
+    *cursor = result.ptr;
+    return true;
+}
+
+static void parse_obj_chunk(ObjChunk *chunk, uint32_t total_vertices, TriangleMesh *mesh)
+{
+    Vector::Vector3 *vertices = mesh->vertices.data() + chunk->first_vertex;
+    uint32_t *indices = mesh->indices.data() + 3 * static_cast<size_t>(chunk->first_triangle);
+    uint32_t vertex_count = 0;
+    uint32_t line = chunk->first_line;
+    auto fail = [chunk, &line](const char *message)
+    {
+        chunk->error = "line " + std::to_string(line) + ": " + message;
+    };
+
+    for (const char *cursor = chunk->begin; cursor < chunk->end; ++line)
+    {
+        const char *end = line_end(cursor, chunk->end);
+        char statement = obj_statement(cursor, end);
+        cursor = skip_blanks(cursor, end) + 1;
+        if (statement == 'v')
+        {
+            Vector::Vector3 &vertex = vertices[vertex_count++];
+            if (!parse_obj_float(&cursor, end, &vertex.x) || !parse_obj_float(&cursor, end, &vertex.y) ||
+                !parse_obj_float(&cursor, end, &vertex.z))
+            {
+                return fail("v expects x y z");
+            }
+        }
+        else if (statement == 'f')
+        {
+            uint32_t corners[3];
+            uint32_t corner_count = 0;
+            for (;;)
+            {
+                cursor = skip_blanks(cursor, end);
+                if ((cursor == end) || (*cursor == '#'))
+                {
+                    break;
+                }
+                int64_t index = 0;
+                auto result = std::from_chars(cursor, end, index);
+                if (result.ec != std::errc())
+                {
+                    return fail("f expects vertex numbers");
+                }
+                // v/vt/vn: the rest of the corner is texture and normal numbers
+                cursor = result.ptr;
+                while ((cursor < end) && !is_blank(*cursor) && (*cursor != '#'))
+                {
+                    ++cursor;
+                }
+
+                // 1 is the first vertex in the file, -1 the latest one
+                int64_t resolved = (index > 0) ? (index - 1) : (static_cast<int64_t>(chunk->first_vertex + vertex_count) + index);
+                if ((index == 0) || (resolved < 0) || (resolved >= total_vertices))
+                {
+                    return fail("f refers to a missing vertex");
+                }
+                auto vertex = static_cast<uint32_t>(resolved);
+                if (corner_count < 2)
+                {
+                    corners[corner_count] = vertex;
+                }
+                else
+                {
+                    corners[2] = vertex;
+                    memcpy(indices, corners, sizeof(corners));
+                    indices += 3;
+                    corners[1] = vertex;
+                }
+                corner_count += 1;
+            }
+            if (corner_count < 3)
+            {
+                return fail("f needs at least three corners");
+            }
+        }
+        cursor = end + 1;
+    }
+}
+
+bool parse_obj_mesh(const char *text, size_t size, uint32_t thread_count, TriangleMesh *mesh, std::string *error)
+{
+    *mesh = {};
+    thread_count = std::max(1u, thread_count);
+    const char *end = text + size;
+    std::vector<ObjChunk> chunks(thread_count);
+    const char *cursor = text;
+    for (uint32_t chunk_index = 0; chunk_index < thread_count; ++chunk_index)
+    {
+        const char *chunk_end = (chunk_index + 1 == thread_count) ? end : text + size * (chunk_index + 1) / thread_count;
+        chunk_end = std::max(chunk_end, cursor);
+        chunk_end = (chunk_end < end) ? std::min(line_end(chunk_end, end) + 1, end) : end;
+        chunks[chunk_index] = ObjChunk { cursor, chunk_end, 0, 0, 0, 0, 0, 0, std::string() };
+        cursor = chunk_end;
+    }
+
+    parallel_chunks(thread_count, thread_count, [&](uint32_t, uint32_t begin, uint32_t chunk_end)
+    {
+        for (uint32_t chunk_index = begin; chunk_index < chunk_end; ++chunk_index)
+        {
+            ObjChunk &chunk = chunks[chunk_index];
+            for (const char *line = chunk.begin; line < chunk.end; ++chunk.line_count)
+            {
+                const char *next = line_end(line, chunk.end);
+                char statement = obj_statement(line, next);
+                if (statement == 'v')
+                {
+                    chunk.vertex_count += 1;
+                }
+                else if (statement == 'f')
+                {
+                    // the statement itself counts as a corner
+                    uint32_t corners = count_corners(line, next) - 1;
+                    chunk.triangle_count += (corners > 2) ? (corners - 2) : 0;
+                }
+                line = next + 1;
+            }
+        }
+    });
+
+    uint64_t vertex_total = 0;
+    uint64_t triangle_total = 0;
+    uint32_t line_total = 1;
+    for (auto &chunk : chunks)
+    {
+        chunk.first_line = line_total;
+        chunk.first_vertex = static_cast<uint32_t>(vertex_total);
+        chunk.first_triangle = static_cast<uint32_t>(triangle_total);
+        line_total += chunk.line_count;
+        vertex_total += chunk.vertex_count;
+        triangle_total += chunk.triangle_count;
+    }
+    if ((vertex_total > UINT32_MAX) || (3 * triangle_total > UINT32_MAX))
+    {
+        *error = "mesh has too many vertices or triangles";
+        return false;
+    }
+    mesh->vertices.resize(vertex_total);
+    mesh->indices.resize(3 * triangle_total);
+
+    parallel_chunks(thread_count, thread_count, [&](uint32_t, uint32_t begin, uint32_t chunk_end)
+    {
+        for (uint32_t chunk_index = begin; chunk_index < chunk_end; ++chunk_index)
+        {
+            parse_obj_chunk(&chunks[chunk_index], static_cast<uint32_t>(vertex_total), mesh);
+        }
+    });
+    for (const auto &chunk : chunks)
+    {
+        if (!chunk.error.empty())
+        {
+            *error = chunk.error;
+            *mesh = {};
+            return false;
+        }
+    }
+    return true;
+}
+
+enum class PlyType
+{
+    Int8,
+    Uint8,
+    Int16,
+    Uint16,
+    Int32,
+    Uint32,
+    Float32,
+    Float64
+};
+
+static bool parse_ply_type(const std::string &name, PlyType *type, uint32_t *size)
+{
+    static const struct { const char *names[2]; PlyType type; uint32_t size; } TYPES[] =
+    {
+        { { "char", "int8" }, PlyType::Int8, 1 },
+        { { "uchar", "uint8" }, PlyType::Uint8, 1 },
+        { { "short", "int16" }, PlyType::Int16, 2 },
+        { { "ushort", "uint16" }, PlyType::Uint16, 2 },
+        { { "int", "int32" }, PlyType::Int32, 4 },
+        { { "uint", "uint32" }, PlyType::Uint32, 4 },
+        { { "float", "float32" }, PlyType::Float32, 4 },
+        { { "double", "float64" }, PlyType::Float64, 8 },
+    };
+    for (const auto &entry : TYPES)
+    {
+        if ((name == entry.names[0]) || (name == entry.names[1]))
+        {
+            *type = entry.type;
+            *size = entry.size;
+            return true;
+        }
+    }
+    return false;
+}
+
+static double read_ply_value(const uint8_t *data, PlyType type, bool swap)
+{
+    uint8_t bytes[8];
+    static const uint32_t SIZES[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+    uint32_t size = SIZES[static_cast<uint32_t>(type)];
+    for (uint32_t byte = 0; byte < size; ++byte)
+    {
+        bytes[byte] = data[swap ? (size - 1 - byte) : byte];
+    }
+    switch (type)
+    {
+        case PlyType::Int8: { int8_t value; memcpy(&value, bytes, 1); return value; }
+        case PlyType::Uint8: { uint8_t value; memcpy(&value, bytes, 1); return value; }
+        case PlyType::Int16: { int16_t value; memcpy(&value, bytes, 2); return value; }
+        case PlyType::Uint16: { uint16_t value; memcpy(&value, bytes, 2); return value; }
+        case PlyType::Int32: { int32_t value; memcpy(&value, bytes, 4); return value; }
+        case PlyType::Uint32: { uint32_t value; memcpy(&value, bytes, 4); return value; }
+        case PlyType::Float32: { float value; memcpy(&value, bytes, 4); return value; }
+        case PlyType::Float64: { double value; memcpy(&value, bytes, 8); return value; }
+    }
+    return 0.0;
+}
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    uint32_t size;
+    bool is_list;
+    PlyType count_type;
+    uint32_t count_size;
+    uint32_t offset;
+};
+
+struct PlyElement
+{
+    std::string name;
+    uint64_t count;
+    std::vector<PlyProperty> properties;
+    // bytes per record, when no property is a list
+    uint32_t stride;
+    bool fixed_size;
+};
+
+static const bool HOST_IS_LITTLE_ENDIAN = (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+
+static bool parse_ply_header(const char *text, size_t size, std::vector<PlyElement> *elements, bool *swap,
+                             size_t *data_offset, std::string *error)
+{
+    const char *end = text + size;
+    const char *cursor = text;
+    bool has_format = false;
+    for (uint32_t line = 1; cursor < end; ++line)
+    {
+        const char *next = line_end(cursor, end);
+        std::vector<std::string> words;
+        for (const char *word = skip_blanks(cursor, next); word < next; word = skip_blanks(word, next))
+        {
+            const char *word_end = word;
+            while ((word_end < next) && !is_blank(*word_end))
+            {
+                ++word_end;
+            }
+            words.emplace_back(word, word_end);
+            word = word_end;
+        }
+        cursor = next + 1;
+        auto fail = [error, line](const std::string &message)
+        {
+            *error = "PLY header line " + std::to_string(line) + ": " + message;
+            return false;
+        };
+
+        if ((line == 1) && ((words.size() != 1) || (words[0] != "ply")))
+        {
+            return fail("not a PLY file");
+        }
+        if (words.empty() || (line == 1) || (words[0] == "comment") || (words[0] == "obj_info"))
+        {
+            continue;
+        }
+        if (words[0] == "end_header")
+        {
+            if (!has_format)
+            {
+                return fail("no format line");
+            }
+            *data_offset = static_cast<size_t>(std::min(cursor, end) - text);
+            return true;
+        }
+        if (words[0] == "format")
+        {
+            if ((words.size() < 2) || ((words[1] != "binary_little_endian") && (words[1] != "binary_big_endian")))
+            {
+                return fail("only binary PLY files are supported");
+            }
+            *swap = (words[1] == "binary_little_endian") != HOST_IS_LITTLE_ENDIAN;
+            has_format = true;
+        }
+        else if (words[0] == "element")
+        {
+            if (words.size() != 3)
+            {
+                return fail("element expects NAME COUNT");
+            }
+            elements->push_back(PlyElement { words[1], std::strtoull(words[2].c_str(), nullptr, 10), {}, 0, true });
+        }
+        else if (words[0] == "property")
+        {
+            if (elements->empty())
+            {
+                return fail("property before any element");
+            }
+            PlyElement &element = elements->back();
+            PlyProperty property = {};
+            property.offset = element.stride;
+            if ((words.size() == 5) && (words[1] == "list") && parse_ply_type(words[2], &property.count_type, &property.count_size) &&
+                parse_ply_type(words[3], &property.type, &property.size))
+            {
+                property.is_list = true;
+                property.name = words[4];
+                element.fixed_size = false;
+            }
+            else if ((words.size() == 3) && parse_ply_type(words[1], &property.type, &property.size))
+            {
+                property.name = words[2];
+                element.stride += property.size;
+            }
+            else
+            {
+                return fail("property expects TYPE NAME or list COUNT_TYPE TYPE NAME");
+            }
+            element.properties.push_back(property);
+        }
+        else
+        {
+            return fail("unknown statement '" + words[0] + "'");
+        }
+    }
+    *error = "PLY header has no end_header";
+    return false;
+}
+
+static const PlyProperty *find_ply_property(const PlyElement &element, const char *name)
+{
+    for (const auto &property : element.properties)
+    {
+        if (property.name == name)
+        {
+            return &property;
+        }
+    }
+    return nullptr;
+}
+
+static bool parse_ply_vertices(const PlyElement &element, const uint8_t *data, bool swap, uint32_t thread_count,
+                               TriangleMesh *mesh, std::string *error)
+{
+    const PlyProperty *axes[3] = { find_ply_property(element, "x"), find_ply_property(element, "y"),
+                                   find_ply_property(element, "z") };
+    if (!element.fixed_size || !axes[0] || !axes[1] || !axes[2])
+    {
+        *error = "PLY vertices need x, y and z and no list properties";
+        return false;
+    }
+    mesh->vertices.resize(element.count);
+    Vector::Vector3 *vertices = mesh->vertices.data();
+    bool native_floats = !swap && (axes[0]->type == PlyType::Float32) && (axes[1]->type == PlyType::Float32) &&
+                         (axes[2]->type == PlyType::Float32);
+    parallel_chunks(static_cast<uint32_t>(element.count), thread_count, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for (uint32_t vertex = begin; vertex < end; ++vertex)
+        {
+            const uint8_t *record = data + static_cast<size_t>(vertex) * element.stride;
+            float values[3];
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                if (native_floats)
+                {
+                    memcpy(&values[axis], record + axes[axis]->offset, sizeof(float));
+                }
+                else
+                {
+                    values[axis] = static_cast<float>(read_ply_value(record + axes[axis]->offset, axes[axis]->type, swap));
+                }
+            }
+            vertices[vertex] = Vector::Vector3 { values[0], values[1], values[2] };
+        }
+    });
+    return true;
+}
+
+// any face: a sequential walk, since records have different sizes
+static bool parse_ply_polygons(const PlyProperty &list, uint64_t face_count, const uint8_t *data, const uint8_t *end,
+                               bool swap, TriangleMesh *mesh, std::string *error)
+{
+    auto vertex_count = static_cast<double>(mesh->vertices.size());
+    mesh->indices.clear();
+    for (uint64_t face = 0; face < face_count; ++face)
+    {
+        if (data + list.count_size > end)
+        {
+            *error = "PLY faces are truncated";
+            return false;
+        }
+        auto corner_count = static_cast<uint64_t>(read_ply_value(data, list.count_type, swap));
+        data += list.count_size;
+        if ((corner_count < 3) || (data + corner_count * list.size > end))
+        {
+            *error = (corner_count < 3) ? "PLY face has fewer than three corners" : "PLY faces are truncated";
+            return false;
+        }
+        uint32_t first = 0, previous = 0;
+        for (uint64_t corner = 0; corner < corner_count; ++corner, data += list.size)
+        {
+            double index = read_ply_value(data, list.type, swap);
+            if (!(index >= 0.0) || (index >= vertex_count))
+            {
+                *error = "PLY face refers to a missing vertex";
+                return false;
+            }
+            auto vertex = static_cast<uint32_t>(index);
+            if (corner == 0)
+            {
+                first = vertex;
+            }
+            else if (corner >= 2)
+            {
+                mesh->indices.insert(mesh->indices.end(), { first, previous, vertex });
+            }
+            previous = vertex;
+        }
+    }
+    return true;
+}
+
+static bool parse_ply_faces(const PlyElement &element, const uint8_t *data, const uint8_t *end, bool swap,
+                            uint32_t thread_count, TriangleMesh *mesh, std::string *error)
+{
+    if ((element.properties.size() != 1) || !element.properties[0].is_list)
+    {
+        *error = "PLY faces must hold only the list of vertex indices";
+        return false;
+    }
+    const PlyProperty &list = element.properties[0];
+
+    // nearly every mesh is all triangles, which makes records a fixed size and lets chunks
+    // parse independently; anything else falls back to the walk
+    size_t record_size = list.count_size + 3 * list.size;
+    if (static_cast<uint64_t>(end - data) / record_size >= element.count)
+    {
+        mesh->indices.resize(3 * element.count);
+        uint32_t *indices = mesh->indices.data();
+        auto vertex_count = static_cast<double>(mesh->vertices.size());
+        volatile uint32_t not_triangles = 0;
+        volatile uint32_t missing_vertex = 0;
+        parallel_chunks(static_cast<uint32_t>(element.count), thread_count, [&](uint32_t, uint32_t begin, uint32_t face_end)
+        {
+            for (uint32_t face = begin; face < face_end; ++face)
+            {
+                const uint8_t *record = data + static_cast<size_t>(face) * record_size;
+                if (read_ply_value(record, list.count_type, swap) != 3.0)
+                {
+                    not_triangles = 1;
+                    return;
+                }
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    double index = read_ply_value(record + list.count_size + corner * list.size, list.type, swap);
+                    if (!(index >= 0.0) || (index >= vertex_count))
+                    {
+                        missing_vertex = 1;
+                        return;
+                    }
+                    indices[3 * static_cast<size_t>(face) + corner] = static_cast<uint32_t>(index);
+                }
+            }
+        });
+        if (!not_triangles)
+        {
+            if (missing_vertex)
+            {
+                *error = "PLY face refers to a missing vertex";
+                return false;
+            }
+            return true;
+        }
+    }
+    return parse_ply_polygons(list, element.count, data, end, swap, mesh, error);
+}
+
+bool parse_ply_mesh(const uint8_t *data, size_t size, uint32_t thread_count, TriangleMesh *mesh, std::string *error)
+{
+    *mesh = {};
+    std::vector<PlyElement> elements;
+    bool swap = false;
+    size_t data_offset = 0;
+    if (!parse_ply_header(reinterpret_cast<const char *>(data), size, &elements, &swap, &data_offset, error))
+    {
+        return false;
+    }
+
+    const uint8_t *cursor = data + data_offset;
+    const uint8_t *end = data + size;
+    bool has_vertices = false;
+    for (const auto &element : elements)
+    {
+        if (element.count > UINT32_MAX / 3)
+        {
+            *error = "PLY element '" + element.name + "' is too large";
+            return false;
+        }
+        if (element.name == "face")
+        {
+            if (!has_vertices)
+            {
+                *error = "PLY faces come before the vertices";
+                return false;
+            }
+            // anything after the faces is of no interest
+            return parse_ply_faces(element, cursor, end, swap, thread_count, mesh, error);
+        }
+        if (!element.fixed_size)
+        {
+            *error = "PLY element '" + element.name + "' has list properties and cannot be skipped";
+            return false;
+        }
+        if (static_cast<uint64_t>(end - cursor) / std::max(element.stride, 1u) < element.count)
+        {
+            *error = "PLY element '" + element.name + "' is truncated";
+            return false;
+        }
+        if (element.name == "vertex")
+        {
+            if (!parse_ply_vertices(element, cursor, swap, thread_count, mesh, error))
+            {
+                return false;
+            }
+            has_vertices = true;
+        }
+        cursor += element.count * element.stride;
+    }
+    *error = "PLY file has no faces";
+    return false;
+}
+
+static bool has_extension(const std::string &file_name, const char *extension)
+{
+    size_t length = strlen(extension);
+    if (file_name.size() < length)
+    {
+        return false;
+    }
+    for (size_t index = 0; index < length; ++index)
+    {
+        if (tolower(file_name[file_name.size() - length + index]) != extension[index])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool load_mesh_file(const std::string &file_name, uint32_t thread_count, TriangleMesh *mesh, std::string *error)
+{
+    bool is_obj = has_extension(file_name, ".obj");
+    if (!is_obj && !has_extension(file_name, ".ply"))
+    {
+        *error = "'" + file_name + "' is neither .obj nor .ply";
+        return false;
+    }
+    MappedFile file;
+    if (!file.open(file_name, error))
+    {
+        return false;
+    }
+    bool parsed = is_obj ? parse_obj_mesh(reinterpret_cast<const char *>(file.data()), file.size(), thread_count, mesh, error)
+                         : parse_ply_mesh(file.data(), file.size(), thread_count, mesh, error);
+    if (!parsed)
+    {
+        *error = file_name + ": " + *error;
+    }
+    return parsed;
+}
+
+bool write_ply_mesh(const TriangleMesh &mesh, const std::string &file_name, std::string *error)
+{
+    FILE *file = fopen(file_name.c_str(), "wb");
+    if (!file)
+    {
+        *error = "cannot write '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+
+    // written in the host's byte order, which the header names
+    fprintf(file, "ply\nformat %s 1.0\nelement vertex %zu\nproperty float x\nproperty float y\nproperty float z\n"
+                  "element face %u\nproperty list uchar int vertex_indices\nend_header\n",
+            HOST_IS_LITTLE_ENDIAN ? "binary_little_endian" : "binary_big_endian", mesh.vertices.size(),
+            triangle_count(mesh));
+    for (const auto &vertex : mesh.vertices)
+    {
+        float values[3] = { vertex.x, vertex.y, vertex.z };
+        fwrite(values, sizeof(values), 1, file);
+    }
+    for (uint32_t triangle = 0; triangle < triangle_count(mesh); ++triangle)
+    {
+        uint8_t record[13] = { 3 };
+        memcpy(record + 1, &mesh.indices[3 * triangle], 3 * sizeof(uint32_t));
+        fwrite(record, sizeof(record), 1, file);
+    }
+
+    bool written = (ferror(file) == 0);
+    written = (fclose(file) == 0) && written;
+    if (!written)
+    {
+        *error = "cannot write '" + file_name + "': " + strerror(errno);
+    }
+    return written;
+}
+
+bool load_scene_meshes(Scene *scene, const std::string &directory, uint32_t thread_count, std::string *error)
+{
+    for (auto &mesh : scene->meshes)
+    {
+        std::string path = (mesh.file_name.empty() || (mesh.file_name[0] == '/') || directory.empty())
+                           ? mesh.file_name : directory + "/" + mesh.file_name;
+        if (!load_mesh_file(path, thread_count, &mesh.geometry, error))
+        {
+            return false;
+        }
+    }
+    return true;
+}
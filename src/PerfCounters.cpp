@@ -0,0 +1,318 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include "../include/PerfCounters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct PerfEventDescription
+{
+    PerfEvent event;
+    const char *label;
+    uint32_t type;
+    uint64_t config;
+};
+
+#if defined(__linux__)
+// L1D is only exposed through the generic cache events: cache id | (op << 8) | (result << 16)
+constexpr uint64_t L1D_READ_MISS = PERF_COUNT_HW_CACHE_L1D |
+                                   (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+static const PerfEventDescription PERF_EVENTS[PERF_EVENT_COUNT] =
+{
+    { PerfEvent::Cycles, "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PerfEvent::Instructions, "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PerfEvent::L1DataMisses, "L1D misses", PERF_TYPE_HW_CACHE, L1D_READ_MISS },
+    // the generic cache miss event maps to last level cache misses on x86 and most arm cores
+    { PerfEvent::LastLevelCacheMisses, "LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PerfEvent::BranchMisses, "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+#else
+static const PerfEventDescription PERF_EVENTS[PERF_EVENT_COUNT] =
+{
+    { PerfEvent::Cycles, "cycles", 0, 0 },
+    { PerfEvent::Instructions, "instructions", 0, 0 },
+    { PerfEvent::L1DataMisses, "L1D misses", 0, 0 },
+    { PerfEvent::LastLevelCacheMisses, "LLC misses", 0, 0 },
+    { PerfEvent::BranchMisses, "branch misses", 0, 0 }
+};
+#endif
+
+static const char *PERF_PHASE_LABELS[PERF_PHASE_COUNT] = { "render", "intersection", "shading" };
+
+const char *perf_event_label(PerfEvent event)
+{
+    return PERF_EVENTS[static_cast<uint32_t>(event)].label;
+}
+
+int perf_counters_open(PerfCounterGroup *group)
+{
+    int error = 0;
+    for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+    {
+        group->file_descriptors[event_index] = -1;
+        group->user_pages[event_index] = nullptr;
+    }
+
+#if defined(__linux__)
+    long page_size = sysconf(_SC_PAGESIZE);
+    for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+    {
+        // events are opened individually rather than as one group so that a PMU
+        // lacking, say, the L1D event (common under virtualization) still reports the rest
+        perf_event_attr attributes = {};
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_EVENTS[event_index].type;
+        attributes.config = PERF_EVENTS[event_index].config;
+        // user space only keeps this usable at the default perf_event_paranoid level of 2
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        int file_descriptor = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        if (file_descriptor < 0)
+        {
+            error = errno;
+            continue;
+        }
+        group->file_descriptors[event_index] = file_descriptor;
+
+        void *page = mmap(nullptr, static_cast<size_t>(page_size), PROT_READ, MAP_SHARED, file_descriptor, 0);
+        if (page != MAP_FAILED)
+        {
+            group->user_pages[event_index] = page;
+        }
+    }
+#else
+    error = ENOSYS;
+#endif
+
+    return error;
+}
+
+void perf_counters_close(PerfCounterGroup *group)
+{
+#if defined(__linux__)
+    long page_size = sysconf(_SC_PAGESIZE);
+    for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+    {
+        if (group->user_pages[event_index])
+        {
+            munmap(group->user_pages[event_index], static_cast<size_t>(page_size));
+            group->user_pages[event_index] = nullptr;
+        }
+        if (group->file_descriptors[event_index] >= 0)
+        {
+            close(group->file_descriptors[event_index]);
+            group->file_descriptors[event_index] = -1;
+        }
+    }
+#endif
+}
+
+bool perf_counter_available(const PerfCounterGroup *group, PerfEvent event)
+{
+    return group->file_descriptors[static_cast<uint32_t>(event)] >= 0;
+}
+
+#if defined(__linux__)
+// self-monitoring read as documented in linux/perf_event.h: while the event is
+// scheduled on the core its live value is offset + rdpmc(index - 1), guarded by
+// a sequence lock the kernel bumps on every reschedule; this costs tens of cycles
+// against roughly a microsecond for the read() system call
+static bool read_user_page(const void *page, uint64_t *value)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    auto *user_page = static_cast<const volatile perf_event_mmap_page *>(page);
+    uint32_t sequence;
+    uint64_t count;
+    uint32_t index;
+    do
+    {
+        sequence = user_page->lock;
+        __sync_synchronize();
+
+        index = user_page->index;
+        count = static_cast<uint64_t>(user_page->offset);
+        if (!user_page->cap_user_rdpmc || (index == 0))
+        {
+            return false;
+        }
+
+        uint32_t low;
+        uint32_t high;
+        __asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index - 1));
+        uint16_t width = user_page->pmc_width;
+        int64_t pmc = static_cast<int64_t>((static_cast<uint64_t>(high) << 32) | low);
+        // counters are narrower than 64 bits; sign extend from the reported width
+        pmc <<= (64 - width);
+        pmc >>= (64 - width);
+        count += static_cast<uint64_t>(pmc);
+
+        __sync_synchronize();
+    } while (user_page->lock != sequence);
+
+    *value = count;
+    return true;
+#else
+    (void)page;
+    (void)value;
+    return false;
+#endif
+}
+#endif
+
+void perf_counters_read(const PerfCounterGroup *group, PerfCounterValues *values)
+{
+    for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+    {
+        uint64_t value = 0;
+#if defined(__linux__)
+        int file_descriptor = group->file_descriptors[event_index];
+        if (file_descriptor >= 0)
+        {
+            const void *page = group->user_pages[event_index];
+            if (!page || !read_user_page(page, &value))
+            {
+                if (read(file_descriptor, &value, sizeof(value)) != sizeof(value))
+                {
+                    value = 0;
+                }
+            }
+        }
+#endif
+        values->values[event_index] = value;
+    }
+}
+
+static void accumulate(PerfCounterValues *total, const PerfCounterValues &end, const PerfCounterValues &start)
+{
+    for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+    {
+        total->values[event_index] += end.values[event_index] - start.values[event_index];
+    }
+}
+
+void perf_thread_begin(PerfSession *session, PerfThreadCounters *counters)
+{
+    *counters = {};
+    int error = perf_counters_open(&counters->group);
+    if (error)
+    {
+        session->open_error = error;
+    }
+
+    uint64_t available_events = 0;
+    for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+    {
+        if (perf_counter_available(&counters->group, static_cast<PerfEvent>(event_index)))
+        {
+            available_events |= (1ull << event_index);
+        }
+    }
+    __sync_fetch_and_or(&session->available_events, available_events);
+
+    counters->profile_kernels = session->profile_kernels;
+    perf_counters_read(&counters->group, &counters->render_start);
+    counters->kernel_mark = counters->render_start;
+}
+
+void perf_thread_end(PerfSession *session, PerfThreadCounters *counters)
+{
+    PerfCounterValues render_end = {};
+    perf_counters_read(&counters->group, &render_end);
+    accumulate(&counters->totals.phases[static_cast<uint32_t>(PerfPhase::Render)], render_end, counters->render_start);
+
+    // one merge per thread; nothing on the hot path touches shared memory
+    for (uint32_t phase_index = 0; phase_index < PERF_PHASE_COUNT; ++phase_index)
+    {
+        for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+        {
+            __sync_fetch_and_add(&session->totals[phase_index][event_index],
+                                 counters->totals.phases[phase_index].values[event_index]);
+        }
+    }
+
+    perf_counters_close(&counters->group);
+}
+
+void perf_kernel_mark(PerfThreadCounters *counters)
+{
+    perf_counters_read(&counters->group, &counters->kernel_mark);
+}
+
+void perf_kernel_finish(PerfThreadCounters *counters, PerfPhase phase)
+{
+    PerfCounterValues now = {};
+    perf_counters_read(&counters->group, &now);
+    accumulate(&counters->totals.phases[static_cast<uint32_t>(phase)], now, counters->kernel_mark);
+    counters->kernel_mark = now;
+}
+
+void perf_print_report(const PerfSession *session, uint64_t rays_traced)
+{
+    if (!session->enabled)
+    {
+        return;
+    }
+
+    std::cout << "\nPerformance counters:\n";
+    if (!session->available_events)
+    {
+        std::cout << "  unavailable (perf_event_open: " << strerror(session->open_error) << ")\n";
+        return;
+    }
+
+    for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+    {
+        if (!(session->available_events & (1ull << event_index)))
+        {
+            std::cout << "  " << PERF_EVENTS[event_index].label << ": not supported on this machine\n";
+        }
+    }
+
+    double rays = static_cast<double>(rays_traced ? rays_traced : 1);
+    auto cycles = static_cast<uint32_t>(PerfEvent::Cycles);
+    auto instructions = static_cast<uint32_t>(PerfEvent::Instructions);
+    double render_cycles = static_cast<double>(session->totals[static_cast<uint32_t>(PerfPhase::Render)][cycles]);
+
+    for (uint32_t phase_index = 0; phase_index < PERF_PHASE_COUNT; ++phase_index)
+    {
+        if ((phase_index != static_cast<uint32_t>(PerfPhase::Render)) && !session->profile_kernels)
+        {
+            continue;
+        }
+
+        const volatile uint64_t *totals = session->totals[phase_index];
+        std::cout << "  " << PERF_PHASE_LABELS[phase_index] << ":";
+        if (totals[cycles] && totals[instructions])
+        {
+            std::cout << std::fixed << std::setprecision(2)
+                      << " IPC " << (static_cast<double>(totals[instructions]) / static_cast<double>(totals[cycles]));
+        }
+        if ((phase_index != static_cast<uint32_t>(PerfPhase::Render)) && (render_cycles > 0.0))
+        {
+            std::cout << std::fixed << std::setprecision(1)
+                      << ", " << (100.0 * static_cast<double>(totals[cycles]) / render_cycles) << "% of render cycles";
+        }
+        std::cout << "\n";
+
+        for (uint32_t event_index = 0; event_index < PERF_EVENT_COUNT; ++event_index)
+        {
+            if (!(session->available_events & (1ull << event_index)))
+            {
+                continue;
+            }
+            std::cout << "    " << std::left << std::setw(14) << PERF_EVENTS[event_index].label << std::right
+                      << std::setw(16) << totals[event_index]
+                      << std::fixed << std::setprecision(4)
+                      << std::setw(14) << (static_cast<double>(totals[event_index]) / rays) << " /ray\n";
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <iomanip>
+#include "../include/RayBinning.h"
+
+constexpr uint32_t RAY_BIN_RADIX_BITS = 8;
+constexpr uint32_t RAY_BIN_RADIX_BUCKETS = 1u << RAY_BIN_RADIX_BITS;
+
+RayBinGrid make_ray_bin_grid(const Aabb &bounds)
+{
+    RayBinGrid grid = {};
+    grid.bounds = bounds;
+    Vector::Vector3 extent = bounds.max - bounds.min;
+    const float cells = static_cast<float>(1u << RAY_BIN_CELL_BITS);
+    grid.scale = Vector::Vector3 { (extent.x > 0.0f) ? cells / extent.x : 0.0f,
+                                   (extent.y > 0.0f) ? cells / extent.y : 0.0f,
+                                   (extent.z > 0.0f) ? cells / extent.z : 0.0f };
+    float diagonal = Math::square_root(Math::inner_product(extent, extent));
+    grid.inverse_diagonal = (diagonal > 0.0f) ? 1.0f / diagonal : 0.0f;
+    return grid;
+}
+
+// one thread per tile already, so unlike the LBVH's sort this one stays on its thread
+void sort_ray_bins(std::vector<uint64_t> *entries, std::vector<uint64_t> *scratch)
+{
+    auto count = static_cast<uint32_t>(entries->size());
+    scratch->resize(count);
+    uint64_t *source = entries->data();
+    uint64_t *target = scratch->data();
+    uint32_t histogram[RAY_BIN_RADIX_BUCKETS];
+    for (uint32_t shift = 32; shift < 64; shift += RAY_BIN_RADIX_BITS)
+    {
+        std::fill(histogram, histogram + RAY_BIN_RADIX_BUCKETS, 0u);
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            histogram[(source[index] >> shift) & (RAY_BIN_RADIX_BUCKETS - 1)] += 1;
+        }
+        if ((count == 0) || (histogram[(source[0] >> shift) & (RAY_BIN_RADIX_BUCKETS - 1)] == count))
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RAY_BIN_RADIX_BUCKETS; ++digit)
+        {
+            uint32_t digit_count = histogram[digit];
+            histogram[digit] = offset;
+            offset += digit_count;
+        }
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            target[histogram[(source[index] >> shift) & (RAY_BIN_RADIX_BUCKETS - 1)]++] = source[index];
+        }
+        std::swap(source, target);
+    }
+    if (source != entries->data())
+    {
+        std::copy(source, source + count, entries->data());
+    }
+}
+
+static void merge_ray_coherence(RayCoherence *total, const RayCoherence &coherence)
+{
+    total->pairs += coherence.pairs;
+    total->same_octant += coherence.same_octant;
+    total->cosine_sum += coherence.cosine_sum;
+    total->spacing_sum += coherence.spacing_sum;
+}
+
+void merge_ray_binning_statistics(RayBinningStatistics *total, const RayBinningStatistics *statistics)
+{
+    total->sorted_rays += statistics->sorted_rays;
+    total->sort_nanoseconds += statistics->sort_nanoseconds;
+    merge_ray_coherence(&total->unsorted, statistics->unsorted);
+    merge_ray_coherence(&total->sorted, statistics->sorted);
+}
+
+void print_ray_binning_statistics(const RayBinningStatistics *statistics)
+{
+    const RayCoherence &unsorted = statistics->unsorted;
+    const RayCoherence &sorted = statistics->sorted;
+    double unsorted_pairs = static_cast<double>(unsorted.pairs ? unsorted.pairs : 1);
+    double sorted_pairs = static_cast<double>(sorted.pairs ? sorted.pairs : 1);
+
+    std::cout << "\nRay binning: " << statistics->sorted_rays << " secondary rays sorted in "
+              << std::fixed << std::setprecision(2) << (static_cast<double>(statistics->sort_nanoseconds) / 1.0e6)
+              << "ms\n";
+    std::cout << "  consecutive rays        unsorted      sorted\n";
+    std::cout << "  same octant           " << std::setw(9) << (100.0 * static_cast<double>(unsorted.same_octant) / unsorted_pairs)
+              << "%" << std::setw(11) << (100.0 * static_cast<double>(sorted.same_octant) / sorted_pairs) << "%\n";
+    std::cout << std::setprecision(3);
+    std::cout << "  direction cosine      " << std::setw(10) << (unsorted.cosine_sum / unsorted_pairs)
+              << std::setw(12) << (sorted.cosine_sum / sorted_pairs) << "\n";
+    std::cout << "  origin spacing        " << std::setw(10) << (unsorted.spacing_sum / unsorted_pairs)
+              << std::setw(12) << (sorted.spacing_sum / sorted_pairs) << "  scene diagonals\n";
+}
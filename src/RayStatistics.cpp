@@ -0,0 +1,77 @@
+#include <iostream>
+#include <iomanip>
+#include "../include/RayStatistics.h"
+
+#if RAY_STATISTICS
+// only the report names the counters, and it is compiled out with them
+static const char *RAY_COUNTER_LABELS[RAY_COUNTER_COUNT] =
+{
+    "sphere tests", "plane tests", "sphere hits", "plane hits", "sky misses", "box tests",
+    "triangle tests", "triangle hits", "sdf steps", "sdf hits"
+};
+
+static const char *RAY_TERMINATION_LABELS[RAY_TERMINATION_COUNT] = { "sky", "bounce limit" };
+#endif
+
+void merge_ray_statistics(RayStatistics *total, const RayStatistics *thread_statistics)
+{
+    for (uint32_t counter_index = 0; counter_index < RAY_COUNTER_COUNT; ++counter_index)
+    {
+        __sync_fetch_and_add(&total->counters[counter_index], thread_statistics->counters[counter_index]);
+    }
+    for (uint32_t reason_index = 0; reason_index < RAY_TERMINATION_COUNT; ++reason_index)
+    {
+        __sync_fetch_and_add(&total->terminations[reason_index], thread_statistics->terminations[reason_index]);
+    }
+    for (uint32_t depth = 0; depth < RAY_DEPTH_BUCKETS; ++depth)
+    {
+        __sync_fetch_and_add(&total->depth_histogram[depth], thread_statistics->depth_histogram[depth]);
+    }
+}
+
+void print_ray_statistics(const RayStatistics *statistics)
+{
+#if RAY_STATISTICS
+    uint64_t paths = 0;
+    for (uint32_t reason_index = 0; reason_index < RAY_TERMINATION_COUNT; ++reason_index)
+    {
+        paths += statistics->terminations[reason_index];
+    }
+    double path_divisor = static_cast<double>(paths ? paths : 1);
+
+    std::cout << "\nRay statistics (" << paths << " paths):\n";
+    for (uint32_t counter_index = 0; counter_index < RAY_COUNTER_COUNT; ++counter_index)
+    {
+        std::cout << "  " << std::left << std::setw(14) << RAY_COUNTER_LABELS[counter_index] << std::right
+                  << std::setw(16) << statistics->counters[counter_index]
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(12) << (static_cast<double>(statistics->counters[counter_index]) / path_divisor)
+                  << " /path\n";
+    }
+
+    std::cout << "  termination:\n";
+    for (uint32_t reason_index = 0; reason_index < RAY_TERMINATION_COUNT; ++reason_index)
+    {
+        std::cout << "    " << std::left << std::setw(12) << RAY_TERMINATION_LABELS[reason_index] << std::right
+                  << std::setw(16) << statistics->terminations[reason_index]
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(8) << (100.0 * static_cast<double>(statistics->terminations[reason_index]) / path_divisor)
+                  << "%\n";
+    }
+
+    std::cout << "  path depth:\n";
+    for (uint32_t depth = 0; depth < RAY_DEPTH_BUCKETS; ++depth)
+    {
+        if (statistics->depth_histogram[depth])
+        {
+            std::cout << "    " << std::setw(2) << depth << ((depth == RAY_DEPTH_BUCKETS - 1) ? "+" : " ")
+                      << std::setw(16) << statistics->depth_histogram[depth]
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(8) << (100.0 * static_cast<double>(statistics->depth_histogram[depth]) / path_divisor)
+                      << "%\n";
+        }
+    }
+#else
+    (void)statistics;
+#endif
+}
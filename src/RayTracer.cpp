@@ -1,12 +1,729 @@
 #include <iostream>
+#include <chrono>
 #include <thread>
+#include <vector>
+#include "../include/Acceleration.h"
+#include "../include/Animation.h"
+#include "../include/Benchmark.h"
+#include "../include/BinaryScene.h"
 #include "../include/Bitmap.h"
+#include "../include/Config.h"
+#include "../include/GBuffer.h"
+#include "../include/HdrImage.h"
+#include "../include/Instancing.h"
+#include "../include/Parallel.h"
+#include "../include/PerfCounters.h"
 #include "../include/RayTracer.h"
+#include "../include/SceneFile.h"
+#include "../include/SceneGenerator.h"
+#include "../include/TileCulling.h"
+#include "../include/TiledImage.h"
 #include "gtest/gtest.h"
 
+// distance to the nearest intersection past min_hit_distance, or false on a miss
+static inline bool intersect_sphere(const Sphere &sphere, const Vector::Vector3 &ray_origin,
+                                    const Vector::Vector3 &ray_direction, float min_hit_distance, float tolerance,
+                                    float *hit_distance)
+{
+    Vector::Vector3 sphere_relative_ray_origin = ray_origin - sphere.position;
+    float a = Math::inner_product(ray_direction, ray_direction);
+    float b = 2.0f * Math::inner_product(ray_direction, sphere_relative_ray_origin);
+    float c = Math::inner_product(sphere_relative_ray_origin, sphere_relative_ray_origin) - (sphere.radius * sphere.radius);
+    float denominator = 2.0f * a;
+    float root_term = Math::square_root(b * b - 4.0f * a * c);
+
+    if (root_term > tolerance)
+    {
+        float positive_term = (-b + root_term) / denominator;
+        float negative_term = (-b - root_term) / denominator;
+
+        float t = positive_term;
+        if ((negative_term > min_hit_distance) &&
+            (negative_term < positive_term)) // better hit (hit's in front of us and closer)
+        {
+            t = negative_term;
+        }
+        if (t > min_hit_distance)
+        {
+            *hit_distance = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Any-hit queries set the hit distance to this on their first hit.  Every walk below skips
+// whatever lies past the hit distance, and nothing lies before 0, so they all unwind at once.
+constexpr float ANY_HIT_FOUND = -1.0f;
+
+struct BvhStackEntry
+{
+    uint32_t node_index;
+    float entry_distance;
+};
+
+// Wide counterpart of the binary walk in intersect_spheres: one wide_node_hits call tests
+// all children of a node, leaves are tested straight away, and the other children are
+// pushed farthest first so the nearest is visited next.
+template <bool ANY_HIT>
+static inline const Sphere *intersect_spheres_wide(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                                   const Vector::Vector3 &ray_direction, float min_hit_distance,
+                                                   float tolerance, float *hit_distance,
+                                                   [[maybe_unused]] RayStatistics *statistics)
+{
+    const Sphere *hit_sphere = nullptr;
+    const WideBvhNode *nodes = scene->sphere_wide_bvh.nodes.data();
+    const uint32_t *primitive_indices = scene->sphere_wide_bvh.primitive_indices.data();
+    const Sphere *spheres = scene->spheres.data();
+    const WideRay ray = make_wide_ray(ray_origin, Vector::Vector3 { 1.0f / ray_direction.x, 1.0f / ray_direction.y,
+                                                                    1.0f / ray_direction.z });
+
+    BvhStackEntry stack[WIDE_BVH_STACK_SIZE];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = BvhStackEntry { 0, 0.0f };
+    while (stack_size)
+    {
+        BvhStackEntry entry = stack[--stack_size];
+        if (entry.entry_distance > *hit_distance)
+        {
+            continue;
+        }
+
+        const WideBvhNode &node = nodes[entry.node_index];
+        RAY_STATS(count_ray(statistics, RayCounter::BoxTests, node.child_count));
+        float entry_distances[WIDE_BVH_WIDTH];
+        uint32_t hits = wide_node_hits(node, ray, *hit_distance, entry_distances);
+
+        // node children that were hit, nearest first
+        BvhStackEntry children[WIDE_BVH_WIDTH];
+        uint32_t child_count = 0;
+        while (hits)
+        {
+            auto slot = static_cast<uint32_t>(__builtin_ctz(hits));
+            hits &= hits - 1;
+            uint8_t meta = node.child_meta[slot];
+            if (wide_child_is_leaf(meta))
+            {
+                uint32_t first = node.first_primitive + (meta >> 3);
+                uint32_t count = meta & 7;
+                RAY_STATS(count_ray(statistics, RayCounter::SphereTests, count));
+                for (uint32_t index = first; index < first + count; ++index)
+                {
+                    const Sphere &sphere = spheres[primitive_indices[index]];
+                    float t;
+                    if (intersect_sphere(sphere, ray_origin, ray_direction, min_hit_distance, tolerance, &t) &&
+                        (t < *hit_distance))
+                    {
+                        *hit_distance = ANY_HIT ? ANY_HIT_FOUND : t;
+                        hit_sphere = &sphere;
+                        if (ANY_HIT)
+                        {
+                            return hit_sphere;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            BvhStackEntry child = { node.first_child + (meta >> 3) - 1, entry_distances[slot] };
+            uint32_t position = child_count++;
+            while ((position > 0) && (children[position - 1].entry_distance > child.entry_distance))
+            {
+                children[position] = children[position - 1];
+                position -= 1;
+            }
+            children[position] = child;
+        }
+        while (child_count)
+        {
+            stack[stack_size++] = children[--child_count];
+        }
+    }
+    return hit_sphere;
+}
+
+// Walks bvh near child first and calls visit_leaf(first, count) for every leaf the ray
+// enters before *hit_distance, which visit_leaf may shorten as it finds hits.
+template <typename LeafFunction>
+static inline void walk_bvh(const Bvh &bvh, const Vector::Vector3 &ray_origin, const Vector::Vector3 &inverse_direction,
+                            const float *hit_distance,
+                            [[maybe_unused]] RayStatistics *statistics, LeafFunction visit_leaf)
+{
+    const BvhNode *nodes = bvh.nodes.data();
+    BvhStackEntry stack[BVH_MAX_DEPTH];
+    uint32_t stack_size = 0;
+    float entry_distance;
+    RAY_STATS(count_ray(statistics, RayCounter::BoxTests, 1));
+    if (!ray_hits_aabb(nodes[0].bounds, ray_origin, inverse_direction, *hit_distance, &entry_distance))
+    {
+        return;
+    }
+    stack[stack_size++] = BvhStackEntry { 0, entry_distance };
+
+    while (stack_size)
+    {
+        BvhStackEntry entry = stack[--stack_size];
+        // something closer was hit since this node was pushed
+        if (entry.entry_distance > *hit_distance)
+        {
+            continue;
+        }
+
+        const BvhNode *node = nodes + entry.node_index;
+        while (node->count == 0)
+        {
+            RAY_STATS(count_ray(statistics, RayCounter::BoxTests, 2));
+            uint32_t near_index = node->first;
+            uint32_t far_index = node->first + 1;
+            float near_entry, far_entry;
+            bool near_hit = ray_hits_aabb(nodes[near_index].bounds, ray_origin, inverse_direction, *hit_distance, &near_entry);
+            bool far_hit = ray_hits_aabb(nodes[far_index].bounds, ray_origin, inverse_direction, *hit_distance, &far_entry);
+            if (near_hit && far_hit)
+            {
+                if (far_entry < near_entry)
+                {
+                    std::swap(near_index, far_index);
+                    std::swap(near_entry, far_entry);
+                }
+                stack[stack_size++] = BvhStackEntry { far_index, far_entry };
+            }
+            else if (far_hit)
+            {
+                near_index = far_index;
+            }
+            else if (!near_hit)
+            {
+                node = nullptr;
+                break;
+            }
+            node = nodes + near_index;
+        }
+
+        if (node)
+        {
+            visit_leaf(node->first, node->count);
+        }
+    }
+}
+
+// Grid counterpart of walk_bvh: steps from cell to cell along the ray (Amanatides and Woo
+// 1987) and calls visit_cell(first, count) for every non-empty one.  Spheres span several
+// cells, so a hit can lie beyond the cell that found it; the walk stops only once the
+// nearest hit is no farther than the exit of the current cell.
+template <typename CellFunction>
+static inline void walk_grid(const Grid &grid, const Vector::Vector3 &ray_origin, const Vector::Vector3 &ray_direction,
+                             const Vector::Vector3 &inverse_direction, const float *hit_distance,
+                             [[maybe_unused]] RayStatistics *statistics, CellFunction visit_cell)
+{
+    float entry_distance;
+    if (!ray_hits_aabb(grid.bounds, ray_origin, inverse_direction, *hit_distance, &entry_distance))
+    {
+        return;
+    }
+
+    Vector::Vector3 entry_point = ray_origin + entry_distance * ray_direction;
+    uint32_t cell[3];
+    int32_t step[3];
+    uint32_t limit[3];
+    float next_crossing[3];
+    float crossing_step[3];
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        cell[axis] = grid_cell(grid, axis, vector_axis(entry_point, axis));
+        float direction = vector_axis(ray_direction, axis);
+        float inverse = vector_axis(inverse_direction, axis);
+        float cell_size = vector_axis(grid.cell_size, axis);
+        float cell_min = vector_axis(grid.bounds.min, axis) + static_cast<float>(cell[axis]) * cell_size;
+        float origin = vector_axis(ray_origin, axis);
+        if (direction > 0.0f)
+        {
+            step[axis] = 1;
+            limit[axis] = grid.resolution[axis];
+            next_crossing[axis] = (cell_min + cell_size - origin) * inverse;
+            crossing_step[axis] = cell_size * inverse;
+        }
+        else if (direction < 0.0f)
+        {
+            // cell coordinates wrap past 0 to UINT32_MAX
+            step[axis] = -1;
+            limit[axis] = UINT32_MAX;
+            next_crossing[axis] = (cell_min - origin) * inverse;
+            crossing_step[axis] = -cell_size * inverse;
+        }
+        else
+        {
+            step[axis] = 0;
+            limit[axis] = UINT32_MAX;
+            next_crossing[axis] = FLT_MAX;
+            crossing_step[axis] = 0.0f;
+        }
+    }
+
+    const uint32_t *cell_starts = grid.cell_starts.data();
+    for (;;)
+    {
+        // a cell step counts as a box test
+        RAY_STATS(count_ray(statistics, RayCounter::BoxTests, 1));
+        uint32_t cell_index = (cell[2] * grid.resolution[1] + cell[1]) * grid.resolution[0] + cell[0];
+        uint32_t first = cell_starts[cell_index];
+        uint32_t count = cell_starts[cell_index + 1] - first;
+        if (count)
+        {
+            visit_cell(first, count);
+        }
+
+        uint32_t axis = (next_crossing[0] < next_crossing[1]) ? ((next_crossing[0] < next_crossing[2]) ? 0 : 2)
+                                                              : ((next_crossing[1] < next_crossing[2]) ? 1 : 2);
+        if (*hit_distance <= next_crossing[axis])
+        {
+            return;
+        }
+        cell[axis] += static_cast<uint32_t>(step[axis]);
+        if (cell[axis] == limit[axis])
+        {
+            return;
+        }
+        next_crossing[axis] += crossing_step[axis];
+    }
+}
+
+// nearest of spheres[indices[first, first + count)] closer than *hit_distance, which it
+// then updates; with ANY_HIT, the first such sphere
+template <bool ANY_HIT>
+static inline const Sphere *intersect_sphere_range(const Sphere *spheres, const uint32_t *indices, uint32_t first,
+                                                   uint32_t count, const Vector::Vector3 &ray_origin,
+                                                   const Vector::Vector3 &ray_direction, float min_hit_distance,
+                                                   float tolerance, float *hit_distance,
+                                                   [[maybe_unused]] RayStatistics *statistics)
+{
+    const Sphere *hit_sphere = nullptr;
+    RAY_STATS(count_ray(statistics, RayCounter::SphereTests, count));
+    for (uint32_t index = first; index < first + count; ++index)
+    {
+        const Sphere &sphere = spheres[indices[index]];
+        float t;
+        if (intersect_sphere(sphere, ray_origin, ray_direction, min_hit_distance, tolerance, &t) && (t < *hit_distance))
+        {
+            *hit_distance = ANY_HIT ? ANY_HIT_FOUND : t;
+            hit_sphere = &sphere;
+            if (ANY_HIT)
+            {
+                break;
+            }
+        }
+    }
+    return hit_sphere;
+}
+
+// a BVH near child first when there is one, every sphere otherwise
+template <bool ANY_HIT>
+static inline const Sphere *intersect_indexed_spheres(const Sphere *spheres, uint32_t sphere_count, const Bvh &bvh,
+                                                      const Vector::Vector3 &ray_origin,
+                                                      const Vector::Vector3 &ray_direction, float min_hit_distance,
+                                                      float tolerance, float *hit_distance, RayStatistics *statistics)
+{
+    const Sphere *hit_sphere = nullptr;
+    if (bvh.nodes.empty())
+    {
+        RAY_STATS(count_ray(statistics, RayCounter::SphereTests, sphere_count));
+        for (uint32_t index = 0; index < sphere_count; ++index)
+        {
+            float t;
+            if (intersect_sphere(spheres[index], ray_origin, ray_direction, min_hit_distance, tolerance, &t) &&
+                (t < *hit_distance))
+            {
+                *hit_distance = ANY_HIT ? ANY_HIT_FOUND : t;
+                hit_sphere = spheres + index;
+                if (ANY_HIT)
+                {
+                    break;
+                }
+            }
+        }
+        return hit_sphere;
+    }
+
+    const uint32_t *primitive_indices = bvh.primitive_indices.data();
+    const Vector::Vector3 inverse_direction = { 1.0f / ray_direction.x, 1.0f / ray_direction.y, 1.0f / ray_direction.z };
+    walk_bvh(bvh, ray_origin, inverse_direction, hit_distance, statistics, [&](uint32_t first, uint32_t count)
+    {
+        const Sphere *sphere = intersect_sphere_range<ANY_HIT>(spheres, primitive_indices, first, count, ray_origin,
+                                                               ray_direction, min_hit_distance, tolerance, hit_distance,
+                                                               statistics);
+        hit_sphere = sphere ? sphere : hit_sphere;
+    });
+    return hit_sphere;
+}
+
+// instanced spheres: the top level finds the instances, and each one walks its object's
+// bottom level with the ray moved into object space
+template <bool ANY_HIT>
+static inline const Sphere *intersect_instances(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                                const Vector::Vector3 &ray_direction, float min_hit_distance,
+                                                float tolerance, float *hit_distance, RayStatistics *statistics,
+                                                const Instance **hit_instance)
+{
+    const Sphere *hit_sphere = nullptr;
+    const Instance *instances = scene->instances.data();
+    const SceneObject *objects = scene->objects.data();
+    auto visit_instance = [&](const Instance &instance)
+    {
+        const SceneObject &object = objects[instance.object];
+        // not renormalized, so distances along it match distances along the world ray
+        Vector::Vector3 object_origin = transform_point(instance.world_to_object, ray_origin);
+        Vector::Vector3 object_direction = transform_vector(instance.world_to_object, ray_direction);
+        const Sphere *sphere = intersect_indexed_spheres<ANY_HIT>(object.spheres.data(),
+                                                                  static_cast<uint32_t>(object.spheres.size()), object.bvh,
+                                                                  object_origin, object_direction, min_hit_distance,
+                                                                  tolerance, hit_distance, statistics);
+        if (sphere)
+        {
+            hit_sphere = sphere;
+            *hit_instance = &instance;
+        }
+    };
+
+    const Bvh &bvh = scene->instance_bvh;
+    if (bvh.nodes.empty())
+    {
+        for (const auto &instance : scene->instances)
+        {
+            visit_instance(instance);
+            if (ANY_HIT && hit_sphere)
+            {
+                break;
+            }
+        }
+        return hit_sphere;
+    }
+    const uint32_t *primitive_indices = bvh.primitive_indices.data();
+    const Vector::Vector3 inverse_direction = { 1.0f / ray_direction.x, 1.0f / ray_direction.y, 1.0f / ray_direction.z };
+    walk_bvh(bvh, ray_origin, inverse_direction, hit_distance, statistics, [&](uint32_t first, uint32_t count)
+    {
+        for (uint32_t index = first; index < first + count; ++index)
+        {
+            visit_instance(instances[primitive_indices[index]]);
+        }
+    });
+    return hit_sphere;
+}
+
+// Nearest sphere hit closer than *hit_distance, which it then updates; walks the scene's
+// wide BVH, grid or binary BVH, or tests every sphere when the scene has none, then the instances.
+// A sphere_list (see TileCulling.h) replaces all of that for the scene spheres.
+// *hit_instance is the instance the returned sphere belongs to, or null for scene spheres.
+// With ANY_HIT it stops at the first sphere closer than *hit_distance instead.
+template <bool ANY_HIT>
+static inline const Sphere *intersect_spheres(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                              const Vector::Vector3 &ray_direction, float min_hit_distance,
+                                              float tolerance, float *hit_distance, RayStatistics *statistics,
+                                              const Instance **hit_instance,
+                                              const std::vector<uint32_t> *sphere_list = nullptr)
+{
+    *hit_instance = nullptr;
+    const Sphere *hit_sphere = nullptr;
+    if (sphere_list)
+    {
+        hit_sphere = intersect_sphere_range<ANY_HIT>(scene->spheres.data(), sphere_list->data(), 0,
+                                                     static_cast<uint32_t>(sphere_list->size()), ray_origin,
+                                                     ray_direction, min_hit_distance, tolerance, hit_distance,
+                                                     statistics);
+    }
+    else if (!scene->sphere_wide_bvh.nodes.empty())
+    {
+        hit_sphere = intersect_spheres_wide<ANY_HIT>(scene, ray_origin, ray_direction, min_hit_distance, tolerance,
+                                                     hit_distance, statistics);
+    }
+    else if (!scene->sphere_grid.cell_starts.empty())
+    {
+        const Sphere *spheres = scene->spheres.data();
+        const uint32_t *primitive_indices = scene->sphere_grid.primitive_indices.data();
+        const Vector::Vector3 inverse_direction = { 1.0f / ray_direction.x, 1.0f / ray_direction.y, 1.0f / ray_direction.z };
+        walk_grid(scene->sphere_grid, ray_origin, ray_direction, inverse_direction, hit_distance, statistics,
+                  [&](uint32_t first, uint32_t count)
+        {
+            const Sphere *sphere = intersect_sphere_range<ANY_HIT>(spheres, primitive_indices, first, count, ray_origin,
+                                                                   ray_direction, min_hit_distance, tolerance,
+                                                                   hit_distance, statistics);
+            hit_sphere = sphere ? sphere : hit_sphere;
+        });
+    }
+    else
+    {
+        hit_sphere = intersect_indexed_spheres<ANY_HIT>(scene->spheres.data(),
+                                                        static_cast<uint32_t>(scene->spheres.size()), scene->sphere_bvh,
+                                                        ray_origin, ray_direction, min_hit_distance, tolerance,
+                                                        hit_distance, statistics);
+    }
+
+    if (!scene->instances.empty() && !(ANY_HIT && hit_sphere))
+    {
+        const Sphere *instanced_sphere = intersect_instances<ANY_HIT>(scene, ray_origin, ray_direction,
+                                                                      min_hit_distance, tolerance, hit_distance,
+                                                                      statistics, hit_instance);
+        hit_sphere = instanced_sphere ? instanced_sphere : hit_sphere;
+    }
+    return hit_sphere;
+}
+
+// nearest plane closer than *hit_distance, which it then updates; with ANY_HIT, the first
+template <bool ANY_HIT>
+static inline const Plane *intersect_planes(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                            const Vector::Vector3 &ray_direction, float min_hit_distance,
+                                            float tolerance, float *hit_distance,
+                                            [[maybe_unused]] RayStatistics *statistics)
+{
+    const Plane *hit_plane = nullptr;
+    RAY_STATS(count_ray(statistics, RayCounter::PlaneTests, scene->planes.size()));
+    for (auto &plane : scene->planes)
+    {
+        float denominator = Math::inner_product(plane.normal, ray_direction);
+
+        if ((denominator < -tolerance) || (denominator > tolerance))
+        {
+            float t = (-plane.distance_from_origin - Math::inner_product(plane.normal, ray_origin)) / denominator;
+            if ((t > min_hit_distance) && (t < *hit_distance))
+            {
+                *hit_distance = ANY_HIT ? ANY_HIT_FOUND : t;
+                hit_plane = &plane;
+                if (ANY_HIT)
+                {
+                    break;
+                }
+            }
+        }
+    }
+    return hit_plane;
+}
+
+// Nearest mesh triangle closer than *hit_distance, which it then updates, with its normal
+// turned to face the ray.  A mesh leaf covers blocks first / width up to its last triangle.
+// With ANY_HIT it stops at the first triangle closer than *hit_distance and leaves the normal.
+template <bool ANY_HIT>
+static inline const Mesh *intersect_meshes(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                           const Vector::Vector3 &ray_direction, float min_hit_distance,
+                                           float *hit_distance, RayStatistics *statistics, Vector::Vector3 *hit_normal)
+{
+    const Mesh *hit_mesh = nullptr;
+    const TriangleRay triangle_ray = make_triangle_ray(ray_origin, ray_direction);
+    const Vector::Vector3 inverse_direction = { 1.0f / ray_direction.x, 1.0f / ray_direction.y, 1.0f / ray_direction.z };
+    for (const auto &mesh : scene->meshes)
+    {
+        const TriangleBlock *blocks = mesh.geometry.blocks.data();
+        auto visit_leaf = [&](uint32_t first, uint32_t count)
+        {
+            uint32_t last_block = (first + count - 1) / TRIANGLE_BLOCK_WIDTH;
+            for (uint32_t block = first / TRIANGLE_BLOCK_WIDTH; block <= last_block; ++block)
+            {
+                RAY_STATS(count_ray(statistics, RayCounter::TriangleTests, TRIANGLE_BLOCK_WIDTH));
+                int32_t lane = intersect_triangle_block(blocks[block], triangle_ray, min_hit_distance, hit_distance);
+                if (lane >= 0)
+                {
+                    hit_mesh = &mesh;
+                    if (ANY_HIT)
+                    {
+                        *hit_distance = ANY_HIT_FOUND;
+                        return;
+                    }
+                    *hit_normal = triangle_block_normal(blocks[block], static_cast<uint32_t>(lane));
+                }
+            }
+        };
+
+        if (mesh.geometry.blocks.empty())
+        {
+            continue;
+        }
+        if (mesh.geometry.bvh.nodes.empty())
+        {
+            visit_leaf(0, static_cast<uint32_t>(mesh.geometry.blocks.size()) * TRIANGLE_BLOCK_WIDTH);
+        }
+        else
+        {
+            walk_bvh(mesh.geometry.bvh, ray_origin, inverse_direction, hit_distance, statistics, visit_leaf);
+        }
+        if (ANY_HIT && hit_mesh)
+        {
+            return hit_mesh;
+        }
+    }
+
+    if (hit_mesh)
+    {
+        *hit_normal = Math::normalize_or_zero(*hit_normal);
+        if (Math::inner_product(*hit_normal, ray_direction) > 0.0f)
+        {
+            *hit_normal = -*hit_normal;
+        }
+    }
+    return hit_mesh;
+}
+
+// Nearest sdf surface closer than *hit_distance, which it then updates; rays that miss an
+// sdf's bounds cost one box test.  With ANY_HIT it stops at the first one it hits.
+template <bool ANY_HIT>
+static inline const Sdf *intersect_sdfs(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                        const Vector::Vector3 &ray_direction, float min_hit_distance,
+                                        float *hit_distance, [[maybe_unused]] RayStatistics *statistics)
+{
+    const Sdf *hit_sdf = nullptr;
+    for (const auto &sdf : scene->sdfs)
+    {
+        uint32_t steps;
+        RAY_STATS(count_ray(statistics, RayCounter::BoxTests, 1));
+        bool hit = trace_sdf(sdf.surface, ray_origin, ray_direction, min_hit_distance, hit_distance, &steps);
+        RAY_STATS(count_ray(statistics, RayCounter::SdfSteps, steps));
+        if (hit)
+        {
+            hit_sdf = &sdf;
+            if (ANY_HIT)
+            {
+                *hit_distance = ANY_HIT_FOUND;
+                return hit_sdf;
+            }
+        }
+    }
+    return hit_sdf;
+}
+
+static inline void describe_plane_hit(const Scene *scene, const Plane *hit_plane, RayHit *hit)
+{
+    hit->kind = HitKind::Plane;
+    hit->primitive = static_cast<uint32_t>(hit_plane - scene->planes.data());
+    hit->material_name = hit_plane->material_name;
+    hit->normal = hit_plane->normal;
+}
+
+// hit_instance is null for scene spheres
+static inline void describe_sphere_hit(const Scene *scene, const Sphere *hit_sphere, const Instance *hit_instance,
+                                       const Vector::Vector3 &ray_origin, const Vector::Vector3 &ray_direction,
+                                       RayHit *hit)
+{
+    hit->material_name = hit_sphere->material_name;
+    if (hit_instance)
+    {
+        hit->kind = HitKind::InstancedSphere;
+        hit->primitive = static_cast<uint32_t>(hit_instance - scene->instances.data());
+        Vector::Vector3 object_point = transform_point(hit_instance->world_to_object,
+                                                       ray_origin + hit->distance * ray_direction);
+        hit->normal = Math::normalize_or_zero(transform_normal_by_inverse(hit_instance->world_to_object,
+                                                                          object_point - hit_sphere->position));
+    }
+    else
+    {
+        hit->kind = HitKind::Sphere;
+        hit->primitive = static_cast<uint32_t>(hit_sphere - scene->spheres.data());
+        hit->normal = Math::normalize_or_zero(hit->distance * ray_direction + (ray_origin - hit_sphere->position));
+    }
+}
+
+// the nearest mesh triangle closer than hit->distance, if any, replaces the hit
+static inline void intersect_scene_meshes(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                          const Vector::Vector3 &ray_direction, float min_hit_distance, RayHit *hit,
+                                          RayStatistics *statistics)
+{
+    if (!scene->meshes.empty())
+    {
+        const Mesh *hit_mesh = intersect_meshes<false>(scene, ray_origin, ray_direction, min_hit_distance,
+                                                       &hit->distance, statistics, &hit->normal);
+        if (hit_mesh)
+        {
+            hit->kind = HitKind::Triangle;
+            hit->primitive = static_cast<uint32_t>(hit_mesh - scene->meshes.data());
+            hit->material_name = hit_mesh->material_name;
+        }
+    }
+}
+
+// the nearest sdf surface closer than hit->distance, if any, replaces the hit
+static inline void intersect_scene_sdfs(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                        const Vector::Vector3 &ray_direction, float min_hit_distance, RayHit *hit,
+                                        RayStatistics *statistics)
+{
+    if (!scene->sdfs.empty())
+    {
+        const Sdf *hit_sdf = intersect_sdfs<false>(scene, ray_origin, ray_direction, min_hit_distance, &hit->distance,
+                                                   statistics);
+        if (hit_sdf)
+        {
+            hit->kind = HitKind::Sdf;
+            hit->primitive = static_cast<uint32_t>(hit_sdf - scene->sdfs.data());
+            hit->material_name = hit_sdf->material_name;
+            hit->normal = sdf_normal(hit_sdf->surface, ray_origin + hit->distance * ray_direction);
+        }
+    }
+}
+
+// Nearest hit of anything in the scene closer than hit->distance, described the way
+// cast_rays shades it; hit->kind stays None on a miss.  sphere_list as in intersect_spheres.
+static inline void intersect_scene(const Scene *scene, const Vector::Vector3 &ray_origin,
+                                   const Vector::Vector3 &ray_direction, float min_hit_distance, float tolerance,
+                                   RayHit *hit, RayStatistics *statistics,
+                                   const std::vector<uint32_t> *sphere_list = nullptr)
+{
+    const Plane *hit_plane = intersect_planes<false>(scene, ray_origin, ray_direction, min_hit_distance, tolerance,
+                                                     &hit->distance, statistics);
+    if (hit_plane)
+    {
+        describe_plane_hit(scene, hit_plane, hit);
+    }
+
+    const Instance *hit_instance;
+    const Sphere *hit_sphere = intersect_spheres<false>(scene, ray_origin, ray_direction, min_hit_distance, tolerance,
+                                                        &hit->distance, statistics, &hit_instance, sphere_list);
+    if (hit_sphere)
+    {
+        describe_sphere_hit(scene, hit_sphere, hit_instance, ray_origin, ray_direction, hit);
+    }
+
+    intersect_scene_meshes(scene, ray_origin, ray_direction, min_hit_distance, hit, statistics);
+    intersect_scene_sdfs(scene, ray_origin, ray_direction, min_hit_distance, hit, statistics);
+}
+
+// Adds what the ray found at this bounce to sample and, unless it escaped to the sky (and
+// false is returned), scatters it off the surface for the next bounce.
+static inline bool shade_hit(const Material *materials, const RayHit &hit, Math::RandomSeries *series,
+                             Vector::Vector3 *ray_origin, Vector::Vector3 *ray_direction,
+                             Vector::Vector3 *attenuation, Vector::Vector3 *sample,
+                             [[maybe_unused]] RayStatistics *statistics)
+{
+    if (hit.material_name == MaterialName::White)
+    {
+        const Material &material = materials[static_cast<uint32_t>(MaterialName::White)];
+        *sample += Math::hadamard_product(*attenuation, material.emit_color);
+        RAY_STATS(count_ray(statistics, RayCounter::SkyMisses, 1));
+        return false;
+    }
+
+    RAY_STATS(count_ray(statistics, (hit.kind == HitKind::Triangle) ? RayCounter::TriangleHits
+                                    : ((hit.kind == HitKind::Sdf) ? RayCounter::SdfHits
+                                    : ((hit.kind == HitKind::Plane) ? RayCounter::PlaneHits
+                                                                    : RayCounter::SphereHits)), 1));
+    const Material &material = materials[static_cast<uint32_t>(hit.material_name)];
+    const Vector::Vector3 next_normal = hit.normal;
+
+    *sample += Math::hadamard_product(*attenuation, material.emit_color);
+    float cosine_attenuation = (Math::inner_product(-*ray_direction, next_normal) + 0.5f);
+    cosine_attenuation = std::max(cosine_attenuation, 0.0f);
+
+    *attenuation = Math::hadamard_product(*attenuation, cosine_attenuation * material.reflection_color);
+    *ray_origin += hit.distance * *ray_direction;
+    Vector::Vector3 pure_bounce = *ray_direction - 2.0f * Math::inner_product(*ray_direction, next_normal) * next_normal;
+    Vector::Vector3 random_bounce = Math::normalize_or_zero(next_normal +
+                                                            Vector::Vector3 {random_bilateral(series),
+                                                                             random_bilateral(series),
+                                                                             random_bilateral(series)});
+    *ray_direction = Math::normalize_or_zero(Math::lerp(random_bounce, material.specular, pure_bounce));
+    return true;
+}
+
+// FIXED_BOUNCE_COUNT of 0 reads the bounce limit from the state; the common limits get
+// their own instantiation so the bounce loop keeps a compile-time trip count
+template <uint32_t FIXED_BOUNCE_COUNT>
 void cast_rays(CastState *state)
 {
     Scene *scene = state->scene;
+    const Material *materials = scene->materials.data();
     const float view_x = state->view_x;
     const float view_y = state->view_y;
     const float half_pixel_height = state->half_pixel_height;
@@ -15,137 +732,492 @@ void cast_rays(CastState *state)
     const float half_view_width = 0.5f * state->view_width;
     const float half_view_height = 0.5f * state->view_height;
 
-    const Vector::Vector3 camera_x_axis = state->camera_x_axis;
-    const Vector::Vector3 camera_y_axis = state->camera_y_axis;
-    const Vector::Vector3 camera_position = state->camera_position;
+    const Vector::Vector3 camera_x_axis = state->camera_x_axis;
+    const Vector::Vector3 camera_y_axis = state->camera_y_axis;
+    const Vector::Vector3 camera_position = state->camera_position;
+
+    Math::RandomSeries series = state->series;
+    const uint32_t rays_per_pixel = state->rays_per_pixel;
+    const uint32_t max_bounce_count = FIXED_BOUNCE_COUNT ? FIXED_BOUNCE_COUNT : state->max_bounce_count;
+    const float contribution = 1.0f / static_cast<float>(rays_per_pixel);
+
+    // kernel attribution costs a few counter reads per bounce, so it is only paid when asked for
+    PerfThreadCounters *perf = (state->perf && state->perf->profile_kernels) ? state->perf : nullptr;
+    RayStatistics *statistics = state->statistics;
+    const std::vector<uint32_t> *primary_spheres = state->primary_spheres;
+    const Vector::Vector3 *primary_directions = state->primary_directions;
+    const RayHit *primary_hits = state->primary_hits;
+
+    uint64_t bounces_computed = 0;
+    Vector::Vector3 final_color = {};
+
+    for (uint32_t ray_index = 0; ray_index < rays_per_pixel; ++ray_index)
+    {
+        Vector::Vector3 ray_origin = camera_position;
+        Vector::Vector3 ray_direction;
+        const RayHit *primary_hit = nullptr;
+        if (primary_hits)
+        {
+            uint32_t subpixel = ray_index % state->primary_hit_count;
+            ray_direction = primary_directions[subpixel];
+            primary_hit = primary_hits + subpixel;
+        }
+        else
+        {
+            float x_offset = view_x + random_bilateral(&series) * half_pixel_width;
+            float y_offset = view_y + random_bilateral(&series) * half_pixel_height;
+
+            Vector::Vector3 film_position = view_center + (x_offset * half_view_width * camera_x_axis)
+                               + (y_offset * half_view_height * camera_y_axis);
+            ray_direction = Math::normalize_or_zero(film_position - camera_position);
+        }
+
+        float min_hit_distance = MINIMUM_HIT_DISTANCE;
+        float tolerance = TOLERANCE;
+
+        Vector::Vector3 sample = {};
+        auto attenuation = Vector::Vector3 {1, 1, 1};
+        if (perf)
+        {
+            perf_kernel_mark(perf);
+        }
+        for (uint32_t bounces = 0; bounces < max_bounce_count; ++bounces)
+        {
+            RayHit hit = { FLOAT32_MAX, HitKind::None, 0, MaterialName::White, {} };
+            ++bounces_computed;
+            if (bounces || !primary_hit)
+            {
+                intersect_scene(scene, ray_origin, ray_direction, min_hit_distance, tolerance, &hit, statistics,
+                                bounces ? nullptr : primary_spheres);
+            }
+            else
+            {
+                hit = *primary_hit;
+            }
+
+            if (perf)
+            {
+                perf_kernel_finish(perf, PerfPhase::Intersection);
+            }
+
+            bool bounced = shade_hit(materials, hit, &series, &ray_origin, &ray_direction, &attenuation, &sample,
+                                     statistics);
+            if (perf)
+            {
+                perf_kernel_finish(perf, PerfPhase::Shading);
+            }
+            if (!bounced)
+            {
+                RAY_STATS(terminate_path(statistics, RayTermination::Sky, bounces + 1));
+                break;
+            }
+            RAY_STATS(if (bounces + 1 == max_bounce_count) { terminate_path(statistics, RayTermination::BounceLimit, bounces + 1); });
+        }
+
+        final_color += contribution * sample;
+    }
+
+    state->bounces_computed += bounces_computed;
+    state->final_color = final_color;
+}
+
+bool closest_hit(const Scene *scene, const Vector::Vector3 &ray_origin, const Vector::Vector3 &ray_direction,
+                 float max_distance, RayHit *hit, RayStatistics *statistics)
+{
+    *hit = RayHit { max_distance, HitKind::None, 0, MaterialName::White, {} };
+    intersect_scene(scene, ray_origin, ray_direction, MINIMUM_HIT_DISTANCE, TOLERANCE, hit, statistics);
+    return hit->kind != HitKind::None;
+}
+
+bool occluded(const Scene *scene, const Vector::Vector3 &ray_origin, const Vector::Vector3 &ray_direction,
+              float max_distance, RayStatistics *statistics)
+{
+    // planes first: a handful of dot products that often settle it
+    float hit_distance = max_distance;
+    const Instance *hit_instance;
+    return intersect_planes<true>(scene, ray_origin, ray_direction, MINIMUM_HIT_DISTANCE, TOLERANCE, &hit_distance,
+                                  statistics) ||
+           intersect_spheres<true>(scene, ray_origin, ray_direction, MINIMUM_HIT_DISTANCE, TOLERANCE, &hit_distance,
+                                   statistics, &hit_instance) ||
+           (!scene->meshes.empty() &&
+            intersect_meshes<true>(scene, ray_origin, ray_direction, MINIMUM_HIT_DISTANCE, &hit_distance, statistics,
+                                   nullptr)) ||
+           (!scene->sdfs.empty() &&
+            intersect_sdfs<true>(scene, ray_origin, ray_direction, MINIMUM_HIT_DISTANCE, &hit_distance, statistics));
+}
+
+CastRaysFunction *select_cast_rays(uint32_t max_bounce_count)
+{
+    switch (max_bounce_count)
+    {
+        case 1: return cast_rays<1>;
+        case 2: return cast_rays<2>;
+        case 4: return cast_rays<4>;
+        case 8: return cast_rays<8>;
+        case 16: return cast_rays<16>;
+        default: return cast_rays<0>;
+    }
+}
+
+auto get_pixel_pointer(ImageData image_data, uint32_t x, uint32_t y)
+{
+    uint32_t *result = image_data.pixels.get() + x + y * image_data.width;
+    return result;
+}
+
+auto synced_fetch_and_add(uint64_t volatile *value, uint64_t addend)
+{
+    uint64_t result = __sync_fetch_and_add(value, addend);
+    return result;
+}
+
+auto now_nanoseconds()
+{
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count());
+}
+
+// most paths a binned tile traces at once; tiles with more samples than that are traced in
+// passes of whole samples per pixel, which keeps a worker's path buffers to a few megabytes
+constexpr uint32_t MAX_BINNED_PATHS = 1u << 16;
+
+// each path has its own series, so the numbers it draws do not depend on the order rays are traced in
+static Math::RandomSeries path_series(Math::RandomSeries entropy, uint32_t path_number)
+{
+    uint32_t state = entropy.state * 0x9E3779B9u + (path_number + 1) * 0x85EBCA6Bu;
+    state ^= state >> 16;
+    state *= 0x7FEB352Du;
+    state ^= state >> 15;
+    return Math::RandomSeries { state ? state : 1u };
+}
 
-    Math::RandomSeries series = state->series;
+// Turns the active paths (in path order) into bin entries and sorts them, counting how alike
+// neighbouring rays were before the sort and after.
+static void sort_active_paths(const RayBinGrid &grid, const TilePath *paths, std::vector<uint64_t> *active,
+                              std::vector<uint64_t> *scratch, RayBinningStatistics *binning)
+{
+    uint64_t *entries = active->data();
+    const auto count = static_cast<uint32_t>(active->size());
+    for (uint32_t index = 1; index < count; ++index)
+    {
+        const TilePath &path = paths[entries[index - 1]];
+        const TilePath &next_path = paths[entries[index]];
+        count_ray_pair(&binning->unsorted, grid, path.ray_origin, path.ray_direction, next_path.ray_origin,
+                       next_path.ray_direction);
+    }
 
-    uint64_t bounces_computed = 0;
-    Vector::Vector3 final_color = {};
+    uint64_t sort_start = now_nanoseconds();
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        const TilePath &path = paths[entries[index]];
+        entries[index] |= static_cast<uint64_t>(ray_bin_key(grid, path.ray_origin, path.ray_direction)) << 32;
+    }
+    sort_ray_bins(active, scratch);
+    binning->sort_nanoseconds += now_nanoseconds() - sort_start;
+    binning->sorted_rays += count;
 
-    for (uint32_t ray_index = 0; ray_index < RAYS_PER_PIXEL; ++ray_index)
+    entries = active->data();
+    for (uint32_t index = 1; index < count; ++index)
     {
-        float x_offset = view_x + random_bilateral(&series) * half_pixel_width;
-        float y_offset = view_y + random_bilateral(&series) * half_pixel_height;
+        const TilePath &path = paths[static_cast<uint32_t>(entries[index - 1])];
+        const TilePath &next_path = paths[static_cast<uint32_t>(entries[index])];
+        count_ray_pair(&binning->sorted, grid, path.ray_origin, path.ray_direction, next_path.ray_origin,
+                       next_path.ray_direction);
+    }
+}
 
-        Vector::Vector3 film_position = view_center + (x_offset * half_view_width * camera_x_axis)
-                           + (y_offset * half_view_height * camera_y_axis);
+// The --sort-rays renderer: all of a tile's paths go out together, one bounce at a time, and
+// the rays of every bounce past the first are sorted on their bin keys before they are traced
+// (see RayBinning.h).  Leaves the tile's colors in worker->tile_colors, row by row, and
+// returns the bounces traced.
+static uint64_t trace_tile_binned(const TileQueue *queue, WorkerState *worker, const CastState &state,
+                                  const TileBatch &order)
+{
+    const Scene *scene = state.scene;
+    const Material *materials = scene->materials.data();
+    const RayBinGrid &grid = queue->ray_bin_grid;
+    RayStatistics *statistics = state.statistics;
+    const uint32_t tile_width = order.one_past_x_max - order.x_min;
+    const uint32_t pixel_count = tile_width * (order.one_past_y_max - order.y_min);
+    const uint32_t rays_per_pixel = state.rays_per_pixel;
+    const uint32_t max_bounce_count = state.max_bounce_count;
+    const float contribution = 1.0f / static_cast<float>(rays_per_pixel);
+    const float half_view_width = 0.5f * state.view_width;
+    const float half_view_height = 0.5f * state.view_height;
+    const uint32_t samples_per_pass = std::max(1u, std::min(rays_per_pixel, MAX_BINNED_PATHS / pixel_count));
+
+    const GBuffer *gbuffer = queue->gbuffer;
+    std::vector<TilePath> &paths = worker->paths;
+    std::vector<uint64_t> &active = worker->ray_bins;
+    worker->tile_colors.assign(pixel_count, Vector::Vector3 {});
+    uint64_t bounces_computed = 0;
 
-        Vector::Vector3 ray_origin = camera_position;
-        Vector::Vector3 ray_direction = Math::normalize_or_zero(film_position - camera_position);
+    for (uint32_t first_sample = 0; first_sample < rays_per_pixel; first_sample += samples_per_pass)
+    {
+        uint32_t one_past_last_sample = std::min(first_sample + samples_per_pass, rays_per_pixel);
+        paths.clear();
+        for (uint32_t pixel = 0; pixel < pixel_count; ++pixel)
+        {
+            uint32_t x = order.x_min + pixel % tile_width;
+            uint32_t y = order.y_min + pixel / tile_width;
+            float view_x = -1.0f + 2.0f * (static_cast<float>(x) / static_cast<float>(order.image_data.width));
+            float view_y = -1.0f + 2.0f * (static_cast<float>(y) / static_cast<float>(order.image_data.height));
+            for (uint32_t sample = first_sample; sample < one_past_last_sample; ++sample)
+            {
+                TilePath path = {};
+                path.series = path_series(order.entropy, pixel * rays_per_pixel + sample);
+                path.ray_origin = state.camera_position;
+                if (gbuffer)
+                {
+                    path.ray_direction = gbuffer->directions[gbuffer_subpixel(gbuffer, x, y, sample)];
+                }
+                else
+                {
+                    float x_offset = view_x + random_bilateral(&path.series) * state.half_pixel_width;
+                    float y_offset = view_y + random_bilateral(&path.series) * state.half_pixel_height;
+                    Vector::Vector3 film_position = state.view_center
+                                       + (x_offset * half_view_width * state.camera_x_axis)
+                                       + (y_offset * half_view_height * state.camera_y_axis);
+                    path.ray_direction = Math::normalize_or_zero(film_position - state.camera_position);
+                }
+                path.attenuation = Vector::Vector3 {1, 1, 1};
+                path.pixel = pixel;
+                path.active = true;
+                paths.push_back(path);
+            }
+        }
 
-        float min_hit_distance = MINIMUM_HIT_DISTANCE;
-        float tolerance = TOLERANCE;
+        // primary rays leave the camera in pixel order, which is as coherent as they get
+        active.clear();
+        for (uint32_t path_index = 0; path_index < paths.size(); ++path_index)
+        {
+            active.push_back(path_index);
+        }
+        for (uint32_t bounces = 0; (bounces < max_bounce_count) && !active.empty(); ++bounces)
+        {
+            if (bounces > 0)
+            {
+                sort_active_paths(grid, paths.data(), &active, &worker->ray_bin_scratch, &worker->binning_statistics);
+            }
+            for (uint64_t entry : active)
+            {
+                auto path_index = static_cast<uint32_t>(entry);
+                TilePath &path = paths[path_index];
+                RayHit hit = { FLOAT32_MAX, HitKind::None, 0, MaterialName::White, {} };
+                ++bounces_computed;
+                if (bounces || !gbuffer)
+                {
+                    intersect_scene(scene, path.ray_origin, path.ray_direction, MINIMUM_HIT_DISTANCE, TOLERANCE,
+                                    &hit, statistics, bounces ? nullptr : state.primary_spheres);
+                }
+                else
+                {
+                    // paths are made pixel by pixel, samples first_sample on of each in turn
+                    uint32_t pass_samples = one_past_last_sample - first_sample;
+                    uint32_t x = order.x_min + path.pixel % tile_width;
+                    uint32_t y = order.y_min + path.pixel / tile_width;
+                    hit = gbuffer->hits[gbuffer_subpixel(gbuffer, x, y, first_sample + path_index % pass_samples)];
+                }
+                if (!shade_hit(materials, hit, &path.series, &path.ray_origin, &path.ray_direction,
+                               &path.attenuation, &path.sample, statistics))
+                {
+                    path.active = false;
+                    RAY_STATS(terminate_path(statistics, RayTermination::Sky, bounces + 1));
+                }
+                else if (bounces + 1 == max_bounce_count)
+                {
+                    path.active = false;
+                    RAY_STATS(terminate_path(statistics, RayTermination::BounceLimit, bounces + 1));
+                }
+            }
 
-        Vector::Vector3 sample = {};
-        auto attenuation = Vector::Vector3 {1, 1, 1};
-        for (uint32_t bounces = 0; bounces < MAX_BOUNCE_COUNT; ++bounces)
+            // survivors go back to path order, the order they would be traced in unsorted
+            active.clear();
+            for (uint32_t path_index = 0; path_index < paths.size(); ++path_index)
+            {
+                if (paths[path_index].active)
+                {
+                    active.push_back(path_index);
+                }
+            }
+        }
+
+        for (const auto &path : paths)
         {
-            Vector::Vector3 next_normal = {};
-            float hit_distance = FLOAT32_MAX;
+            worker->tile_colors[path.pixel] += contribution * path.sample;
+        }
+    }
+    return bounces_computed;
+}
 
-            MaterialName hit_material_name = MaterialName::White;
-            ++bounces_computed;
+static uint32_t pack_pixel(const Vector::Vector3 &final_color)
+{
+    Vector::Vector3 bitmap_color =
+    {
+        255.0f * Math::linear_to_sRGB(final_color.x),
+        255.0f * Math::linear_to_sRGB(final_color.y),
+        255.0f * Math::linear_to_sRGB(final_color.z)
+    };
+    return Math::pack_BGRA(bitmap_color);
+}
+
+void setup_camera(const Camera &camera, uint32_t image_width, uint32_t image_height, CastState *state)
+{
+    state->camera_position = camera.position;
+    state->camera_z_axis = Math::normalize_or_zero(camera.position - camera.look_at);
+    state->camera_x_axis = Math::normalize_or_zero(Math::cross_product(camera.up, state->camera_z_axis));
+    state->camera_y_axis = Math::normalize_or_zero(Math::cross_product(state->camera_z_axis, state->camera_x_axis));
+
+    state->view_width = 1.0f;
+    state->view_height = 1.0f;
+
+    // correct ratio for unequal width and height
+    if (image_width > image_height)
+    {
+        state->view_height = state->view_width * (static_cast<float>(image_height) / static_cast<float>(image_width));
+    }
+    else if (image_height > image_width)
+    {
+        state->view_width = state->view_height * (static_cast<float>(image_width) / static_cast<float>(image_height));
+    }
+
+    state->view_center = state->camera_position - (camera.film_distance * state->camera_z_axis);
+
+    state->half_pixel_width = 0.5f / image_width;
+    state->half_pixel_height = 0.5f / image_height;
+}
+
+void build_gbuffer(const Scene *scene, uint32_t image_width, uint32_t image_height, uint32_t size,
+                   uint32_t thread_count, GBuffer *gbuffer)
+{
+    CastState camera = {};
+    setup_camera(scene->camera, image_width, image_height, &camera);
+    const Vector::Vector3 camera_position = camera.camera_position;
+    const float half_view_width = 0.5f * camera.view_width;
+    const float half_view_height = 0.5f * camera.view_height;
+    const uint32_t subpixel_count = size * size;
+    const size_t row_subpixels = static_cast<size_t>(image_width) * subpixel_count;
+
+    gbuffer->width = image_width;
+    gbuffer->height = image_height;
+    gbuffer->size = size;
+    gbuffer->directions.resize(row_subpixels * image_height);
+    gbuffer->hits.assign(row_subpixels * image_height, RayHit { FLOAT32_MAX, HitKind::None, 0, MaterialName::White, {} });
+
+    // each chunk is a band of rows, which it rasterizes every sphere into
+    parallel_chunks(image_height, resolve_thread_count(thread_count), [&](uint32_t, uint32_t row_begin, uint32_t row_end)
+    {
+        Vector::Vector3 *directions = gbuffer->directions.data();
+        RayHit *hits = gbuffer->hits.data();
+        const size_t band_begin = row_begin * row_subpixels;
+        const size_t band_end = row_end * row_subpixels;
 
-            for (auto &plane : scene->planes)
+        // the rays cast_rays would make, with the subpixel in place of the jitter
+        for (uint32_t y = row_begin; y < row_end; ++y)
+        {
+            float view_y = -1.0f + 2.0f * (static_cast<float>(y) / static_cast<float>(image_height));
+            for (uint32_t x = 0; x < image_width; ++x)
             {
-                float denominator = Math::inner_product(plane.normal, ray_direction);
+                float view_x = -1.0f + 2.0f * (static_cast<float>(x) / static_cast<float>(image_width));
+                Vector::Vector3 *pixel_directions = directions + gbuffer_subpixel(gbuffer, x, y, 0);
+                for (uint32_t subpixel = 0; subpixel < subpixel_count; ++subpixel)
+                {
+                    float x_offset = view_x + gbuffer_subpixel_offset(subpixel % size, size) * camera.half_pixel_width;
+                    float y_offset = view_y + gbuffer_subpixel_offset(subpixel / size, size) * camera.half_pixel_height;
+                    Vector::Vector3 film_position = camera.view_center + (x_offset * half_view_width * camera.camera_x_axis)
+                                       + (y_offset * half_view_height * camera.camera_y_axis);
+                    pixel_directions[subpixel] = Math::normalize_or_zero(film_position - camera_position);
+                }
+            }
+        }
 
-                if ((denominator < -tolerance) || (denominator > tolerance))
+        // planes cover the whole image; same arithmetic as intersect_planes
+        for (uint32_t plane_index = 0; plane_index < scene->planes.size(); ++plane_index)
+        {
+            const Plane &plane = scene->planes[plane_index];
+            float origin_distance = -plane.distance_from_origin - Math::inner_product(plane.normal, camera_position);
+            for (size_t subpixel = band_begin; subpixel < band_end; ++subpixel)
+            {
+                float denominator = Math::inner_product(plane.normal, directions[subpixel]);
+                if ((denominator < -TOLERANCE) || (denominator > TOLERANCE))
                 {
-                    float t = (-plane.distance_from_origin - Math::inner_product(plane.normal, ray_origin)) / denominator;
-                    if ((t > min_hit_distance) && (t < hit_distance))
+                    float t = origin_distance / denominator;
+                    if ((t > MINIMUM_HIT_DISTANCE) && (t < hits[subpixel].distance))
                     {
-                        hit_distance = t;
-                        hit_material_name = plane.material_name;
-
-                        next_normal = plane.normal;
+                        hits[subpixel].distance = t;
+                        hits[subpixel].kind = HitKind::Plane;
+                        hits[subpixel].primitive = plane_index;
                     }
                 }
             }
+        }
 
-            for (auto &sphere : scene->spheres)
+        // spheres only where their silhouettes fall
+        const Sphere *spheres = scene->spheres.data();
+        for (uint32_t sphere_index = 0; sphere_index < scene->spheres.size(); ++sphere_index)
+        {
+            const Sphere &sphere = spheres[sphere_index];
+            PixelRect rect = sphere_pixel_rect(camera, image_width, image_height, sphere);
+            for (uint32_t y = std::max(rect.y_min, row_begin); y < std::min(rect.one_past_y_max, row_end); ++y)
             {
-                Vector::Vector3 sphere_relative_ray_origin = ray_origin - sphere.position;
-                float a = Math::inner_product(ray_direction, ray_direction);
-                float b = 2.0f * Math::inner_product(ray_direction, sphere_relative_ray_origin);
-                float c = Math::inner_product(sphere_relative_ray_origin, sphere_relative_ray_origin) - (sphere.radius * sphere.radius);
-                float denominator = 2.0f * a;
-                float root_term = Math::square_root(b * b - 4.0f * a * c);
-
-                if (root_term > tolerance)
+                size_t first = gbuffer_subpixel(gbuffer, rect.x_min, y, 0);
+                size_t one_past_last = gbuffer_subpixel(gbuffer, rect.one_past_x_max, y, 0);
+                for (size_t subpixel = first; subpixel < one_past_last; ++subpixel)
                 {
-                    float positive_term = (-b + root_term) / denominator;
-                    float negative_term = (-b - root_term) / denominator;
-
-                    float t = positive_term;
-                    if ((negative_term > min_hit_distance) &&
-                        (negative_term < positive_term)) // better hit (hit's in front of us and closer)
-                    {
-                        t = negative_term;
-                    }
-                    if ((t > min_hit_distance) && (t < hit_distance))
+                    float t;
+                    if (intersect_sphere(sphere, camera_position, directions[subpixel], MINIMUM_HIT_DISTANCE,
+                                         TOLERANCE, &t) && (t < hits[subpixel].distance))
                     {
-                        hit_distance = t;
-                        hit_material_name = sphere.material_name;
-
-                        next_normal = Math::normalize_or_zero(t * ray_direction + sphere_relative_ray_origin);
+                        hits[subpixel].distance = t;
+                        hits[subpixel].kind = HitKind::Sphere;
+                        hits[subpixel].primitive = sphere_index;
                     }
                 }
             }
+        }
 
-            if (hit_material_name != MaterialName::White)
+        // instances, meshes and sdfs are traced, no farther than the depth so far, and every hit is
+        // described the way intersect_scene describes it
+        RayStatistics statistics = {};
+        for (size_t subpixel = band_begin; subpixel < band_end; ++subpixel)
+        {
+            RayHit *hit = hits + subpixel;
+            const Vector::Vector3 &ray_direction = directions[subpixel];
+            const Plane *hit_plane = (hit->kind == HitKind::Plane) ? &scene->planes[hit->primitive] : nullptr;
+            const Sphere *hit_sphere = (hit->kind == HitKind::Sphere) ? spheres + hit->primitive : nullptr;
+            const Instance *hit_instance = nullptr;
+            if (!scene->instances.empty())
             {
-                Material material = MATERIALS.at(hit_material_name);
-
-                sample += Math::hadamard_product(attenuation, material.emit_color);
-                float cosine_attenuation = (Math::inner_product(-ray_direction, next_normal) + 0.5f);
-                cosine_attenuation = std::max(cosine_attenuation, 0.0f);
-
-                attenuation = Math::hadamard_product(attenuation, cosine_attenuation * material.reflection_color);
-                ray_origin += hit_distance * ray_direction;
-                Vector::Vector3 pure_bounce = ray_direction - 2.0f * Math::inner_product(ray_direction, next_normal) * next_normal;
-                Vector::Vector3 random_bounce = Math::normalize_or_zero(next_normal +
-                                                                        Vector::Vector3 {random_bilateral(&series),
-                                                                                         random_bilateral(&series),
-                                                                                         random_bilateral(&series)});
-                ray_direction = Math::normalize_or_zero(Math::lerp(random_bounce, material.specular, pure_bounce));
+                const Sphere *instanced_sphere = intersect_instances<false>(scene, camera_position, ray_direction,
+                                                                            MINIMUM_HIT_DISTANCE, TOLERANCE,
+                                                                            &hit->distance, &statistics, &hit_instance);
+                hit_sphere = instanced_sphere ? instanced_sphere : hit_sphere;
             }
-            else
+            if (hit_plane)
             {
-                Material material = MATERIALS.at(MaterialName::White);
-                sample += Math::hadamard_product(attenuation, material.emit_color);
-                break;
+                describe_plane_hit(scene, hit_plane, hit);
             }
+            if (hit_sphere)
+            {
+                describe_sphere_hit(scene, hit_sphere, hit_instance, camera_position, ray_direction, hit);
+            }
+            intersect_scene_meshes(scene, camera_position, ray_direction, MINIMUM_HIT_DISTANCE, hit, &statistics);
+            intersect_scene_sdfs(scene, camera_position, ray_direction, MINIMUM_HIT_DISTANCE, hit, &statistics);
         }
-
-        final_color += CONTRIBUTION * sample;
-    }
-
-    state->bounces_computed += bounces_computed;
-    state->final_color = final_color;
-}
-
-auto get_pixel_pointer(ImageData image_data, uint32_t x, uint32_t y)
-{
-    uint32_t *result = image_data.pixels.get() + x + y * image_data.width;
-    return result;
-}
-
-auto synced_fetch_and_add(uint64_t volatile *value, uint64_t addend)
-{
-    uint64_t result = __sync_fetch_and_add(value, addend);
-    return result;
+    });
 }
 
-bool render_tile(TileQueue *queue)
+bool render_tile(TileQueue *queue, WorkerState *worker)
 {
+    uint64_t dequeue_start = now_nanoseconds();
     uint64_t work_order_index = synced_fetch_and_add(&queue->next_tile_batch_index, 1);
+    uint64_t tile_start = now_nanoseconds();
     if (work_order_index >= queue->tile_batch_count)
     {
+        // finding the queue empty is where the idle time starts, not queue time
         return false;
     }
+    worker->queue_nanoseconds += tile_start - dequeue_start;
     TileBatch *order = queue->tile_batches + work_order_index;
 
     ImageData image_data = order->image_data;
@@ -153,149 +1225,271 @@ bool render_tile(TileQueue *queue)
     uint32_t y_min = order->y_min;
     uint32_t one_past_x_max = order->one_past_x_max;
     uint32_t one_past_y_max = order->one_past_y_max;
-    float film_distance = 1.0f;
-
     CastState state = {};
 
     state.scene = order->scene;
     state.series = order->entropy;
+    state.perf = worker->perf;
+    state.statistics = &worker->statistics;
+    state.rays_per_pixel = queue->rays_per_pixel;
+    state.max_bounce_count = queue->max_bounce_count;
+    CastRaysFunction *cast_rays_function = queue->cast_rays;
 
-    state.camera_position = Vector::Vector3 {0, -10, 1};
-    state.camera_z_axis = Math::normalize_or_zero(state.camera_position);
-    state.camera_x_axis = Math::normalize_or_zero(Math::cross_product(Vector::Vector3 {0, 0, 1}, state.camera_z_axis));
-    state.camera_y_axis = Math::normalize_or_zero(Math::cross_product(state.camera_z_axis, state.camera_x_axis));
-
-    state.view_width = 1.0f;
-    state.view_height = 1.0f;
+    setup_camera(order->scene->camera, image_data.width, image_data.height, &state);
+    state.bounces_computed = 0;
 
-    // correct ratio for unequal width and height
-    if (image_data.width > image_data.height)
+    // a G-buffer already knows every primary hit, so there is nothing to cull for
+    const GBuffer *gbuffer = queue->gbuffer;
+    if (gbuffer)
     {
-        state.view_height = state.view_width * (static_cast<float>(image_data.height) / static_cast<float>(image_data.width));
+        state.primary_hit_count = gbuffer->size * gbuffer->size;
     }
-    else if (image_data.height > image_data.width)
+    else if (cull_tile_spheres(*state.scene, make_tile_frustum(state, *order), &worker->tile_spheres))
     {
-        state.view_width = state.view_height * (static_cast<float>(image_data.width) / static_cast<float>(image_data.height));
+        state.primary_spheres = &worker->tile_spheres;
     }
 
-    state.view_center = state.camera_position - (film_distance * state.camera_z_axis);
-
-    state.half_pixel_width = 0.5f / image_data.width;
-    state.half_pixel_height = 0.5f / image_data.height;
-
-    state.bounces_computed = 0;
+    // rows of the tile in the image, or in a buffer of the tile alone on its way to the file
+    const uint32_t tile_pixel_width = one_past_x_max - x_min;
+    TiledImageWriter *tiled_output = queue->tiled_output;
+    if (tiled_output)
+    {
+        worker->tile_pixels.resize(static_cast<size_t>(tile_pixel_width) * (one_past_y_max - y_min));
+    }
+    auto row_pixels = [&](uint32_t y)
+    {
+        return tiled_output ? worker->tile_pixels.data() + static_cast<size_t>(y - y_min) * tile_pixel_width
+                            : get_pixel_pointer(image_data, x_min, y);
+    };
+    Vector::Vector3 *linear_colors = queue->linear_colors;
+    auto linear_row = [&](uint32_t y)
+    {
+        return linear_colors + static_cast<size_t>(y) * image_data.width + x_min;
+    };
 
-    for (uint32_t y = y_min; y < one_past_y_max; ++y)
+    if (queue->sort_rays)
     {
-        uint32_t *pixels = get_pixel_pointer(image_data, x_min, y);
-        state.view_y = -1.0f + 2.0f * (static_cast<float>(y) / static_cast<float>(image_data.height));
-        for (uint32_t x = x_min; x < one_past_x_max; ++x)
+        state.bounces_computed = trace_tile_binned(queue, worker, state, *order);
+        const Vector::Vector3 *colors = worker->tile_colors.data();
+        for (uint32_t y = y_min; y < one_past_y_max; ++y)
         {
-            state.view_x = -1.0f + 2.0f * (static_cast<float>(x) / static_cast<float>(image_data.width));
-
-            cast_rays(&state);
-            Vector::Vector3 final_color = state.final_color;
-
-            Vector::Vector3 bitmap_color =
+            uint32_t *pixels = row_pixels(y);
+            if (linear_colors)
+            {
+                std::copy(colors, colors + tile_pixel_width, linear_row(y));
+            }
+            for (uint32_t x = x_min; x < one_past_x_max; ++x)
+            {
+                *pixels++ = pack_pixel(*colors++);
+            }
+        }
+    }
+    else
+    {
+        for (uint32_t y = y_min; y < one_past_y_max; ++y)
+        {
+            uint32_t *pixels = row_pixels(y);
+            state.view_y = -1.0f + 2.0f * (static_cast<float>(y) / static_cast<float>(image_data.height));
+            for (uint32_t x = x_min; x < one_past_x_max; ++x)
             {
-                255.0f * Math::linear_to_sRGB(final_color.x),
-                255.0f * Math::linear_to_sRGB(final_color.y),
-                255.0f * Math::linear_to_sRGB(final_color.z)
-            };
+                state.view_x = -1.0f + 2.0f * (static_cast<float>(x) / static_cast<float>(image_data.width));
+                if (gbuffer)
+                {
+                    size_t first_subpixel = gbuffer_subpixel(gbuffer, x, y, 0);
+                    state.primary_directions = gbuffer->directions.data() + first_subpixel;
+                    state.primary_hits = gbuffer->hits.data() + first_subpixel;
+                }
 
-            uint32_t packed_bitmap_color_value = Math::pack_BGRA(bitmap_color);
-            *pixels++ = packed_bitmap_color_value;
+                cast_rays_function(&state);
+                *pixels++ = pack_pixel(state.final_color);
+                if (linear_colors)
+                {
+                    linear_row(y)[x - x_min] = state.final_color;
+                }
+            }
         }
     }
 
+    if (tiled_output)
+    {
+        tiled_output->write_tile(x_min, y_min, tile_pixel_width, one_past_y_max - y_min, worker->tile_pixels.data(),
+                                 &worker->tile_samples);
+    }
+
+    uint64_t tile_end = now_nanoseconds();
     synced_fetch_and_add(&queue->bounces_computed, state.bounces_computed);
     synced_fetch_and_add(&queue->tiles_done, 1);
+    worker->queue_nanoseconds += now_nanoseconds() - tile_end;
+    worker->busy_nanoseconds += tile_end - tile_start;
+    worker->tiles_rendered += 1;
 
     return true;
 }
 
-void *process_tile_queue(void *queue)
+void begin_worker(TileQueue *queue, WorkerState *worker)
 {
-    auto *tile_queue = static_cast<TileQueue *>(queue);
-    while(render_tile(tile_queue)) {};
+    *worker = {};
 
-    return nullptr;
+    PerfSession *session = queue->perf_session;
+    if (session && session->enabled)
+    {
+        perf_thread_begin(session, &worker->perf_counters);
+        worker->perf = &worker->perf_counters;
+    }
 }
 
-int main(int argc, char **argv)
+// merges everything the worker collected into the queue's totals, once per thread
+void end_worker(TileQueue *queue, WorkerState *worker)
 {
-    ::testing::InitGoogleTest(&argc, argv);
-    RUN_ALL_TESTS();
+    if (worker->perf)
+    {
+        perf_thread_end(queue->perf_session, worker->perf);
+    }
+    RAY_STATS(merge_ray_statistics(queue->ray_statistics, &worker->statistics));
+}
 
-    std::cout << "clocks/sec: " << CLOCKS_PER_SEC << std::endl;
+void process_tile_queue(TileQueue *queue, WorkerState *worker)
+{
+    begin_worker(queue, worker);
+    while(render_tile(queue, worker)) {};
+    end_worker(queue, worker);
+}
 
-    Scene scene = {};
-    scene.planes.push_back(Plane { Vector::Vector3 {0.0f, 0.0f, 1.0f}, 0.0f, MaterialName::Metallic });
-    scene.spheres.push_back(Sphere { Vector::Vector3 {0.0f, 2.0f, 1.8f}, 0.5f, MaterialName::Orange});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-1.2f, 2.0f, 1.8f}, 0.5f, MaterialName::MirrorBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {0.0f, 2.0f, 2.9f}, 0.5f, MaterialName::MirrorBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {1.2f, 2.0f, 1.8f}, 0.5f, MaterialName::MirrorBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {0.0f, 2.0f, 0.7f}, 0.5f, MaterialName::MirrorBlue});
-
-    scene.spheres.push_back(Sphere { Vector::Vector3 {0.8f, -3.6f, 0.3f}, 0.25f, MaterialName::Green});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-1.7f, 4.2f, 0.3f}, 0.1f, MaterialName::LightBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-2.0f, 3.6f, 0.3f}, 0.1f, MaterialName::LightBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-2.5f, 3.2f, 0.3f}, 0.1f, MaterialName::LightBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-3.0f, 2.8f, 0.3f}, 0.1f, MaterialName::LightBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-3.4f, 2.4f, 0.3f}, 0.1f, MaterialName::LightBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-4.0f, 2.6f, 0.3f}, 0.1f, MaterialName::LightBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-4.5f, 2.8f, 0.3f}, 0.1f, MaterialName::LightBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-5.0f, 3.2f, 0.3f}, 0.1f, MaterialName::LightBlue});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-5.5f, 3.6f, 0.3f}, 0.1f, MaterialName::LightBlue});
-
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-1.2f, -4.6f, 0.3f}, 0.1f, MaterialName::Raspberry});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-1.8f, -4.6f, 0.3f}, 0.1f, MaterialName::Raspberry});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-1.4f, -5.3f, 0.3f}, 0.1f, MaterialName::Raspberry});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-1.6f, -4.0f, 0.3f}, 0.1f, MaterialName::Raspberry});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-1.4f, -5.0f, 0.15f}, 0.1f, MaterialName::Green});
-
-    scene.spheres.push_back(Sphere { Vector::Vector3 {4.0f, 1.0f, 2.0f}, 1.5f, MaterialName::Violet});
-    scene.spheres.push_back(Sphere { Vector::Vector3 {-4.0f, 5.0f, 1.0f}, 2.0f, MaterialName::LightGreen});
-
-    scene.spheres.push_back(Sphere { Vector::Vector3 {7.0f, 17.0f, 0.0f}, 5.0f, MaterialName::LightBlueReflective});
-
-    Bitmap bitmap = Bitmap(IMAGE_WIDTH, IMAGE_HEIGHT);
-    const ImageData *image_data = bitmap.get_image_data();
-
-    // 64x64 tiles seem to be a sweet spot; keeping at that resolution
-    uint32_t tile_width = 64;  // image_data->width / CORE_COUNT;
-    uint32_t tile_height = 64; // tile_width;
-
-    uint32_t tile_count_x = (IMAGE_WIDTH + tile_width - 1) / tile_width;
-    uint32_t tile_count_y = (IMAGE_HEIGHT + tile_height - 1) / tile_height;
+void build_default_scene(Scene *scene)
+{
+    scene->planes.push_back(Plane { Vector::Vector3 {0.0f, 0.0f, 1.0f}, 0.0f, MaterialName::Metallic });
+    scene->spheres.push_back(Sphere { Vector::Vector3 {0.0f, 2.0f, 1.8f}, 0.5f, MaterialName::Orange});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-1.2f, 2.0f, 1.8f}, 0.5f, MaterialName::MirrorBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {0.0f, 2.0f, 2.9f}, 0.5f, MaterialName::MirrorBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {1.2f, 2.0f, 1.8f}, 0.5f, MaterialName::MirrorBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {0.0f, 2.0f, 0.7f}, 0.5f, MaterialName::MirrorBlue});
+
+    scene->spheres.push_back(Sphere { Vector::Vector3 {0.8f, -3.6f, 0.3f}, 0.25f, MaterialName::Green});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-1.7f, 4.2f, 0.3f}, 0.1f, MaterialName::LightBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-2.0f, 3.6f, 0.3f}, 0.1f, MaterialName::LightBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-2.5f, 3.2f, 0.3f}, 0.1f, MaterialName::LightBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-3.0f, 2.8f, 0.3f}, 0.1f, MaterialName::LightBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-3.4f, 2.4f, 0.3f}, 0.1f, MaterialName::LightBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-4.0f, 2.6f, 0.3f}, 0.1f, MaterialName::LightBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-4.5f, 2.8f, 0.3f}, 0.1f, MaterialName::LightBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-5.0f, 3.2f, 0.3f}, 0.1f, MaterialName::LightBlue});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-5.5f, 3.6f, 0.3f}, 0.1f, MaterialName::LightBlue});
+
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-1.2f, -4.6f, 0.3f}, 0.1f, MaterialName::Raspberry});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-1.8f, -4.6f, 0.3f}, 0.1f, MaterialName::Raspberry});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-1.4f, -5.3f, 0.3f}, 0.1f, MaterialName::Raspberry});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-1.6f, -4.0f, 0.3f}, 0.1f, MaterialName::Raspberry});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-1.4f, -5.0f, 0.15f}, 0.1f, MaterialName::Green});
+
+    scene->spheres.push_back(Sphere { Vector::Vector3 {4.0f, 1.0f, 2.0f}, 1.5f, MaterialName::Violet});
+    scene->spheres.push_back(Sphere { Vector::Vector3 {-4.0f, 5.0f, 1.0f}, 2.0f, MaterialName::LightGreen});
+
+    scene->spheres.push_back(Sphere { Vector::Vector3 {7.0f, 17.0f, 0.0f}, 5.0f, MaterialName::LightBlueReflective});
+}
+
+bool build_scene(const RenderConfig &config, Scene *scene, std::string *error)
+{
+    SceneLayout layout;
+    if (!config.scene_file.empty())
+    {
+        if (is_binary_scene_file(config.scene_file))
+        {
+            return load_scene_binary(config.scene_file, scene, error);
+        }
+        return load_scene_text(config.scene_file, scene, error);
+    }
+    if (!config.scene_layout.empty() && parse_scene_layout(config.scene_layout, &layout))
+    {
+        generate_sphere_field(scene, layout, config.primitive_count, config.seed);
+        return true;
+    }
+
+    build_default_scene(scene);
+    return true;
+}
+
+// what secondary rays are binned over: everything bounded, and the camera
+static Aabb ray_bin_bounds(const Scene &scene)
+{
+    Aabb bounds = empty_aabb();
+    grow_aabb(&bounds, scene.camera.position);
+    for (const auto &sphere : scene.spheres)
+    {
+        grow_aabb(&bounds, sphere_bounds(sphere));
+    }
+    std::vector<Aabb> instance_bounds;
+    instance_world_bounds(scene, &instance_bounds);
+    for (const auto &box : instance_bounds)
+    {
+        grow_aabb(&bounds, box);
+    }
+    for (const auto &mesh : scene.meshes)
+    {
+        for (const auto &vertex : mesh.geometry.vertices)
+        {
+            grow_aabb(&bounds, vertex);
+        }
+    }
+    for (const auto &sdf : scene.sdfs)
+    {
+        grow_aabb(&bounds, sdf.surface.bounds);
+    }
+    return bounds;
+}
+
+void render_scene(Scene *scene, const RenderConfig &config, ImageData image_data, bool show_progress, RenderResult *result,
+                  TiledImageWriter *tiled_output, Vector::Vector3 *linear_colors)
+{
+    const uint32_t image_width = image_data.width;
+    const uint32_t image_height = image_data.height;
+    const uint32_t tile_width = config.tile_width;
+    const uint32_t tile_height = config.tile_height;
+    const uint32_t thread_count = resolve_thread_count(config.thread_count);
+
+    uint32_t tile_count_x = (image_width + tile_width - 1) / tile_width;
+    uint32_t tile_count_y = (image_height + tile_height - 1) / tile_height;
     uint32_t total_tiles = tile_count_x * tile_count_y;
 
-    std::cout << "Total tiles " << total_tiles << std::endl;
-    TileQueue queue = {};
-    queue.tile_batches = reinterpret_cast<TileBatch *>(malloc(total_tiles * sizeof(TileBatch)));
+    result->perf_session.enabled = config.perf_counters;
+    result->perf_session.profile_kernels = config.perf_kernels;
+    result->thread_count = thread_count;
+    result->total_tiles = total_tiles;
 
-    std::cout << "Configuration: " << CORE_COUNT << " cores with " << tile_width << "x" << tile_height
-              << " (" << (tile_width * tile_height * sizeof(uint32_t) / 1024) << "k/tile) " << "tiles\n";
-    std::cout << "Quality: " << RAYS_PER_PIXEL << " rays/pixel, " << MAX_BOUNCE_COUNT << " bounces (max) per ray\n";
+    TileQueue queue = {};
+    queue.perf_session = &result->perf_session;
+    queue.ray_statistics = &result->ray_statistics;
+    queue.rays_per_pixel = config.rays_per_pixel;
+    queue.max_bounce_count = config.max_bounce_count;
+    queue.cast_rays = select_cast_rays(config.max_bounce_count);
+    queue.sort_rays = config.sort_rays;
+    queue.tiled_output = tiled_output;
+    queue.linear_colors = linear_colors;
+    if (config.sort_rays)
+    {
+        queue.ray_bin_grid = make_ray_bin_grid(ray_bin_bounds(*scene));
+    }
+    // constructed, not malloc'ed: TileBatch holds the image's shared_ptr
+    std::vector<TileBatch> tile_batches(total_tiles);
+    queue.tile_batches = tile_batches.data();
 
     for (uint32_t tile_y = 0; tile_y < tile_count_y; ++tile_y)
     {
         uint32_t min_y = tile_y * tile_height;
         uint32_t one_past_max_y = min_y + tile_height;
-        one_past_max_y = std::min(one_past_max_y, IMAGE_HEIGHT);
+        one_past_max_y = std::min(one_past_max_y, image_height);
 
         for (uint32_t tile_x = 0; tile_x < tile_count_x; ++tile_x)
         {
             uint32_t min_x = tile_x * tile_width;
             uint32_t one_past_max_x = min_x + tile_width;
 
-            one_past_max_x = std::min(one_past_max_x, IMAGE_WIDTH);
+            one_past_max_x = std::min(one_past_max_x, image_width);
 
             TileBatch *batch = queue.tile_batches + queue.tile_batch_count++;
             assert(queue.tile_batch_count <= total_tiles);
 
-            batch->scene = &scene;
-            batch->image_data = *image_data;
+            batch->scene = scene;
+            batch->image_data = image_data;
             batch->x_min = min_x;
             batch->y_min = min_y;
             batch->one_past_x_max = one_past_max_x;
@@ -312,36 +1506,225 @@ int main(int argc, char **argv)
     // not *entirely* necessary, but it doesn't hurt
     synced_fetch_and_add(&queue.next_tile_batch_index, 0);
 
-    clock_t start_clock = clock();
+    auto start_time = std::chrono::steady_clock::now();
+    GBuffer gbuffer = {};
+    if (config.gbuffer_size)
+    {
+        build_gbuffer(scene, image_width, image_height, config.gbuffer_size, thread_count, &gbuffer);
+        queue.gbuffer = &gbuffer;
+        result->gbuffer_milliseconds =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    }
+
+    // workers are joined rather than detached so their counter totals are merged before reporting
+    std::vector<std::thread> workers;
+    // worker_states[0] belongs to the main thread
+    std::vector<WorkerState> worker_states(thread_count);
 
-    // To turn on/off multi-threading
-#if 1
     // core zero is occupied by main thread
-    for (uint32_t core_index = 1; core_index < CORE_COUNT; ++core_index)
+    for (uint32_t core_index = 1; core_index < thread_count; ++core_index)
     {
-        std::thread thread(process_tile_queue, &queue);
-        thread.detach();
+        workers.emplace_back(process_tile_queue, &queue, &worker_states[core_index]);
     }
-#endif
 
-    while (queue.tiles_done < total_tiles)
+    // the main thread renders like any worker until the queue is empty, then waits for the
+    // others in join, so its wait counts as idle time rather than as spinning on the queue
+    WorkerState &main_worker = worker_states[0];
+    begin_worker(&queue, &main_worker);
+    while (render_tile(&queue, &main_worker))
     {
-        if (render_tile(&queue))
+        if (show_progress)
         {
             std::cout << "\rRay casting " << (100 * static_cast<uint32_t>(queue.tiles_done) / total_tiles) << "%...";
             fflush(stdout);
         }
     }
-    clock_t end_clock = clock();
+    end_worker(&queue, &main_worker);
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    auto end_time = std::chrono::steady_clock::now();
+
+    result->elapsed_milliseconds = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    result->bounces_computed = queue.bounces_computed;
+    result->workers.clear();
+    for (const auto &worker : worker_states)
+    {
+        merge_ray_binning_statistics(&result->ray_binning, &worker.binning_statistics);
+        result->workers.push_back(WorkerTiming { static_cast<double>(worker.busy_nanoseconds) / 1.0e6,
+                                                 static_cast<double>(worker.queue_nanoseconds) / 1.0e6,
+                                                 worker.tiles_rendered });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    RUN_ALL_TESTS();
+
+    RenderConfig config;
+    std::string error;
+    if (!parse_command_line(&config, argc, argv, &error) || !validate_config(config, &error))
+    {
+        std::cerr << "error: " << error << "\n";
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (config.show_help)
+    {
+        print_usage(argv[0]);
+        return 0;
+    }
+    if (config.sweep)
+    {
+        return run_parameter_sweep(config);
+    }
+    if (config.scaling)
+    {
+        return run_thread_scaling(config);
+    }
+    if (config.scene_scaling)
+    {
+        return run_scene_scaling(config);
+    }
+    if (config.bvh_builders)
+    {
+        return run_bvh_builders(config);
+    }
+    if (config.compare_accelerators)
+    {
+        return run_accelerator_comparison(config);
+    }
+    if (config.occlusion)
+    {
+        return run_occlusion_benchmark(config);
+    }
+    if (config.frame_count)
+    {
+        return run_animation(config);
+    }
+
+    Scene scene = {};
+    auto load_start = std::chrono::steady_clock::now();
+    if (!build_scene(config, &scene, &error))
+    {
+        std::cerr << "error: " << error << "\n";
+        return 1;
+    }
+    auto load_end = std::chrono::steady_clock::now();
+    if (!config.scene_file.empty())
+    {
+        uint64_t triangles = 0;
+        for (const auto &mesh : scene.meshes)
+        {
+            triangles += triangle_count(mesh.geometry);
+        }
+        std::cout << "Loaded " << config.scene_file << ": " << scene.spheres.size() << " spheres, "
+                  << scene.planes.size() << " planes, " << triangles << " triangles, " << scene.sdfs.size()
+                  << " sdf surfaces in "
+                  << std::chrono::duration<double, std::milli>(load_end - load_start).count() << "ms\n";
+    }
+    if (!config.write_scene_file.empty())
+    {
+        bool written = has_binary_scene_extension(config.write_scene_file) ?
+                       write_scene_binary(scene, config.write_scene_file, &error) :
+                       write_scene_text(scene, config.write_scene_file, &error);
+        if (!written)
+        {
+            std::cerr << "error: " << error << "\n";
+            return 1;
+        }
+        std::cout << "wrote " << config.write_scene_file << "\n";
+        return 0;
+    }
+
+    AccelerationReport acceleration = {};
+    prepare_acceleration(config, &scene, &acceleration);
+    print_acceleration_report(acceleration);
+
+    // a tiled output file is written tile by tile and the image never exists whole
+    const bool tiled_output = has_tiled_image_extension(config.output_file);
+    Bitmap bitmap = tiled_output ? Bitmap(0, 0) : Bitmap(config.image_width, config.image_height);
+    if (config.map_output && !bitmap.map_file(config.output_file, &error))
+    {
+        std::cerr << "error: " << error << "\n";
+        return 1;
+    }
+    ImageData image_data = *bitmap.get_image_data();
+    TiledImageWriter tiled_writer;
+    if (tiled_output)
+    {
+        image_data = ImageData { config.image_width, config.image_height, nullptr };
+        if (!tiled_writer.create(config.output_file, config.image_width, config.image_height, config.tile_width,
+                                 config.tile_height, &error))
+        {
+            std::cerr << "error: " << error << "\n";
+            return 1;
+        }
+    }
+
+    const uint32_t tile_width = config.tile_width;
+    const uint32_t tile_height = config.tile_height;
+    std::cout << "Configuration: " << resolve_thread_count(config.thread_count) << " cores with "
+              << tile_width << "x" << tile_height
+              << " (" << (tile_width * tile_height * sizeof(uint32_t) / 1024) << "k/tile) " << "tiles\n";
+    std::cout << "Quality: " << config.rays_per_pixel << " rays/pixel, " << config.max_bounce_count
+              << " bounces (max) per ray\n";
+
+    std::vector<Vector::Vector3> linear_colors;
+    if (!config.hdr_output_file.empty())
+    {
+        linear_colors.resize(static_cast<size_t>(config.image_width) * config.image_height);
+    }
+
+    RenderResult result = {};
+    render_scene(&scene, config, image_data, true, &result, tiled_output ? &tiled_writer : nullptr,
+                 linear_colors.empty() ? nullptr : linear_colors.data());
 
-    double time_elapsed = (end_clock - start_clock) / ((CLOCKS_PER_SEC * CORE_COUNT) / 1000);
+    double time_elapsed = result.elapsed_milliseconds;
     std::cout << std::endl;
+    std::cout << "Total tiles " << result.total_tiles << std::endl;
     std::cout << "Ray casting time: " << time_elapsed << "ms\n";
-    std::cout << "Total bounces: " << queue.bounces_computed << std::endl;
-    std::cout << "Performance: " << std::fixed << (time_elapsed / queue.bounces_computed) << "ms/bounce\n";
+    if (config.gbuffer_size)
+    {
+        std::cout << "G-buffer: " << config.gbuffer_size << "x" << config.gbuffer_size << " subpixels per pixel in "
+                  << result.gbuffer_milliseconds << "ms\n";
+    }
+    std::cout << "Total bounces: " << result.bounces_computed << std::endl;
+    std::cout << "Performance: " << std::fixed << (time_elapsed / result.bounces_computed) << "ms/bounce\n";
+    perf_print_report(&result.perf_session, result.bounces_computed);
+    print_ray_statistics(&result.ray_statistics);
+    if (config.sort_rays)
+    {
+        print_ray_binning_statistics(&result.ray_binning);
+    }
 
-    std::string file_name = "test.bmp";
-    bitmap.write_image(file_name);
+    if (!tiled_output)
+    {
+        bitmap.write_image(config.output_file);
+    }
+    else if (!tiled_writer.close(&error))
+    {
+        std::cerr << "error: " << config.output_file << ": " << error << "\n";
+        return 1;
+    }
+    if (!config.hdr_output_file.empty())
+    {
+        ExrCompression compression = ExrCompression::Zip;
+        parse_exr_compression(config.exr_compression, &compression);
+        auto hdr_start = std::chrono::steady_clock::now();
+        if (!write_hdr_image(config.hdr_output_file, config.image_width, config.image_height, linear_colors.data(),
+                             compression, resolve_thread_count(config.thread_count), &error))
+        {
+            std::cerr << "error: " << error << "\n";
+            return 1;
+        }
+        std::cout << "Wrote " << config.hdr_output_file << " in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - hdr_start).count()
+                  << "ms\n";
+    }
 
     std::cout << "\nShit's Done, Bitch!\n";
     return 0;
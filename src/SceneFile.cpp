@@ -0,0 +1,528 @@
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include "../include/Instancing.h"
+#include "../include/MappedFile.h"
+#include "../include/MeshFile.h"
+#include "../include/SceneFile.h"
+
+struct SceneToken
+{
+    const char *start;
+    size_t length;
+};
+
+struct SceneTokenizer
+{
+    const char *cursor;
+    const char *end;
+    uint32_t line;
+};
+
+static bool is_blank(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static bool token_equals(const SceneToken &token, const char *text)
+{
+    size_t length = strlen(text);
+    return (token.length == length) && (memcmp(token.start, text, length) == 0);
+}
+
+// next token on the current line; false once the line (or a comment) ends
+static bool next_token(SceneTokenizer *tokenizer, SceneToken *token)
+{
+    const char *cursor = tokenizer->cursor;
+    const char *end = tokenizer->end;
+    while ((cursor < end) && is_blank(*cursor))
+    {
+        ++cursor;
+    }
+    if ((cursor == end) || (*cursor == '\n') || (*cursor == '#'))
+    {
+        tokenizer->cursor = cursor;
+        return false;
+    }
+
+    const char *start = cursor;
+    while ((cursor < end) && !is_blank(*cursor) && (*cursor != '\n') && (*cursor != '#'))
+    {
+        ++cursor;
+    }
+    tokenizer->cursor = cursor;
+    *token = SceneToken { start, static_cast<size_t>(cursor - start) };
+    return true;
+}
+
+static void next_line(SceneTokenizer *tokenizer)
+{
+    const void *newline = memchr(tokenizer->cursor, '\n', static_cast<size_t>(tokenizer->end - tokenizer->cursor));
+    tokenizer->cursor = newline ? (static_cast<const char *>(newline) + 1) : tokenizer->end;
+    ++tokenizer->line;
+}
+
+static bool parse_float(SceneTokenizer *tokenizer, float *value)
+{
+    SceneToken token = {};
+    if (!next_token(tokenizer, &token))
+    {
+        return false;
+    }
+    auto result = std::from_chars(token.start, token.start + token.length, *value);
+    return (result.ec == std::errc()) && (result.ptr == token.start + token.length);
+}
+
+static bool parse_vector(SceneTokenizer *tokenizer, Vector::Vector3 *value)
+{
+    return parse_float(tokenizer, &value->x) && parse_float(tokenizer, &value->y) && parse_float(tokenizer, &value->z);
+}
+
+// material names point either at BUILTIN_MATERIAL_NAMES or into the mapped file
+struct MaterialTable
+{
+    std::vector<SceneToken> names;
+    uint32_t last_match;
+};
+
+static bool find_material(MaterialTable *table, const SceneToken &name, uint32_t *index)
+{
+    // primitives tend to come in runs of the same material
+    auto matches = [&name](const SceneToken &candidate)
+    {
+        return (candidate.length == name.length) && (memcmp(candidate.start, name.start, name.length) == 0);
+    };
+    if ((table->last_match < table->names.size()) && matches(table->names[table->last_match]))
+    {
+        *index = table->last_match;
+        return true;
+    }
+
+    for (uint32_t material_index = 0; material_index < table->names.size(); ++material_index)
+    {
+        if (matches(table->names[material_index]))
+        {
+            table->last_match = material_index;
+            *index = material_index;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_material_reference(SceneTokenizer *tokenizer, MaterialTable *table, MaterialName *material_name)
+{
+    SceneToken token = {};
+    uint32_t index = 0;
+    if (!next_token(tokenizer, &token) || !find_material(table, token, &index))
+    {
+        return false;
+    }
+    *material_name = static_cast<MaterialName>(index);
+    return true;
+}
+
+static bool find_object(const std::vector<SceneToken> &names, const SceneToken &name, uint32_t *index)
+{
+    for (uint32_t object_index = 0; object_index < names.size(); ++object_index)
+    {
+        if ((names[object_index].length == name.length) && (memcmp(names[object_index].start, name.start, name.length) == 0))
+        {
+            *index = object_index;
+            return true;
+        }
+    }
+    return false;
+}
+
+// tx ty tz, or all 12 entries of the matrix
+static bool parse_transform(SceneTokenizer *tokenizer, Transform *transform)
+{
+    Vector::Vector3 translation = {};
+    if (!parse_vector(tokenizer, &translation))
+    {
+        return false;
+    }
+    SceneTokenizer matrix = *tokenizer;
+    float entries[12] = { translation.x, translation.y, translation.z };
+    if (!parse_float(&matrix, &entries[3]))
+    {
+        *transform = identity_transform();
+        transform->m[0][3] = translation.x;
+        transform->m[1][3] = translation.y;
+        transform->m[2][3] = translation.z;
+        return true;
+    }
+    for (uint32_t entry = 4; entry < 12; ++entry)
+    {
+        if (!parse_float(&matrix, &entries[entry]))
+        {
+            return false;
+        }
+    }
+    *tokenizer = matrix;
+    memcpy(transform->m, entries, sizeof(entries));
+    return true;
+}
+
+static bool fail(const SceneTokenizer &tokenizer, const char *message, std::string *error)
+{
+    *error = "line " + std::to_string(tokenizer.line) + ": " + message;
+    return false;
+}
+
+bool parse_scene_text(const char *text, size_t size, Scene *scene, std::string *error)
+{
+    *scene = {};
+
+    // one primitive per line at most, so the line count bounds the arrays
+    size_t line_count = 1;
+    const char *end = text + size;
+    for (const char *cursor = text; size && (cursor = static_cast<const char *>(memchr(cursor, '\n', end - cursor)));)
+    {
+        ++line_count;
+        ++cursor;
+    }
+    scene->spheres.reserve(line_count);
+
+    MaterialTable table = {};
+    for (uint32_t material_index = 0; material_index < BUILTIN_MATERIAL_COUNT; ++material_index)
+    {
+        const char *name = BUILTIN_MATERIAL_NAMES[material_index];
+        table.names.push_back(SceneToken { name, strlen(name) });
+    }
+
+    std::vector<SceneToken> object_names;
+    // the object whose spheres are being read, or null outside object ... end
+    SceneObject *open_object = nullptr;
+    // likewise the sdf whose shapes are being read
+    Sdf *open_sdf = nullptr;
+
+    SceneTokenizer tokenizer = { text, text + size, 1 };
+    while (tokenizer.cursor < tokenizer.end)
+    {
+        SceneToken keyword = {};
+        if (!next_token(&tokenizer, &keyword))
+        {
+            next_line(&tokenizer);
+            continue;
+        }
+
+        if (open_sdf && !token_equals(keyword, "end"))
+        {
+            if (token_equals(keyword, "sphere"))
+            {
+                SdfSphere sphere = {};
+                if (!parse_vector(&tokenizer, &sphere.center) || !parse_float(&tokenizer, &sphere.radius))
+                {
+                    return fail(tokenizer, "sdf sphere expects x y z radius", error);
+                }
+                open_sdf->surface.spheres.push_back(sphere);
+            }
+            else if (token_equals(keyword, "box"))
+            {
+                SdfBox box = {};
+                if (!parse_vector(&tokenizer, &box.center) || !parse_vector(&tokenizer, &box.half_extent))
+                {
+                    return fail(tokenizer, "sdf box expects x y z hx hy hz", error);
+                }
+                open_sdf->surface.boxes.push_back(box);
+            }
+            else
+            {
+                return fail(tokenizer, "only spheres and boxes can go between sdf and end", error);
+            }
+        }
+        else if (token_equals(keyword, "sphere"))
+        {
+            Sphere sphere = {};
+            if (!parse_vector(&tokenizer, &sphere.position) || !parse_float(&tokenizer, &sphere.radius))
+            {
+                return fail(tokenizer, "sphere expects x y z radius MATERIAL", error);
+            }
+            if (!parse_material_reference(&tokenizer, &table, &sphere.material_name))
+            {
+                return fail(tokenizer, "sphere has an unknown material", error);
+            }
+            if (open_object)
+            {
+                open_object->spheres.push_back(sphere);
+            }
+            else
+            {
+                scene->spheres.push_back(sphere);
+            }
+        }
+        else if (open_object && !token_equals(keyword, "end"))
+        {
+            return fail(tokenizer, "only spheres can go between object and end", error);
+        }
+        else if (token_equals(keyword, "plane"))
+        {
+            Plane plane = {};
+            if (!parse_vector(&tokenizer, &plane.normal) || !parse_float(&tokenizer, &plane.distance_from_origin))
+            {
+                return fail(tokenizer, "plane expects nx ny nz distance MATERIAL", error);
+            }
+            if (!parse_material_reference(&tokenizer, &table, &plane.material_name))
+            {
+                return fail(tokenizer, "plane has an unknown material", error);
+            }
+            scene->planes.push_back(plane);
+        }
+        else if (token_equals(keyword, "material"))
+        {
+            SceneToken name = {};
+            Material material = {};
+            if (!next_token(&tokenizer, &name) || !parse_float(&tokenizer, &material.specular) ||
+                !parse_vector(&tokenizer, &material.emit_color) || !parse_vector(&tokenizer, &material.reflection_color))
+            {
+                return fail(tokenizer, "material expects NAME specular er eg eb rr rg rb", error);
+            }
+
+            uint32_t index = 0;
+            if (find_material(&table, name, &index))
+            {
+                scene->materials[index] = material;
+            }
+            else
+            {
+                table.names.push_back(name);
+                scene->materials.push_back(material);
+            }
+        }
+        else if (token_equals(keyword, "object"))
+        {
+            SceneToken name = {};
+            uint32_t index = 0;
+            if (!next_token(&tokenizer, &name))
+            {
+                return fail(tokenizer, "object expects NAME", error);
+            }
+            if (find_object(object_names, name, &index))
+            {
+                return fail(tokenizer, "object is already defined", error);
+            }
+            object_names.push_back(name);
+            scene->objects.emplace_back();
+            open_object = &scene->objects.back();
+        }
+        else if (token_equals(keyword, "sdf"))
+        {
+            Sdf sdf = {};
+            if (!parse_material_reference(&tokenizer, &table, &sdf.material_name) ||
+                !parse_float(&tokenizer, &sdf.surface.smoothness))
+            {
+                return fail(tokenizer, "sdf expects MATERIAL smoothness", error);
+            }
+            if (sdf.surface.smoothness < 0.0f)
+            {
+                return fail(tokenizer, "sdf smoothness cannot be negative", error);
+            }
+            scene->sdfs.push_back(std::move(sdf));
+            open_sdf = &scene->sdfs.back();
+        }
+        else if (token_equals(keyword, "end"))
+        {
+            if (open_sdf)
+            {
+                if (open_sdf->surface.spheres.empty() && open_sdf->surface.boxes.empty())
+                {
+                    return fail(tokenizer, "sdf has no shapes", error);
+                }
+                finish_sdf_surface(&open_sdf->surface);
+                open_sdf = nullptr;
+            }
+            else
+            {
+                if (!open_object)
+                {
+                    return fail(tokenizer, "end without object or sdf", error);
+                }
+                if (open_object->spheres.empty())
+                {
+                    return fail(tokenizer, "object has no spheres", error);
+                }
+                open_object = nullptr;
+            }
+        }
+        else if (token_equals(keyword, "instance"))
+        {
+            SceneToken name = {};
+            uint32_t index = 0;
+            Transform transform = {};
+            if (!next_token(&tokenizer, &name) || !find_object(object_names, name, &index))
+            {
+                return fail(tokenizer, "instance of an unknown object", error);
+            }
+            if (!parse_transform(&tokenizer, &transform))
+            {
+                return fail(tokenizer, "instance expects NAME tx ty tz, or NAME and 12 matrix entries", error);
+            }
+            if (!add_instance(scene, index, transform))
+            {
+                return fail(tokenizer, "instance transform cannot be inverted", error);
+            }
+        }
+        else if (token_equals(keyword, "mesh"))
+        {
+            SceneToken file_name = {};
+            Mesh mesh = {};
+            if (!next_token(&tokenizer, &file_name) || !parse_material_reference(&tokenizer, &table, &mesh.material_name))
+            {
+                return fail(tokenizer, "mesh expects FILE MATERIAL", error);
+            }
+            mesh.file_name.assign(file_name.start, file_name.length);
+            scene->meshes.push_back(std::move(mesh));
+        }
+        else if (token_equals(keyword, "camera"))
+        {
+            Camera camera = DEFAULT_CAMERA;
+            if (!parse_vector(&tokenizer, &camera.position) || !parse_vector(&tokenizer, &camera.look_at))
+            {
+                return fail(tokenizer, "camera expects px py pz lx ly lz [ux uy uz [film_distance]]", error);
+            }
+
+            SceneTokenizer optional = tokenizer;
+            if (parse_vector(&optional, &camera.up))
+            {
+                tokenizer = optional;
+                if (parse_float(&optional, &camera.film_distance))
+                {
+                    tokenizer = optional;
+                }
+            }
+            scene->camera = camera;
+        }
+        else
+        {
+            return fail(tokenizer, "unknown statement", error);
+        }
+
+        SceneToken trailing = {};
+        if (next_token(&tokenizer, &trailing))
+        {
+            return fail(tokenizer, "unexpected text after statement", error);
+        }
+        next_line(&tokenizer);
+    }
+
+    if (open_object)
+    {
+        return fail(tokenizer, "object without end", error);
+    }
+    if (open_sdf)
+    {
+        return fail(tokenizer, "sdf without end", error);
+    }
+    return true;
+}
+
+bool load_scene_text(const std::string &file_name, Scene *scene, std::string *error)
+{
+    MappedFile file;
+    if (!file.open(file_name, error))
+    {
+        return false;
+    }
+    if (!parse_scene_text(reinterpret_cast<const char *>(file.data()), file.size(), scene, error))
+    {
+        *error = file_name + ": " + *error;
+        return false;
+    }
+    size_t slash = file_name.rfind('/');
+    std::string directory = (slash == std::string::npos) ? std::string() : file_name.substr(0, slash);
+    return load_scene_meshes(scene, directory, resolve_thread_count(DEFAULT_THREAD_COUNT), error);
+}
+
+bool write_scene_text(const Scene &scene, const std::string &file_name, std::string *error)
+{
+    FILE *file = fopen(file_name.c_str(), "w");
+    if (!file)
+    {
+        *error = "cannot write '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+
+    // materials past the built-in ones have no name left once loaded; number them
+    std::vector<std::string> names(BUILTIN_MATERIAL_NAMES, BUILTIN_MATERIAL_NAMES + BUILTIN_MATERIAL_COUNT);
+    for (size_t material_index = BUILTIN_MATERIAL_COUNT; material_index < scene.materials.size(); ++material_index)
+    {
+        names.push_back("Material" + std::to_string(material_index));
+    }
+
+    const Camera &camera = scene.camera;
+    fprintf(file, "camera %.9g %.9g %.9g  %.9g %.9g %.9g  %.9g %.9g %.9g  %.9g\n",
+            camera.position.x, camera.position.y, camera.position.z,
+            camera.look_at.x, camera.look_at.y, camera.look_at.z,
+            camera.up.x, camera.up.y, camera.up.z, camera.film_distance);
+
+    for (size_t material_index = 0; material_index < scene.materials.size(); ++material_index)
+    {
+        const Material &material = scene.materials[material_index];
+        fprintf(file, "material %s %.9g  %.9g %.9g %.9g  %.9g %.9g %.9g\n", names[material_index].c_str(),
+                material.specular, material.emit_color.x, material.emit_color.y, material.emit_color.z,
+                material.reflection_color.x, material.reflection_color.y, material.reflection_color.z);
+    }
+
+    for (const auto &plane : scene.planes)
+    {
+        fprintf(file, "plane %.9g %.9g %.9g %.9g %s\n", plane.normal.x, plane.normal.y, plane.normal.z,
+                plane.distance_from_origin, names[static_cast<uint32_t>(plane.material_name)].c_str());
+    }
+
+    for (const auto &sphere : scene.spheres)
+    {
+        fprintf(file, "sphere %.9g %.9g %.9g %.9g %s\n", sphere.position.x, sphere.position.y, sphere.position.z,
+                sphere.radius, names[static_cast<uint32_t>(sphere.material_name)].c_str());
+    }
+
+    for (size_t object_index = 0; object_index < scene.objects.size(); ++object_index)
+    {
+        fprintf(file, "object Object%zu\n", object_index);
+        for (const auto &sphere : scene.objects[object_index].spheres)
+        {
+            fprintf(file, "sphere %.9g %.9g %.9g %.9g %s\n", sphere.position.x, sphere.position.y, sphere.position.z,
+                    sphere.radius, names[static_cast<uint32_t>(sphere.material_name)].c_str());
+        }
+        fprintf(file, "end\n");
+    }
+
+    for (const auto &instance : scene.instances)
+    {
+        const float (*m)[4] = instance.object_to_world.m;
+        fprintf(file, "instance Object%u %.9g %.9g %.9g %.9g  %.9g %.9g %.9g %.9g  %.9g %.9g %.9g %.9g\n",
+                instance.object, m[0][0], m[0][1], m[0][2], m[0][3], m[1][0], m[1][1], m[1][2], m[1][3],
+                m[2][0], m[2][1], m[2][2], m[2][3]);
+    }
+
+    for (const auto &mesh : scene.meshes)
+    {
+        fprintf(file, "mesh %s %s\n", mesh.file_name.c_str(), names[static_cast<uint32_t>(mesh.material_name)].c_str());
+    }
+
+    for (const auto &sdf : scene.sdfs)
+    {
+        fprintf(file, "sdf %s %.9g\n", names[static_cast<uint32_t>(sdf.material_name)].c_str(), sdf.surface.smoothness);
+        for (const auto &sphere : sdf.surface.spheres)
+        {
+            fprintf(file, "sphere %.9g %.9g %.9g %.9g\n", sphere.center.x, sphere.center.y, sphere.center.z,
+                    sphere.radius);
+        }
+        for (const auto &box : sdf.surface.boxes)
+        {
+            fprintf(file, "box %.9g %.9g %.9g  %.9g %.9g %.9g\n", box.center.x, box.center.y, box.center.z,
+                    box.half_extent.x, box.half_extent.y, box.half_extent.z);
+        }
+        fprintf(file, "end\n");
+    }
+
+    bool written = (ferror(file) == 0);
+    written = (fclose(file) == 0) && written;
+    if (!written)
+    {
+        *error = "failed writing '" + file_name + "'";
+    }
+    return written;
+}
@@ -0,0 +1,225 @@
+#include <cmath>
+#include "../include/Instancing.h"
+#include "../include/SceneGenerator.h"
+
+// field in front of the default camera at (0, -10, 1), standing on the ground plane
+constexpr float FIELD_MIN_X = -8.0f;
+constexpr float FIELD_MAX_X = 8.0f;
+constexpr float FIELD_MIN_Y = -4.0f;
+constexpr float FIELD_MAX_Y = 20.0f;
+constexpr float FIELD_MIN_Z = 0.0f;
+constexpr float FIELD_MAX_Z = 6.0f;
+// share of the field volume covered by spheres
+constexpr float FIELD_FILL = 0.05f;
+
+// every material except White, which marks a miss
+constexpr MaterialName FIELD_MATERIALS[] =
+{
+    MaterialName::Metallic, MaterialName::Orange, MaterialName::Violet, MaterialName::LightGreen,
+    MaterialName::Green, MaterialName::MirrorBlue, MaterialName::LightBlue, MaterialName::Raspberry,
+    MaterialName::LightBlueReflective
+};
+constexpr uint32_t FIELD_MATERIAL_COUNT = sizeof(FIELD_MATERIALS) / sizeof(FIELD_MATERIALS[0]);
+
+bool parse_scene_layout(const std::string &name, SceneLayout *layout)
+{
+    if (name == "random")
+    {
+        *layout = SceneLayout::Random;
+    }
+    else if (name == "clustered")
+    {
+        *layout = SceneLayout::Clustered;
+    }
+    else if (name == "grid")
+    {
+        *layout = SceneLayout::Grid;
+    }
+    else if (name == "instanced")
+    {
+        *layout = SceneLayout::Instanced;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char *scene_layout_name(SceneLayout layout)
+{
+    switch (layout)
+    {
+        case SceneLayout::Random: return "random";
+        case SceneLayout::Clustered: return "clustered";
+        case SceneLayout::Grid: return "grid";
+        case SceneLayout::Instanced: return "instanced";
+    }
+    return "unknown";
+}
+
+// xor_shift gets stuck on a zero state, and nearby seeds should not give nearby sequences
+static Math::RandomSeries seed_series(uint32_t seed)
+{
+    uint32_t state = (seed + 1) * 2654435761u;
+    Math::RandomSeries series = { state ? state : 1 };
+    for (uint32_t warm_up = 0; warm_up < 8; ++warm_up)
+    {
+        Math::xor_shift(&series);
+    }
+    return series;
+}
+
+static float random_range(Math::RandomSeries *series, float minimum, float maximum)
+{
+    return minimum + (maximum - minimum) * Math::random_unilateral(series);
+}
+
+static MaterialName random_material(Math::RandomSeries *series)
+{
+    return FIELD_MATERIALS[Math::xor_shift(series) % FIELD_MATERIAL_COUNT];
+}
+
+static void generate_random(Scene *scene, uint32_t sphere_count, float radius, Math::RandomSeries *series)
+{
+    for (uint32_t sphere_index = 0; sphere_index < sphere_count; ++sphere_index)
+    {
+        float sphere_radius = radius * random_range(series, 0.5f, 1.5f);
+        Vector::Vector3 position =
+        {
+            random_range(series, FIELD_MIN_X, FIELD_MAX_X),
+            random_range(series, FIELD_MIN_Y, FIELD_MAX_Y),
+            random_range(series, FIELD_MIN_Z + sphere_radius, FIELD_MAX_Z)
+        };
+        scene->spheres.push_back(Sphere { position, sphere_radius, random_material(series) });
+    }
+}
+
+static void generate_clustered(Scene *scene, uint32_t sphere_count, float radius, Math::RandomSeries *series)
+{
+    auto cluster_count = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<float>(sphere_count))));
+    std::vector<Vector::Vector3> centers(cluster_count);
+    for (auto &center : centers)
+    {
+        center = Vector::Vector3
+        {
+            random_range(series, FIELD_MIN_X, FIELD_MAX_X),
+            random_range(series, FIELD_MIN_Y, FIELD_MAX_Y),
+            random_range(series, FIELD_MIN_Z, FIELD_MAX_Z)
+        };
+    }
+
+    // clumps are sized so that each one is as dense as a field with 20x the spheres
+    float field_volume = (FIELD_MAX_X - FIELD_MIN_X) * (FIELD_MAX_Y - FIELD_MIN_Y) * (FIELD_MAX_Z - FIELD_MIN_Z);
+    float cluster_radius = std::cbrt(field_volume / (20.0f * static_cast<float>(cluster_count)));
+    for (uint32_t sphere_index = 0; sphere_index < sphere_count; ++sphere_index)
+    {
+        const Vector::Vector3 &center = centers[Math::xor_shift(series) % cluster_count];
+        // sum of two uniforms concentrates spheres toward the middle of the clump
+        Vector::Vector3 offset =
+        {
+            0.5f * (Math::random_bilateral(series) + Math::random_bilateral(series)),
+            0.5f * (Math::random_bilateral(series) + Math::random_bilateral(series)),
+            0.5f * (Math::random_bilateral(series) + Math::random_bilateral(series))
+        };
+        float sphere_radius = radius * random_range(series, 0.5f, 1.5f);
+        Vector::Vector3 position = center + cluster_radius * offset;
+        position.z = std::max(position.z, FIELD_MIN_Z + sphere_radius);
+        scene->spheres.push_back(Sphere { position, sphere_radius, random_material(series) });
+    }
+}
+
+static void generate_grid(Scene *scene, uint32_t sphere_count, Math::RandomSeries *series)
+{
+    auto cells_per_axis = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<float>(sphere_count))));
+    float step_x = (FIELD_MAX_X - FIELD_MIN_X) / static_cast<float>(cells_per_axis);
+    float step_y = (FIELD_MAX_Y - FIELD_MIN_Y) / static_cast<float>(cells_per_axis);
+    float step_z = (FIELD_MAX_Z - FIELD_MIN_Z) / static_cast<float>(cells_per_axis);
+    float radius = 0.4f * std::min(step_x, std::min(step_y, step_z));
+
+    uint32_t sphere_index = 0;
+    for (uint32_t z = 0; (z < cells_per_axis) && (sphere_index < sphere_count); ++z)
+    {
+        for (uint32_t y = 0; (y < cells_per_axis) && (sphere_index < sphere_count); ++y)
+        {
+            for (uint32_t x = 0; (x < cells_per_axis) && (sphere_index < sphere_count); ++x, ++sphere_index)
+            {
+                Vector::Vector3 position =
+                {
+                    FIELD_MIN_X + (static_cast<float>(x) + 0.5f) * step_x,
+                    FIELD_MIN_Y + (static_cast<float>(y) + 0.5f) * step_y,
+                    FIELD_MIN_Z + (static_cast<float>(z) + 0.5f) * step_z
+                };
+                scene->spheres.push_back(Sphere { position, radius, random_material(series) });
+            }
+        }
+    }
+}
+
+// the raspberries and leaf from build_default_scene, around the middle of their base
+const Sphere BERRY_CLUSTER[] =
+{
+    Sphere { Vector::Vector3 {0.3f, 0.05f, 0.3f}, 0.1f, MaterialName::Raspberry },
+    Sphere { Vector::Vector3 {-0.3f, 0.05f, 0.3f}, 0.1f, MaterialName::Raspberry },
+    Sphere { Vector::Vector3 {0.1f, -0.65f, 0.3f}, 0.1f, MaterialName::Raspberry },
+    Sphere { Vector::Vector3 {-0.1f, 0.65f, 0.3f}, 0.1f, MaterialName::Raspberry },
+    Sphere { Vector::Vector3 {0.1f, -0.35f, 0.15f}, 0.1f, MaterialName::Green }
+};
+constexpr uint32_t BERRY_CLUSTER_SIZE = sizeof(BERRY_CLUSTER) / sizeof(BERRY_CLUSTER[0]);
+
+static void generate_instanced(Scene *scene, uint32_t sphere_count, float radius, Math::RandomSeries *series)
+{
+    scene->objects.emplace_back();
+    scene->objects.back().spheres.assign(BERRY_CLUSTER, BERRY_CLUSTER + BERRY_CLUSTER_SIZE);
+
+    // clusters shrink with the field like spheres do, and the cluster that does not fit
+    // completely still counts as a whole one
+    uint32_t instance_count = (sphere_count + BERRY_CLUSTER_SIZE - 1) / BERRY_CLUSTER_SIZE;
+    float scale = radius / BERRY_CLUSTER[0].radius;
+    scene->instances.reserve(instance_count);
+    for (uint32_t instance_index = 0; instance_index < instance_count; ++instance_index)
+    {
+        float instance_scale = scale * random_range(series, 0.5f, 1.5f);
+        Vector::Vector3 position =
+        {
+            random_range(series, FIELD_MIN_X, FIELD_MAX_X),
+            random_range(series, FIELD_MIN_Y, FIELD_MAX_Y),
+            random_range(series, FIELD_MIN_Z, FIELD_MAX_Z)
+        };
+        float angle = random_range(series, 0.0f, 2.0f * static_cast<float>(M_PI));
+        add_instance(scene, 0, scale_rotate_translate(instance_scale, angle, position));
+    }
+}
+
+void generate_sphere_field(Scene *scene, SceneLayout layout, uint32_t sphere_count, uint32_t seed)
+{
+    scene->planes.clear();
+    scene->spheres.clear();
+    scene->objects.clear();
+    scene->instances.clear();
+    scene->materials = builtin_materials();
+    scene->camera = DEFAULT_CAMERA;
+    if (layout != SceneLayout::Instanced)
+    {
+        scene->spheres.reserve(sphere_count);
+    }
+    scene->planes.push_back(Plane { Vector::Vector3 {0.0f, 0.0f, 1.0f}, 0.0f, MaterialName::Metallic });
+
+    if (sphere_count == 0)
+    {
+        return;
+    }
+
+    // radius that makes sphere_count spheres fill FIELD_FILL of the field
+    float field_volume = (FIELD_MAX_X - FIELD_MIN_X) * (FIELD_MAX_Y - FIELD_MIN_Y) * (FIELD_MAX_Z - FIELD_MIN_Z);
+    float radius = std::cbrt((3.0f * FIELD_FILL * field_volume) / (4.0f * static_cast<float>(M_PI) * sphere_count));
+
+    Math::RandomSeries series = seed_series(seed);
+    switch (layout)
+    {
+        case SceneLayout::Random: generate_random(scene, sphere_count, radius, &series); break;
+        case SceneLayout::Clustered: generate_clustered(scene, sphere_count, radius, &series); break;
+        case SceneLayout::Grid: generate_grid(scene, sphere_count, &series); break;
+        case SceneLayout::Instanced: generate_instanced(scene, sphere_count, radius, &series); break;
+    }
+}
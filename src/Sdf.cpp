@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "../include/Math.h"
+#include "../include/Sdf.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// offset of the four samples sdf_normal takes around the point
+constexpr float SDF_NORMAL_STEP = 1.0e-3f;
+
+void finish_sdf_surface(SdfSurface *surface)
+{
+    surface->sphere_blocks.assign((surface->spheres.size() + SDF_BLOCK_WIDTH - 1) / SDF_BLOCK_WIDTH, SdfSphereBlock {});
+    surface->box_blocks.assign((surface->boxes.size() + SDF_BLOCK_WIDTH - 1) / SDF_BLOCK_WIDTH, SdfBoxBlock {});
+    surface->bounds = empty_aabb();
+    for (size_t index = 0; index < surface->spheres.size(); ++index)
+    {
+        const SdfSphere &sphere = surface->spheres[index];
+        SdfSphereBlock &block = surface->sphere_blocks[index / SDF_BLOCK_WIDTH];
+        size_t lane = index % SDF_BLOCK_WIDTH;
+        block.center[0][lane] = sphere.center.x;
+        block.center[1][lane] = sphere.center.y;
+        block.center[2][lane] = sphere.center.z;
+        block.radius[lane] = sphere.radius;
+        float radius = std::fabs(sphere.radius);
+        Vector::Vector3 extent = { radius, radius, radius };
+        grow_aabb(&surface->bounds, Aabb { sphere.center - extent, sphere.center + extent });
+    }
+    for (size_t index = 0; index < surface->boxes.size(); ++index)
+    {
+        const SdfBox &box = surface->boxes[index];
+        SdfBoxBlock &block = surface->box_blocks[index / SDF_BLOCK_WIDTH];
+        size_t lane = index % SDF_BLOCK_WIDTH;
+        Vector::Vector3 extent = { std::fabs(box.half_extent.x), std::fabs(box.half_extent.y),
+                                   std::fabs(box.half_extent.z) };
+        block.center[0][lane] = box.center.x;
+        block.center[1][lane] = box.center.y;
+        block.center[2][lane] = box.center.z;
+        block.half_extent[0][lane] = extent.x;
+        block.half_extent[1][lane] = extent.y;
+        block.half_extent[2][lane] = extent.z;
+        grow_aabb(&surface->bounds, Aabb { box.center - extent, box.center + extent });
+    }
+
+    // each blend lowers the field by at most smoothness / 4, so far from every shape the
+    // field can sit that much per blend under the nearest shape's distance
+    size_t shape_count = surface->spheres.size() + surface->boxes.size();
+    if ((shape_count > 1) && (surface->smoothness > 0.0f))
+    {
+        float bulge = 0.25f * surface->smoothness * static_cast<float>(shape_count - 1);
+        Vector::Vector3 extent = { bulge, bulge, bulge };
+        surface->bounds.min -= extent;
+        surface->bounds.max += extent;
+    }
+}
+
+static inline float smooth_min(float a, float b, float smoothness)
+{
+    if (smoothness <= 0.0f)
+    {
+        return std::min(a, b);
+    }
+    float h = std::max(smoothness - std::fabs(a - b), 0.0f) / smoothness;
+    return std::min(a, b) - h * h * smoothness * 0.25f;
+}
+
+static inline void sphere_block_distances(const SdfSphereBlock &block, const Vector::Vector3 &point, float *distances)
+{
+#ifdef __SSE2__
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(block.center[0]), _mm_set1_ps(point.x));
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(block.center[1]), _mm_set1_ps(point.y));
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(block.center[2]), _mm_set1_ps(point.z));
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+    _mm_storeu_ps(distances, _mm_sub_ps(length, _mm_loadu_ps(block.radius)));
+#else
+    for (uint32_t lane = 0; lane < SDF_BLOCK_WIDTH; ++lane)
+    {
+        Vector::Vector3 offset = { block.center[0][lane] - point.x, block.center[1][lane] - point.y,
+                                   block.center[2][lane] - point.z };
+        distances[lane] = Math::square_root(Math::inner_product(offset, offset)) - block.radius[lane];
+    }
+#endif
+}
+
+// per axis q = |p - center| - half_extent; outside the box the distance is the length of
+// q's positive part, inside it is q's largest (negative) component
+static inline void box_block_distances(const SdfBoxBlock &block, const Vector::Vector3 &point, float *distances)
+{
+#ifdef __SSE2__
+    const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 zero = _mm_setzero_ps();
+    __m128 qx = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(point.x), _mm_loadu_ps(block.center[0])), magnitude),
+                           _mm_loadu_ps(block.half_extent[0]));
+    __m128 qy = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(point.y), _mm_loadu_ps(block.center[1])), magnitude),
+                           _mm_loadu_ps(block.half_extent[1]));
+    __m128 qz = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(_mm_set1_ps(point.z), _mm_loadu_ps(block.center[2])), magnitude),
+                           _mm_loadu_ps(block.half_extent[2]));
+    __m128 ox = _mm_max_ps(qx, zero), oy = _mm_max_ps(qy, zero), oz = _mm_max_ps(qz, zero);
+    __m128 outside = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)));
+    __m128 inside = _mm_min_ps(_mm_max_ps(qx, _mm_max_ps(qy, qz)), zero);
+    _mm_storeu_ps(distances, _mm_add_ps(outside, inside));
+#else
+    for (uint32_t lane = 0; lane < SDF_BLOCK_WIDTH; ++lane)
+    {
+        float qx = std::fabs(point.x - block.center[0][lane]) - block.half_extent[0][lane];
+        float qy = std::fabs(point.y - block.center[1][lane]) - block.half_extent[1][lane];
+        float qz = std::fabs(point.z - block.center[2][lane]) - block.half_extent[2][lane];
+        Vector::Vector3 outside = { std::max(qx, 0.0f), std::max(qy, 0.0f), std::max(qz, 0.0f) };
+        distances[lane] = Math::square_root(Math::inner_product(outside, outside)) +
+                          std::min(std::max(qx, std::max(qy, qz)), 0.0f);
+    }
+#endif
+}
+
+float sdf_distance(const SdfSurface &surface, const Vector::Vector3 &point)
+{
+    float distance = FLT_MAX;
+    float lanes[SDF_BLOCK_WIDTH];
+    size_t remaining = surface.spheres.size();
+    for (const auto &block : surface.sphere_blocks)
+    {
+        sphere_block_distances(block, point, lanes);
+        size_t lane_count = std::min(remaining, static_cast<size_t>(SDF_BLOCK_WIDTH));
+        for (size_t lane = 0; lane < lane_count; ++lane)
+        {
+            distance = smooth_min(distance, lanes[lane], surface.smoothness);
+        }
+        remaining -= lane_count;
+    }
+    remaining = surface.boxes.size();
+    for (const auto &block : surface.box_blocks)
+    {
+        box_block_distances(block, point, lanes);
+        size_t lane_count = std::min(remaining, static_cast<size_t>(SDF_BLOCK_WIDTH));
+        for (size_t lane = 0; lane < lane_count; ++lane)
+        {
+            distance = smooth_min(distance, lanes[lane], surface.smoothness);
+        }
+        remaining -= lane_count;
+    }
+    return distance;
+}
+
+// the field's gradient from four samples at the corners of a tetrahedron
+Vector::Vector3 sdf_normal(const SdfSurface &surface, const Vector::Vector3 &point)
+{
+    const Vector::Vector3 corners[4] = { { 1.0f, -1.0f, -1.0f }, { -1.0f, -1.0f, 1.0f },
+                                         { -1.0f, 1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f } };
+    Vector::Vector3 gradient = {};
+    for (const auto &corner : corners)
+    {
+        gradient += sdf_distance(surface, point + SDF_NORMAL_STEP * corner) * corner;
+    }
+    return Math::normalize_or_zero(gradient);
+}
+
+// how far the ray runs before leaving box, the far end of the slab test in ray_hits_aabb
+static inline float ray_exit_distance(const Aabb &box, const Vector::Vector3 &ray_origin,
+                                      const Vector::Vector3 &inverse_direction)
+{
+    float x0 = (box.min.x - ray_origin.x) * inverse_direction.x;
+    float x1 = (box.max.x - ray_origin.x) * inverse_direction.x;
+    float y0 = (box.min.y - ray_origin.y) * inverse_direction.y;
+    float y1 = (box.max.y - ray_origin.y) * inverse_direction.y;
+    float z0 = (box.min.z - ray_origin.z) * inverse_direction.z;
+    float z1 = (box.max.z - ray_origin.z) * inverse_direction.z;
+    return std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::max(z0, z1));
+}
+
+bool trace_sdf(const SdfSurface &surface, const Vector::Vector3 &ray_origin, const Vector::Vector3 &ray_direction,
+               float min_hit_distance, float *hit_distance, uint32_t *steps)
+{
+    *steps = 0;
+    const Vector::Vector3 inverse_direction = { 1.0f / ray_direction.x, 1.0f / ray_direction.y, 1.0f / ray_direction.z };
+    float entry_distance;
+    if (!ray_hits_aabb(surface.bounds, ray_origin, inverse_direction, *hit_distance, &entry_distance))
+    {
+        return false;
+    }
+    const float length = Math::square_root(Math::inner_product(ray_direction, ray_direction));
+    if (!(length > 0.0f))
+    {
+        return false;
+    }
+
+    // field distances are in world units, t in multiples of ray_direction
+    const float world_to_ray = 1.0f / length;
+    const float end = std::min(ray_exit_distance(surface.bounds, ray_origin, inverse_direction), *hit_distance);
+    // a ray from outside the bounds starts outside the surface, which may touch the bounds
+    bool outside = (entry_distance > min_hit_distance);
+    float t = std::max(entry_distance, min_hit_distance);
+    for (uint32_t step = 0; (step < SDF_MAX_STEPS) && (t < end); ++step)
+    {
+        float distance = sdf_distance(surface, ray_origin + t * ray_direction);
+        *steps += 1;
+        float epsilon = SDF_HIT_EPSILON * std::max(1.0f, t * length);
+        if (distance >= epsilon)
+        {
+            outside = true;
+        }
+        else if (outside)
+        {
+            *hit_distance = t;
+            return true;
+        }
+        // until it is clear of the surface it started on or in, the ray steps through it
+        t += std::max(std::fabs(distance), epsilon) * world_to_ray;
+    }
+    return false;
+}
@@ -0,0 +1,129 @@
+#include "../include/TileCulling.h"
+
+TileFrustum make_tile_frustum(const CastState &state, const TileBatch &tile)
+{
+    const float image_width = static_cast<float>(tile.image_data.width);
+    const float image_height = static_cast<float>(tile.image_data.height);
+    const float half_view_width = 0.5f * state.view_width;
+    const float half_view_height = 0.5f * state.view_height;
+
+    // jitter reaches half a pixel past the first and last pixels; another half keeps rounding
+    // in the ray setup from carrying a ray across a plane
+    float x_min = -1.0f + 2.0f * (static_cast<float>(tile.x_min) / image_width) - 2.0f * state.half_pixel_width;
+    float x_max = -1.0f + 2.0f * (static_cast<float>(tile.one_past_x_max - 1) / image_width) + 2.0f * state.half_pixel_width;
+    float y_min = -1.0f + 2.0f * (static_cast<float>(tile.y_min) / image_height) - 2.0f * state.half_pixel_height;
+    float y_max = -1.0f + 2.0f * (static_cast<float>(tile.one_past_y_max - 1) / image_height) + 2.0f * state.half_pixel_height;
+
+    auto film_direction = [&](float x_offset, float y_offset)
+    {
+        Vector::Vector3 film_position = state.view_center + (x_offset * half_view_width * state.camera_x_axis)
+                           + (y_offset * half_view_height * state.camera_y_axis);
+        return film_position - state.camera_position;
+    };
+    const Vector::Vector3 corners[4] = { film_direction(x_min, y_min), film_direction(x_max, y_min),
+                                         film_direction(x_max, y_max), film_direction(x_min, y_max) };
+    const Vector::Vector3 center = film_direction(0.5f * (x_min + x_max), 0.5f * (y_min + y_max));
+
+    TileFrustum frustum = {};
+    frustum.apex = state.camera_position;
+    for (uint32_t edge = 0; edge < 4; ++edge)
+    {
+        Vector::Vector3 normal = Math::normalize_or_zero(Math::cross_product(corners[edge], corners[(edge + 1) % 4]));
+        frustum.normals[edge] = (Math::inner_product(normal, center) < 0.0f) ? -normal : normal;
+    }
+    frustum.normals[4] = -state.camera_z_axis;
+    return frustum;
+}
+
+static bool sphere_outside_frustum(const TileFrustum &frustum, const Sphere &sphere)
+{
+    Vector::Vector3 offset = sphere.position - frustum.apex;
+    float radius = std::fabs(sphere.radius);
+    for (const auto &normal : frustum.normals)
+    {
+        if (Math::inner_product(normal, offset) < -radius)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// true when the box lies wholly behind one of the planes, judged by its corner farthest along the normal
+static bool box_outside_frustum(const TileFrustum &frustum, const Aabb &box)
+{
+    for (const auto &normal : frustum.normals)
+    {
+        Vector::Vector3 corner = { (normal.x >= 0.0f) ? box.max.x : box.min.x,
+                                   (normal.y >= 0.0f) ? box.max.y : box.min.y,
+                                   (normal.z >= 0.0f) ? box.max.z : box.min.z };
+        if (Math::inner_product(normal, corner - frustum.apex) < 0.0f)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cull_tile_spheres(const Scene &scene, const TileFrustum &frustum, std::vector<uint32_t> *spheres)
+{
+    spheres->clear();
+    const Sphere *scene_spheres = scene.spheres.data();
+    const auto sphere_count = static_cast<uint32_t>(scene.spheres.size());
+
+    const Bvh &bvh = scene.sphere_bvh;
+    if (!bvh.nodes.empty())
+    {
+        const BvhNode *nodes = bvh.nodes.data();
+        const uint32_t *primitive_indices = bvh.primitive_indices.data();
+        uint32_t stack[BVH_MAX_DEPTH + 1];
+        uint32_t stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size)
+        {
+            const BvhNode &node = nodes[stack[--stack_size]];
+            if (box_outside_frustum(frustum, node.bounds))
+            {
+                continue;
+            }
+            if (node.count == 0)
+            {
+                stack[stack_size++] = node.first;
+                stack[stack_size++] = node.first + 1;
+                continue;
+            }
+            for (uint32_t index = node.first; index < node.first + node.count; ++index)
+            {
+                uint32_t sphere = primitive_indices[index];
+                if (!sphere_outside_frustum(frustum, scene_spheres[sphere]))
+                {
+                    spheres->push_back(sphere);
+                }
+            }
+            if (spheres->size() > TILE_SPHERE_LIMIT)
+            {
+                return false;
+            }
+        }
+        std::sort(spheres->begin(), spheres->end());
+        return true;
+    }
+
+    bool indexed = !scene.sphere_wide_bvh.nodes.empty() || !scene.sphere_grid.cell_starts.empty();
+    if (indexed && (sphere_count > TILE_CULL_SCAN_LIMIT))
+    {
+        return false;
+    }
+    for (uint32_t sphere = 0; sphere < sphere_count; ++sphere)
+    {
+        if (!sphere_outside_frustum(frustum, scene_spheres[sphere]))
+        {
+            spheres->push_back(sphere);
+            if (indexed && (spheres->size() > TILE_SPHERE_LIMIT))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
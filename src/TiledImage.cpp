@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../include/TiledImage.h"
+
+constexpr uint16_t TIFF_SHORT = 3;
+constexpr uint16_t TIFF_LONG = 4;
+constexpr uint16_t TIFF_LONG8 = 16;
+// tile data starts on a page, after the header and tables
+constexpr uint64_t TILE_DATA_ALIGNMENT = 4096;
+constexpr uint32_t TIFF_SAMPLES_PER_PIXEL = 3;
+
+bool has_tiled_image_extension(const std::string &file_name)
+{
+    for (const char *extension : { ".tif", ".tiff" })
+    {
+        size_t extension_length = strlen(extension);
+        if ((file_name.size() > extension_length) &&
+            (file_name.compare(file_name.size() - extension_length, extension_length, extension) == 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void put_little_endian(std::vector<uint8_t> *bytes, uint64_t value, uint32_t size)
+{
+    for (uint32_t byte = 0; byte < size; ++byte)
+    {
+        bytes->push_back(static_cast<uint8_t>(value >> (8 * byte)));
+    }
+}
+
+// one IFD entry; values lie inline when they fit the entry's value field, after the IFD otherwise
+struct TiffEntry
+{
+    uint16_t tag;
+    uint16_t type;
+    uint64_t count;
+    std::vector<uint8_t> values;
+};
+
+static TiffEntry make_tiff_entry(uint16_t tag, uint16_t type, const std::vector<uint64_t> &values)
+{
+    TiffEntry entry = { tag, type, values.size(), {} };
+    uint32_t size = (type == TIFF_SHORT) ? 2 : ((type == TIFF_LONG) ? 4 : 8);
+    entry.values.reserve(values.size() * size);
+    for (uint64_t value : values)
+    {
+        put_little_endian(&entry.values, value, size);
+    }
+    return entry;
+}
+
+static bool write_fully(int file_descriptor, const uint8_t *data, uint64_t size, uint64_t offset)
+{
+    while (size)
+    {
+        ssize_t written = pwrite(file_descriptor, data, size, static_cast<off_t>(offset));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<uint64_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+TiledImageWriter::TiledImageWriter()
+{
+    file_descriptor = -1;
+    tile_width = 0;
+    tile_height = 0;
+    tiles_across = 0;
+    data_offset = 0;
+    tile_bytes = 0;
+    write_error = 0;
+}
+
+TiledImageWriter::~TiledImageWriter()
+{
+    if (file_descriptor >= 0)
+    {
+        ::close(file_descriptor);
+    }
+}
+
+bool TiledImageWriter::create(const std::string &file_name, uint32_t image_width, uint32_t image_height,
+                              uint32_t tile_width, uint32_t tile_height, std::string *error)
+{
+    this->tile_width = tile_width;
+    this->tile_height = tile_height;
+    tiles_across = (image_width + tile_width - 1) / tile_width;
+    uint64_t tile_count = static_cast<uint64_t>(tiles_across) * ((image_height + tile_height - 1) / tile_height);
+    tile_bytes = static_cast<uint64_t>(tile_width) * tile_height * TIFF_SAMPLES_PER_PIXEL;
+
+    // a classic TIFF's 4 byte offsets do unless the tiles reach past them; the header and
+    // IFD take well under 256 bytes, the two tables 4 bytes per tile each
+    const uint64_t classic_table_bytes = 256 + 8 * tile_count;
+    const bool big = (classic_table_bytes + TILE_DATA_ALIGNMENT + tile_count * tile_bytes) >= (1ull << 32);
+    const uint32_t offset_size = big ? 8 : 4;
+    const uint64_t header_size = big ? 16 : 8;
+
+    std::vector<TiffEntry> entries;
+    entries.push_back(make_tiff_entry(256, TIFF_LONG, { image_width }));
+    entries.push_back(make_tiff_entry(257, TIFF_LONG, { image_height }));
+    entries.push_back(make_tiff_entry(258, TIFF_SHORT, { 8, 8, 8 }));
+    entries.push_back(make_tiff_entry(259, TIFF_SHORT, { 1 }));  // no compression
+    entries.push_back(make_tiff_entry(262, TIFF_SHORT, { 2 }));  // RGB
+    entries.push_back(make_tiff_entry(274, TIFF_SHORT, { 4 }));  // row 0 at the bottom
+    entries.push_back(make_tiff_entry(277, TIFF_SHORT, { TIFF_SAMPLES_PER_PIXEL }));
+    entries.push_back(make_tiff_entry(284, TIFF_SHORT, { 1 }));  // samples interleaved
+    entries.push_back(make_tiff_entry(322, TIFF_LONG, { tile_width }));
+    entries.push_back(make_tiff_entry(323, TIFF_LONG, { tile_height }));
+    // the tile offsets are only known once the tables are laid out; until then only their
+    // size counts
+    std::vector<uint64_t> tile_values(tile_count);
+    entries.push_back(make_tiff_entry(324, big ? TIFF_LONG8 : TIFF_LONG, tile_values));
+    entries.push_back(make_tiff_entry(325, big ? TIFF_LONG8 : TIFF_LONG, tile_values));
+    const uint64_t ifd_size = big ? (8 + 20 * entries.size() + 8) : (2 + 12 * entries.size() + 4);
+
+    // values past the IFD each start on 8 bytes
+    const uint64_t values_offset = (header_size + ifd_size + 7) & ~7ull;
+    uint64_t next_value_offset = values_offset;
+    std::vector<uint64_t> value_offsets(entries.size());
+    for (size_t index = 0; index < entries.size(); ++index)
+    {
+        if (entries[index].values.size() > offset_size)
+        {
+            value_offsets[index] = next_value_offset;
+            next_value_offset += (entries[index].values.size() + 7) & ~7ull;
+        }
+    }
+    data_offset = (next_value_offset + TILE_DATA_ALIGNMENT - 1) / TILE_DATA_ALIGNMENT * TILE_DATA_ALIGNMENT;
+    for (uint64_t tile = 0; tile < tile_count; ++tile)
+    {
+        tile_values[tile] = data_offset + tile * tile_bytes;
+    }
+    entries[entries.size() - 2] = make_tiff_entry(324, big ? TIFF_LONG8 : TIFF_LONG, tile_values);
+    std::fill(tile_values.begin(), tile_values.end(), tile_bytes);
+    entries[entries.size() - 1] = make_tiff_entry(325, big ? TIFF_LONG8 : TIFF_LONG, tile_values);
+
+    std::vector<uint8_t> head;
+    head.reserve(next_value_offset);
+    head.push_back('I');
+    head.push_back('I');
+    put_little_endian(&head, big ? 43 : 42, 2);
+    if (big)
+    {
+        put_little_endian(&head, 8, 2);
+        put_little_endian(&head, 0, 2);
+    }
+    put_little_endian(&head, header_size, offset_size);
+    put_little_endian(&head, entries.size(), big ? 8 : 2);
+    for (size_t index = 0; index < entries.size(); ++index)
+    {
+        const TiffEntry &entry = entries[index];
+        put_little_endian(&head, entry.tag, 2);
+        put_little_endian(&head, entry.type, 2);
+        put_little_endian(&head, entry.count, offset_size);
+        if (entry.values.size() > offset_size)
+        {
+            put_little_endian(&head, value_offsets[index], offset_size);
+        }
+        else
+        {
+            head.insert(head.end(), entry.values.begin(), entry.values.end());
+            head.resize(head.size() + offset_size - entry.values.size(), 0);
+        }
+    }
+    put_little_endian(&head, 0, offset_size);  // no next IFD
+    head.resize(values_offset, 0);
+    for (const auto &entry : entries)
+    {
+        if (entry.values.size() > offset_size)
+        {
+            head.insert(head.end(), entry.values.begin(), entry.values.end());
+            head.resize((head.size() + 7) & ~static_cast<size_t>(7), 0);
+        }
+    }
+
+    file_descriptor = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor < 0)
+    {
+        *error = "cannot create '" + file_name + "': " + strerror(errno);
+        return false;
+    }
+    if ((ftruncate(file_descriptor, static_cast<off_t>(data_offset + tile_count * tile_bytes)) != 0) ||
+        !write_fully(file_descriptor, head.data(), head.size(), 0))
+    {
+        *error = "cannot write '" + file_name + "': " + strerror(errno);
+        ::close(file_descriptor);
+        file_descriptor = -1;
+        return false;
+    }
+    return true;
+}
+
+void TiledImageWriter::write_tile(uint32_t x_min, uint32_t y_min, uint32_t width, uint32_t height,
+                                  const uint32_t *pixels, std::vector<uint8_t> *scratch)
+{
+    // edge tiles are padded with black
+    scratch->assign(tile_bytes, 0);
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        uint8_t *samples = scratch->data() + static_cast<size_t>(row) * tile_width * TIFF_SAMPLES_PER_PIXEL;
+        for (uint32_t column = 0; column < width; ++column)
+        {
+            uint32_t pixel = *pixels++;
+            *samples++ = static_cast<uint8_t>(pixel >> 16);
+            *samples++ = static_cast<uint8_t>(pixel >> 8);
+            *samples++ = static_cast<uint8_t>(pixel);
+        }
+    }
+
+    uint64_t tile_index = static_cast<uint64_t>(y_min / tile_height) * tiles_across + x_min / tile_width;
+    if (!write_fully(file_descriptor, scratch->data(), tile_bytes, data_offset + tile_index * tile_bytes))
+    {
+        __sync_bool_compare_and_swap(&write_error, 0, errno);
+    }
+}
+
+bool TiledImageWriter::close(std::string *error)
+{
+    bool closed = (::close(file_descriptor) == 0);
+    file_descriptor = -1;
+    if (write_error)
+    {
+        *error = std::string("failed writing tiles: ") + strerror(write_error);
+        return false;
+    }
+    if (!closed)
+    {
+        *error = std::string("failed closing the tiled image: ") + strerror(errno);
+    }
+    return closed;
+}
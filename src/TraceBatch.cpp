@@ -0,0 +1,84 @@
+#include <thread>
+#include "../include/TraceBatch.h"
+
+static void trace_slice(const Scene &scene, const RayBatch &rays, uint32_t begin, uint32_t end, HitBatch *hits,
+                        RayStatistics *statistics)
+{
+    for (uint32_t ray = begin; ray < end; ++ray)
+    {
+        Vector::Vector3 origin = { rays.origin_x[ray], rays.origin_y[ray], rays.origin_z[ray] };
+        Vector::Vector3 direction = { rays.direction_x[ray], rays.direction_y[ray], rays.direction_z[ray] };
+        float max_distance = rays.max_distance ? rays.max_distance[ray] : FLOAT32_MAX;
+        if (rays.query == RayQuery::AnyHit)
+        {
+            bool blocked = occluded(&scene, origin, direction, max_distance, statistics);
+            if (hits->hit)
+            {
+                hits->hit[ray] = blocked;
+            }
+            continue;
+        }
+
+        RayHit hit;
+        bool found = closest_hit(&scene, origin, direction, max_distance, &hit, statistics);
+        if (hits->hit)
+        {
+            hits->hit[ray] = found;
+        }
+        if (hits->distance)
+        {
+            hits->distance[ray] = hit.distance;
+        }
+        if (hits->kind)
+        {
+            hits->kind[ray] = static_cast<uint8_t>(hit.kind);
+        }
+        if (hits->primitive)
+        {
+            hits->primitive[ray] = hit.primitive;
+        }
+        if (hits->material)
+        {
+            hits->material[ray] = static_cast<uint32_t>(hit.material_name);
+        }
+        if (hits->normal_x && hits->normal_y && hits->normal_z)
+        {
+            hits->normal_x[ray] = hit.normal.x;
+            hits->normal_y[ray] = hit.normal.y;
+            hits->normal_z[ray] = hit.normal.z;
+        }
+    }
+}
+
+void trace_batch(const Scene &scene, const RayBatch &rays, uint32_t thread_count, HitBatch *hits)
+{
+    uint32_t slice_count = (rays.count + TRACE_BATCH_SLICE_SIZE - 1) / TRACE_BATCH_SLICE_SIZE;
+    thread_count = std::max(1u, std::min(resolve_thread_count(thread_count), slice_count));
+
+    uint64_t volatile next_ray = 0;
+    auto work = [&]()
+    {
+        RayStatistics statistics = {};
+        for (;;)
+        {
+            uint64_t begin = __sync_fetch_and_add(&next_ray, TRACE_BATCH_SLICE_SIZE);
+            if (begin >= rays.count)
+            {
+                return;
+            }
+            uint64_t end = std::min<uint64_t>(begin + TRACE_BATCH_SLICE_SIZE, rays.count);
+            trace_slice(scene, rays, static_cast<uint32_t>(begin), static_cast<uint32_t>(end), hits, &statistics);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t thread_index = 1; thread_index < thread_count; ++thread_index)
+    {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
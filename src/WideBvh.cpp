@@ -0,0 +1,188 @@
+#include <cmath>
+#include "../include/WideBvh.h"
+
+// a child slot while a node is being filled: a binary node, or a range of primitives from
+// an oversized binary leaf that still has to be split
+struct WideChild
+{
+    Aabb bounds;
+    uint32_t binary_node;
+    uint32_t first;
+    uint32_t count;
+};
+
+static bool is_inner(const WideChild &child)
+{
+    return child.count == 0;
+}
+
+static bool is_leaf(const WideChild &child)
+{
+    return (child.count != 0) && (child.count <= BVH_MAX_LEAF_SIZE);
+}
+
+// smallest power of two step that spans extent in 255 steps from origin, in float arithmetic
+static int8_t quantization_exponent(float origin, float extent_max)
+{
+    float extent = extent_max - origin;
+    int exponent = -126;
+    if (extent > 0.0f)
+    {
+        std::frexp(extent / 255.0f, &exponent);
+        exponent = std::max(exponent - 1, -126);
+    }
+    while ((exponent < 127) && (origin + 255.0f * wide_exponent_scale(static_cast<int8_t>(exponent)) < extent_max))
+    {
+        exponent += 1;
+    }
+    return static_cast<int8_t>(exponent);
+}
+
+static uint8_t quantize_lower(float origin, float scale, float value)
+{
+    float steps = std::floor((value - origin) / scale);
+    auto quantized = static_cast<int>(std::min(std::max(steps, 0.0f), 255.0f));
+    // rounding in origin + q * scale must not move the plane inside the box
+    while ((quantized > 0) && (origin + quantized * scale > value))
+    {
+        quantized -= 1;
+    }
+    return static_cast<uint8_t>(quantized);
+}
+
+static uint8_t quantize_upper(float origin, float scale, float value)
+{
+    float steps = std::ceil((value - origin) / scale);
+    auto quantized = static_cast<int>(std::min(std::max(steps, 0.0f), 255.0f));
+    while ((quantized < 255) && (origin + quantized * scale < value))
+    {
+        quantized += 1;
+    }
+    return static_cast<uint8_t>(quantized);
+}
+
+static WideChild binary_child(const Bvh &bvh, uint32_t node_index)
+{
+    const BvhNode &node = bvh.nodes[node_index];
+    return WideChild { node.bounds, node_index, node.first, node.count };
+}
+
+static void build_wide_node(const Bvh &bvh, WideBvh *wide, uint32_t wide_index, const WideChild &source)
+{
+    WideChild children[WIDE_BVH_WIDTH];
+    uint32_t child_count = 0;
+    if (is_inner(source))
+    {
+        // open the child with the largest surface area until the node is full
+        children[child_count++] = source;
+        while (child_count < WIDE_BVH_WIDTH)
+        {
+            int widest = -1;
+            float widest_area = -1.0f;
+            for (uint32_t slot = 0; slot < child_count; ++slot)
+            {
+                float area = aabb_surface_area(children[slot].bounds);
+                if (is_inner(children[slot]) && (area > widest_area))
+                {
+                    widest = static_cast<int>(slot);
+                    widest_area = area;
+                }
+            }
+            if (widest < 0)
+            {
+                break;
+            }
+            const BvhNode &opened = bvh.nodes[children[widest].binary_node];
+            children[widest] = binary_child(bvh, opened.first);
+            children[child_count++] = binary_child(bvh, opened.first + 1);
+        }
+    }
+    else if (is_leaf(source))
+    {
+        // only when the whole tree is one leaf
+        children[child_count++] = source;
+    }
+    else
+    {
+        // an oversized leaf: up to 8 even parts of its range, all with the leaf's box
+        uint32_t part_size = std::max((source.count + WIDE_BVH_WIDTH - 1) / WIDE_BVH_WIDTH, 1u);
+        for (uint32_t first = source.first; first < source.first + source.count; first += part_size)
+        {
+            uint32_t count = std::min(part_size, source.first + source.count - first);
+            children[child_count++] = WideChild { source.bounds, 0, first, count };
+        }
+    }
+
+    Aabb bounds = empty_aabb();
+    for (uint32_t slot = 0; slot < child_count; ++slot)
+    {
+        grow_aabb(&bounds, children[slot].bounds);
+    }
+
+    WideBvhNode node = {};
+    node.origin = bounds.min;
+    node.child_count = static_cast<uint8_t>(child_count);
+    node.first_primitive = static_cast<uint32_t>(wide->primitive_indices.size());
+    const float *origin = &bounds.min.x;
+    const float *maximum = &bounds.max.x;
+    float scale[3];
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        node.exponents[axis] = quantization_exponent(origin[axis], maximum[axis]);
+        scale[axis] = wide_exponent_scale(node.exponents[axis]);
+    }
+
+    uint32_t inner_count = 0;
+    uint32_t leaf_offset = 0;
+    for (uint32_t slot = 0; slot < child_count; ++slot)
+    {
+        const WideChild &child = children[slot];
+        const float *child_min = &child.bounds.min.x;
+        const float *child_max = &child.bounds.max.x;
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            node.lower[axis][slot] = quantize_lower(origin[axis], scale[axis], child_min[axis]);
+            node.upper[axis][slot] = quantize_upper(origin[axis], scale[axis], child_max[axis]);
+        }
+        if (is_leaf(child))
+        {
+            node.child_meta[slot] = static_cast<uint8_t>((leaf_offset << 3) | child.count);
+            for (uint32_t index = child.first; index < child.first + child.count; ++index)
+            {
+                wide->primitive_indices.push_back(bvh.primitive_indices[index]);
+            }
+            leaf_offset += child.count;
+        }
+        else
+        {
+            node.child_meta[slot] = static_cast<uint8_t>((inner_count + 1) << 3);
+            inner_count += 1;
+        }
+    }
+
+    // node children sit side by side, in slot order
+    node.first_child = static_cast<uint32_t>(wide->nodes.size());
+    wide->nodes.resize(wide->nodes.size() + inner_count);
+    wide->nodes[wide_index] = node;
+    uint32_t child_index = node.first_child;
+    for (uint32_t slot = 0; slot < child_count; ++slot)
+    {
+        if (!is_leaf(children[slot]))
+        {
+            build_wide_node(bvh, wide, child_index++, children[slot]);
+        }
+    }
+}
+
+void build_wide_bvh(const Bvh &bvh, WideBvh *wide)
+{
+    *wide = {};
+    if (bvh.nodes.empty())
+    {
+        return;
+    }
+    wide->primitive_indices.reserve(bvh.primitive_indices.size());
+
+    wide->nodes.resize(1);
+    build_wide_node(bvh, wide, 0, binary_child(bvh, 0));
+}
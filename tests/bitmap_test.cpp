@@ -0,0 +1,50 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "../include/Bitmap.h"
+#include "gtest/gtest.h"
+
+static std::vector<char> read_file(const std::string &file_name)
+{
+    std::ifstream file(file_name, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+TEST(BitmapTest, ValidateMappedBitmapsHoldTheSamePixelsAsWrittenOnes)
+{
+    std::string written_name = testing::TempDir() + "bitmap_test_written.bmp";
+    std::string mapped_name = testing::TempDir() + "bitmap_test_mapped.bmp";
+    const uint32_t width = 37;
+    const uint32_t height = 11;
+    {
+        Bitmap written(width, height);
+        Bitmap mapped(width, height);
+        std::string error;
+        ASSERT_TRUE(mapped.map_file(mapped_name, &error)) << error;
+        for (uint32_t pixel = 0; pixel < width * height; ++pixel)
+        {
+            written.get_image_data()->pixels.get()[pixel] = pixel * 2654435761u;
+            mapped.get_image_data()->pixels.get()[pixel] = pixel * 2654435761u;
+        }
+        written.write_image(written_name);
+        mapped.write_image(mapped_name);
+    }
+
+    std::vector<char> written = read_file(written_name);
+    std::vector<char> mapped = read_file(mapped_name);
+    ASSERT_EQ(sizeof(BitmapHeader) + width * height * 4, written.size());
+    ASSERT_EQ(MAPPED_PIXEL_OFFSET + width * height * 4, mapped.size());
+
+    BitmapHeader written_header, mapped_header;
+    memcpy(&written_header, written.data(), sizeof(BitmapHeader));
+    memcpy(&mapped_header, mapped.data(), sizeof(BitmapHeader));
+    EXPECT_EQ(MAPPED_PIXEL_OFFSET, mapped_header.bitmap_offset);
+    EXPECT_EQ(mapped.size(), mapped_header.file_size);
+    EXPECT_EQ(written_header.width, mapped_header.width);
+    EXPECT_EQ(written_header.size_of_bitmap, mapped_header.size_of_bitmap);
+    EXPECT_EQ(0, memcmp(written.data() + written_header.bitmap_offset, mapped.data() + MAPPED_PIXEL_OFFSET,
+                        width * height * 4));
+    remove(written_name.c_str());
+    remove(mapped_name.c_str());
+}
@@ -0,0 +1,293 @@
+#include <cstdio>
+#include <cstring>
+#include "../include/Bvh.h"
+#include "../include/Grid.h"
+#include "../include/WideBvh.h"
+#include "gtest/gtest.h"
+
+static std::vector<Aabb> test_bounds(uint32_t count)
+{
+    std::vector<Aabb> bounds;
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        // scattered, not sorted along any axis
+        auto x = static_cast<float>((index * 7919) % 101);
+        auto y = static_cast<float>((index * 104729) % 37);
+        auto z = static_cast<float>(index % 5);
+        bounds.push_back(Aabb { Vector::Vector3 { x, y, z }, Vector::Vector3 { x + 1.0f, y + 0.5f, z + 2.0f } });
+    }
+    return bounds;
+}
+
+static bool contains(const Aabb &outer, const Aabb &inner)
+{
+    return (outer.min.x <= inner.min.x) && (outer.min.y <= inner.min.y) && (outer.min.z <= inner.min.z) &&
+           (outer.max.x >= inner.max.x) && (outer.max.y >= inner.max.y) && (outer.max.z >= inner.max.z);
+}
+
+static void expect_valid_bvh(const std::vector<Aabb> &bounds, const Bvh &bvh)
+{
+    std::vector<uint32_t> seen(bounds.size(), 0);
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty())
+    {
+        ASSERT_LT(stack.back(), bvh.nodes.size());
+        const BvhNode &node = bvh.nodes[stack.back()];
+        stack.pop_back();
+        if (node.count)
+        {
+            EXPECT_LE(node.count, BVH_MAX_LEAF_SIZE);
+            for (uint32_t index = node.first; index < node.first + node.count; ++index)
+            {
+                uint32_t primitive = bvh.primitive_indices[index];
+                EXPECT_TRUE(contains(node.bounds, bounds[primitive]));
+                seen[primitive] += 1;
+            }
+        }
+        else
+        {
+            ASSERT_LT(node.first + 1, bvh.nodes.size());
+            EXPECT_TRUE(contains(node.bounds, bvh.nodes[node.first].bounds));
+            EXPECT_TRUE(contains(node.bounds, bvh.nodes[node.first + 1].bounds));
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+    for (uint32_t count : seen)
+    {
+        EXPECT_EQ(1u, count);
+    }
+}
+
+TEST(BvhTest, ValidateEveryPrimitiveIsInOneLeafInsideItsAncestors)
+{
+    std::vector<Aabb> bounds = test_bounds(1000);
+    Bvh bvh;
+    build_bvh_median(bounds.data(), static_cast<uint32_t>(bounds.size()), &bvh);
+    expect_valid_bvh(bounds, bvh);
+}
+
+TEST(BvhTest, ValidateParallelSahBuildIsValidAndNoWorseThanMedian)
+{
+    // enough primitives that subtrees are handed to other threads
+    std::vector<Aabb> bounds = test_bounds(20000);
+    Bvh median;
+    build_bvh_median(bounds.data(), static_cast<uint32_t>(bounds.size()), &median);
+    Bvh sah;
+    build_bvh_binned_sah(bounds.data(), static_cast<uint32_t>(bounds.size()), 4, &sah);
+
+    expect_valid_bvh(bounds, sah);
+    EXPECT_LE(bvh_sah_cost(sah), bvh_sah_cost(median));
+}
+
+TEST(BvhTest, ValidateLbvhIsValidWithDuplicateCenters)
+{
+    std::vector<Aabb> bounds = test_bounds(5000);
+    // a run of identical boxes shares one Morton code
+    for (uint32_t index = 100; index < 300; ++index)
+    {
+        bounds[index] = bounds[100];
+    }
+    Bvh bvh;
+    build_bvh_lbvh(bounds.data(), static_cast<uint32_t>(bounds.size()), 3, &bvh);
+    EXPECT_EQ(2 * bounds.size() - 1, bvh.nodes.size());
+    expect_valid_bvh(bounds, bvh);
+
+    Bvh single;
+    build_bvh_lbvh(bounds.data(), 1, 3, &single);
+    ASSERT_EQ(1u, single.nodes.size());
+    EXPECT_EQ(1u, single.nodes[0].count);
+}
+
+TEST(BvhTest, ValidateRefitFollowsMovedPrimitivesAndReportsTheirCost)
+{
+    std::vector<Aabb> bounds = test_bounds(5000);
+    for (BvhBuilder builder : { BvhBuilder::BinnedSah, BvhBuilder::Lbvh })
+    {
+        Bvh bvh;
+        build_bvh(builder, bounds.data(), static_cast<uint32_t>(bounds.size()), 4, &bvh);
+        BvhRefitState state;
+        prepare_bvh_refit(bvh, &state);
+        EXPECT_NEAR(state.built_sah_cost, refit_bvh(bounds.data(), 4, state, &bvh), 1e-3f * state.built_sah_cost);
+
+        // every box swaps places with another far away, which a tree built for the old
+        // places covers badly
+        std::vector<Aabb> moved(bounds.size());
+        for (size_t index = 0; index < bounds.size(); ++index)
+        {
+            moved[index] = bounds[(index * 2459) % bounds.size()];
+        }
+        float cost = refit_bvh(moved.data(), 4, state, &bvh);
+        expect_valid_bvh(moved, bvh);
+        EXPECT_NEAR(bvh_sah_cost(bvh), cost, 1e-3f * cost);
+        EXPECT_GT(cost, 1.5f * state.built_sah_cost);
+    }
+}
+
+TEST(BvhTest, ValidateGridListsEveryPrimitiveInEveryCellItOverlaps)
+{
+    std::vector<Aabb> bounds = test_bounds(3000);
+    // one flat primitive, so the grid is flat too
+    std::vector<Aabb> flat = { Aabb { Vector::Vector3 { 0.0f, 0.0f, 1.0f }, Vector::Vector3 { 4.0f, 2.0f, 1.0f } } };
+    // a few boxes spanning the whole scene, under a reference limit the fine grid would break
+    std::vector<Aabb> spanning = bounds;
+    Grid fine;
+    build_grid(bounds.data(), static_cast<uint32_t>(bounds.size()), 4, &fine);
+    for (uint32_t index = 0; index < 10; ++index)
+    {
+        spanning.push_back(fine.bounds);
+    }
+    const uint64_t spanning_limit = 4 * spanning.size();
+    for (const auto *primitives : { &bounds, &flat, &spanning })
+    {
+        const uint64_t limit = (primitives == &spanning) ? spanning_limit : GRID_MAX_REFERENCES;
+        Grid grid;
+        build_grid(primitives->data(), static_cast<uint32_t>(primitives->size()), 4, &grid, limit);
+        uint32_t cell_count = grid.resolution[0] * grid.resolution[1] * grid.resolution[2];
+        ASSERT_EQ(cell_count + 1, grid.cell_starts.size());
+        EXPECT_LE(cell_count, static_cast<uint32_t>(GRID_CELLS_PER_PRIMITIVE * 8.0f * primitives->size()));
+        ASSERT_EQ(grid.primitive_indices.size(), grid.cell_starts.back());
+        EXPECT_LE(grid.primitive_indices.size(), limit);
+        if (primitives == &spanning)
+        {
+            EXPECT_LT(cell_count, fine.resolution[0] * fine.resolution[1] * fine.resolution[2]);
+        }
+
+        std::vector<uint32_t> listed(primitives->size(), 0);
+        for (uint32_t cell = 0; cell < cell_count; ++cell)
+        {
+            uint32_t coordinates[3] = { cell % grid.resolution[0], (cell / grid.resolution[0]) % grid.resolution[1],
+                                        cell / (grid.resolution[0] * grid.resolution[1]) };
+            for (uint32_t index = grid.cell_starts[cell]; index < grid.cell_starts[cell + 1]; ++index)
+            {
+                uint32_t primitive = grid.primitive_indices[index];
+                const Aabb &box = (*primitives)[primitive];
+                for (uint32_t axis = 0; axis < 3; ++axis)
+                {
+                    EXPECT_GE(coordinates[axis], grid_cell(grid, axis, vector_axis(box.min, axis)));
+                    EXPECT_LE(coordinates[axis], grid_cell(grid, axis, vector_axis(box.max, axis)));
+                }
+                listed[primitive] += 1;
+            }
+        }
+        for (uint32_t primitive = 0; primitive < primitives->size(); ++primitive)
+        {
+            // every cell in the box's range lists it exactly once
+            const Aabb &box = (*primitives)[primitive];
+            uint32_t expected = 1;
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                expected *= grid_cell(grid, axis, vector_axis(box.max, axis)) - grid_cell(grid, axis, vector_axis(box.min, axis)) + 1;
+            }
+            EXPECT_EQ(expected, listed[primitive]);
+        }
+    }
+}
+
+static void expect_valid_wide_bvh(const std::vector<Aabb> &bounds, const WideBvh &wide)
+{
+    std::vector<uint32_t> seen(bounds.size(), 0);
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty())
+    {
+        ASSERT_LT(stack.back(), wide.nodes.size());
+        const WideBvhNode &node = wide.nodes[stack.back()];
+        stack.pop_back();
+        ASSERT_GE(node.child_count, 1);
+        for (uint32_t slot = 0; slot < node.child_count; ++slot)
+        {
+            // quantized boxes may only grow
+            Aabb child_bounds = wide_child_bounds(node, slot);
+            uint8_t meta = node.child_meta[slot];
+            if (wide_child_is_leaf(meta))
+            {
+                for (uint32_t index = node.first_primitive + (meta >> 3);
+                     index < node.first_primitive + (meta >> 3) + (meta & 7); ++index)
+                {
+                    uint32_t primitive = wide.primitive_indices[index];
+                    EXPECT_TRUE(contains(child_bounds, bounds[primitive]));
+                    seen[primitive] += 1;
+                }
+            }
+            else
+            {
+                ASSERT_NE(0, meta);
+                uint32_t child = node.first_child + (meta >> 3) - 1;
+                ASSERT_LT(child, wide.nodes.size());
+                for (uint32_t grandchild = 0; grandchild < wide.nodes[child].child_count; ++grandchild)
+                {
+                    EXPECT_TRUE(contains(child_bounds, wide_child_bounds(wide.nodes[child], grandchild)));
+                }
+                stack.push_back(child);
+            }
+        }
+    }
+    for (uint32_t count : seen)
+    {
+        EXPECT_EQ(1u, count);
+    }
+}
+
+TEST(BvhTest, ValidateWideBvhKeepsEveryPrimitiveInsideItsQuantizedBoxes)
+{
+    std::vector<Aabb> bounds = test_bounds(5000);
+    Bvh bvh;
+    build_bvh_binned_sah(bounds.data(), static_cast<uint32_t>(bounds.size()), 1, &bvh);
+    WideBvh wide;
+    build_wide_bvh(bvh, &wide);
+    expect_valid_wide_bvh(bounds, wide);
+    EXPECT_LT(wide.nodes.size() * sizeof(WideBvhNode), bvh.nodes.size() * sizeof(BvhNode) / 2);
+
+    // a ray straight down the x axis through one box enters exactly the children on its way
+    const WideBvhNode &root = wide.nodes[0];
+    WideRay ray = make_wide_ray(Vector::Vector3 { -10.0f, 0.25f, 0.5f }, Vector::Vector3 { 1.0f, 1.0f / 0.0f, 1.0f / 0.0f });
+    float entry_distances[WIDE_BVH_WIDTH];
+    uint32_t hits = wide_node_hits(root, ray, FLT_MAX, entry_distances);
+    for (uint32_t slot = 0; slot < root.child_count; ++slot)
+    {
+        Aabb child_bounds = wide_child_bounds(root, slot);
+        bool crossed = (child_bounds.min.y <= 0.25f) && (child_bounds.max.y >= 0.25f) && (child_bounds.min.z <= 0.5f) &&
+                       (child_bounds.max.z >= 0.5f);
+        EXPECT_EQ(crossed, ((hits >> slot) & 1) != 0);
+    }
+
+    // a tree that is a single leaf
+    Bvh single;
+    build_bvh_median(bounds.data(), 3, &single);
+    build_wide_bvh(single, &wide);
+    ASSERT_EQ(1u, wide.nodes.size());
+    EXPECT_EQ(3u, wide.primitive_indices.size());
+    expect_valid_wide_bvh(std::vector<Aabb>(bounds.begin(), bounds.begin() + 3), wide);
+}
+
+TEST(BvhTest, ValidateCacheIsReusedOnlyForTheSameScene)
+{
+    std::vector<Aabb> bounds = test_bounds(100);
+    Bvh bvh;
+    build_bvh_median(bounds.data(), static_cast<uint32_t>(bounds.size()), &bvh);
+
+    std::string file_name = testing::TempDir() + "bvh_test.bvh";
+    std::string error;
+    ASSERT_TRUE(write_bvh_cache(file_name, 42, bvh, &error)) << error;
+
+    Bvh cached;
+    ASSERT_TRUE(load_bvh_cache(file_name, 42, 100, &cached, &error)) << error;
+    EXPECT_TRUE(cached.nodes.is_view());
+    ASSERT_EQ(bvh.nodes.size(), cached.nodes.size());
+    EXPECT_EQ(0, memcmp(bvh.nodes.data(), cached.nodes.data(), bvh.nodes.size() * sizeof(BvhNode)));
+    EXPECT_EQ(0, memcmp(bvh.primitive_indices.data(), cached.primitive_indices.data(), 100 * sizeof(uint32_t)));
+
+    EXPECT_FALSE(load_bvh_cache(file_name, 43, 100, &cached, &error));
+
+    // flip one byte of the node data
+    FILE *file = fopen(file_name.c_str(), "r+b");
+    ASSERT_NE(nullptr, file);
+    fseek(file, 200, SEEK_SET);
+    int byte = fgetc(file);
+    fseek(file, 200, SEEK_SET);
+    fputc(byte ^ 0xFF, file);
+    fclose(file);
+    EXPECT_FALSE(load_bvh_cache(file_name, 42, 100, &cached, &error));
+    EXPECT_EQ("truncated or damaged", error);
+    remove(file_name.c_str());
+}
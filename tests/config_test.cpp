@@ -0,0 +1,94 @@
+#include "../include/Config.h"
+#include "gtest/gtest.h"
+
+TEST(ConfigTest, ValidateDefaultsMatchPreviousConstants)
+{
+    RenderConfig config;
+    std::string error;
+
+    EXPECT_EQ(1280u, config.image_width);
+    EXPECT_EQ(720u, config.image_height);
+    EXPECT_EQ(512u, config.rays_per_pixel);
+    EXPECT_EQ(8u, config.max_bounce_count);
+    EXPECT_EQ("test.bmp", config.output_file);
+    EXPECT_TRUE(validate_config(config, &error));
+}
+
+TEST(ConfigTest, ValidateCommandLineOverridesDefaults)
+{
+    RenderConfig config;
+    std::string error;
+    const char *args[] = {"raytracer", "--width", "320", "--height=200", "--spp", "16", "--tile", "32x16",
+                          "--bounces", "3", "--perf-kernels", "--output", "out.bmp"};
+
+    ASSERT_TRUE(parse_command_line(&config, 13, const_cast<char **>(args), &error)) << error;
+    EXPECT_EQ(320u, config.image_width);
+    EXPECT_EQ(200u, config.image_height);
+    EXPECT_EQ(16u, config.rays_per_pixel);
+    EXPECT_EQ(32u, config.tile_width);
+    EXPECT_EQ(16u, config.tile_height);
+    EXPECT_EQ(3u, config.max_bounce_count);
+    EXPECT_TRUE(config.perf_counters);
+    EXPECT_TRUE(config.perf_kernels);
+    EXPECT_EQ("out.bmp", config.output_file);
+}
+
+TEST(ConfigTest, ValidateBadValuesAreRejected)
+{
+    RenderConfig config;
+    std::string error;
+
+    EXPECT_FALSE(apply_config_option(&config, "spp", "-4", &error));
+    EXPECT_FALSE(apply_config_option(&config, "width", "12px", &error));
+    EXPECT_FALSE(apply_config_option(&config, "colour", "red", &error));
+
+    config.rays_per_pixel = 0;
+    EXPECT_FALSE(validate_config(config, &error));
+}
+
+TEST(ConfigTest, ValidateMisspeltOptionsAreReportedAsUnknown)
+{
+    RenderConfig config;
+    std::string error;
+
+    // with or without something after it that could be its value
+    const char *last[] = { "raytracer", "--spp", "4", "--sort-ray" };
+    EXPECT_FALSE(parse_command_line(&config, 4, const_cast<char **>(last), &error));
+    EXPECT_EQ("unknown option 'sort-ray'", error);
+    const char *followed[] = { "raytracer", "--sort-ray", "--spp", "4" };
+    EXPECT_FALSE(parse_command_line(&config, 4, const_cast<char **>(followed), &error));
+    EXPECT_EQ("unknown option 'sort-ray'", error);
+
+    const char *missing[] = { "raytracer", "--spp" };
+    EXPECT_FALSE(parse_command_line(&config, 2, const_cast<char **>(missing), &error));
+    EXPECT_EQ("missing value for --spp", error);
+}
+
+TEST(ConfigTest, ValidateOnlyBitmapsAreHeldToTheBitmapPixelLimit)
+{
+    RenderConfig config;
+    std::string error;
+
+    config.image_width = 65536;
+    config.image_height = 65536;
+    EXPECT_FALSE(validate_config(config, &error));
+    config.map_output = true;
+    EXPECT_FALSE(validate_config(config, &error));
+    config.map_output = false;
+
+    // a tiled TIFF is streamed to the file, unless a benchmark renders into memory anyway
+    config.output_file = "huge.tif";
+    EXPECT_TRUE(validate_config(config, &error)) << error;
+    config.scaling = true;
+    EXPECT_FALSE(validate_config(config, &error));
+    config.scaling = false;
+
+    // but its tiles still have to be countable in 32 bits
+    config.image_width = UINT32_MAX;
+    config.image_height = UINT32_MAX;
+    EXPECT_FALSE(validate_config(config, &error));
+    config.image_height = 16;
+    EXPECT_FALSE(validate_config(config, &error));
+    config.image_width = UINT32_MAX - 64;
+    EXPECT_TRUE(validate_config(config, &error)) << error;
+}
@@ -0,0 +1,47 @@
+#include "../include/Acceleration.h"
+#include "../include/GBuffer.h"
+#include "../include/SceneGenerator.h"
+#include "gtest/gtest.h"
+
+TEST(GBufferTest, ValidateRasterizedHitsMatchTracedPrimaryRays)
+{
+    for (SceneLayout layout : { SceneLayout::Clustered, SceneLayout::Instanced })
+    {
+        Scene scene = {};
+        generate_sphere_field(&scene, layout, 600, 3);
+        scene.planes.push_back(Plane { Vector::Vector3 { 0.0f, 0.0f, 1.0f }, 0.0f, MaterialName::Metallic });
+        Mesh mesh = { "", MaterialName::Green, {} };
+        mesh.geometry.vertices = { Vector::Vector3 { -2.0f, 0.0f, 0.2f }, Vector::Vector3 { 2.0f, 0.0f, 0.2f },
+                                   Vector::Vector3 { 0.0f, 1.0f, 3.0f } };
+        mesh.geometry.indices = { 0, 1, 2 };
+        scene.meshes.push_back(mesh);
+        RenderConfig config = {};
+        AccelerationReport report = {};
+        prepare_acceleration(config, &scene, &report);
+
+        // odd sizes, so rows split unevenly between the threads
+        GBuffer gbuffer;
+        build_gbuffer(&scene, 37, 23, 2, 3, &gbuffer);
+        ASSERT_EQ(37u * 23u * 4u, gbuffer.hits.size());
+
+        RayStatistics statistics = {};
+        uint32_t kinds[5] = {};
+        for (size_t subpixel = 0; subpixel < gbuffer.hits.size(); ++subpixel)
+        {
+            const RayHit &hit = gbuffer.hits[subpixel];
+            RayHit expected;
+            closest_hit(&scene, scene.camera.position, gbuffer.directions[subpixel], FLOAT32_MAX, &expected, &statistics);
+            kinds[static_cast<uint32_t>(hit.kind)] += 1;
+            ASSERT_EQ(static_cast<uint32_t>(expected.kind), static_cast<uint32_t>(hit.kind)) << subpixel;
+            EXPECT_EQ(expected.distance, hit.distance) << subpixel;
+            EXPECT_EQ(expected.primitive, hit.primitive) << subpixel;
+            EXPECT_EQ(expected.material_name, hit.material_name) << subpixel;
+            EXPECT_EQ(expected.normal.z, hit.normal.z) << subpixel;
+        }
+        EXPECT_GT(kinds[static_cast<uint32_t>(HitKind::Plane)], 0u);
+        EXPECT_GT(kinds[static_cast<uint32_t>(HitKind::Triangle)], 0u);
+        // the instanced field places all its spheres through instances
+        HitKind sphere_kind = (layout == SceneLayout::Instanced) ? HitKind::InstancedSphere : HitKind::Sphere;
+        EXPECT_GT(kinds[static_cast<uint32_t>(sphere_kind)], 0u);
+    }
+}
@@ -0,0 +1,281 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "../include/Acceleration.h"
+#include "../include/Deflate.h"
+#include "../include/HdrImage.h"
+#include "../include/Math.h"
+#include "gtest/gtest.h"
+
+static std::vector<uint8_t> read_bytes(const std::string &file_name)
+{
+    std::ifstream file(file_name, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+struct BitReader
+{
+    const std::vector<uint8_t> &bytes;
+    size_t position;
+    uint32_t bit;
+
+    uint32_t get(uint32_t count)
+    {
+        uint32_t value = 0;
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            value |= ((bytes.at(position) >> bit) & 1) << index;
+            if (++bit == 8)
+            {
+                bit = 0;
+                ++position;
+            }
+        }
+        return value;
+    }
+
+    uint32_t get_code(uint32_t count)
+    {
+        uint32_t code = 0;
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            code = (code << 1) | get(1);
+        }
+        return code;
+    }
+};
+
+// inflates the fixed Huffman blocks zlib_compress writes, and nothing else
+static std::vector<uint8_t> zlib_decompress(const std::vector<uint8_t> &stream)
+{
+    static const uint16_t length_base[29] = { 3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                              31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t length_extra_bits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                   2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t distance_base[30] = { 1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                                33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                                1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t distance_extra_bits[30] = { 0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                                     6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    std::vector<uint8_t> output;
+    EXPECT_EQ(0u, ((stream.at(0) << 8) | stream.at(1)) % 31);
+    BitReader reader = { stream, 2, 0 };
+    bool final_block = false;
+    while (!final_block)
+    {
+        final_block = reader.get(1);
+        EXPECT_EQ(1u, reader.get(2));
+        for (;;)
+        {
+            uint32_t symbol = reader.get_code(7);
+            if (symbol >= 24)
+            {
+                symbol = (symbol << 1) | reader.get(1);
+                if ((symbol >= 0x30) && (symbol < 0xc0))
+                {
+                    symbol -= 0x30;
+                }
+                else if ((symbol >= 0xc0) && (symbol < 0xc8))
+                {
+                    symbol = 280 + symbol - 0xc0;
+                }
+                else
+                {
+                    symbol = 144 + ((symbol << 1) | reader.get(1)) - 0x190;
+                }
+            }
+            else
+            {
+                symbol += 256;
+            }
+
+            if (symbol < 256)
+            {
+                output.push_back(static_cast<uint8_t>(symbol));
+                continue;
+            }
+            if (symbol == 256)
+            {
+                break;
+            }
+            uint32_t length = length_base[symbol - 257] + reader.get(length_extra_bits[symbol - 257]);
+            uint32_t distance_code = reader.get_code(5);
+            uint32_t distance = distance_base[distance_code] + reader.get(distance_extra_bits[distance_code]);
+            if (distance > output.size())
+            {
+                ADD_FAILURE() << "distance " << distance << " reaches before the start";
+                return output;
+            }
+            for (uint32_t index = 0; index < length; ++index)
+            {
+                output.push_back(output[output.size() - distance]);
+            }
+        }
+    }
+    size_t end = reader.position + (reader.bit ? 1 : 0);
+    EXPECT_EQ(end + 4, stream.size());
+    uint32_t checksum = 0;
+    for (size_t index = end; index < std::min(end + 4, stream.size()); ++index)
+    {
+        checksum = (checksum << 8) | stream[index];
+    }
+    EXPECT_EQ(adler32(output.data(), output.size()), checksum);
+    return output;
+}
+
+TEST(HdrImageTest, ValidateDeflateRoundTrips)
+{
+    std::vector<std::vector<uint8_t>> inputs(4);
+    uint32_t series = 12345;
+    for (uint32_t index = 0; index < 20000; ++index)
+    {
+        series = series * 1664525u + 1013904223u;
+        inputs[1].push_back(static_cast<uint8_t>(series >> 24));
+        inputs[2].push_back("abcabd"[index % 6]);
+    }
+    // long runs, and matches from the far end of the window
+    inputs[3].assign(100000, 128);
+    inputs[3].insert(inputs[3].end(), inputs[1].begin(), inputs[1].end());
+    inputs[3].insert(inputs[3].end(), inputs[1].begin(), inputs[1].begin() + 5000);
+
+    for (const auto &input : inputs)
+    {
+        std::vector<uint8_t> compressed;
+        zlib_compress(input.data(), input.size(), &compressed);
+        EXPECT_TRUE(zlib_decompress(compressed) == input) << input.size() << " bytes";
+        if (input.size() == 20000 && input[0] == 'a')
+        {
+            EXPECT_LT(compressed.size(), 200u);
+        }
+    }
+}
+
+// the EXR's B, G and R values of every pixel, in the renderer's row order
+static std::vector<Vector::Vector3> read_exr(const std::string &file_name, uint32_t width, uint32_t height)
+{
+    std::vector<uint8_t> file = read_bytes(file_name);
+    std::vector<Vector::Vector3> colors(static_cast<size_t>(width) * height);
+    EXPECT_EQ(0, memcmp(file.data(), "\x76\x2f\x31\x01", 4));
+
+    // attributes until an empty name
+    size_t position = 8;
+    uint8_t compression = 255;
+    while (file.at(position))
+    {
+        std::string name(reinterpret_cast<const char *>(&file[position]));
+        position += name.size() + 1;
+        std::string type(reinterpret_cast<const char *>(&file[position]));
+        position += type.size() + 1;
+        int32_t size;
+        memcpy(&size, &file[position], sizeof(size));
+        position += sizeof(size);
+        if (name == "compression")
+        {
+            compression = file[position];
+        }
+        if (name == "dataWindow")
+        {
+            int32_t box[4];
+            memcpy(box, &file[position], sizeof(box));
+            EXPECT_EQ(static_cast<int32_t>(width) - 1, box[2]);
+            EXPECT_EQ(static_cast<int32_t>(height) - 1, box[3]);
+        }
+        position += size;
+    }
+    ++position;
+    EXPECT_TRUE((compression == 0) || (compression == 3));
+    const uint32_t block_lines = (compression == 3) ? 16 : 1;
+    const uint32_t block_count = (height + block_lines - 1) / block_lines;
+
+    for (uint32_t block = 0; block < block_count; ++block)
+    {
+        uint64_t offset;
+        memcpy(&offset, &file[position + block * sizeof(offset)], sizeof(offset));
+        int32_t block_head[2];
+        memcpy(block_head, &file.at(offset), sizeof(block_head));
+        EXPECT_EQ(static_cast<int32_t>(block * block_lines), block_head[0]);
+        uint32_t line_count = std::min(block_lines, height - block * block_lines);
+        size_t raw_size = static_cast<size_t>(line_count) * width * 3 * sizeof(float);
+        std::vector<uint8_t> data(file.begin() + offset + 8, file.begin() + offset + 8 + block_head[1]);
+        if (data.size() < raw_size)
+        {
+            // undo the prediction and the even/odd split
+            std::vector<uint8_t> predicted = zlib_decompress(data);
+            EXPECT_EQ(raw_size, predicted.size());
+            predicted.resize(raw_size);
+            for (size_t index = 1; index < raw_size; ++index)
+            {
+                predicted[index] = static_cast<uint8_t>(predicted[index - 1] + predicted[index] - 128);
+            }
+            data.resize(raw_size);
+            for (size_t index = 0; index < raw_size; ++index)
+            {
+                data[index] = predicted[(index & 1) ? (raw_size + 1) / 2 + index / 2 : index / 2];
+            }
+        }
+        EXPECT_EQ(raw_size, data.size());
+        const float *values = reinterpret_cast<const float *>(data.data());
+        for (uint32_t line = 0; line < line_count; ++line)
+        {
+            Vector::Vector3 *row = colors.data() + static_cast<size_t>(height - 1 - (block * block_lines + line)) * width;
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                row[x] = Vector::Vector3 { values[2 * width + x], values[width + x], values[x] };
+            }
+            values += 3 * width;
+        }
+    }
+    return colors;
+}
+
+TEST(HdrImageTest, ValidateFloatFilesHoldTheLinearColorsOfTheRender)
+{
+    Scene scene = {};
+    build_default_scene(&scene);
+    RenderConfig config = {};
+    config.image_width = 37;
+    config.image_height = 21;
+    config.rays_per_pixel = 2;
+    config.tile_width = 16;
+    config.tile_height = 16;
+    config.thread_count = 2;
+    AccelerationReport report = {};
+    prepare_acceleration(config, &scene, &report);
+
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+    std::vector<Vector::Vector3> colors(config.image_width * config.image_height);
+    RenderResult result = {};
+    render_scene(&scene, config, *image_data, false, &result, nullptr, colors.data());
+    bool over_one = false;
+    for (uint32_t pixel = 0; pixel < colors.size(); ++pixel)
+    {
+        Vector::Vector3 color = { 255.0f * Math::linear_to_sRGB(colors[pixel].x),
+                                  255.0f * Math::linear_to_sRGB(colors[pixel].y),
+                                  255.0f * Math::linear_to_sRGB(colors[pixel].z) };
+        ASSERT_EQ(Math::pack_BGRA(color), image_data->pixels.get()[pixel]) << pixel;
+        over_one = over_one || (colors[pixel].x > 1.0f) || (colors[pixel].y > 1.0f) || (colors[pixel].z > 1.0f);
+    }
+    // some way outside [0, 1], so the files have to keep the full range
+    colors[5] = Vector::Vector3 { 37.5f, -0.25f, 1.0e-7f };
+
+    std::string error;
+    std::string pfm_name = testing::TempDir() + "hdr_image_test.pfm";
+    ASSERT_TRUE(write_pfm(pfm_name, config.image_width, config.image_height, colors.data(), &error)) << error;
+    std::vector<uint8_t> pfm = read_bytes(pfm_name);
+    const char *pfm_header = "PF\n37 21\n-1.0\n";
+    ASSERT_EQ(strlen(pfm_header) + colors.size() * 12, pfm.size());
+    EXPECT_EQ(0, memcmp(pfm.data(), pfm_header, strlen(pfm_header)));
+    EXPECT_EQ(0, memcmp(pfm.data() + strlen(pfm_header), colors.data(), colors.size() * 12));
+    remove(pfm_name.c_str());
+
+    for (ExrCompression compression : { ExrCompression::None, ExrCompression::Zip })
+    {
+        std::string exr_name = testing::TempDir() + "hdr_image_test.exr";
+        ASSERT_TRUE(write_hdr_image(exr_name, config.image_width, config.image_height, colors.data(), compression, 3,
+                                    &error)) << error;
+        std::vector<Vector::Vector3> read = read_exr(exr_name, config.image_width, config.image_height);
+        EXPECT_EQ(0, memcmp(read.data(), colors.data(), colors.size() * sizeof(Vector::Vector3)));
+        remove(exr_name.c_str());
+    }
+}
@@ -0,0 +1,142 @@
+#include <cstring>
+#include "../include/Acceleration.h"
+#include "../include/Bitmap.h"
+#include "../include/Instancing.h"
+#include "../include/SceneFile.h"
+#include "gtest/gtest.h"
+
+static bool near_vector(const Vector::Vector3 &a, const Vector::Vector3 &b)
+{
+    return (std::fabs(a.x - b.x) < 1e-4f) && (std::fabs(a.y - b.y) < 1e-4f) && (std::fabs(a.z - b.z) < 1e-4f);
+}
+
+TEST(InstancingTest, ValidateTransformsInvertAndBoundBoxes)
+{
+    Transform transform = scale_rotate_translate(2.0f, 0.7f, Vector::Vector3 { 1.0f, -3.0f, 0.5f });
+    transform.m[0][2] = 0.25f;  // and a shear, so the inverse is not just a transpose
+    Transform inverse;
+    ASSERT_TRUE(invert_transform(transform, &inverse));
+
+    Vector::Vector3 point = { 0.3f, -1.2f, 2.0f };
+    EXPECT_TRUE(near_vector(point, transform_point(inverse, transform_point(transform, point))));
+
+    Aabb box = { Vector::Vector3 { -1.0f, 0.0f, 2.0f }, Vector::Vector3 { 1.0f, 0.5f, 3.0f } };
+    Aabb world_box = transform_aabb(transform, box);
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        Vector::Vector3 box_corner = { (corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                                       (corner & 4) ? box.max.z : box.min.z };
+        Vector::Vector3 world = transform_point(transform, box_corner);
+        EXPECT_TRUE((world.x >= world_box.min.x - 1e-5f) && (world.x <= world_box.max.x + 1e-5f));
+        EXPECT_TRUE((world.y >= world_box.min.y - 1e-5f) && (world.y <= world_box.max.y + 1e-5f));
+        EXPECT_TRUE((world.z >= world_box.min.z - 1e-5f) && (world.z <= world_box.max.z + 1e-5f));
+    }
+
+    Transform flat = identity_transform();
+    flat.m[2][2] = 0.0f;
+    EXPECT_FALSE(invert_transform(flat, &inverse));
+}
+
+TEST(InstancingTest, ValidateObjectsAndInstancesAreParsedAndWritten)
+{
+    const char *text =
+        "object Berry\n"
+        "sphere 0 0 0.3 0.1 Raspberry\n"
+        "sphere 0.2 0 0.3 0.1 Green\n"
+        "end\n"
+        "instance Berry 1 2 0\n"
+        "instance Berry 2 0 0 0  0 2 0 5  0 0 2 0\n";
+    Scene scene = {};
+    std::string error;
+    ASSERT_TRUE(parse_scene_text(text, strlen(text), &scene, &error)) << error;
+    EXPECT_EQ(0u, scene.spheres.size());
+    ASSERT_EQ(1u, scene.objects.size());
+    EXPECT_EQ(2u, scene.objects[0].spheres.size());
+    ASSERT_EQ(2u, scene.instances.size());
+    EXPECT_EQ(4u, instanced_sphere_count(scene));
+    EXPECT_FLOAT_EQ(2.0f, scene.instances[0].object_to_world.m[1][3]);
+    EXPECT_FLOAT_EQ(-2.5f, scene.instances[1].world_to_object.m[1][3]);
+
+    std::string file_name = testing::TempDir() + "instancing_test.txt";
+    ASSERT_TRUE(write_scene_text(scene, file_name, &error)) << error;
+    Scene reloaded = {};
+    ASSERT_TRUE(load_scene_text(file_name, &reloaded, &error)) << error;
+    remove(file_name.c_str());
+    ASSERT_EQ(2u, reloaded.instances.size());
+    EXPECT_EQ(0, memcmp(&scene.instances[1], &reloaded.instances[1], sizeof(Instance)));
+
+    const char *unfinished = "object Berry\nsphere 0 0 0 1 Orange\n";
+    EXPECT_FALSE(parse_scene_text(unfinished, strlen(unfinished), &scene, &error));
+    const char *unknown = "instance Berry 0 0 0\n";
+    EXPECT_FALSE(parse_scene_text(unknown, strlen(unknown), &scene, &error));
+    const char *plane_inside = "object Berry\nplane 0 0 1 0 Metallic\nend\n";
+    EXPECT_FALSE(parse_scene_text(plane_inside, strlen(plane_inside), &scene, &error));
+}
+
+static std::vector<uint32_t> render_pixels(Scene *scene, const char *accelerator)
+{
+    RenderConfig config = {};
+    config.image_width = 48;
+    config.image_height = 27;
+    config.rays_per_pixel = 8;
+    config.accelerator = accelerator;
+    AccelerationReport report = {};
+    prepare_acceleration(config, scene, &report);
+
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+    RenderResult result = {};
+    render_scene(scene, config, *image_data, false, &result);
+    return std::vector<uint32_t>(image_data->pixels.get(), image_data->pixels.get() + config.image_width * config.image_height);
+}
+
+TEST(InstancingTest, ValidateInstancesRenderLikeTheirFlattenedSpheres)
+{
+    const char *text =
+        "plane 0 0 1 0 Metallic\n"
+        "sphere 0 2 1 1 Orange\n"
+        "object Berry\n"
+        "sphere 0.3 0.05 0.3 0.1 Raspberry\n"
+        "sphere -0.3 0.05 0.3 0.1 Raspberry\n"
+        "sphere 0.1 -0.65 0.3 0.1 Raspberry\n"
+        "sphere -0.1 0.65 0.3 0.1 Raspberry\n"
+        "sphere 0.1 -0.35 0.15 0.1 Green\n"
+        "end\n"
+        "instance Berry -1.5 -4.6 0\n"
+        "instance Berry 2.1 -1.2 0 1  1.2 2.1 0 -1  0 0 2.4187 0\n"
+        "instance Berry -2.8 0 0 1.5  0 -2.8 0 2  0 0 2.8 0.2\n";
+    Scene instanced = {};
+    std::string error;
+    ASSERT_TRUE(parse_scene_text(text, strlen(text), &instanced, &error)) << error;
+    Scene flattened = {};
+    ASSERT_TRUE(parse_scene_text(text, strlen(text), &flattened, &error)) << error;
+    ASSERT_TRUE(flatten_instances(&flattened));
+    EXPECT_EQ(16u, flattened.spheres.size());
+
+    std::vector<uint32_t> flat_pixels = render_pixels(&flattened, "bvh");
+    for (const char *accelerator : { "none", "bvh" })
+    {
+        // transformed rays round differently, so only the odd edge pixel may change
+        std::vector<uint32_t> pixels = render_pixels(&instanced, accelerator);
+        uint32_t different = 0;
+        for (size_t pixel = 0; pixel < pixels.size(); ++pixel)
+        {
+            for (uint32_t shift = 0; shift < 24; shift += 8)
+            {
+                int difference = static_cast<int>((pixels[pixel] >> shift) & 0xFF) -
+                                 static_cast<int>((flat_pixels[pixel] >> shift) & 0xFF);
+                if (std::abs(difference) > 4)
+                {
+                    different += 1;
+                    break;
+                }
+            }
+        }
+        EXPECT_LE(different, pixels.size() / 100) << accelerator;
+    }
+
+    // a squashed berry has no flat equivalent
+    instanced.instances[0].object_to_world.m[2][2] = 0.5f;
+    EXPECT_FALSE(flatten_instances(&instanced));
+    EXPECT_EQ(3u, instanced.instances.size());
+}
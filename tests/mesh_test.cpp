@@ -0,0 +1,154 @@
+#include <cstring>
+#include "../include/MeshFile.h"
+#include "gtest/gtest.h"
+
+// nearest hit over every block, the way a mesh without a BVH is traced
+static int32_t nearest_block_hit(const TriangleMesh &mesh, const TriangleRay &ray, float *hit_distance)
+{
+    int32_t hit_block = -1;
+    for (size_t block = 0; block < mesh.blocks.size(); ++block)
+    {
+        if (intersect_triangle_block(mesh.blocks[block], ray, 0.0f, hit_distance) >= 0)
+        {
+            hit_block = static_cast<int32_t>(block);
+        }
+    }
+    return hit_block;
+}
+
+TEST(MeshTest, ValidateObjFilesAreParsedInChunks)
+{
+    const char *text =
+        "# a unit square and a triangle after it\n"
+        "o square\n"
+        "v 0 0 0\n"
+        "v 1 0 0\n"
+        "vt 0.5 0.5\n"
+        "v 1 1 0\n"
+        "v 0 1 0   # trailing comment\n"
+        "vn 0 0 1\n"
+        "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+        "\n"
+        "v 0 0 1\n"
+        "v 1 0 1\n"
+        "v 0 1 1\n"
+        "f -3 -2 -1\n";
+    for (uint32_t thread_count : { 1u, 3u, 16u })
+    {
+        TriangleMesh mesh;
+        std::string error;
+        ASSERT_TRUE(parse_obj_mesh(text, strlen(text), thread_count, &mesh, &error)) << error;
+        ASSERT_EQ(7u, mesh.vertices.size());
+        ASSERT_EQ(3u, triangle_count(mesh));
+        const uint32_t expected[] = { 0, 1, 2, 0, 2, 3, 4, 5, 6 };
+        EXPECT_EQ(0, memcmp(expected, mesh.indices.data(), sizeof(expected)));
+        EXPECT_FLOAT_EQ(1.0f, mesh.vertices[6].z);
+    }
+
+    const char *broken = "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\nf 1 2 9\n";
+    TriangleMesh mesh;
+    std::string error;
+    EXPECT_FALSE(parse_obj_mesh(broken, strlen(broken), 2, &mesh, &error));
+    EXPECT_EQ("line 5: f refers to a missing vertex", error);
+}
+
+TEST(MeshTest, ValidatePlyFilesRoundTripAndPolygonsAreFanned)
+{
+    TriangleMesh mesh;
+    for (uint32_t vertex = 0; vertex < 40; ++vertex)
+    {
+        mesh.vertices.push_back(Vector::Vector3 { static_cast<float>(vertex), 0.5f * vertex, -1.0f });
+    }
+    for (uint32_t triangle = 0; triangle < 38; ++triangle)
+    {
+        mesh.indices.insert(mesh.indices.end(), { triangle, triangle + 1, triangle + 2 });
+    }
+    std::string file_name = testing::TempDir() + "mesh_test.ply";
+    std::string error;
+    ASSERT_TRUE(write_ply_mesh(mesh, file_name, &error)) << error;
+
+    TriangleMesh loaded;
+    ASSERT_TRUE(load_mesh_file(file_name, 4, &loaded, &error)) << error;
+    EXPECT_EQ(mesh.indices, loaded.indices);
+    ASSERT_EQ(mesh.vertices.size(), loaded.vertices.size());
+    EXPECT_FLOAT_EQ(19.5f, loaded.vertices[39].y);
+
+    // big endian, double vertices with an extra property, and a quad
+    std::string ply = "ply\nformat binary_big_endian 1.0\nelement vertex 4\nproperty double x\nproperty double y\n"
+                      "property double z\nproperty uchar red\nelement face 1\nproperty list uchar ushort vertex_indices\n"
+                      "end_header\n";
+    for (uint32_t vertex = 0; vertex < 4; ++vertex)
+    {
+        double values[3] = { static_cast<double>(vertex & 1), static_cast<double>(vertex >> 1), 2.0 };
+        for (double value : values)
+        {
+            uint8_t bytes[8];
+            memcpy(bytes, &value, 8);
+            for (int32_t byte = 7; byte >= 0; --byte)
+            {
+                ply.push_back(static_cast<char>(bytes[byte]));
+            }
+        }
+        ply.push_back(static_cast<char>(255));
+    }
+    const uint8_t face[] = { 4, 0, 0, 0, 1, 0, 3, 0, 2 };
+    ply.append(reinterpret_cast<const char *>(face), sizeof(face));
+    ASSERT_TRUE(parse_ply_mesh(reinterpret_cast<const uint8_t *>(ply.data()), ply.size(), 2, &loaded, &error)) << error;
+    EXPECT_EQ((std::vector<uint32_t> { 0, 1, 3, 0, 3, 2 }), loaded.indices);
+    EXPECT_FLOAT_EQ(1.0f, loaded.vertices[3].y);
+    EXPECT_FLOAT_EQ(2.0f, loaded.vertices[3].z);
+
+    // the last index points past the vertices
+    ply[ply.size() - 1] = 9;
+    EXPECT_FALSE(parse_ply_mesh(reinterpret_cast<const uint8_t *>(ply.data()), ply.size(), 2, &loaded, &error));
+}
+
+TEST(MeshTest, ValidateRaysNeverSlipBetweenTrianglesSharingAnEdge)
+{
+    // a grid of squares, each cut along its diagonal
+    const uint32_t size = 12;
+    TriangleMesh mesh;
+    for (uint32_t y = 0; y <= size; ++y)
+    {
+        for (uint32_t x = 0; x <= size; ++x)
+        {
+            mesh.vertices.push_back(Vector::Vector3 { 0.1f * x, 0.1f * y, 0.0f });
+        }
+    }
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            uint32_t corner = y * (size + 1) + x;
+            mesh.indices.insert(mesh.indices.end(), { corner, corner + 1, corner + size + 2 });
+            mesh.indices.insert(mesh.indices.end(), { corner, corner + size + 2, corner + size + 1 });
+        }
+    }
+    TriangleMesh in_order = mesh;
+    build_mesh_blocks(&in_order);
+    build_mesh_bvh(BvhBuilder::BinnedSah, 2, &mesh);
+    ASSERT_FALSE(mesh.bvh.nodes.empty());
+    for (const auto &node : mesh.bvh.nodes)
+    {
+        EXPECT_EQ(0u, (node.count == 0) ? 0u : node.first % TRIANGLE_BLOCK_WIDTH);
+    }
+
+    // aimed at points along shared edges and vertices, from both sides
+    for (uint32_t step = 0; step < 400; ++step)
+    {
+        float s = 0.05f + 1.1f * step / 400.0f;
+        Vector::Vector3 targets[2] = { Vector::Vector3 { s, s, 0.0f }, Vector::Vector3 { s, 0.1f * (step % 12 + 0.5f), 0.0f } };
+        for (const auto &target : targets)
+        {
+            Vector::Vector3 origin = { 0.37f, -0.21f, (step & 1) ? 5.0f : -5.0f };
+            Vector::Vector3 direction = target - origin;
+            TriangleRay ray = make_triangle_ray(origin, direction);
+            float grid_distance = FLT_MAX, ordered_distance = FLT_MAX;
+            int32_t grid_block = nearest_block_hit(mesh, ray, &grid_distance);
+            int32_t ordered_block = nearest_block_hit(in_order, ray, &ordered_distance);
+            EXPECT_GE(grid_block, 0) << "slipped through at step " << step;
+            EXPECT_GE(ordered_block, 0);
+            EXPECT_EQ(grid_distance, ordered_distance);
+        }
+    }
+}
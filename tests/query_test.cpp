@@ -0,0 +1,110 @@
+#include "../include/Acceleration.h"
+#include "../include/SceneGenerator.h"
+#include "../include/TraceBatch.h"
+#include "gtest/gtest.h"
+
+TEST(QueryTest, ValidateOccludedAgreesWithClosestHitThroughEveryAccelerator)
+{
+    for (SceneLayout layout : { SceneLayout::Random, SceneLayout::Instanced })
+    {
+        Scene scene = {};
+        generate_sphere_field(&scene, layout, 2000, 7);
+        Mesh mesh = { "", MaterialName::Green, {} };
+        mesh.geometry.vertices = { Vector::Vector3 { -3.0f, -3.0f, 0.5f }, Vector::Vector3 { 3.0f, -3.0f, 0.5f },
+                                   Vector::Vector3 { 0.0f, 3.0f, 2.5f } };
+        mesh.geometry.indices = { 0, 1, 2 };
+        scene.meshes.push_back(mesh);
+
+        std::vector<float> reference;
+        for (const char *accelerator : { "none", "bvh", "bvh8", "grid" })
+        {
+            RenderConfig config = {};
+            config.accelerator = accelerator;
+            AccelerationReport report = {};
+            prepare_acceleration(config, &scene, &report);
+
+            Math::RandomSeries series = { 1234 };
+            RayStatistics statistics = {};
+            for (uint32_t ray = 0; ray < 2000; ++ray)
+            {
+                Vector::Vector3 origin = { 6.0f * random_bilateral(&series), 6.0f * random_bilateral(&series),
+                                           3.0f * random_unilateral(&series) };
+                Vector::Vector3 direction = { 4.0f * random_bilateral(&series), 4.0f * random_bilateral(&series),
+                                              2.0f * random_bilateral(&series) };
+                RayHit ray_hit;
+                bool hit = closest_hit(&scene, origin, direction, 1.0f, &ray_hit, &statistics);
+                float hit_distance = ray_hit.distance;
+                EXPECT_EQ(hit, occluded(&scene, origin, direction, 1.0f, &statistics)) << accelerator << " ray " << ray;
+                if (hit)
+                {
+                    // the nearest hit blocks any segment reaching past it
+                    EXPECT_TRUE(occluded(&scene, origin, direction, hit_distance * 1.0001f, &statistics));
+                }
+                if (reference.size() < 2000)
+                {
+                    reference.push_back(hit_distance);
+                }
+                else
+                {
+                    EXPECT_FLOAT_EQ(reference[ray], hit_distance) << accelerator << " ray " << ray;
+                }
+            }
+        }
+    }
+}
+
+TEST(QueryTest, ValidateTraceBatchMatchesSingleRayQueries)
+{
+    Scene scene = {};
+    generate_sphere_field(&scene, SceneLayout::Clustered, 3000, 11);
+    RenderConfig config = {};
+    AccelerationReport report = {};
+    prepare_acceleration(config, &scene, &report);
+
+    // more than one slice per thread, and a short last slice
+    const uint32_t count = 3 * TRACE_BATCH_SLICE_SIZE + 77;
+    std::vector<float> origin[3], direction[3], max_distance(count);
+    Math::RandomSeries series = { 99 };
+    for (uint32_t ray = 0; ray < count; ++ray)
+    {
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            origin[axis].push_back(5.0f * random_bilateral(&series));
+            direction[axis].push_back(random_bilateral(&series));
+        }
+        max_distance[ray] = 10.0f * random_unilateral(&series);
+    }
+    RayBatch rays = { RayQuery::ClosestHit, count, origin[0].data(), origin[1].data(), origin[2].data(),
+                      direction[0].data(), direction[1].data(), direction[2].data(), max_distance.data() };
+    std::vector<uint8_t> hit(count), kind(count), blocked(count);
+    std::vector<float> distance(count), normal_x(count), normal_y(count), normal_z(count);
+    std::vector<uint32_t> primitive(count);
+    HitBatch hits = { hit.data(), distance.data(), kind.data(), primitive.data(), nullptr, normal_x.data(),
+                      normal_y.data(), normal_z.data() };
+    trace_batch(scene, rays, 3, &hits);
+    rays.query = RayQuery::AnyHit;
+    HitBatch any_hits = { blocked.data(), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+    trace_batch(scene, rays, 3, &any_hits);
+
+    RayStatistics statistics = {};
+    uint32_t hit_count = 0;
+    for (uint32_t ray = 0; ray < count; ++ray)
+    {
+        Vector::Vector3 ray_origin = { origin[0][ray], origin[1][ray], origin[2][ray] };
+        Vector::Vector3 ray_direction = { direction[0][ray], direction[1][ray], direction[2][ray] };
+        RayHit expected;
+        bool found = closest_hit(&scene, ray_origin, ray_direction, max_distance[ray], &expected, &statistics);
+        hit_count += found;
+        ASSERT_EQ(found, hit[ray] == 1) << ray;
+        EXPECT_EQ(found, blocked[ray] == 1) << ray;
+        EXPECT_EQ(expected.distance, distance[ray]);
+        EXPECT_EQ(static_cast<uint8_t>(expected.kind), kind[ray]);
+        if (found)
+        {
+            EXPECT_EQ(expected.primitive, primitive[ray]);
+            EXPECT_EQ(expected.normal.z, normal_z[ray]);
+        }
+    }
+    EXPECT_GT(hit_count, count / 10);
+    EXPECT_LT(hit_count, count);
+}
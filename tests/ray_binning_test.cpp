@@ -0,0 +1,40 @@
+#include "../include/RayBinning.h"
+#include "gtest/gtest.h"
+
+TEST(RayBinningTest, ValidateRaysSortByOctantThenOriginCellAndKeepTheirOrderWithinABin)
+{
+    RayBinGrid grid = make_ray_bin_grid(Aabb { Vector::Vector3 { -1.0f, -1.0f, -1.0f }, Vector::Vector3 { 1.0f, 1.0f, 1.0f } });
+    const Vector::Vector3 up = { 0.0f, 0.0f, 1.0f };
+    const Vector::Vector3 down = { 0.0f, 0.0f, -1.0f };
+    const Vector::Vector3 near_corner = { -0.9f, -0.9f, -0.9f };
+    const Vector::Vector3 far_corner = { 0.9f, 0.9f, 0.9f };
+
+    EXPECT_LT(ray_bin_key(grid, far_corner, up), ray_bin_key(grid, near_corner, down));
+    EXPECT_LT(ray_bin_key(grid, near_corner, up), ray_bin_key(grid, far_corner, up));
+    // outside the grid counts as its border cells
+    EXPECT_EQ(ray_bin_key(grid, Vector::Vector3 { -5.0f, -5.0f, -5.0f }, up), ray_bin_key(grid, Vector::Vector3 { -1.0f, -1.0f, -1.0f }, up));
+
+    // payloads 0..5, alternating between two bins, with a third bin ahead of both
+    std::vector<uint64_t> entries;
+    const uint32_t keys[] = { ray_bin_key(grid, near_corner, down), ray_bin_key(grid, far_corner, up) };
+    for (uint32_t payload = 0; payload < 6; ++payload)
+    {
+        entries.push_back((static_cast<uint64_t>(keys[payload & 1]) << 32) | payload);
+    }
+    entries.push_back((static_cast<uint64_t>(ray_bin_key(grid, near_corner, up)) << 32) | 6);
+    std::vector<uint64_t> scratch;
+    sort_ray_bins(&entries, &scratch);
+
+    const uint32_t expected[] = { 6, 1, 3, 5, 0, 2, 4 };
+    ASSERT_EQ(7u, entries.size());
+    for (uint32_t index = 0; index < 7; ++index)
+    {
+        EXPECT_EQ(expected[index], static_cast<uint32_t>(entries[index])) << index;
+    }
+
+    // keys that only differ in one digit, so the other passes are skipped
+    std::vector<uint64_t> shared_digits = { (0x1234u << 8 | 0x03ull) << 32 | 0, (0x1234u << 8 | 0x01ull) << 32 | 1 };
+    sort_ray_bins(&shared_digits, &scratch);
+    EXPECT_EQ(1u, static_cast<uint32_t>(shared_digits[0]));
+    EXPECT_EQ(0u, static_cast<uint32_t>(shared_digits[1]));
+}
@@ -0,0 +1,84 @@
+#include <cstring>
+#include "../include/BinaryScene.h"
+#include "../include/SceneFile.h"
+#include "gtest/gtest.h"
+
+TEST(SceneFileTest, ValidatePrimitivesAndMaterialsAreParsed)
+{
+    const char *text =
+        "# two spheres on a floor\n"
+        "camera 0 -10 1  0 0 0\n"
+        "material Gold 0.9  0 0 0  1 0.8 0.2\n"
+        "plane 0 0 1 0 Metallic\n"
+        "sphere 0 2 1.8 0.5 Orange   # trailing comment\n"
+        "\n"
+        "sphere -1.5e0 2 .5 0.25 Gold\n";
+    Scene scene = {};
+    std::string error;
+
+    ASSERT_TRUE(parse_scene_text(text, strlen(text), &scene, &error)) << error;
+    ASSERT_EQ(1u, scene.planes.size());
+    ASSERT_EQ(2u, scene.spheres.size());
+    EXPECT_EQ(MaterialName::Metallic, scene.planes[0].material_name);
+    EXPECT_EQ(MaterialName::Orange, scene.spheres[0].material_name);
+    EXPECT_FLOAT_EQ(-1.5f, scene.spheres[1].position.x);
+    EXPECT_FLOAT_EQ(0.5f, scene.spheres[1].position.z);
+
+    // custom materials are appended after the built-in ones
+    ASSERT_EQ(BUILTIN_MATERIAL_COUNT + 1, scene.materials.size());
+    EXPECT_EQ(BUILTIN_MATERIAL_COUNT, static_cast<uint32_t>(scene.spheres[1].material_name));
+    EXPECT_FLOAT_EQ(0.9f, scene.materials[BUILTIN_MATERIAL_COUNT].specular);
+    EXPECT_FLOAT_EQ(0.8f, scene.materials[BUILTIN_MATERIAL_COUNT].reflection_color.y);
+}
+
+TEST(SceneFileTest, ValidateErrorsReportTheLine)
+{
+    Scene scene = {};
+    std::string error;
+
+    const char *unknown_material = "sphere 0 0 0 1 Orange\nsphere 0 0 0 1 Gold\n";
+    EXPECT_FALSE(parse_scene_text(unknown_material, strlen(unknown_material), &scene, &error));
+    EXPECT_EQ(0u, error.find("line 2"));
+
+    const char *missing_radius = "sphere 0 0 0 Orange\n";
+    EXPECT_FALSE(parse_scene_text(missing_radius, strlen(missing_radius), &scene, &error));
+
+    const char *unknown_statement = "cube 0 0 0 1 Orange\n";
+    EXPECT_FALSE(parse_scene_text(unknown_statement, strlen(unknown_statement), &scene, &error));
+}
+
+TEST(SceneFileTest, ValidateBinarySceneIsTracedInPlace)
+{
+    const char *text =
+        "camera 1 -8 2  0 0 0  0 0 1  2\n"
+        "material Gold 0.9  0 0 0  1 0.8 0.2\n"
+        "plane 0 0 1 0 Metallic\n"
+        "sphere 0 2 1.8 0.5 Orange\n"
+        "sphere -1.5 2 0.5 0.25 Gold\n";
+    Scene text_scene = {};
+    std::string error;
+    ASSERT_TRUE(parse_scene_text(text, strlen(text), &text_scene, &error)) << error;
+
+    std::string file_name = testing::TempDir() + "scene_file_test.rtscene";
+    ASSERT_TRUE(write_scene_binary(text_scene, file_name, &error)) << error;
+    ASSERT_TRUE(is_binary_scene_file(file_name));
+
+    Scene scene = {};
+    ASSERT_TRUE(load_scene_binary(file_name, &scene, &error)) << error;
+    EXPECT_TRUE(scene.spheres.is_view());
+    ASSERT_EQ(2u, scene.spheres.size());
+    ASSERT_EQ(1u, scene.planes.size());
+    EXPECT_EQ(0, memcmp(text_scene.spheres.data(), scene.spheres.data(), 2 * sizeof(Sphere)));
+    EXPECT_EQ(BUILTIN_MATERIAL_COUNT + 1, scene.materials.size());
+    EXPECT_FLOAT_EQ(2.0f, scene.camera.film_distance);
+
+    // editing a mapped scene copies the array instead of writing to the file
+    scene.spheres.push_back(Sphere {});
+    EXPECT_FALSE(scene.spheres.is_view());
+    EXPECT_EQ(3u, scene.spheres.size());
+    EXPECT_EQ(MaterialName::Orange, scene.spheres[0].material_name);
+
+    Scene text_loaded = {};
+    EXPECT_FALSE(load_scene_text(file_name, &text_loaded, &error));
+    remove(file_name.c_str());
+}
@@ -0,0 +1,147 @@
+#include <cstring>
+#include "../include/SceneFile.h"
+#include "gtest/gtest.h"
+
+TEST(SdfTest, ValidateSphereTracingMatchesAnalyticSpheres)
+{
+    // the same spheres once as primitives and once as an sdf of unblended spheres
+    Scene spheres = {};
+    Scene sdfs = {};
+    Sdf sdf = { MaterialName::Orange, {} };
+    for (uint32_t index = 0; index < 6; ++index)
+    {
+        Vector::Vector3 center = { -2.5f + static_cast<float>(index), 0.3f * static_cast<float>(index % 3), 1.0f };
+        float radius = 0.3f + 0.05f * static_cast<float>(index);
+        spheres.spheres.push_back(Sphere { center, radius, MaterialName::Orange });
+        sdf.surface.spheres.push_back(SdfSphere { center, radius });
+    }
+    finish_sdf_surface(&sdf.surface);
+    sdfs.sdfs.push_back(sdf);
+
+    Math::RandomSeries series = { 29 };
+    RayStatistics statistics = {};
+    uint32_t hits = 0;
+    for (uint32_t ray = 0; ray < 500; ++ray)
+    {
+        Vector::Vector3 origin = { random_bilateral(&series) * 4.0f, -10.0f, 1.0f + random_bilateral(&series) * 2.0f };
+        Vector::Vector3 target = { random_bilateral(&series) * 3.0f, 0.0f, 1.0f + random_bilateral(&series) };
+        Vector::Vector3 direction = Math::normalize_or_zero(target - origin);
+        RayHit expected, hit;
+        bool found = closest_hit(&spheres, origin, direction, FLOAT32_MAX, &expected, &statistics);
+        ASSERT_EQ(found, closest_hit(&sdfs, origin, direction, FLOAT32_MAX, &hit, &statistics)) << ray;
+        ASSERT_EQ(found, occluded(&sdfs, origin, direction, FLOAT32_MAX, &statistics)) << ray;
+        if (!found)
+        {
+            continue;
+        }
+        hits += 1;
+        EXPECT_EQ(HitKind::Sdf, hit.kind);
+        EXPECT_EQ(MaterialName::Orange, hit.material_name);
+        // short of the sphere by at most the hit epsilon, which is 1e-3 at this range; grazing
+        // rays stop that close to the surface well before the analytic hit
+        Vector::Vector3 point = origin + hit.distance * direction;
+        const Sphere &sphere = spheres.spheres[expected.primitive];
+        Vector::Vector3 offset = point - sphere.position;
+        float surface_distance = Math::square_root(Math::inner_product(offset, offset)) - sphere.radius;
+        EXPECT_GE(surface_distance, 0.0f) << ray;
+        EXPECT_LT(surface_distance, 1.5e-3f) << ray;
+        EXPECT_LE(hit.distance, expected.distance) << ray;
+        // normalize_or_zero is only good to a few parts in a thousand, so compare directions
+        float lengths = Math::inner_product(offset, offset) * Math::inner_product(hit.normal, hit.normal);
+        float cosine = Math::inner_product(offset, hit.normal) / Math::square_root(lengths);
+        EXPECT_GT(cosine, 0.9999f) << ray;
+
+        // a bounce leaving the surface doesn't find the point it left from
+        EXPECT_FALSE(occluded(&sdfs, point, hit.normal, 0.05f, &statistics)) << ray;
+    }
+    EXPECT_GT(hits, 100u);
+}
+
+TEST(SdfTest, ValidateSmoothUnionsStayInsideTheirBounds)
+{
+    SdfSurface surface = {};
+    surface.spheres.push_back(SdfSphere { Vector::Vector3 { -1.0f, 0.0f, 0.0f }, 0.8f });
+    surface.spheres.push_back(SdfSphere { Vector::Vector3 { 1.0f, 0.0f, 0.0f }, 0.8f });
+    for (uint32_t box = 0; box < 5; ++box)
+    {
+        surface.boxes.push_back(SdfBox { Vector::Vector3 { 0.0f, 0.0f, -1.0f - 0.5f * static_cast<float>(box) },
+                                         Vector::Vector3 { 1.5f, 0.2f, 0.1f } });
+    }
+    surface.smoothness = 0.5f;
+    finish_sdf_surface(&surface);
+
+    // the gap between the spheres fills in, and the boxes' insides stay inside
+    EXPECT_NEAR(0.075f, sdf_distance(surface, Vector::Vector3 { 0.0f, 0.0f, 0.0f }), 1.0e-5f);
+    EXPECT_LT(sdf_distance(surface, Vector::Vector3 { 1.4f, 0.0f, -2.0f }), 0.0f);
+    // exact away from the blends
+    EXPECT_NEAR(0.7f, sdf_distance(surface, Vector::Vector3 { 1.0f, 1.5f, 0.0f }), 1.0e-5f);
+
+    Math::RandomSeries series = { 3 };
+    const Aabb &bounds = surface.bounds;
+    for (uint32_t sample = 0; sample < 2000; ++sample)
+    {
+        // a point on the boundary of the bounds is outside the surface
+        Vector::Vector3 point = { bounds.min.x + random_unilateral(&series) * (bounds.max.x - bounds.min.x),
+                                  bounds.min.y + random_unilateral(&series) * (bounds.max.y - bounds.min.y),
+                                  bounds.min.z + random_unilateral(&series) * (bounds.max.z - bounds.min.z) };
+        switch (sample % 3)
+        {
+            case 0: point.x = (sample & 4) ? bounds.max.x : bounds.min.x; break;
+            case 1: point.y = (sample & 4) ? bounds.max.y : bounds.min.y; break;
+            default: point.z = (sample & 4) ? bounds.max.z : bounds.min.z; break;
+        }
+        EXPECT_GE(sdf_distance(surface, point), 0.0f) << sample;
+    }
+
+    Vector::Vector3 normal = sdf_normal(surface, Vector::Vector3 { 1.0f, 0.0f, 0.8f });
+    EXPECT_GT(normal.z, 0.99f);
+
+    // a lone box's bounds lie flat against its faces, where rays from outside enter
+    SdfSurface box = {};
+    box.boxes.push_back(SdfBox { Vector::Vector3 { 0.0f, 0.0f, 0.5f }, Vector::Vector3 { 1.0f, 0.5f, 0.5f } });
+    finish_sdf_surface(&box);
+    float hit_distance = FLOAT32_MAX;
+    uint32_t steps;
+    ASSERT_TRUE(trace_sdf(box, Vector::Vector3 { 0.2f, -10.0f, 0.7f }, Vector::Vector3 { 0.0f, 1.0f, 0.0f },
+                          MINIMUM_HIT_DISTANCE, &hit_distance, &steps));
+    EXPECT_NEAR(9.5f, hit_distance, 1.0e-3f);
+    EXPECT_GT(steps, 0u);
+}
+
+TEST(SdfTest, ValidateSdfBlocksAreParsedAndWritten)
+{
+    const char *text =
+        "sdf Green 0.25\n"
+        "sphere 0 0 1 0.5\n"
+        "box 0 0 0.5  1 1 0.25\n"
+        "end\n"
+        "sphere 0 3 1 0.5 Orange\n";
+    Scene scene = {};
+    std::string error;
+    ASSERT_TRUE(parse_scene_text(text, strlen(text), &scene, &error)) << error;
+    ASSERT_EQ(1u, scene.sdfs.size());
+    ASSERT_EQ(1u, scene.spheres.size());
+    const Sdf &sdf = scene.sdfs[0];
+    EXPECT_EQ(MaterialName::Green, sdf.material_name);
+    EXPECT_FLOAT_EQ(0.25f, sdf.surface.smoothness);
+    ASSERT_EQ(1u, sdf.surface.boxes.size());
+    EXPECT_FLOAT_EQ(0.25f, sdf.surface.boxes[0].half_extent.z);
+    EXPECT_LE(sdf.surface.bounds.min.x, -1.0f);
+
+    const char *errors[] = { "sdf Green 0.25\nsphere 0 0 0 1 Green\nend\n", "sdf Green 0.25\nend\n",
+                             "sdf Green 0.25\nbox 0 0 0  1 1 1\n", "box 0 0 0  1 1 1\n", "sdf Green -1\n" };
+    for (const char *bad : errors)
+    {
+        Scene bad_scene = {};
+        EXPECT_FALSE(parse_scene_text(bad, strlen(bad), &bad_scene, &error)) << bad;
+    }
+
+    std::string file_name = testing::TempDir() + "sdf_test.txt";
+    ASSERT_TRUE(write_scene_text(scene, file_name, &error)) << error;
+    Scene reloaded = {};
+    ASSERT_TRUE(load_scene_text(file_name, &reloaded, &error)) << error;
+    ASSERT_EQ(1u, reloaded.sdfs.size());
+    EXPECT_EQ(1u, reloaded.sdfs[0].surface.spheres.size());
+    EXPECT_FLOAT_EQ(sdf.surface.bounds.max.z, reloaded.sdfs[0].surface.bounds.max.z);
+    remove(file_name.c_str());
+}
@@ -0,0 +1,79 @@
+#include "../include/Acceleration.h"
+#include "../include/SceneGenerator.h"
+#include "../include/TileCulling.h"
+#include "gtest/gtest.h"
+
+TEST(TileCullingTest, ValidateEverySphereAPrimaryRayHitsIsInItsTileList)
+{
+    Scene scene = {};
+    generate_sphere_field(&scene, SceneLayout::Random, 400, 5);
+    RenderConfig config = {};
+    config.accelerator = "none";
+    AccelerationReport report = {};
+    prepare_acceleration(config, &scene, &report);
+
+    // the camera set up the way render_tile does it, for a 64x48 image
+    const Camera &camera = scene.camera;
+    CastState state = {};
+    state.scene = &scene;
+    state.camera_position = camera.position;
+    state.camera_z_axis = Math::normalize_or_zero(camera.position - camera.look_at);
+    state.camera_x_axis = Math::normalize_or_zero(Math::cross_product(camera.up, state.camera_z_axis));
+    state.camera_y_axis = Math::normalize_or_zero(Math::cross_product(state.camera_z_axis, state.camera_x_axis));
+    state.view_width = 1.0f;
+    state.view_height = 0.75f;
+    state.view_center = state.camera_position - (camera.film_distance * state.camera_z_axis);
+    state.half_pixel_width = 0.5f / 64.0f;
+    state.half_pixel_height = 0.5f / 48.0f;
+
+    TileBatch tile = {};
+    tile.image_data.width = 64;
+    tile.image_data.height = 48;
+    Math::RandomSeries series = { 17 };
+    RayStatistics statistics = {};
+    uint32_t hits = 0;
+    size_t most_spheres = 0;
+    std::vector<uint32_t> spheres;
+    for (tile.y_min = 0; tile.y_min < 48; tile.y_min += 8)
+    {
+        for (tile.x_min = 0; tile.x_min < 64; tile.x_min += 8)
+        {
+            tile.one_past_x_max = tile.x_min + 8;
+            tile.one_past_y_max = tile.y_min + 8;
+            TileFrustum frustum = make_tile_frustum(state, tile);
+            ASSERT_TRUE(cull_tile_spheres(scene, frustum, &spheres));
+            most_spheres = std::max(most_spheres, spheres.size());
+            for (uint32_t ray = 0; ray < 200; ++ray)
+            {
+                // anywhere in the tile, out to the edges of the jitter
+                float x = static_cast<float>(tile.x_min) + random_unilateral(&series) * 7.0f;
+                float y = static_cast<float>(tile.y_min) + random_unilateral(&series) * 7.0f;
+                float x_offset = -1.0f + 2.0f * (x / 64.0f) + random_bilateral(&series) * state.half_pixel_width;
+                float y_offset = -1.0f + 2.0f * (y / 48.0f) + random_bilateral(&series) * state.half_pixel_height;
+                Vector::Vector3 film_position = state.view_center
+                                                + (x_offset * 0.5f * state.view_width * state.camera_x_axis)
+                                                + (y_offset * 0.5f * state.view_height * state.camera_y_axis);
+                Vector::Vector3 direction = Math::normalize_or_zero(film_position - state.camera_position);
+                RayHit hit;
+                if (closest_hit(&scene, state.camera_position, direction, FLOAT32_MAX, &hit, &statistics) &&
+                    (hit.kind == HitKind::Sphere))
+                {
+                    hits += 1;
+                    EXPECT_TRUE(std::binary_search(spheres.begin(), spheres.end(), hit.primitive))
+                        << "tile " << tile.x_min << "," << tile.y_min << " ray " << ray;
+                }
+            }
+        }
+    }
+    EXPECT_GT(hits, 500u);
+    EXPECT_LT(most_spheres, scene.spheres.size() / 4);
+
+    // with a BVH to fall back on, the last tile's list is only kept while it stays short
+    tile.x_min = 56;
+    tile.y_min = 40;
+    config.accelerator = "bvh";
+    prepare_acceleration(config, &scene, &report);
+    std::vector<uint32_t> bvh_spheres;
+    EXPECT_EQ(spheres.size() <= TILE_SPHERE_LIMIT,
+              cull_tile_spheres(scene, make_tile_frustum(state, tile), &bvh_spheres));
+}
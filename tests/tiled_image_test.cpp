@@ -0,0 +1,151 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include "../include/Acceleration.h"
+#include "../include/TiledImage.h"
+#include "gtest/gtest.h"
+
+static uint64_t read_little_endian(const std::vector<uint8_t> &bytes, uint64_t offset, uint32_t size)
+{
+    uint64_t value = 0;
+    for (uint32_t byte = 0; byte < size; ++byte)
+    {
+        value |= static_cast<uint64_t>(bytes[offset + byte]) << (8 * byte);
+    }
+    return value;
+}
+
+// the tags of a classic TIFF's first IFD, with values that fit inline or the offset of the rest
+static std::map<uint32_t, uint32_t> read_tiff_tags(const std::vector<uint8_t> &file)
+{
+    std::map<uint32_t, uint32_t> tags;
+    uint32_t ifd = read_little_endian(file, 4, 4);
+    uint32_t entry_count = read_little_endian(file, ifd, 2);
+    for (uint32_t entry = 0; entry < entry_count; ++entry)
+    {
+        uint64_t start = ifd + 2 + 12 * entry;
+        uint32_t type = read_little_endian(file, start + 2, 2);
+        uint32_t count = read_little_endian(file, start + 4, 4);
+        bool inline_short = (type == 3) && (count <= 2);
+        tags[read_little_endian(file, start, 2)] = read_little_endian(file, start + 8, inline_short ? 2 : 4);
+    }
+    return tags;
+}
+
+TEST(TiledImageTest, ValidateStreamedTilesMatchTheRenderedBitmap)
+{
+    Scene scene = {};
+    build_default_scene(&scene);
+    RenderConfig config = {};
+    config.image_width = 40;
+    config.image_height = 27;
+    config.rays_per_pixel = 4;
+    config.tile_width = 16;
+    config.tile_height = 16;
+    config.thread_count = 2;
+    AccelerationReport report = {};
+    prepare_acceleration(config, &scene, &report);
+
+    Bitmap bitmap = Bitmap(config.image_width, config.image_height);
+    const ImageData *image_data = bitmap.get_image_data();
+    RenderResult result = {};
+    render_scene(&scene, config, *image_data, false, &result);
+
+    std::string file_name = testing::TempDir() + "tiled_image_test.tif";
+    std::string error;
+    {
+        TiledImageWriter writer;
+        ASSERT_TRUE(writer.create(file_name, config.image_width, config.image_height, 16, 16, &error)) << error;
+        ImageData size_only = { config.image_width, config.image_height, nullptr };
+        render_scene(&scene, config, size_only, false, &result, &writer);
+        ASSERT_TRUE(writer.close(&error)) << error;
+    }
+
+    std::ifstream stream(file_name, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    ASSERT_GT(file.size(), 8u);
+    EXPECT_EQ(0, memcmp(file.data(), "II*\0", 4));
+    std::map<uint32_t, uint32_t> tags = read_tiff_tags(file);
+    EXPECT_EQ(40u, tags[256]);
+    EXPECT_EQ(27u, tags[257]);
+    EXPECT_EQ(3u, tags[277]);
+    EXPECT_EQ(4u, tags[274]);
+    ASSERT_EQ(16u, tags[322]);
+    ASSERT_EQ(16u, tags[323]);
+
+    // 3 x 2 tiles, the last column and row padded out
+    const uint32_t tile_offsets = tags[324];
+    for (uint32_t y = 0; y < config.image_height; ++y)
+    {
+        for (uint32_t x = 0; x < config.image_width; ++x)
+        {
+            uint32_t tile = (y / 16) * 3 + x / 16;
+            uint64_t sample = read_little_endian(file, tile_offsets + 4 * tile, 4) + ((y % 16) * 16 + x % 16) * 3;
+            ASSERT_LT(sample + 2, file.size());
+            uint32_t pixel = image_data->pixels.get()[y * config.image_width + x];
+            EXPECT_EQ((pixel >> 16) & 0xff, file[sample]) << x << "," << y;
+            EXPECT_EQ((pixel >> 8) & 0xff, file[sample + 1]) << x << "," << y;
+            EXPECT_EQ(pixel & 0xff, file[sample + 2]) << x << "," << y;
+        }
+    }
+    remove(file_name.c_str());
+}
+
+TEST(TiledImageTest, ValidateImagesPast4GiBGetABigTiffHeader)
+{
+    // 65536 x 65536 pixels in 64 x 64 tiles, 12 GiB of tiles the file holds sparse
+    const uint64_t tile_count = 1024 * 1024;
+    const uint64_t tile_bytes = 64 * 64 * 3;
+    std::string file_name = testing::TempDir() + "tiled_image_test_big.tif";
+    std::string error;
+    {
+        TiledImageWriter writer;
+        ASSERT_TRUE(writer.create(file_name, 65536, 65536, 64, 64, &error)) << error;
+        ASSERT_TRUE(writer.close(&error)) << error;
+    }
+
+    // the header, IFD and both tile tables; the tiles themselves are never read
+    std::ifstream stream(file_name, std::ios::binary | std::ios::ate);
+    const uint64_t file_size = static_cast<uint64_t>(stream.tellg());
+    std::vector<uint8_t> file(4096 + 16 * tile_count);
+    stream.seekg(0);
+    stream.read(reinterpret_cast<char *>(file.data()), file.size());
+    ASSERT_TRUE(stream);
+    stream.close();
+    remove(file_name.c_str());
+
+    EXPECT_EQ(0, memcmp(file.data(), "II+\0\x08\0\0\0", 8));
+    uint64_t ifd = read_little_endian(file, 8, 8);
+    uint64_t entry_count = read_little_endian(file, ifd, 8);
+    ASSERT_LT(ifd + 8 + 20 * entry_count + 8, file.size());
+    std::map<uint32_t, uint64_t> types, counts, values;
+    for (uint64_t entry = 0; entry < entry_count; ++entry)
+    {
+        uint64_t start = ifd + 8 + 20 * entry;
+        uint32_t tag = static_cast<uint32_t>(read_little_endian(file, start, 2));
+        types[tag] = read_little_endian(file, start + 2, 2);
+        counts[tag] = read_little_endian(file, start + 4, 8);
+        values[tag] = read_little_endian(file, start + 12, (types[tag] == 3) ? 2 : ((types[tag] == 4) ? 4 : 8));
+    }
+    EXPECT_EQ(65536u, values[256]);
+    EXPECT_EQ(65536u, values[257]);
+    EXPECT_EQ(64u, values[322]);
+    EXPECT_EQ(64u, values[323]);
+
+    // LONG8 tables of every tile, one after the other from the first aligned offset
+    ASSERT_EQ(16u, types[324]);
+    ASSERT_EQ(16u, types[325]);
+    ASSERT_EQ(tile_count, counts[324]);
+    ASSERT_EQ(tile_count, counts[325]);
+    ASSERT_LE(values[324] + 8 * tile_count, file.size());
+    ASSERT_LE(values[325] + 8 * tile_count, file.size());
+    uint64_t first_tile = read_little_endian(file, values[324], 8);
+    EXPECT_EQ(0u, first_tile % 4096);
+    for (uint64_t tile = 0; tile < tile_count; tile += 4099)
+    {
+        EXPECT_EQ(first_tile + tile * tile_bytes, read_little_endian(file, values[324] + 8 * tile, 8)) << tile;
+        EXPECT_EQ(tile_bytes, read_little_endian(file, values[325] + 8 * tile, 8)) << tile;
+    }
+    EXPECT_EQ(first_tile + tile_count * tile_bytes, file_size);
+}